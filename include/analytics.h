@@ -0,0 +1,51 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+struct TTopology;
+
+/**
+ * Statistics of the model kept up to date as it's edited. Every chunk keeps
+ * the count of voxels per colour and the bounds it had at a given revision,
+ * so after any edit only the chunks changed since are counted again (and
+ * paged in), and the totals are adjusted by the difference.
+ */
+
+// Brings the counts and bounds up to date with the chunks changed since the
+// last call. Cheap if nothing changed
+void updateAnalytics();
+// Voxels of the given colour of the palette
+int colourVoxels(int colour);
+// Colours with any voxel
+int usedColours();
+// Bounds of the voxels (cells)
+// - Returns: 0 if there are no voxels
+int voxelBounds(int min[3], int max[3]);
+// Connected components, floating voxels and surface of the model, out of the
+// occupancy bitsets (no chunk is paged in)
+// - Returns: 0 on success, -1 if there isn't memory enough
+int analyseModel(struct TTopology *out);
+// Prints every statistic of the model and the time they took
+void printStats();
+// Releases the counts
+void analyticsCleanup();
+
+#endif
@@ -0,0 +1,31 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+// Monotonic clock in seconds, used to time the benchmarks
+double benchNow();
+// Prints a benchmark result line: total time, time per iteration and
+// throughput of 'items' processed per iteration
+void benchReport(const char *label, double seconds, int iterations, double items, const char *unit);
+// Percentage of a CPU used by the process (user + system time), measured
+// over periods of at least a second; the last complete one is returned
+int cpuUsage();
+
+#endif
@@ -0,0 +1,122 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <AR/ar.h>
+#include <AR/arMulti.h>
+#include <stddef.h>
+
+/**
+ * Tracking assets bundle. The camera parameters, the brush pattern and the
+ * multimarker layout (with its inverse transforms and corners already
+ * computed) are compiled from the text files of the data directory into a
+ * single binary file next to them, which is mapped in on startup instead of
+ * parsing every file.
+ *
+ * The bundle records the size and modification time of every source and a
+ * checksum of its contents, so it's rebuilt whenever a source changes or
+ * it's damaged. It's only valid for the machine that built it (host byte
+ * order and struct layout).
+ *
+ * ARToolKit only registers pattern templates from files, so the patterns
+ * themselves are still read by arLoadPatt().
+ */
+
+// Files of the data directory
+#define BUNDLE_FILE "tracking.bundle"
+#define CAMERA_FILE "camera_para.dat"
+#define MARKER_FILE "marker.dat"
+#define BRUSH_PATTERN "simple.patt"
+// Width of the brush pattern (mm)
+#define BRUSH_WIDTH 120.0
+
+#define BUNDLE_MAGIC "ARVB"
+#define BUNDLE_VERSION 2
+// Longest file name in the bundle, relative to the data directory
+#define BUNDLE_NAME_LENGTH 64
+
+/**
+ * Start of the bundle, followed by n_sources TBundleSource and n_patterns
+ * TBundlePattern
+ */
+struct TBundleHeader {
+  char magic[4];
+  unsigned int version;
+  unsigned int checksum;    // FNV-1a of everything after this field
+  unsigned int length;      // Bytes of the whole bundle
+  int n_sources;
+  int n_patterns;
+  ARParam camera;           // As stored in the camera file (before resizing)
+};
+
+/**
+ * A file the bundle was built from
+ */
+struct TBundleSource {
+  char name[BUNDLE_NAME_LENGTH];
+  long long size;
+  long long mtime;
+};
+
+/**
+ * A pattern: the brush or a marker of the canvas
+ */
+struct TBundlePattern {
+  char name[BUNDLE_NAME_LENGTH];
+  int multi;                // Part of the canvas (1) or the brush (0)?
+  double width;
+  double center[2];
+  double trans[3][4];       // Pose in the canvas and its inverse (canvas only)
+  double itrans[3][4];
+  double pos3d[4][3];       // Corners in the canvas (canvas only)
+};
+
+/**
+ * A bundle in memory: mapped from its file or just built
+ */
+struct TBundle {
+  const struct TBundleHeader *header;
+  const struct TBundleSource *sources;
+  const struct TBundlePattern *patterns;
+  void *data;
+  size_t length;
+  int mapped;               // From mmap() (1) or malloc() (0)?
+};
+
+// Full path of a file of the data directory: $ARVE_DATA, else "data" in the
+// working directory, else "data" next to the directory of the executable
+// - Returns: a static buffer, overwritten by the next call
+const char* dataPath(const char *name);
+// Maps the given bundle and checks it's complete and up to date
+// - Returns: 0 on success, -1 if it's missing, damaged or stale
+int bundleOpen(const char *file, struct TBundle *bundle);
+// Compiles the bundle from the files of the data directory and writes it to
+// the given file (a failed write is only reported: 'bundle' is still valid)
+// - Returns: 0 on success, -1 if the sources couldn't be read
+int bundleBuild(const char *file, struct TBundle *bundle);
+// Loads the patterns of the canvas and returns its multimarker config, as
+// arMultiReadConfigFile() would
+// - Returns: NULL if a pattern couldn't be loaded
+ARMultiMarkerInfoT* bundleMultiMarker(const struct TBundle *bundle);
+// Releases the bundle
+void bundleClose(struct TBundle *bundle);
+
+#endif
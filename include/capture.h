@@ -0,0 +1,44 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <AR/ar.h>
+
+/**
+ * Frames are grabbed by a background thread, so the render thread sleeps
+ * until one is ready instead of polling the video device. The thread copies
+ * every frame into a triple buffer and hands the device buffer back at once;
+ * the render thread always gets the newest frame, dropping any it was too
+ * slow to take
+ */
+
+// Starts capturing frames of the given size (pixels) from the open video device
+// - Returns: 0 on success, -1 if the thread couldn't be started
+int captureStart(int width, int height);
+// Waits up to 'timeout' milliseconds for a frame newer than the last one
+// returned. 'fresh' tells whether it is
+// - Returns: the newest frame, valid until the next call; NULL if none has
+//   arrived yet
+ARUint8* captureWait(int timeout, int *fresh);
+// Stops the capture thread
+void captureStop();
+
+#endif
@@ -0,0 +1,58 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef COLLAB_H
+#define COLLAB_H
+
+/**
+ * Shared editing: one editor hosts its model on a local socket and others
+ * join it, so several stations edit the same model. The host orders every
+ * edit: those of a peer are sent to it, applied and broadcast to every peer
+ * (the sender included) in the order the host applied them, so all the
+ * models end equal even if two peers change the same cell at once.
+ *
+ * Edits are gathered by an edit listener and sent once per frame as a
+ * batch (wire.h). Edits that don't notify every cell (fills, pastes...)
+ * send the chunks changed since the last batch instead, and a peer joining
+ * gets the whole model as a snapshot of its chunks. A background thread
+ * moves the bytes, so the render thread never waits on a socket.
+ */
+
+// Address used when none is given: [host:]port, or a path for a Unix socket
+#define COLLAB_ADDRESS "7878"
+// Peers a host accepts at most
+#define COLLAB_MAX_PEERS 16
+// A peer with more bytes pending than this is too slow and is dropped
+#define COLLAB_MAX_BACKLOG (64 << 20)
+
+// Hosts the current model at the given address
+// - Returns: 0 on success, -1 on error
+int collabHost(const char *address);
+// Joins the model hosted at the given address, replacing the current one
+// once its snapshot arrives
+// - Returns: 0 on success, -1 on error
+int collabJoin(const char *address);
+// Applies the edits received and sends the ones made since the last call;
+// must be called from the render thread, once per frame
+void collabPoll();
+// Prints the state of the session and its traffic
+void collabStatus();
+// Ends the session, if any
+void collabStop();
+
+#endif
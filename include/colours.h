@@ -181,9 +181,14 @@ struct TColour {
   enum EColour index;     // Relation to the enum value it represents
 };
 
+// Entries of the palette: the fixed colours first, then the ones added by
+// palette.h. Voxels keep 15-bit indices of it
+#define PALETTE_SIZE 32768
+
 /**
- * An array of fixed colours
+ * The palette: an array of fixed colours followed by room for any other.
+ * Entries never move, so pointers to them stay valid
  */
-extern struct TColour colours[COLOURS_LENGTH];
+extern struct TColour colours[PALETTE_SIZE];
 
 #endif /* COLOURS_H */
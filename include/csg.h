@@ -0,0 +1,48 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CSG_H
+#define CSG_H
+
+struct TModelVoxel;
+
+/**
+ * The ways a model can be combined with the current one
+ */
+enum ECsg {
+  CSG_MERGE,      // Union; the cells of the model keep its colours
+  CSG_SUBTRACT,   // Difference; the cells of the model are emptied
+  CSG_INTERSECT,  // Intersection; the cells kept keep their current colours
+  CSG_LENGTH
+};
+
+// Names of the operations, as typed in the command line
+extern const char *csg_names[CSG_LENGTH];
+
+// Combines the given voxels, moved by (dx, dy, dz) cells, with the current
+// model. Chunks are combined as whole occupancy bitsets and only the cells
+// that change are touched. Undone as a single step
+// - Returns:
+//      the number of cells changed
+int combineModel(struct TModelVoxel *model, int n, int dx, int dy, int dz, enum ECsg op);
+// Reads a VOX file and combines it with the current model (see combineModel())
+// - Returns:
+//      the number of cells changed; -1 on error
+int combineFile(const char *filename, int dx, int dy, int dz, enum ECsg op);
+
+#endif
@@ -0,0 +1,49 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef DIFF_H
+#define DIFF_H
+
+struct TModelVoxel;
+struct TVoxEdit;
+
+// Edits turning model 'a' into model 'b': the cells only in 'a' are
+// removed, the ones only in 'b' added and the shared ones of other colour
+// recoloured. Both models are sorted along the Morton curve (see voxMorton())
+// and walked side by side once, so the edits come in that order too. Cells
+// must not be repeated in a model
+// - Returns:
+//     >= 0 the number of edits of *edits, to be freed by the caller
+//       -1 out of memory
+int diffModels(struct TModelVoxel *a, int n_a, struct TModelVoxel *b, int n_b, struct TVoxEdit **edits);
+// Applies the edits of diffModels() to a model, walking both side by side.
+// Edits not matching the model (adding on a populated cell, removing or
+// recolouring an empty one) are applied anyway and counted in 'conflicts'
+// - Returns:
+//     >= 0 the number of voxels of *patched, to be freed by the caller
+//       -1 out of memory or edits out of order
+int patchModel(struct TModelVoxel *model, int n, struct TVoxEdit *edits, int n_edits,
+               struct TModelVoxel **patched, int *conflicts);
+// Reads two VOX files and writes the patch turning the first into the second
+// - Returns:
+//     >= 0 the number of edits written
+//       -1 on error (already printed)
+int diffFiles(const char *a, const char *b, const char *patch);
+
+#endif
@@ -0,0 +1,53 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EDITLOG_H
+#define EDITLOG_H
+
+/**
+ * Crash-safe autosave. Every edit is appended as a 10-byte record to a
+ * binary log by a background thread, which writes and fsyncs the pending
+ * records in batches every EDITLOG_FLUSH_MS. Bulk changes are logged as the
+ * chunks they touched, each emptied and filled again. When the log outgrows
+ * the model (or the voxel size changes) it's compacted: a full VOX
+ * snapshot is written and the log starts over. Both carry a generation, so
+ * a log left behind by a compaction cut short is never replayed over the
+ * newer snapshot. On startup the snapshot is loaded and the log replayed on
+ * top of it.
+ *
+ * So autosaving costs O(edit) I/O, and O(model) only amortized.
+ */
+
+// Default location of the autosave files
+#define EDITLOG_SNAPSHOT "autosave.vox"
+#define EDITLOG_LOG "autosave.log"
+// Time between two batches of writes (ms)
+#define EDITLOG_FLUSH_MS 1000
+// Records the log may always hold before being compacted
+#define EDITLOG_COMPACT_MIN 65536
+
+// Recovers the model from the given snapshot and log (if any) and starts
+// logging the edits of the canvas
+// - Returns:
+//     >= 0 the number of records replayed
+//       -1 the log couldn't be opened; autosave is disabled
+int editLogOpen(const char *snapshot, const char *log);
+// Writes the pending records and stops the logging thread
+void editLogClose();
+
+#endif
@@ -21,12 +21,14 @@
 
 #include <AR/arMulti.h>
 
+#include "structs.h"
+
 #define PAPER_HEIGHT 297
 #define PAPER_WIDTH 210
 #define ERROR(msg, args...) { fprintf(stderr, msg, ##args); exit(1); }
 
-struct TVoxel;
 struct TColour;
+struct TModelVoxel;
 
 // Multimarker data structure used for reference displaying
 extern ARMultiMarkerInfoT *mMarker;
@@ -40,56 +42,83 @@ extern int grid_height, grid_width;
 extern struct TObject *objects;
 // Number of markers
 extern int n_objects;
-// "List" of voxels
-extern struct TVoxel *voxels;
-// Number of voxels
+// Number of voxels. The voxels themselves live in the chunks of store.h
 extern int n_voxels;
-// Number of disty voxels, i.e., old voxel locations which are now free
-extern int n_voxels_non_dirty;
 // The brush
 extern struct TBrush brush;
 // The current colour we have selected
-extern unsigned char colour_index ;
+extern int colour_index;
 // The number of colours in the canvas
 extern int n_colours;
 // Control variable to check whether command line is active
 extern int is_input;
 // Stores the last characted pressed. character[1] = '\0' to be strcat friendly
 extern char character[2];
+// Incremented on every change of the voxels so cached render data can be rebuilt
+extern int model_revision;
+// Whether the brush targets the voxel its marker points at instead of its own cell
+extern int pick_mode;
 
 // Round the given number: 0.9 = 1, 0.4 = 0.
 inline int roundNum(float num);
 
 // Prints the menu and some useful information
 void menu();
+// Whether anything drawn besides the camera frame changed since the last
+// call: the model, a key pressed, a background job or meshes in progress
+int sceneChanged();
 // Command line management
 void input();
+// Returns the colour with the given name (case insensitive) or index; -1 if none
+int findColour(const char *name);
+// Registers a function called after every change of the voxels. The voxel
+// is NULL for EDIT_CLEAR and EDIT_MODEL
+void addEditListener(void (*listener)(enum EEdit edit, struct TVoxel* voxel));
 // Adds a new marker to the "list"
 void addObject(char *p, int patt_id, double w, double c[2], void (*draw)(void));
-// Adds a new voxel to the "list" and consequently to the canvas
+// Adds a new voxel to the "list" and consequently to the canvas.
+// If the cell is populated, the voxel there takes the given colour.
+// Cells out of the 16-bit range of the grid are ignored
 void addVoxel(struct TColour* colour, int x, int y, int z);
-// Removes the last added voxel from the "list" and consequently from the canvas
-// Used with the 'undo' feature
-void removeLastVoxel();
-// Removes the given voxel from the "list" and consequently from the canvas
+// Removes the given voxel from the canvas. The pointer is no longer valid after
 void removeVoxel(struct TVoxel* voxel);
+// Sets a cell to the given colour, or empties it if colour < 0, saving its
+// previous state for undo. The colour count isn't updated, and with
+// notify = 0 neither are the edit listeners until modelEdited()
+void setCell(int x, int y, int z, int colour, int notify);
+// Publishes the changes made straight on the store (e.g., with setCell() and
+// notify = 0) as a new model
+void modelEdited();
 // Loads a model from disk and draw onto the canvas
-void loadModel(char *filename);
+// - Returns: 0 on success, -1 on error
+int loadModel(char *filename);
 // Saves the drawed model to disk
 void saveModel(char *filename);
+// Applies a patch file (see diffModels()) to the current model, undone as a
+// single step
+// - Returns: the number of cells changed; -1 on error
+int patchFile(const char *filename);
+// Changes the size of the voxels resampling the current model to it
+void setResolution(int size);
+// Copies the existing voxels into a new array; to be freed by the caller
+struct TModelVoxel* snapshotModel(int *n);
+// Replaces the whole canvas by the given voxels, which must be on unique cells
+void setModel(struct TModelVoxel *model, int n);
 
 // Callbacked function to handle the keyboard
 void keyboard(unsigned char key, int x, int y);
 
-// Checks whether he given location is populated by a voxel
+// Checks whether he given grid cell is populated by a voxel
 // In case it is, a provided callback function can be executed for that voxel
 // - Returns:
-//     >= 0 the index of the 'voxels' array the voxel is occupying
 //       -1 location is populated
 //       -2 location is empty
 int isPopulated(int x, int y, int z, void (*cb)(struct TVoxel *voxel));
-// Returns the number of colours of the drawed model
+// Returns the number of colours of the drawed model, kept up to date by
+// analytics.h
 int countColours();
+// Writes the centre of the given voxel in canvas units into 'centre'
+void voxelCentre(struct TVoxel* voxel, float centre[3]);
 // Changes the colour of the given voxel by the current selected
 // Usually used as a callback to 'isPopulated'
 void changeColour(struct TVoxel* voxel);
@@ -112,8 +141,17 @@ void drawCube(float size, struct TColour* colour, float x, float y, float z, int
 void drawReference();
 // Draws the brush marker, i.e., the wired voxel, the shadow and axis
 void drawBrush();
-// Draws the whole scene
+// Draws the whole scene from the camera, placed by the canvas marker
 void draw();
+// Draws the canvas, the attached models of the visible patterns and the
+// voxels with the current camera. The modelview matrix must map the canvas
+// coordinates, as set by draw() or an offscreen camera
+void drawScene();
+// Renders the voxels 'frames' times per render mode from the last known
+// canvas location and prints the timings
+void benchmark(int frames);
+// Times the full scans of the voxel store: lookups, colour count and snapshot
+void benchScans(int iterations);
 // Removes all the voxels from the canvas
 void cleanCanvas();
 
@@ -0,0 +1,38 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef GIZMO_H
+#define GIZMO_H
+
+struct TColour;
+
+/**
+ * The brush gizmo: wired cube, shadow square, lines projected to the
+ * axis planes and a circle where each of them hits the plane.
+ *
+ * The unit geometry (cube edges and circle table) is computed just once and
+ * the gizmo is laid out into a single vertex array which is only refilled
+ * when the brush moves, changes its size or its colour. It's drawn with one
+ * GL_LINES and one GL_TRIANGLES call, no trigonometry per frame
+ */
+
+// Draws the gizmo of a voxel of the given size and colour centered at
+// (x, y, z). If cube = 0 the wired cube is omitted (custom brush.draw)
+void drawGizmo(float size, struct TColour* colour, float x, float y, float z, int cube);
+
+#endif
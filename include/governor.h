@@ -0,0 +1,56 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+// Frame time the governor aims for by default, in seconds (30 frames/s)
+#define GOVERNOR_DEFAULT_BUDGET (1.0 / 30.0)
+
+/**
+ * What the current quality level draws and detects
+ */
+struct TQuality {
+  int level;            // 0 = full quality; higher is cheaper
+  int half_detection;   // Detect the markers on a half sized image?
+  int lod;              // Voxels merged per axis: 2^lod (see render_lod)
+  int shadows;          // Draw the footprint of the voxels?
+  int overlay;          // Draw the list of controls?
+};
+
+// Current quality level
+extern struct TQuality quality;
+// Frame time the governor aims for, in seconds; 0 if it's disabled
+extern double frame_budget;
+// Number of quality levels
+extern const int n_quality_levels;
+// Textual representation of the current quality level, for the overlay
+extern char quality_name[64];
+
+// Feeds the time the last frame took (without waiting for the camera) and
+// lowers or raises the quality level if it stays out of the budget
+void governorFrame(double seconds);
+// Sets the frame budget in seconds; 0 disables the governor and restores
+// the full quality
+void setFrameBudget(double seconds);
+// Switches to the given quality level (clamped to the valid ones, which
+// depend on the render mode: see renderLodSupported())
+void setQualityLevel(int level);
+
+#endif
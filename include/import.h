@@ -0,0 +1,52 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef IMPORT_H
+#define IMPORT_H
+
+struct TModelVoxel;
+
+// Largest side of an imported model, in cells
+#define IMPORT_MAX_SIZE 1024
+// Most cells of the grid an OBJ mesh or a heightmap is voxelized into
+#define IMPORT_MAX_CELLS (128 * 1024 * 1024)
+
+// Voxelizes an OBJ triangle mesh so its longest side spans 'size' cells. The
+// OBJ Y axis becomes the canvas Z (up) axis and the mesh stands on the canvas
+// from its corner. Closed meshes are filled; the colours come from the Kd of
+// their materials (or 'colour' without them), added to the palette
+// - Returns:
+//      the number of voxels of *out, to be freed by the caller; -1 on error
+int voxelizeObj(const char *filename, int size, int colour, struct TModelVoxel **out);
+// Turns a grayscale PGM image into columns of voxels: the longest side of the
+// image spans 'size' cells and white is 'height' cells high. Colours go from
+// water to snow with the height. Fails beyond IMPORT_MAX_CELLS cells
+// - Returns:
+//      the number of voxels of *out, to be freed by the caller; -1 on error
+int voxelizeHeightmap(const char *filename, int size, int height, struct TModelVoxel **out);
+// Voxelizes a closed box in memory at a few sizes, checking it comes out
+// solid, and times it
+// - Returns: 0 if the box is right; -1 otherwise
+int benchImport(int iterations);
+// Voxelizes an OBJ mesh or PGM heightmap (by its extension) and merges it
+// with the current model as a single undo step, printing the timings
+// - Returns:
+//      the number of voxels imported; -1 on error
+int importModel(const char *filename, int size);
+
+#endif
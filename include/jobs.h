@@ -0,0 +1,46 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+/**
+ * Models are loaded and saved by a background worker so the AR loop keeps
+ * tracking while the disk is busy. Only one job runs at a time:
+ * - save: the voxels are snapshotted on the render thread and the worker
+ *   writes the snapshot, so the model can be edited meanwhile.
+ * - load: the worker parses the file into a staging array which is swapped
+ *   in by pollModelJobs() on the render thread once it's complete.
+ */
+
+// Starts loading a model in the background
+// - Returns: 0 if started, -1 if another job is running
+int loadModelAsync(char *filename);
+// Starts saving the current model in the background
+// - Returns: 0 if started, -1 if another job is running
+int saveModelAsync(char *filename);
+// Finishes the completed jobs; must be called from the render thread
+void pollModelJobs();
+// Progress of the running job in permille (-1 if idle). 'name' is set to
+// a textual description of the job
+int modelJobProgress(const char **name);
+// Blocks until the running job (if any) is finished. A loaded model is
+// discarded; used on exit so no file is left half written
+void waitModelJobs();
+
+#endif
@@ -0,0 +1,46 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef MESHER_H
+#define MESHER_H
+
+/**
+ * Chunk meshes for the meshed render path. Every chunk gets a mesh of the
+ * faces of its voxels that aren't hidden by another voxel, with the coplanar
+ * faces of the same colour merged into rectangles (greedy meshing):
+ * - On the GL thread, the changed chunks (and their neighbours) are copied
+ *   for the workers, within a time budget per frame.
+ * - The task pool meshes the copies in parallel.
+ * - Back on the GL thread, the finished meshes are uploaded to the back
+ *   buffer of their chunk, which is then swapped with the front one. Until
+ *   then, the previous mesh of the chunk keeps being drawn.
+ */
+
+// Copies the changed chunks for meshing and uploads the finished meshes,
+// spending at most a few milliseconds. Must be called from the GL thread
+void updateMeshes();
+// Draws the current mesh of every chunk: quads of (short) vertices in cells
+// with (byte) normals and (unsigned byte) RGB colours
+void drawMeshes();
+// Number of chunks waiting to be meshed or uploaded
+int meshesPending();
+// Waits for the meshing tasks and releases every mesh
+void meshCleanup();
+
+#endif
@@ -0,0 +1,45 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+/**
+ * Rendering without camera, window or display: an EGL context without
+ * surfaces (Mesa's surfaceless platform when available) drawing to a
+ * framebuffer object, and a virtual camera in place of the canvas marker.
+ * GLUT isn't initialized, so just the paths that don't use it work
+ */
+
+// Creates the context and a width x height framebuffer to draw to
+// - Returns: 0 on success, -1 on error
+int offscreenOpen(int width, int height);
+// Clears the framebuffer and sets a camera looking at the whole model (or the
+// canvas if it's empty) from above its front right corner
+void offscreenCamera();
+// Reads the framebuffer as RGB rows, the top one first
+void offscreenRead(unsigned char *rgb);
+// Releases the framebuffer and the context
+void offscreenClose();
+// Writes RGB rows to a PNG file, or a binary PPM one if the name doesn't end
+// in .png
+// - Returns: 0 on success, -1 on error
+int writeImage(const char *filename, const unsigned char *rgb, int width, int height);
+
+#endif
@@ -0,0 +1,31 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+// Entries of colours[] in use: the fixed ones plus the ones added since
+extern int n_palette;
+
+// Returns the entry of colours[] of the given RGB colour, adding it if it's
+// new. Once the palette is full, the nearest entry is returned. Thread safe
+int paletteColour(int r, int g, int b);
+// Returns the fixed colour (enum EColour) nearest to the given RGB colour
+int nearestColour(int r, int g, int b);
+
+#endif
@@ -0,0 +1,47 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PICK_H
+#define PICK_H
+
+struct TColour;
+
+// Furthest a ray is cast, in canvas units
+#define PICK_MAX_DISTANCE (4 * PAPER_WIDTH)
+
+/**
+ * The result of casting a ray through the grid
+ */
+struct TPick {
+  int x, y, z;        // Cell of the voxel hit
+  int normal[3];      // Outwards normal of the face the ray entered it through
+  int target[3];      // Cell to put a voxel on: next to the face or on the canvas
+  float distance;     // Distance to the hit along the ray, in canvas units
+};
+
+// Casts a ray from 'origin' along 'direction' (canvas units) through the
+// voxels with a 3D DDA, skipping the empty chunks as a whole
+// - Returns:
+//        1 a voxel was hit; the whole pick is filled
+//        0 no voxel was hit but the ray crosses the canvas; only target is filled
+//       -1 nothing was hit within PICK_MAX_DISTANCE
+int pickVoxel(const float origin[3], const float direction[3], struct TPick* pick);
+// Highlights the voxel and the face hit by a pick
+void drawPick(struct TPick* pick, struct TColour* colour);
+
+#endif
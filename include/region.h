@@ -0,0 +1,49 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef REGION_H
+#define REGION_H
+
+// Most cells a single region edit may change
+#define REGION_MAX_CELLS (16 * 1024 * 1024)
+
+// Orders the corners of a box and clamps them to the 16-bit grid
+// - Returns:
+//      the number of cells of the box
+//     -1 if it's above REGION_MAX_CELLS
+int regionBox(int *x0, int *y0, int *z0, int *x1, int *y1, int *z1);
+
+// Region edits work straight on the chunks of the store, are undone as a
+// single step and publish the result as a new model. They return the number
+// of cells changed, or -1 if the region is too big
+
+// Fills the box between the given cells (both included) with a colour,
+// recolouring the voxels already in it
+int fillBox(int x0, int y0, int z0, int x1, int y1, int z1, int colour);
+// Removes the voxels of the box between the given cells (both included)
+int eraseBox(int x0, int y0, int z0, int x1, int y1, int z1);
+// Flood fills from the given cell: a voxel gets its 6-connected voxels of the
+// same colour recoloured, and an empty cell gets the empty space connected to
+// it over the canvas filled
+int floodFill(int x, int y, int z, int colour);
+// Changes the colour of every voxel of colour 'from' to 'to'
+int recolourAll(int from, int to);
+// Changes every voxel out of the fixed colours to its nearest fixed colour
+int quantizeModel();
+
+#endif
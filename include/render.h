@@ -0,0 +1,59 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+// Coarsest level of detail: 4x4x4 cells per cube
+#define RENDER_MAX_LOD 2
+
+/**
+ * The available paths to render the stored voxels
+ */
+enum ERenderMode {
+  RENDER_IMMEDIATE,   // One glutSolidCube call per voxel
+  RENDER_INSTANCED,   // One instanced draw call for the whole model
+  RENDER_MESHED,      // Greedy meshes of the visible faces, one per chunk
+
+  RENDER_MODES_LENGTH
+};
+
+// Path currently used by drawVoxels()
+extern enum ERenderMode render_mode;
+// Level of detail of the immediate and instanced paths: every 2^render_lod
+// cells per axis are drawn as a single cube (0 to RENDER_MAX_LOD)
+extern int render_lod;
+// Textual representation of every render mode
+extern const char *render_mode_names[RENDER_MODES_LENGTH];
+
+// Checks whether the given render mode can be used with the current GL context
+int renderModeSupported(enum ERenderMode mode);
+// Checks whether drawVoxels() honours render_lod with the current render
+// mode; the meshed path always draws the full detail
+int renderLodSupported();
+// Draws the stored voxels (lit cubes only) with the current render mode. The
+// immediate and instanced paths draw the chunks paged out by the store in a
+// single colour, as reading them back every frame would thrash the swap file
+void drawVoxels();
+// Draws every voxel with every supported render mode 'frames' times and
+// prints the time per frame. The modelview matrix must already be set
+void benchRender(int frames);
+// Releases the GL objects used by the render paths
+void renderCleanup();
+
+#endif
@@ -0,0 +1,38 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+struct TModelVoxel;
+
+// Maximum number of voxels a resampling may produce
+#define RESAMPLE_MAX_VOXELS (64 * 1024 * 1024)
+
+// Resamples a model built with voxels of 'old_size' units into voxels of
+// 'new_size' units, in parallel:
+// - Finer: every voxel is split into the new cells whose centres it holds.
+// - Coarser: every new cell holding the centre of any old voxel is filled
+//   with the most frequent colour among them (2x2x2 -> 1 when halving).
+// - Returns:
+//     >= 0 the number of voxels of *out, to be freed by the caller
+//       -1 the result doesn't fit the grid or RESAMPLE_MAX_VOXELS
+int resampleModel(struct TModelVoxel *in, int n, int old_size, int new_size,
+                  struct TModelVoxel **out);
+
+#endif
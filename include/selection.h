@@ -0,0 +1,65 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SELECTION_H
+#define SELECTION_H
+
+struct TColour;
+
+/**
+ * A box of the grid the transform commands work on
+ */
+struct TSelection {
+  int active;             // Whether there is a selection
+  int min[3], max[3];     // Corner cells, both included
+};
+
+// The current selection
+extern struct TSelection selection;
+
+// Selects the box between the given cells (both included)
+// - Returns:
+//      0 on success
+//     -1 if the box is too big
+int selectBox(int x0, int y0, int z0, int x1, int y1, int z1);
+// Clears the selection
+void selectNone();
+// Copies the voxels of the selection to the clipboard
+// - Returns:
+//      the number of voxels copied; -1 if there's no selection
+int copySelection();
+// Pastes the clipboard with its lowest corner on the given cell and selects
+// it. Undone as a single step
+// - Returns:
+//      the number of voxels pasted; -1 if the clipboard is empty
+int pasteClipboard(int x, int y, int z);
+// Rotates the selection 'turns' quarters of a turn around the given axis
+// (0 = x, 1 = y, 2 = z), keeping its lowest corner. Undone as a single step
+// - Returns:
+//      the number of voxels moved; -1 if there's no selection
+int rotateSelection(int axis, int turns);
+// Mirrors the selection along the given axis. Undone as a single step
+// - Returns:
+//      the number of voxels moved; -1 if there's no selection
+int mirrorSelection(int axis);
+// Draws the selection as a wired box
+void drawSelection(struct TColour* colour);
+// Times copying and transforming the current selection
+void benchSelection(int iterations);
+
+#endif
@@ -0,0 +1,46 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SHADOW_H
+#define SHADOW_H
+
+struct TColour;
+
+/**
+ * The "shadow" of the model over the canvas is the XY projection of the
+ * occupied columns. Each column keeps the number of voxels stacked on it,
+ * updated on every add/remove, in tiles of 16x16 columns found by hashing, so
+ * any place of the grid costs the same. The footprint is drawn as a set of
+ * merged rectangles per tile, only rebuilt for the tiles where a column became
+ * empty or occupied
+ */
+
+// Registers a new voxel on the column of the grid cell (x, y)
+void shadowAdd(int x, int y);
+// Unregisters a voxel from the column of the grid cell (x, y)
+void shadowRemove(int x, int y);
+// Empties all the columns
+void shadowClear();
+// Draws the footprint over the canvas at height z with a single batch
+void drawShadow(struct TColour* colour, float z);
+// Number of rectangles the footprint is currently drawn with
+int shadowRectangles();
+// Releases the memory of the footprint
+void shadowCleanup();
+
+#endif
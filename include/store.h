@@ -0,0 +1,123 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef STORE_H
+#define STORE_H
+
+#include "structs.h"
+
+// Chunks are cubes of CHUNK_SIZE^3 cells
+#define CHUNK_BITS 4
+#define CHUNK_SIZE (1 << CHUNK_BITS)
+#define CHUNK_CELLS (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+#define CHUNK_WORDS (CHUNK_CELLS / 64)
+
+// Chunk holding a cell and index of the cell inside its chunk
+#define CHUNK_COORD(c) ((c) >> CHUNK_BITS)
+#define CELL_INDEX(x, y, z) (((x) & (CHUNK_SIZE-1)) | \
+                             (((y) & (CHUNK_SIZE-1)) << CHUNK_BITS) | \
+                             (((z) & (CHUNK_SIZE-1)) << (2*CHUNK_BITS)))
+
+// Default and lowest memory budget of the resident chunks, in bytes
+#define STORE_DEFAULT_BUDGET (1024LL << 20)
+#define STORE_MIN_BUDGET (8LL << 20)
+
+/**
+ * A cube of the grid. The chunk owns the voxels placed in it, packed without
+ * holes, plus two views of its cells: a bitset of the occupied ones and the
+ * slot of the voxel of each of them.
+ *
+ * The bitset always stays in memory. The voxels and slots are only resident
+ * while the chunk is in the cache; beyond the memory budget the least
+ * recently used chunks are paged out to a swap file, so they must be loaded
+ * with loadChunk() or editChunk() before being touched. The bitset and
+ * 'colour' summarize the chunks paged out without reading them back
+ */
+struct TChunk {
+  short cx, cy, cz;                           // Chunk coordinates (cell >> CHUNK_BITS)
+  int index;                                  // Position in chunks[]
+  unsigned int revision;                      // Bumped whenever it's edited
+  int n_voxels;                               // Voxels in the chunk
+  int max_voxels;                             // Capacity of voxels
+  struct TVoxel *voxels;                      // The voxels of the chunk (if resident)
+  unsigned short *slot;                       // Index + 1 in voxels of every cell; 0 if empty
+                                              // (CHUNK_CELLS entries, NULL if not resident)
+  unsigned long long occupancy[CHUNK_WORDS];  // One bit per cell (CELL_INDEX order)
+  int dirty;                                  // Changed since it was paged in?
+  int page_capacity;                          // Voxels that fit in its page of the swap file
+  long long page_offset;                      // Offset of that page; -1 if it has none
+  int colour;                                 // Colour of its first voxel when paged out
+  struct TChunk *newer, *older;               // Neighbours in the cache (if resident)
+};
+
+/**
+ * Counters of the chunk cache
+ */
+struct TStoreStats {
+  long long hits;        // Loads of resident chunks
+  long long misses;      // Loads that paged a chunk in
+  long long evictions;   // Chunks paged out
+  long long writes;      // Evictions that had to write the page
+  long long resident;    // Bytes of voxels and slots in memory
+  int n_resident;        // Chunks in memory
+};
+
+// Every chunk with (or that had) voxels, for iterating the model
+extern struct TChunk **chunks;
+// Number of chunks
+extern int n_chunks;
+// Bumped by clearStore(), so data kept per index of chunks[] is dropped
+extern int store_generation;
+// Memory the resident chunks may take before paging out, in bytes
+extern long long store_budget;
+// Counters of the chunk cache
+extern struct TStoreStats store_stats;
+
+// Returns the chunk of the given chunk coordinates; NULL if it doesn't exist
+// and create = 0
+struct TChunk* getChunk(int cx, int cy, int cz, int create);
+// Makes the voxels and slots of the chunk resident, paging them in if needed,
+// and marks it as the most recently used
+void loadChunk(struct TChunk* chunk);
+// Same as loadChunk(), for chunks about to be changed: bumps their revision
+void editChunk(struct TChunk* chunk);
+// Changes the memory budget (at least STORE_MIN_BUDGET) and pages out the
+// chunks exceeding it
+void setStoreBudget(long long bytes);
+// Returns the voxel of the given cell; NULL if the cell is empty
+struct TVoxel* findVoxel(int x, int y, int z);
+// Checks whether the given cell is occupied with the bitset of its chunk
+int cellOccupied(int x, int y, int z);
+// Places a voxel on an empty cell and returns it
+struct TVoxel* storeVoxel(int x, int y, int z, int colour);
+// Removes the voxel of the given cell (if any). The last voxel of the chunk
+// is moved to its slot, so pointers to voxels of that chunk are invalidated
+void eraseVoxel(int x, int y, int z);
+// Places a voxel on an empty cell of the given chunk and returns it
+struct TVoxel* chunkStore(struct TChunk* chunk, int x, int y, int z, int colour);
+// Removes the voxel of the given cell of the chunk (if any), moving its last
+// voxel to the hole
+void chunkErase(struct TChunk* chunk, int x, int y, int z);
+// Fills every cell of the chunk with the given colour, replacing its voxels
+void chunkFill(struct TChunk* chunk, int colour);
+// Removes every voxel of the chunk
+void chunkClear(struct TChunk* chunk);
+// Removes all the voxels and chunks, and the swap file
+void clearStore();
+
+#endif
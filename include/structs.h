@@ -25,6 +25,17 @@
  */
 enum PATT_ID { BRUSH_PATT };
 
+/**
+ * The kinds of changes of the voxels reported to the edit listeners
+ */
+enum EEdit {
+  EDIT_ADD,       // A voxel was placed
+  EDIT_REMOVE,    // A voxel was removed
+  EDIT_RECOLOUR,  // A voxel changed its colour
+  EDIT_CLEAR,     // All the voxels were removed
+  EDIT_MODEL      // The whole model was replaced (load, resolution change...)
+};
+
 /**
  * Represent a pattern to be identified by ARToolKit
  */
@@ -45,6 +56,9 @@ struct TBrush {
   int remove_voxel;                        // Control flag to remove a voxel
   struct TColour* colour;                  // The current colour of the voxel
   struct TObject* parent;                  // The pattern associated to the brush
+  int cell[3];                             // Cell targeted on the last frame
+  int picked;                              // Whether its ray hit a voxel on the last frame...
+  int picked_cell[3];                      // ... and the cell of that voxel
 
   /**
    * Draw function actually used to put voxels.
@@ -58,12 +72,13 @@ struct TBrush {
 };
 
 /**
- * A simple voxel data structure
+ * A simple voxel data structure, packed in 8 bytes: the grid cell as 16-bit
+ * fields plus the colour as an index of the colours array (the palette). The location in
+ * canvas units is computed on demand with voxelCentre()
  */
 struct TVoxel {
-  struct TColour* colour; // Colour
-  int x, y, z;            // Location as integer to be mapped to the grid
-  int dirty;              // Whether the voxel exists or can be replaced by another
+  short x, y, z;          // Grid cell (same coordinates addVoxel() takes)
+  unsigned short colour;  // Index of the colour in colours[]
 };
 
 #endif
@@ -0,0 +1,46 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef TEXT_H
+#define TEXT_H
+
+/**
+ * A block of 2D text laid out over a glyph atlas. The block keeps the
+ * string and the quads it was laid out with, so drawing the same text again
+ * costs a single textured quads batch; it's only laid out again when the
+ * string, the location or the font change
+ */
+struct TTextBlock {
+  char *text;           // String the quads were laid out from
+  void *font;           // GLUT bitmap font
+  int x, y, top;        // Location as given to printText()
+  float *vertices;      // (x, y, u, v) per quad corner
+  int n_vertices;       // Number of vertices laid out
+  int max_vertices;     // Capacity of vertices
+};
+
+// Same as printText() but through the glyph atlas of the font. Falls back
+// to printText() if the GL context can't render to textures
+void drawText(struct TTextBlock* block, float r, float g, float b,
+              int x, int y, void *font, char *string, int top);
+// Releases the memory of a text block
+void freeTextBlock(struct TTextBlock* block);
+// Releases the glyph atlases
+void textCleanup();
+
+#endif
@@ -0,0 +1,39 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef THREADS_H
+#define THREADS_H
+
+// Number of threads the parallel helpers split the work into: the number of
+// online CPUs, unless overridden by the ARVE_THREADS environment variable
+int threadCount();
+// Splits [0, n) into threadCount() contiguous slices and calls
+// fn(ctx, slice, begin, end) for each of them in parallel, returning when
+// all of them are done. The last slice runs on the calling thread
+void parallelFor(int n, void (*fn)(void *ctx, int slice, int begin, int end), void *ctx);
+// Sorts the keys in ascending order: slices sorted in parallel and then
+// merged in parallel pairwise rounds
+void parallelSortKeys(unsigned long long *keys, int n);
+// Queues fn(arg) on a pool of threadCount() workers, started on first use.
+// Every worker takes tasks from the back of its own deque and, when it runs
+// dry, steals from the front of the others. Tasks may spawn more tasks
+void spawnTask(void (*fn)(void *arg), void *arg);
+// Runs queued tasks on the calling thread until every spawned one is done
+void waitTasks();
+
+#endif
@@ -0,0 +1,60 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+struct TModelVoxel;
+
+/**
+ * Occupancy of a chunk of 16x16x16 cells: one bit per cell, in the
+ * CELL_INDEX order of the store
+ */
+struct TOccupancy {
+  int cx, cy, cz;                     // Chunk coordinates (cell >> CHUNK_BITS)
+  const unsigned long long *bits;     // CHUNK_WORDS words
+};
+
+/**
+ * Shape of a set of occupied cells
+ */
+struct TTopology {
+  int voxels;
+  int components;           // Groups of voxels sharing faces
+  int largest;              // Voxels of the biggest group
+  int floating;             // Voxels of the groups with no voxel on the canvas (z <= 0)
+  int floating_components;  // ... and the number of those groups
+  long long faces;          // Faces not shared with another voxel (surface area)
+  int min[3], max[3];       // Bounds (cells); min > max if there are no voxels
+};
+
+// Bounds of the occupied cells of a chunk, widening 'min' and 'max'
+void occupancyBounds(const struct TOccupancy *chunk, int min[3], int max[3]);
+// Finds the 6-connected components (parallel union-find over the cells of
+// every chunk and then across their faces), the floating voxels and the
+// surface of the given chunks
+// - Returns: 0 on success, -1 if there isn't memory enough
+int analyseTopology(const struct TOccupancy *chunks, int n, struct TTopology *out);
+// Builds the occupancy chunks of an array of voxels
+// - Returns: the number of chunks; *chunks and *bits must be freed by the
+//   caller. -1 if there isn't memory enough
+int voxelOccupancy(const struct TModelVoxel *voxels, int n, struct TOccupancy **chunks,
+                   unsigned long long **bits);
+
+#endif
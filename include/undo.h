@@ -0,0 +1,51 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef UNDO_H
+#define UNDO_H
+
+// Colour saved for a cell that was empty
+#define UNDO_EMPTY 0xFFFF
+// Cells kept in the history at most; the oldest steps are dropped beyond it
+#define UNDO_MAX_CELLS (8 * 1024 * 1024)
+// Steps of up to this number of cells are undone notifying every cell; bigger
+// ones are published as a new model
+#define UNDO_NOTIFY_CELLS 256
+
+// Opens a step: every change saved until the matching undoEnd() is undone at
+// once. Steps can be nested; changes saved out of any step form a step each
+void undoBegin();
+// Saves the state of a cell before changing it; 'colour' is UNDO_EMPTY if the
+// cell was empty
+void undoSave(int x, int y, int z, int colour);
+// Closes the step opened by undoBegin()
+void undoEnd();
+// Stops saving changes until the matching undoResume(), for changes that are
+// reverted by their own means (e.g., benchmarks). Calls can be nested
+void undoSuspend();
+// Saves changes again after undoSuspend()
+void undoResume();
+// Reverts the last step
+// - Returns:
+//      the number of cells restored; 0 if there was nothing to undo
+int undo();
+// Forgets every step, e.g., when a whole new model is set. Refused while a
+// step is open (between undoBegin() and undoEnd())
+void undoClear();
+
+#endif
@@ -0,0 +1,183 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef VOX_H
+#define VOX_H
+
+#include <stdio.h>
+
+/**
+ * A voxel as stored in a VOX file: colour index and grid location, with Y
+ * already negated as the canvas expects it (see addVoxel())
+ */
+struct TModelVoxel {
+  int colour;             // Index in colours[]
+  int x, y, z;            // Grid cell
+};
+
+/**
+ * Binary VOX format, little endian:
+ *   "\x89VXB", version (u32)
+ *   number of palette entries (u32), then (index u16, r, g, b u8) each
+ *   number of voxels (u32), then (x, y, z s16, colour u16) each
+ * Coordinates and indices mean the same as in the text format. The first
+ * byte can't start a text line, so readVox() tells the formats apart
+ */
+#define VOX_BINARY_MAGIC "\x89VXB"
+#define VOX_BINARY_VERSION 1
+// Extension of the files saved in the binary format
+#define VOX_BINARY_EXTENSION ".vxb"
+
+/**
+ * Compressed VOX format, little endian:
+ *   "\x89VXZ", version (u32)
+ *   palette as in the binary format
+ *   number of voxels (u32), origin x, y, z (s16), the minimum of the voxels
+ *   colour runs until every voxel is read, varints (7 bits per byte, low first):
+ *     colour, number of spans, then (gap, length - 1) per span
+ * Cells are sorted by the Morton code of their offset from the origin (the
+ * bits of x, y and z interleaved, x lowest), and a span is a range of
+ * consecutive codes of the same colour. Its gap is the distance from the end
+ * of the previous span, or from 0 for the first one
+ */
+#define VOX_COMPRESSED_MAGIC "\x89VXZ"
+#define VOX_COMPRESSED_VERSION 1
+// Extension of the files saved in the compressed format
+#define VOX_COMPRESSED_EXTENSION ".vxz"
+
+/**
+ * VOX patch format, little endian, with the edits turning a model into
+ * another one (see diffModels()):
+ *   "\x89VXP", version (u32)
+ *   palette as in the binary format
+ *   number of edits (u32), then varints as in the compressed format:
+ *     gap << 2 | edit, then the colour unless it's a removal
+ * Edits are sorted by the voxMorton() code of their cell, and the gap is the
+ * distance from the code of the previous one, or from 0 for the first one
+ */
+#define VOX_PATCH_MAGIC "\x89VXP"
+#define VOX_PATCH_VERSION 1
+// Extension of the patch files
+#define VOX_PATCH_EXTENSION ".vxp"
+
+/**
+ * Formats of a VOX file
+ */
+enum EVoxFormat {
+  VOX_TEXT,
+  VOX_BINARY,
+  VOX_COMPRESSED,
+  VOX_FORMATS_LENGTH
+};
+
+/**
+ * Kinds of edit of a patch
+ */
+enum EVoxEdit {
+  VOX_EDIT_ADD,           // The cell was empty
+  VOX_EDIT_REMOVE,
+  VOX_EDIT_RECOLOUR,
+  VOX_EDITS_LENGTH
+};
+
+/**
+ * An edit of a patch: the cell and the colour it ends with
+ */
+struct TVoxEdit {
+  enum EVoxEdit edit;
+  struct TModelVoxel voxel;   // Its colour is unused when removing
+};
+
+/**
+ * What validateVox() found in a file
+ */
+struct TVoxReport {
+  enum EVoxFormat format; // Format of the file
+  int voxels;             // Voxels read
+  int repeated;           // Voxels on a cell used before (the last one wins)
+  int bad;                // Records that couldn't be parsed or have an unknown colour
+  int first_bad;          // Line (text), record (binary) or voxel (compressed) of the first of them; 0 if none
+  int out_of_grid;        // Voxels beyond the 16-bit grid of the canvas
+  int truncated;          // Binary or compressed file shorter than its header says?
+};
+
+// Parses a VOX file (in any format) into a new array of voxels. Voxels repeated on the same
+// cell keep the last colour, as loading them one by one would do. 'size' is
+// the file size used to report the progress (0 to skip it) in 'permille'.
+// Colours of the palette of the file ('p' lines) are added to colours[].
+// - Returns:
+//      0 on success; *voxels must be freed by the caller
+//     -1 on error
+int readVox(FILE *f, long size, struct TModelVoxel **voxels, int *n_voxels, volatile int *permille);
+// Same as readVox(), telling the format of the file in 'format' (if not NULL)
+int readVoxFormat(FILE *f, long size, struct TModelVoxel **voxels, int *n_voxels,
+                  volatile int *permille, enum EVoxFormat *format);
+// Writes the given voxels in VOX format, reporting the progress in 'permille'.
+// The colours out of the fixed ones are written first as 'p index r g b' lines
+// - Returns:
+//      0 on success
+//     -1 on error
+int writeVox(FILE *f, struct TModelVoxel *voxels, int n_voxels, int n_colours, volatile int *permille);
+// Same as writeVox() in the binary format
+// - Returns:
+//      0 on success
+//     -1 on error or if a voxel is beyond the 16-bit grid
+int writeVoxBinary(FILE *f, struct TModelVoxel *voxels, int n_voxels, volatile int *permille);
+// Same as writeVox() in the compressed format. Cells must not be repeated
+// - Returns:
+//      0 on success
+//     -1 on error or if a voxel is beyond the 16-bit grid
+int writeVoxCompressed(FILE *f, struct TModelVoxel *voxels, int n_voxels, volatile int *permille);
+// Writes the given voxels in any format, see the functions above
+// - Returns:
+//      0 on success
+//     -1 on error
+int writeVoxFormat(FILE *f, enum EVoxFormat format, struct TModelVoxel *voxels, int n_voxels,
+                   int n_colours, volatile int *permille);
+// Writes a patch, whose edits must be sorted as diffModels() gives them
+// - Returns:
+//      0 on success
+//     -1 on error, if an edit is beyond the 16-bit grid or they're out of order
+int writeVoxPatch(FILE *f, struct TVoxEdit *edits, int n_edits);
+// Reads a patch into a new array of edits. Colours of its palette are added
+// to colours[]
+// - Returns:
+//      0 on success; *edits must be freed by the caller
+//     -1 on error or if the patch is malformed
+int readVoxPatch(FILE *f, struct TVoxEdit **edits, int *n_edits);
+// Morton code of a cell of the 16-bit grid: the bits of x, y and z
+// interleaved, x lowest, counted from the lowest corner of the grid
+unsigned long long voxMorton(int x, int y, int z);
+// Cell of a Morton code of voxMorton()
+void voxMortonCell(unsigned long long code, int *x, int *y, int *z);
+// Keeps the last voxel of every cell, preserving the order of the rest
+// - Returns: the number of voxels kept
+int removeRepeated(struct TModelVoxel *voxels, int n);
+// Format a file of the given name is saved in, after its extension
+enum EVoxFormat voxFormat(const char *filename);
+// Extension of the files saved in a format
+const char* voxExtension(enum EVoxFormat format);
+// Reads a VOX file (in any format) as readVox() would, reporting whatever
+// it would skip or overwrite instead of keeping the voxels
+// - Returns:
+//      0 if the file is valid (no bad, repeated or out of grid voxels)
+//      1 if it has problems, described in 'report'
+//     -1 on read error
+int validateVox(FILE *f, struct TVoxReport *report);
+
+#endif
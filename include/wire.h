@@ -0,0 +1,224 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+
+struct TModelVoxel;
+
+/**
+ * Wire format of the shared editing sessions (collab.h). A stream of
+ * messages, each a type byte, the payload size (varint) and the payload.
+ * Integers are LEB128 varints, signed ones zigzag encoded first, so small
+ * values take a byte whatever their sign.
+ *
+ *   WIRE_HELLO     version. Asks the host for a snapshot
+ *   WIRE_EDITS     seq, number of edits, colour table, edits
+ *   WIRE_SNAPSHOT  seq, voxel size, number of chunks; the model is replaced
+ *                  by the WIRE_CHUNK messages that follow
+ *   WIRE_CHUNK     seq, chunk (cx, cy, cz), voxels, colour table, voxels;
+ *                  replaces the contents of the chunk
+ *
+ * A colour table is its size plus an RGB triplet per entry, and colours are
+ * referred to by their position in it, so every message stands on its own
+ * and is encoded once for every receiver. An edit is (colour << 2 | op)
+ * followed, but for WIRE_CLEAR, by the difference between its cell and the
+ * one of the previous edit. The voxels of a chunk are listed in CELL_INDEX
+ * order as (cells skipped since the previous one << 1 | colour changed),
+ * plus the colour if it changed: a run of cells of the same colour takes a
+ * byte per voxel.
+ *
+ * Every message after the HELLO carries the sequence number of its sender,
+ * one more than the previous message, so a gap can be told from an edit.
+ */
+
+#define WIRE_VERSION 1
+// Bigger messages are taken as a corrupted stream
+#define WIRE_MAX_MESSAGE (64 << 20)
+
+enum EWireMessage {
+  WIRE_HELLO = 1,
+  WIRE_EDITS,
+  WIRE_SNAPSHOT,
+  WIRE_CHUNK
+};
+
+enum EWireOp {
+  WIRE_SET,       // Puts a voxel or changes its colour
+  WIRE_REMOVE,
+  WIRE_CLEAR      // Removes every voxel
+};
+
+/**
+ * A growing byte buffer. 'failed' is set if it couldn't grow; appending to
+ * it does nothing from then on
+ */
+struct TWireBuffer {
+  unsigned char *data;
+  size_t size, capacity;
+  int failed;
+};
+
+/**
+ * Reads a payload. 'failed' is set if it ends early or holds a bad value;
+ * reading from it returns 0 from then on
+ */
+struct TWireReader {
+  const unsigned char *data;
+  size_t size, pos;
+  int failed;
+};
+
+/**
+ * Colours referred to by position in a message
+ */
+struct TWireColours {
+  int *entries;             // Entries of colours[]
+  int n, max;
+  int last;                 // Position of the last colour looked up
+};
+
+/**
+ * A WIRE_EDITS message being built
+ */
+struct TWireBatch {
+  struct TWireBuffer edits;
+  struct TWireColours colours;
+  int n_edits;
+  int x, y, z;              // Cell of the last edit
+};
+
+/**
+ * An edit read from a WIRE_EDITS message
+ */
+struct TWireEdit {
+  enum EWireOp op;
+  int x, y, z;
+  int colour;               // Entry of colours[] of WIRE_SET
+};
+
+/**
+ * Reading position in a WIRE_EDITS message
+ */
+struct TWireEdits {
+  struct TWireReader in;
+  unsigned int seq;
+  int n_edits, n_read;
+  int n_colours;
+  const unsigned char *rgb; // n_colours triplets, inside the message
+  int x, y, z;
+};
+
+/**
+ * Sequence numbers received from a peer
+ */
+struct TWireSequence {
+  unsigned int seq;         // Last one
+  int snapshot_chunks;      // Chunks of the snapshot being received
+};
+
+/**
+ * Header of a WIRE_CHUNK message
+ */
+struct TWireChunk {
+  unsigned int seq;
+  int cx, cy, cz;
+  int n_voxels;
+  int n_colours;
+  const unsigned char *rgb; // n_colours triplets, inside the message
+  struct TWireReader in;    // At the first voxel
+};
+
+// Appends bytes to a buffer
+void wirePut(struct TWireBuffer *buffer, const void *data, size_t size);
+// Appends an unsigned varint
+void wirePutVarint(struct TWireBuffer *buffer, unsigned long long value);
+// Appends a zigzag encoded signed varint
+void wirePutSigned(struct TWireBuffer *buffer, long long value);
+// Reads an unsigned varint
+unsigned long long wireGetVarint(struct TWireReader *in);
+// Reads a zigzag encoded signed varint
+long long wireGetSigned(struct TWireReader *in);
+// Empties a buffer keeping its memory
+void wireReset(struct TWireBuffer *buffer);
+// Drops the first 'size' bytes of a buffer
+void wireConsume(struct TWireBuffer *buffer, size_t size);
+// Releases the memory of a buffer
+void wireFree(struct TWireBuffer *buffer);
+
+// Position of a colours[] entry in a table, adding it if it's new
+int wireColour(struct TWireColours *table, int colour);
+
+// Appends a whole message
+void wireMessage(struct TWireBuffer *out, enum EWireMessage type, const struct TWireBuffer *payload);
+// Takes the next complete message from the start of a received stream
+// - Returns: 1 and its type and payload (valid until the stream changes),
+//   'size' being the bytes taken with its header; 0 if it isn't complete;
+//   -1 if the stream is corrupted
+int wireNextMessage(const struct TWireBuffer *in, enum EWireMessage *type,
+                    struct TWireReader *payload, size_t *size);
+
+// Checks the sequence number of a message received: one more than the last
+// one, but for a snapshot, which starts over, and its chunks, which carry
+// its number
+// - Returns: 0 if it's right, -1 if it isn't
+int wireCheckSeq(struct TWireSequence *sequence, enum EWireMessage type, struct TWireReader payload);
+// Appends a WIRE_HELLO message
+void wireHello(struct TWireBuffer *out);
+// Adds an edit to a batch. The colour (entry of colours[]) is ignored but
+// for WIRE_SET
+void wireBatchAdd(struct TWireBatch *batch, enum EWireOp op, int x, int y, int z, int colour);
+// Appends the batch as a WIRE_EDITS message and empties it
+void wireBatchFlush(struct TWireBatch *batch, unsigned int seq, struct TWireBuffer *out);
+// Releases the memory of a batch
+void wireBatchFree(struct TWireBatch *batch);
+// Starts reading a WIRE_EDITS payload
+// - Returns: 0 on success, -1 if it's malformed
+int wireReadEdits(struct TWireReader *payload, struct TWireEdits *edits);
+// Reads the next edit, adding its colour to the palette if it's new
+// - Returns: 1 if read, 0 at the end, -1 if it's malformed
+int wireNextEdit(struct TWireEdits *edits, struct TWireEdit *edit);
+
+// Appends a WIRE_SNAPSHOT message
+void wireSnapshot(struct TWireBuffer *out, unsigned int seq, int voxel_size, int n_chunks);
+// Reads a WIRE_SNAPSHOT payload
+// - Returns: 0 on success, -1 if it's malformed
+int wireReadSnapshot(struct TWireReader *payload, unsigned int *seq, int *voxel_size, int *n_chunks);
+// Appends a WIRE_CHUNK message with the voxels of a chunk, which must be
+// sorted by CELL_INDEX
+void wireChunk(struct TWireBuffer *out, unsigned int seq, int cx, int cy, int cz,
+               const struct TModelVoxel *voxels, int n);
+// Reads the header of a WIRE_CHUNK payload
+// - Returns: 0 on success, -1 if it's malformed
+int wireReadChunk(struct TWireReader *payload, struct TWireChunk *chunk);
+// Reads the n_voxels voxels of a chunk, adding their colours to the palette
+// if they're new
+// - Returns: 0 on success, -1 if it's malformed
+int wireChunkVoxels(struct TWireChunk *chunk, struct TModelVoxel *voxels);
+
+// Opens a socket listening at an address: a path for a Unix socket or
+// [host:]port for TCP (127.0.0.1 by default)
+// - Returns: the socket; -1 on error
+int wireListen(const char *address);
+// Connects to an address as given to wireListen()
+// - Returns: the socket; -1 on error
+int wireConnect(const char *address);
+
+#endif
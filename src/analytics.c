@@ -0,0 +1,240 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "analytics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "colours.h"
+#include "functions.h"
+#include "palette.h"
+#include "store.h"
+#include "topology.h"
+
+// Colours listed by printStats()
+#define STATS_TOP_COLOURS 8
+
+/**
+ * What a chunk held when it was last counted
+ */
+struct TChunkCensus {
+  int counted;                  // Whether the fields below are valid
+  unsigned int revision;        // Revision of the chunk counted
+  int n_entries;
+  unsigned short (*entries)[2]; // (colour, voxels) of the colours in the chunk
+  int min[3], max[3];           // Bounds; min > max if it was empty
+};
+
+static struct {
+  int generation;               // store_generation the chunks belong to
+  int revision;                 // model_revision last updated
+  struct TChunkCensus *chunks;  // One per chunks[] entry
+  int n_chunks, max_chunks;
+  int counts[PALETTE_SIZE];     // Voxels of every colour
+  int n_colours;                // Colours with any voxel
+  int min[3], max[3];
+} census = { .generation = -1, .revision = -1 };
+
+static void addCount(int colour, int voxels) {
+  if(census.counts[colour] == 0 && voxels > 0)
+    census.n_colours++;
+  census.counts[colour] += voxels;
+  if(census.counts[colour] == 0 && voxels < 0)
+    census.n_colours--;
+}
+
+// Counts the voxels per colour of a chunk again, replacing its old counts
+static void recountChunk(struct TChunk* chunk, struct TChunkCensus* c) {
+  static int voxels[PALETTE_SIZE];
+  static unsigned short used[CHUNK_CELLS];
+  struct TOccupancy occupancy;
+  int i, n_used = 0;
+
+  for(i = 0; i < c->n_entries; ++i)
+    addCount(c->entries[i][0], -c->entries[i][1]);
+
+  if(chunk->n_voxels > 0) {
+    loadChunk(chunk);
+    for(i = 0; i < chunk->n_voxels; ++i) {
+      int colour = chunk->voxels[i].colour;
+      if(voxels[colour]++ == 0)
+        used[n_used++] = colour;
+    }
+  }
+
+  c->entries = (unsigned short (*)[2])realloc(c->entries, sizeof(*c->entries) * (n_used ? n_used : 1));
+  c->n_entries = n_used;
+  for(i = 0; i < n_used; ++i) {
+    c->entries[i][0] = used[i];
+    c->entries[i][1] = voxels[used[i]];
+    addCount(used[i], voxels[used[i]]);
+    voxels[used[i]] = 0;
+  }
+
+  c->min[0] = c->min[1] = c->min[2] = 1 << 30;
+  c->max[0] = c->max[1] = c->max[2] = -(1 << 30);
+  occupancy.cx = chunk->cx;
+  occupancy.cy = chunk->cy;
+  occupancy.cz = chunk->cz;
+  occupancy.bits = chunk->occupancy;
+  occupancyBounds(&occupancy, c->min, c->max);
+
+  c->revision = chunk->revision;
+  c->counted = 1;
+}
+
+void analyticsCleanup() {
+  int i;
+
+  for(i = 0; i < census.n_chunks; ++i)
+    free(census.chunks[i].entries);
+  free(census.chunks);
+  census.chunks = NULL;
+  census.n_chunks = census.max_chunks = 0;
+  memset(census.counts, 0, sizeof(census.counts));
+  census.n_colours = 0;
+  census.revision = -1;
+}
+
+void updateAnalytics() {
+  int i, k;
+
+  // A cleared store starts over
+  if(census.generation != store_generation) {
+    analyticsCleanup();
+    census.generation = store_generation;
+  }
+
+  if(census.revision == model_revision && census.n_chunks == n_chunks)
+    return;
+  census.revision = model_revision;
+
+  if(n_chunks > census.max_chunks) {
+    census.max_chunks = n_chunks * 2;
+    census.chunks = (struct TChunkCensus*)realloc(census.chunks, sizeof(struct TChunkCensus) * census.max_chunks);
+  }
+  for(i = census.n_chunks; i < n_chunks; ++i)
+    memset(&census.chunks[i], 0, sizeof(struct TChunkCensus));
+  census.n_chunks = n_chunks;
+
+  census.min[0] = census.min[1] = census.min[2] = 1 << 30;
+  census.max[0] = census.max[1] = census.max[2] = -(1 << 30);
+  for(i = 0; i < n_chunks; ++i) {
+    struct TChunkCensus* c = &census.chunks[i];
+
+    if(!c->counted || c->revision != chunks[i]->revision)
+      recountChunk(chunks[i], c);
+
+    for(k = 0; k < 3; ++k) {
+      if(c->min[k] < census.min[k]) census.min[k] = c->min[k];
+      if(c->max[k] > census.max[k]) census.max[k] = c->max[k];
+    }
+  }
+}
+
+int colourVoxels(int colour) {
+  updateAnalytics();
+  return colour >= 0 && colour < PALETTE_SIZE ? census.counts[colour] : 0;
+}
+
+int usedColours() {
+  updateAnalytics();
+  return census.n_colours;
+}
+
+int voxelBounds(int min[3], int max[3]) {
+  updateAnalytics();
+  if(census.min[0] > census.max[0])
+    return 0;
+
+  memcpy(min, census.min, sizeof(census.min));
+  memcpy(max, census.max, sizeof(census.max));
+  return 1;
+}
+
+int analyseModel(struct TTopology *out) {
+  struct TOccupancy *occupancy = (struct TOccupancy*)malloc(sizeof(struct TOccupancy) * (n_chunks ? n_chunks : 1));
+  int i, n = 0, result;
+
+  if(!occupancy)
+    return -1;
+
+  for(i = 0; i < n_chunks; ++i) {
+    if(chunks[i]->n_voxels == 0)
+      continue;
+
+    occupancy[n].cx = chunks[i]->cx;
+    occupancy[n].cy = chunks[i]->cy;
+    occupancy[n].cz = chunks[i]->cz;
+    occupancy[n].bits = chunks[i]->occupancy;
+    ++n;
+  }
+
+  result = analyseTopology(occupancy, n, out);
+  free(occupancy);
+  return result;
+}
+
+void printStats() {
+  struct TTopology topology;
+  int top[STATS_TOP_COLOURS], n_top = 0, min[3], max[3];
+  double start = benchNow(), counted, analysed;
+  double size = voxel_size;
+  int i, j;
+
+  if(!voxelBounds(min, max)) {
+    printf("The canvas is empty.\n");
+    return;
+  }
+  counted = benchNow() - start;
+
+  start = benchNow();
+  if(analyseModel(&topology) < 0) {
+    fprintf(stderr, "Not enough memory to analyse the model.\n");
+    return;
+  }
+  analysed = benchNow() - start;
+
+  // The most used colours, by insertion into a short sorted list
+  for(i = 0; i < n_palette; ++i) {
+    if(census.counts[i] == 0)
+      continue;
+    for(j = n_top; j > 0 && census.counts[top[j-1]] < census.counts[i]; --j)
+      if(j < STATS_TOP_COLOURS)
+        top[j] = top[j-1];
+    if(j < STATS_TOP_COLOURS) {
+      top[j] = i;
+      if(n_top < STATS_TOP_COLOURS)
+        n_top++;
+    }
+  }
+
+  printf("Voxels: %d in %d colours, volume %.0f mm^3\n", n_voxels, census.n_colours, n_voxels * size * size * size);
+  printf("Bounds: (%d, %d, %d)-(%d, %d, %d), %dx%dx%d cells\n", min[0], min[1], min[2],
+         max[0], max[1], max[2], max[0] - min[0] + 1, max[1] - min[1] + 1, max[2] - min[2] + 1);
+  printf("Surface: %lld faces, %.0f mm^2\n", topology.faces, topology.faces * size * size);
+  printf("Components: %d (largest %d voxels), floating: %d voxels in %d components\n",
+         topology.components, topology.largest, topology.floating, topology.floating_components);
+  for(i = 0; i < n_top; ++i)
+    printf("  %-24s %d\n", colours[top[i]].name, census.counts[top[i]]);
+  printf("[bench] counts %.2f ms, topology %.2f ms on %d voxels\n", counted * 1000.0, analysed * 1000.0, n_voxels);
+}
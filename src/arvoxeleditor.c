@@ -24,37 +24,69 @@
 #include <AR/ar.h>
 #include <AR/arMulti.h>
 
+#include <limits.h>
 #include <math.h>
+#include <stdio.h>
 #include <unistd.h>
 
+#include "bench.h"
+#include "bundle.h"
+#include "capture.h"
+#include "collab.h"
 #include "colours.h"
+#include "editlog.h"
 #include "functions.h"
+#include "governor.h"
+#include "jobs.h"
 #include "structs.h"
 
-#define PATTERN_WIDTH 120.0
+// Longest wait for a camera frame before checking the scene for changes, in
+// milliseconds, so keys are still handled if the camera stalls
+#define FRAME_TIMEOUT 30
+
+// When main() started, to time the startup
+static double launch;
 
 void init(char *arg) {
   ARParam  wparam, cparam;
-  double c[2] = {0.0, 0.0};
+  struct TBundle bundle;
+  char bundle_file[PATH_MAX], brush_file[PATH_MAX];
+  const char *source = "bundle";
+  double start;
+  int i;
 
   // Open video device
   if(arVideoOpen(arg) < 0) exit(0);
   if(arVideoInqSize(&dim[0], &dim[1]) < 0) exit(0);
 
-  // Load intrinsics parameters of the camera
-  if(arParamLoad("data/camera_para.dat", 1, &wparam) < 0)
-    ERROR("Error loading camera parameters");
+  // Camera parameters and patterns, from the bundle when it's up to date
+  start = benchNow();
+  snprintf(bundle_file, sizeof(bundle_file), "%s", dataPath(BUNDLE_FILE));
+  if(bundleOpen(bundle_file, &bundle) < 0) {
+    source = "sources";
+    if(bundleBuild(bundle_file, &bundle) < 0)
+      ERROR("Error loading the tracking assets");
+  }
 
   // Initialize camera
+  wparam = bundle.header->camera;
   arParamChangeSize(&wparam, dim[0], dim[1], &cparam);
   arInitCparam(&cparam);
 
   // Load brush marker
-  addObject("data/simple.patt", BRUSH_PATT, PATTERN_WIDTH, c, drawBrush);
+  for(i = 0; i < bundle.header->n_patterns; ++i) {
+    const struct TBundlePattern *p = &bundle.patterns[i];
+    if(!p->multi) {
+      snprintf(brush_file, sizeof(brush_file), "%s", dataPath(p->name));
+      addObject(brush_file, BRUSH_PATT, p->width, (double*)p->center, drawBrush);
+    }
+  }
 
-  // Load multimarker file (canvas)
-  if((mMarker = arMultiReadConfigFile("data/marker.dat")) == NULL)
+  // Load multimarker (canvas)
+  if((mMarker = bundleMultiMarker(&bundle)) == NULL)
     ERROR("Error in marker.dat file");
+  bundleClose(&bundle);
+  printf("[bench] tracking assets loaded from %s in %.2f ms\n", source, (benchNow() - start) * 1000.0);
 
   // Some brush initialization
   brush.colour = &colours[BLACK];
@@ -62,35 +94,25 @@ void init(char *arg) {
 
   // Open the window
   argInit(&cparam, 1.0, 0, 0, 0, 0);
+
+  // Recover the last session and autosave from now on
+  editLogOpen(EDITLOG_SNAPSHOT, EDITLOG_LOG);
 }
 
-void mainLoop() {
+// Detects the markers on a camera frame and updates their poses
+// - Returns: whether the canvas is visible
+static int detectMarkers(ARUint8 *dataPtr) {
   static int useCont = 0;
 
-  ARUint8 *dataPtr;
   ARMarkerInfo *marker_info;
   int marker_num, i, j, k;
 
-  // Frame grab from camera
-  if((dataPtr = (ARUint8 *)arVideoGetImage()) == NULL) {
-    // No new frame ready
-    arUtilSleep(2);
-    return;
-  }
-
-  // Draw the frame
-  argDrawMode2D();
-  argDispImage(dataPtr, 0,0);
-
   // Detect the marker on the frame (error = -1)
   if(arDetectMarker(dataPtr, 100, &marker_info, &marker_num) < 0) {
     cleanup();
     exit(0);
   }
 
-  // Grab the next video frame
-  arVideoCapNext();
-
   // Match the most appropriate pattern in the detected markers
   for(i = 0; i < n_objects; ++i) {
     for(j = 0, k = -1; j < marker_num; ++j) {
@@ -120,17 +142,62 @@ void mainLoop() {
     }
   }
 
+  return arMultiGetTransMat(marker_info, marker_num, mMarker) > 0;
+}
+
+void mainLoop() {
+  static int canvas = 0;
+
+  ARUint8 *dataPtr;
+  double start;
+  int fresh;
+
+  // Sleep until the capture thread has a new frame (or a while)
+  if((dataPtr = captureWait(FRAME_TIMEOUT, &fresh)) == NULL)
+    return;
+
+  // Swap in the models loaded in the background
+  pollModelJobs();
+
+  // Apply the edits of the other peers and send ours
+  collabPoll();
+
+  // Without a new frame the last one is drawn again with the last poses,
+  // but only if something else changed
+  if(!sceneChanged() && !fresh)
+    return;
+
+  // Draw the frame
+  start = benchNow();
+  argDrawMode2D();
+  argDispImage(dataPtr, 0,0);
+
+  if(fresh) {
+    arImageProcMode = quality.half_detection ? AR_IMAGE_PROC_IN_HALF : AR_IMAGE_PROC_IN_FULL;
+    canvas = detectMarkers(dataPtr);
+
+    if(canvas && launch > 0.0) {
+      printf("[bench] first tracked frame %.0f ms after launch\n", (benchNow() - launch) * 1000.0);
+      launch = 0.0;
+    }
+  }
+
   // If canvas is detected, draw all
-  if(arMultiGetTransMat(marker_info, marker_num, mMarker) > 0)
+  if(canvas)
     draw();
 
   // Print the menu and some information
   menu();
 
   argSwapBuffers();
+
+  // Time spent on the frame, without waiting for the camera
+  governorFrame(benchNow() - start);
 }
 
 int main(int argc, char **argv) {
+  launch = benchNow();
+
   // Using GLUT for windowing stuff
   glutInit(&argc, argv);
 
@@ -151,6 +218,8 @@ int main(int argc, char **argv) {
   }
 
   arVideoCapStart();
+  if(captureStart(dim[0], dim[1]) < 0)
+    exit(0);
   argMainLoop(NULL, keyboard, mainLoop);
 
   return 0;
@@ -0,0 +1,57 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+double benchNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void benchReport(const char *label, double seconds, int iterations, double items, const char *unit) {
+  double per_iteration = iterations > 0 ? seconds / iterations : seconds;
+
+  printf("[bench] %-24s %8.3f ms/iter  %12.0f %s/s  (%d iters, %.3f s)\n",
+         label, per_iteration * 1000.0,
+         per_iteration > 0 ? items / per_iteration : 0.0, unit,
+         iterations, seconds);
+}
+
+int cpuUsage() {
+  static double last_wall = -1.0, last_cpu = 0.0;
+  static int usage = 0;
+  struct rusage ru;
+  double wall = benchNow(), cpu;
+
+  if(last_wall >= 0.0 && wall - last_wall < 1.0)
+    return usage;
+
+  getrusage(RUSAGE_SELF, &ru);
+  cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+  if(last_wall >= 0.0)
+    usage = (int)((cpu - last_cpu) * 100.0 / (wall - last_wall) + 0.5);
+
+  last_wall = wall;
+  last_cpu = cpu;
+  return usage;
+}
@@ -0,0 +1,377 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "bundle.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <AR/param.h>
+
+// FNV-1a (32 bits) of a block of memory
+static unsigned int checksum(const void *data, size_t length) {
+  const unsigned char *bytes = (const unsigned char*)data;
+  unsigned int hash = 2166136261u;
+  size_t i;
+
+  for(i = 0; i < length; ++i)
+    hash = (hash ^ bytes[i]) * 16777619u;
+
+  return hash;
+}
+
+// Checksum of a bundle: everything after the checksum field, so the header
+// (and the camera in it) is covered too
+static unsigned int bundleChecksum(const struct TBundleHeader *header, size_t length) {
+  size_t start = offsetof(struct TBundleHeader, checksum) + sizeof(header->checksum);
+  return checksum((const unsigned char*)header + start, length - start);
+}
+
+static int directoryExists(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Finds the data directory once
+static const char* dataDirectory() {
+  static char directory[PATH_MAX] = "";
+  char exe[PATH_MAX];
+  const char *env;
+  ssize_t len;
+  char *slash;
+
+  if(directory[0])
+    return directory;
+
+  if((env = getenv("ARVE_DATA")) != NULL && env[0]) {
+    snprintf(directory, sizeof(directory), "%s", env);
+    return directory;
+  }
+
+  // The executables are built into exec/, next to data/
+  snprintf(directory, sizeof(directory), "data");
+  if(!directoryExists(directory) &&
+     (len = readlink("/proc/self/exe", exe, sizeof(exe) - 1)) > 0) {
+    exe[len] = '\0';
+    if((slash = strrchr(exe, '/')) != NULL) {
+      *slash = '\0';
+      if(snprintf(directory, sizeof(directory), "%s/../data", exe) >= (int)sizeof(directory) ||
+         !directoryExists(directory))
+        snprintf(directory, sizeof(directory), "data");
+    }
+  }
+
+  return directory;
+}
+
+const char* dataPath(const char *name) {
+  static char path[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/%s", dataDirectory(), name);
+  return path;
+}
+
+// Points the sections of the bundle into its data
+static void bundleSections(struct TBundle *bundle) {
+  bundle->header = (const struct TBundleHeader*)bundle->data;
+  bundle->sources = (const struct TBundleSource*)(bundle->header + 1);
+  bundle->patterns = (const struct TBundlePattern*)(bundle->sources + bundle->header->n_sources);
+}
+
+static size_t bundleLength(int n_sources, int n_patterns) {
+  return sizeof(struct TBundleHeader) +
+         sizeof(struct TBundleSource) * n_sources +
+         sizeof(struct TBundlePattern) * n_patterns;
+}
+
+// Records the size and modification time of a file of the data directory
+static int statSource(const char *name, struct TBundleSource *source) {
+  struct stat st;
+
+  if(stat(dataPath(name), &st) != 0)
+    return -1;
+
+  memset(source, 0, sizeof(*source));
+  snprintf(source->name, sizeof(source->name), "%s", name);
+  source->size = st.st_size;
+  source->mtime = st.st_mtime;
+  return 0;
+}
+
+int bundleOpen(const char *file, struct TBundle *bundle) {
+  const struct TBundleHeader *header;
+  struct TBundleSource current;
+  struct stat st;
+  void *data;
+  int fd, i;
+
+  memset(bundle, 0, sizeof(*bundle));
+  if((fd = open(file, O_RDONLY)) < 0)
+    return -1;
+
+  if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct TBundleHeader) ||
+     (data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  close(fd);
+
+  bundle->data = data;
+  bundle->length = st.st_size;
+  bundle->mapped = 1;
+  header = (const struct TBundleHeader*)data;
+
+  if(memcmp(header->magic, BUNDLE_MAGIC, 4) != 0 || header->version != BUNDLE_VERSION ||
+     header->length != bundle->length || header->n_sources < 0 || header->n_patterns < 0 ||
+     bundleLength(header->n_sources, header->n_patterns) != bundle->length ||
+     bundleChecksum(header, bundle->length) != header->checksum) {
+    fprintf(stderr, "The assets bundle %s is damaged.\n", file);
+    bundleClose(bundle);
+    return -1;
+  }
+  bundleSections(bundle);
+
+  // Stale if any source has changed since it was built
+  for(i = 0; i < header->n_sources; ++i) {
+    const struct TBundleSource *source = &bundle->sources[i];
+
+    if(statSource(source->name, &current) < 0 ||
+       current.size != source->size || current.mtime != source->mtime) {
+      fprintf(stderr, "The assets bundle is out of date: %s has changed.\n", source->name);
+      bundleClose(bundle);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Next line of the config file that isn't blank or a comment (as ARToolKit
+// reads marker.dat)
+static char* nextLine(char *buff, int size, FILE *fp) {
+  while(fgets(buff, size, fp) != NULL) {
+    if(buff[0] != '#' && buff[0] != '\n' && buff[0] != '\r')
+      return buff;
+  }
+  return NULL;
+}
+
+// Reads the layout of the canvas from marker.dat, appending its patterns
+// after the brush
+// - Returns: the number of patterns read; -1 on error
+static int readMarkers(struct TBundlePattern **patterns) {
+  char buff[256], name[256], *base;
+  struct TBundlePattern *p;
+  double wpos3d[4][2];
+  int n, i, j, k;
+  FILE *fp;
+
+  if((fp = fopen(dataPath(MARKER_FILE), "r")) == NULL)
+    return -1;
+
+  if(nextLine(buff, sizeof(buff), fp) == NULL || sscanf(buff, "%d", &n) != 1 || n <= 0) {
+    fclose(fp);
+    return -1;
+  }
+
+  *patterns = (struct TBundlePattern*)realloc(*patterns, sizeof(struct TBundlePattern) * (n + 1));
+  for(i = 0; i < n; ++i) {
+    p = &(*patterns)[i + 1];
+    memset(p, 0, sizeof(*p));
+    p->multi = 1;
+
+    // Pattern files are written relative to the working directory, like
+    // data/10.patt; they're kept relative to the data directory
+    if(nextLine(buff, sizeof(buff), fp) == NULL || sscanf(buff, "%255s", name) != 1)
+      break;
+    base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+    if(strlen(base) >= sizeof(p->name))
+      break;
+    strcpy(p->name, base);
+
+    if(nextLine(buff, sizeof(buff), fp) == NULL || sscanf(buff, "%lf", &p->width) != 1 ||
+       nextLine(buff, sizeof(buff), fp) == NULL ||
+       sscanf(buff, "%lf %lf", &p->center[0], &p->center[1]) != 2)
+      break;
+    for(j = 0; j < 3; ++j) {
+      if(nextLine(buff, sizeof(buff), fp) == NULL ||
+         sscanf(buff, "%lf %lf %lf %lf", &p->trans[j][0], &p->trans[j][1],
+                &p->trans[j][2], &p->trans[j][3]) != 4)
+        break;
+    }
+    if(j < 3)
+      break;
+
+    // What arMultiReadConfigFile() computes on every launch
+    arUtilMatInv(p->trans, p->itrans);
+    wpos3d[0][0] = p->center[0] - p->width / 2.0;
+    wpos3d[0][1] = p->center[1] + p->width / 2.0;
+    wpos3d[1][0] = p->center[0] + p->width / 2.0;
+    wpos3d[1][1] = p->center[1] + p->width / 2.0;
+    wpos3d[2][0] = p->center[0] + p->width / 2.0;
+    wpos3d[2][1] = p->center[1] - p->width / 2.0;
+    wpos3d[3][0] = p->center[0] - p->width / 2.0;
+    wpos3d[3][1] = p->center[1] - p->width / 2.0;
+    for(j = 0; j < 4; ++j) {
+      for(k = 0; k < 3; ++k) {
+        p->pos3d[j][k] = p->trans[k][0] * wpos3d[j][0] +
+                         p->trans[k][1] * wpos3d[j][1] +
+                         p->trans[k][3];
+      }
+    }
+  }
+  fclose(fp);
+
+  if(i < n) {
+    fprintf(stderr, "Error in %s: marker %d is incomplete.\n", MARKER_FILE, i + 1);
+    return -1;
+  }
+
+  return n;
+}
+
+int bundleBuild(const char *file, struct TBundle *bundle) {
+  struct TBundlePattern *patterns;
+  struct TBundleHeader *header;
+  struct TBundleSource *sources;
+  char tmp_path[PATH_MAX];
+  ARParam camera;
+  int n_patterns, n_sources, i;
+  unsigned char *data;
+  size_t length;
+  FILE *fp;
+
+  memset(bundle, 0, sizeof(*bundle));
+  if(arParamLoad(dataPath(CAMERA_FILE), 1, &camera) < 0) {
+    fprintf(stderr, "Error loading camera parameters from %s\n", dataPath(CAMERA_FILE));
+    return -1;
+  }
+
+  // The brush goes first, then the canvas
+  patterns = (struct TBundlePattern*)calloc(1, sizeof(struct TBundlePattern));
+  snprintf(patterns[0].name, sizeof(patterns[0].name), "%s", BRUSH_PATTERN);
+  patterns[0].width = BRUSH_WIDTH;
+  if((n_patterns = readMarkers(&patterns)) < 0) {
+    fprintf(stderr, "Error reading %s\n", dataPath(MARKER_FILE));
+    free(patterns);
+    return -1;
+  }
+  n_patterns++;
+
+  // Sources: the camera, the config and every pattern
+  n_sources = n_patterns + 2;
+  length = bundleLength(n_sources, n_patterns);
+  if((data = (unsigned char*)calloc(1, length)) == NULL) {
+    free(patterns);
+    return -1;
+  }
+  header = (struct TBundleHeader*)data;
+  sources = (struct TBundleSource*)(header + 1);
+  if(statSource(CAMERA_FILE, &sources[0]) < 0 || statSource(MARKER_FILE, &sources[1]) < 0) {
+    free(patterns);
+    free(data);
+    return -1;
+  }
+  for(i = 0; i < n_patterns; ++i) {
+    if(statSource(patterns[i].name, &sources[i + 2]) < 0) {
+      fprintf(stderr, "Error loading pattern %s\n", dataPath(patterns[i].name));
+      free(patterns);
+      free(data);
+      return -1;
+    }
+  }
+  memcpy(sources + n_sources, patterns, sizeof(struct TBundlePattern) * n_patterns);
+  free(patterns);
+
+  memcpy(header->magic, BUNDLE_MAGIC, 4);
+  header->version = BUNDLE_VERSION;
+  header->length = length;
+  header->n_sources = n_sources;
+  header->n_patterns = n_patterns;
+  header->camera = camera;
+  header->checksum = bundleChecksum(header, length);
+
+  bundle->data = data;
+  bundle->length = length;
+  bundle->mapped = 0;
+  bundleSections(bundle);
+
+  // Written aside and renamed, so a crash never leaves half a bundle
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", file);
+  if((fp = fopen(tmp_path, "wb")) == NULL ||
+     fwrite(data, 1, length, fp) != length || fclose(fp) != 0 ||
+     rename(tmp_path, file) != 0) {
+    fprintf(stderr, "Error writing the assets bundle %s\n", file);
+    remove(tmp_path);
+  }
+
+  return 0;
+}
+
+ARMultiMarkerInfoT* bundleMultiMarker(const struct TBundle *bundle) {
+  ARMultiMarkerInfoT *config;
+  int i, n = 0;
+
+  for(i = 0; i < bundle->header->n_patterns; ++i)
+    n += bundle->patterns[i].multi;
+
+  config = (ARMultiMarkerInfoT*)calloc(1, sizeof(ARMultiMarkerInfoT));
+  config->marker = (ARMultiEachMarkerInfoT*)calloc(n, sizeof(ARMultiEachMarkerInfoT));
+  for(i = 0, n = 0; i < bundle->header->n_patterns; ++i) {
+    const struct TBundlePattern *p = &bundle->patterns[i];
+    ARMultiEachMarkerInfoT *marker = &config->marker[n];
+
+    if(!p->multi)
+      continue;
+
+    if((marker->patt_id = arLoadPatt(dataPath(p->name))) < 0) {
+      fprintf(stderr, "Error loading pattern %s\n", dataPath(p->name));
+      free(config->marker);
+      free(config);
+      return NULL;
+    }
+    marker->width = p->width;
+    memcpy(marker->center, p->center, sizeof(marker->center));
+    memcpy(marker->trans, p->trans, sizeof(marker->trans));
+    memcpy(marker->itrans, p->itrans, sizeof(marker->itrans));
+    memcpy(marker->pos3d, p->pos3d, sizeof(marker->pos3d));
+    ++n;
+  }
+  config->marker_num = n;
+  config->prevF = 0;
+
+  return config;
+}
+
+void bundleClose(struct TBundle *bundle) {
+  if(bundle->data) {
+    if(bundle->mapped)
+      munmap(bundle->data, bundle->length);
+    else
+      free(bundle->data);
+  }
+  memset(bundle, 0, sizeof(*bundle));
+}
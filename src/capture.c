@@ -0,0 +1,140 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "capture.h"
+
+#include <AR/video.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef AR_PIX_SIZE_DEFAULT
+#define CAPTURE_PIXEL_SIZE AR_PIX_SIZE_DEFAULT
+#else
+#define CAPTURE_PIXEL_SIZE AR_PIX_SIZE
+#endif
+
+static struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;     // Signaled when a frame is published
+  volatile int running;
+  size_t size;              // Bytes of a frame
+  ARUint8 *buffers[3];      // Triple buffer:
+  int writing;              // - Being filled by the capture thread
+  int published;            // - Newest complete frame
+  int reading;              // - Handed to the render thread
+  unsigned int sequence;    // Frames published so far
+  unsigned int taken;       // Sequence of the frame in 'reading'
+} capture = { .lock = PTHREAD_MUTEX_INITIALIZER, .ready = PTHREAD_COND_INITIALIZER };
+
+static void* captureLoop(void *arg) {
+  ARUint8 *image;
+  int swap;
+
+  (void)arg;
+  while(capture.running) {
+    // Most drivers block here until the next frame; the rest are given a
+    // short nap on this thread rather than the render one
+    if((image = (ARUint8 *)arVideoGetImage()) == NULL) {
+      arUtilSleep(2);
+      continue;
+    }
+
+    memcpy(capture.buffers[capture.writing], image, capture.size);
+    arVideoCapNext();
+
+    pthread_mutex_lock(&capture.lock);
+    swap = capture.published;
+    capture.published = capture.writing;
+    capture.writing = swap;
+    capture.sequence++;
+    pthread_cond_signal(&capture.ready);
+    pthread_mutex_unlock(&capture.lock);
+  }
+
+  return NULL;
+}
+
+int captureStart(int width, int height) {
+  int i;
+
+  capture.size = (size_t)width * height * CAPTURE_PIXEL_SIZE;
+  for(i = 0; i < 3; ++i) {
+    if((capture.buffers[i] = (ARUint8*)malloc(capture.size)) == NULL) {
+      fprintf(stderr, "Not enough memory for the capture buffers.\n");
+      return -1;
+    }
+  }
+  capture.writing = 0;
+  capture.published = 1;
+  capture.reading = 2;
+  capture.sequence = capture.taken = 0;
+
+  capture.running = 1;
+  if(pthread_create(&capture.thread, NULL, captureLoop, NULL) != 0) {
+    fprintf(stderr, "Error starting the capture thread.\n");
+    capture.running = 0;
+    return -1;
+  }
+
+  return 0;
+}
+
+ARUint8* captureWait(int timeout, int *fresh) {
+  struct timespec deadline;
+  int swap;
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_nsec += (long)timeout * 1000000L;
+  deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+  deadline.tv_nsec %= 1000000000L;
+
+  pthread_mutex_lock(&capture.lock);
+  while(capture.sequence == capture.taken &&
+        pthread_cond_timedwait(&capture.ready, &capture.lock, &deadline) != ETIMEDOUT);
+
+  *fresh = capture.sequence != capture.taken;
+  if(*fresh) {
+    swap = capture.reading;
+    capture.reading = capture.published;
+    capture.published = swap;
+    capture.taken = capture.sequence;
+  }
+  pthread_mutex_unlock(&capture.lock);
+
+  return capture.taken ? capture.buffers[capture.reading] : NULL;
+}
+
+void captureStop() {
+  int i;
+
+  if(!capture.running)
+    return;
+
+  capture.running = 0;
+  pthread_join(capture.thread, NULL);
+  for(i = 0; i < 3; ++i) {
+    free(capture.buffers[i]);
+    capture.buffers[i] = NULL;
+  }
+}
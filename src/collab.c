@@ -0,0 +1,795 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "collab.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "colours.h"
+#include "functions.h"
+#include "store.h"
+#include "structs.h"
+#include "undo.h"
+#include "vox.h"
+#include "wire.h"
+
+// Bytes read from a socket at once
+#define COLLAB_READ_SIZE (64 << 10)
+// Edits batched at most; beyond them the batch is sent without waiting for
+// the frame to end
+#define COLLAB_BATCH_EDITS 65536
+
+enum ECollabRole {
+  COLLAB_OFF,
+  COLLAB_HOST,
+  COLLAB_PEER
+};
+
+/**
+ * The other end of a connection. Added and removed by the network thread;
+ * the render thread only touches it with the lock held
+ */
+struct TPeer {
+  int id;
+  int fd;
+  struct TWireBuffer in;        // Received, not a whole message yet
+  struct TWireBuffer out;       // Still to be sent
+  int joined;                   // Host: got its snapshot, so it gets the broadcasts
+  int dropped;                  // To be closed by the network thread
+  struct TWireSequence received;
+};
+
+/**
+ * Chunk revision the peers know
+ */
+struct TSentChunk {
+  int known;
+  unsigned int revision;
+};
+
+static struct {
+  enum ECollabRole role;
+  char address[256];
+  int listen_fd;                // Host
+  int wake[2];                  // Pipe waking the network thread up
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int running, stop;
+  struct TPeer *peers[COLLAB_MAX_PEERS];
+  int n_peers, next_id;
+  int lost;                     // Peer: the connection to the host was lost
+  struct TWireBuffer inbox;     // Messages received, each after the id of its peer
+  long long bytes_in, bytes_out;
+
+  // Render thread only
+  int applying;                 // Edits of the host being applied by a peer
+  int silent;                   // Chunks changed without notifying their cells
+  int synced;                   // Peer: got the snapshot of the host
+  struct TWireBatch batch;      // Edits since the last message
+  struct TWireBuffer outgoing;  // Messages for every peer
+  unsigned int seq;             // Last sequence number sent
+  struct TSentChunk *sent;      // One per chunks[] entry
+  int n_sent, max_sent;
+  int generation, voxel_size;   // Of the model the peers know
+  struct TModelVoxel *snapshot; // Snapshot being received
+  int n_snapshot, max_snapshot, snapshot_chunks, snapshot_voxel_size;
+  long long edits_out, edits_in;
+  long long edit_bytes;         // Of the WIRE_EDITS messages sent
+} collab = { .lock = PTHREAD_MUTEX_INITIALIZER, .listen_fd = -1, .wake = { -1, -1 } };
+
+static void wake() {
+  char byte = 0;
+
+  if(write(collab.wake[1], &byte, 1) < 0 && errno != EAGAIN)
+    perror("collab");
+}
+
+static struct TPeer* newPeer(int fd) {
+  struct TPeer *peer = (struct TPeer*)calloc(1, sizeof(struct TPeer));
+  int one = 1;
+
+  if(!peer)
+    return NULL;
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  peer->fd = fd;
+  peer->id = collab.next_id++;
+  collab.peers[collab.n_peers++] = peer;
+  return peer;
+}
+
+// Closes a connection; the lock must be held
+static void dropPeer(int i) {
+  struct TPeer *peer = collab.peers[i];
+
+  close(peer->fd);
+  wireFree(&peer->in);
+  wireFree(&peer->out);
+  free(peer);
+  collab.peers[i] = collab.peers[--collab.n_peers];
+  if(collab.role == COLLAB_PEER)
+    collab.lost = 1;
+}
+
+static struct TPeer* findPeer(int id) {
+  int i;
+
+  for(i = 0; i < collab.n_peers; ++i)
+    if(collab.peers[i]->id == id)
+      return collab.peers[i];
+  return NULL;
+}
+
+// Moves the whole messages received from a peer to the inbox; the lock must
+// be held
+// - Returns: -1 if the stream is corrupted
+static int receive(struct TPeer *peer) {
+  struct TWireReader payload;
+  enum EWireMessage type;
+  size_t size;
+  int result;
+
+  while((result = wireNextMessage(&peer->in, &type, &payload, &size)) == 1) {
+    if(wireCheckSeq(&peer->received, type, payload) < 0) {
+      fprintf(stderr, "Peer %d sent a message out of sequence.\n", peer->id);
+      return -1;
+    }
+    wirePut(&collab.inbox, &peer->id, sizeof(peer->id));
+    wirePut(&collab.inbox, peer->in.data, size);
+    wireConsume(&peer->in, size);
+  }
+
+  if(result < 0)
+    fprintf(stderr, "Peer %d sent a corrupted message.\n", peer->id);
+  return result;
+}
+
+static void* networkLoop(void *arg) {
+  struct pollfd fds[COLLAB_MAX_PEERS + 2];
+  int ids[COLLAB_MAX_PEERS];
+  unsigned char *buffer = (unsigned char*)malloc(COLLAB_READ_SIZE);
+  int i, n, n_listed, listening;
+
+  if(!buffer) {
+    fprintf(stderr, "Not enough memory for the session.\n");
+    return NULL;
+  }
+
+  for(;;) {
+    pthread_mutex_lock(&collab.lock);
+    for(i = collab.n_peers - 1; i >= 0; --i)
+      if(collab.peers[i]->dropped)
+        dropPeer(i);
+    if(collab.stop) {
+      pthread_mutex_unlock(&collab.lock);
+      break;
+    }
+
+    n = 0;
+    fds[n].fd = collab.wake[0];
+    fds[n++].events = POLLIN;
+    listening = collab.listen_fd >= 0 && collab.n_peers < COLLAB_MAX_PEERS;
+    if(listening) {
+      fds[n].fd = collab.listen_fd;
+      fds[n++].events = POLLIN;
+    }
+    for(i = 0, n_listed = collab.n_peers; i < n_listed; ++i) {
+      ids[i] = collab.peers[i]->id;
+      fds[n].fd = collab.peers[i]->fd;
+      fds[n++].events = POLLIN | (collab.peers[i]->out.size > 0 ? POLLOUT : 0);
+    }
+    pthread_mutex_unlock(&collab.lock);
+
+    if(poll(fds, n, -1) < 0) {
+      if(errno == EINTR)
+        continue;
+      perror("collab");
+      break;
+    }
+
+    if(fds[0].revents & POLLIN)
+      while(read(collab.wake[0], buffer, COLLAB_READ_SIZE) > 0)
+        ;
+
+    pthread_mutex_lock(&collab.lock);
+    if(listening && (fds[1].revents & POLLIN)) {
+      int fd = accept(collab.listen_fd, NULL, NULL);
+      if(fd >= 0 && !newPeer(fd))
+        close(fd);
+    }
+
+    // Peers are only removed by this thread, so the listed ones are there
+    for(i = 0; i < n_listed; ++i) {
+      struct pollfd *p = &fds[1 + listening + i];
+      struct TPeer *peer = findPeer(ids[i]);
+      int failed = 0;
+
+      if(p->revents & (POLLIN | POLLHUP | POLLERR)) {
+        ssize_t size = recv(peer->fd, buffer, COLLAB_READ_SIZE, 0);
+        if(size > 0) {
+          collab.bytes_in += size;
+          wirePut(&peer->in, buffer, size);
+          failed = peer->in.failed || receive(peer) < 0;
+        }
+        else if(size == 0 || (errno != EAGAIN && errno != EINTR))
+          failed = 1;
+      }
+
+      if(!failed && (p->revents & POLLOUT) && peer->out.size > 0) {
+        ssize_t size = send(peer->fd, peer->out.data, peer->out.size, MSG_NOSIGNAL);
+        if(size > 0) {
+          collab.bytes_out += size;
+          wireConsume(&peer->out, size);
+        }
+        else if(size < 0 && errno != EAGAIN && errno != EINTR)
+          failed = 1;
+      }
+
+      if(failed)
+        peer->dropped = 1;
+    }
+    pthread_mutex_unlock(&collab.lock);
+  }
+
+  free(buffer);
+  return NULL;
+}
+
+// Hands the outgoing messages to the peers: every joined one for the host
+static void deliver() {
+  int i;
+
+  if(collab.outgoing.size == 0)
+    return;
+
+  pthread_mutex_lock(&collab.lock);
+  for(i = 0; i < collab.n_peers; ++i) {
+    struct TPeer *peer = collab.peers[i];
+    if(collab.role == COLLAB_HOST && !peer->joined)
+      continue;
+
+    wirePut(&peer->out, collab.outgoing.data, collab.outgoing.size);
+    if(peer->out.failed || peer->out.size > COLLAB_MAX_BACKLOG) {
+      fprintf(stderr, "Peer %d is too slow; dropped.\n", peer->id);
+      peer->dropped = 1;
+    }
+  }
+  pthread_mutex_unlock(&collab.lock);
+
+  wireReset(&collab.outgoing);
+  wake();
+}
+
+static void flushBatch() {
+  size_t size = collab.outgoing.size;
+
+  if(collab.batch.n_edits > 0) {
+    wireBatchFlush(&collab.batch, ++collab.seq, &collab.outgoing);
+    collab.edit_bytes += collab.outgoing.size - size;
+  }
+}
+
+// Starts over the revisions of the chunks if the store was cleared
+static void checkGeneration() {
+  if(collab.generation != store_generation) {
+    collab.generation = store_generation;
+    collab.n_sent = 0;
+  }
+
+  if(n_chunks > collab.max_sent) {
+    collab.max_sent = n_chunks * 2;
+    collab.sent = (struct TSentChunk*)realloc(collab.sent, sizeof(struct TSentChunk) * collab.max_sent);
+  }
+  if(n_chunks > collab.n_sent) {
+    memset(&collab.sent[collab.n_sent], 0, sizeof(struct TSentChunk) * (n_chunks - collab.n_sent));
+    collab.n_sent = n_chunks;
+  }
+}
+
+static void markSent(struct TChunk* chunk) {
+  collab.sent[chunk->index].known = 1;
+  collab.sent[chunk->index].revision = chunk->revision;
+}
+
+// Takes every chunk as known by the peers
+static void markAllSent() {
+  int i;
+
+  checkGeneration();
+  for(i = 0; i < n_chunks; ++i)
+    markSent(chunks[i]);
+  collab.voxel_size = voxel_size;
+}
+
+// Appends a chunk as a WIRE_CHUNK message
+static void encodeChunk(struct TWireBuffer *out, struct TChunk* chunk, unsigned int seq) {
+  static struct TModelVoxel voxels[CHUNK_CELLS];
+  int w, n = 0;
+
+  if(chunk->n_voxels > 0) {
+    loadChunk(chunk);
+    for(w = 0; w < CHUNK_WORDS; ++w) {
+      unsigned long long bits = chunk->occupancy[w];
+      while(bits) {
+        struct TVoxel* v = &chunk->voxels[chunk->slot[w * 64 + __builtin_ctzll(bits)] - 1];
+        bits &= bits - 1;
+
+        voxels[n].colour = v->colour;
+        voxels[n].x = v->x;
+        voxels[n].y = v->y;
+        voxels[n].z = v->z;
+        ++n;
+      }
+    }
+  }
+
+  wireChunk(out, seq, chunk->cx, chunk->cy, chunk->cz, voxels, n);
+}
+
+// Appends the whole model as a WIRE_SNAPSHOT message and its chunks
+static void encodeSnapshot(struct TWireBuffer *out, unsigned int seq) {
+  int i, n = 0;
+
+  for(i = 0; i < n_chunks; ++i)
+    n += chunks[i]->n_voxels > 0;
+
+  wireSnapshot(out, seq, voxel_size, n);
+  for(i = 0; i < n_chunks; ++i)
+    if(chunks[i]->n_voxels > 0)
+      encodeChunk(out, chunks[i], seq);
+}
+
+// Sends the chunks changed without notifying their cells, or the whole model
+// if the voxel size changed
+static void sendChanges() {
+  int i;
+
+  flushBatch();
+  if(voxel_size != collab.voxel_size) {
+    encodeSnapshot(&collab.outgoing, ++collab.seq);
+    markAllSent();
+    return;
+  }
+
+  checkGeneration();
+  for(i = 0; i < n_chunks; ++i) {
+    struct TSentChunk *sent = &collab.sent[i];
+    if(!sent->known || sent->revision != chunks[i]->revision) {
+      encodeChunk(&collab.outgoing, chunks[i], ++collab.seq);
+      markSent(chunks[i]);
+    }
+  }
+}
+
+static void onEdit(enum EEdit edit, struct TVoxel* voxel) {
+  if(collab.role == COLLAB_OFF || collab.applying || !collab.synced)
+    return;
+
+  switch(edit) {
+  case EDIT_ADD:
+  case EDIT_RECOLOUR:
+  case EDIT_REMOVE:
+    wireBatchAdd(&collab.batch, edit == EDIT_REMOVE ? WIRE_REMOVE : WIRE_SET,
+                 voxel->x, voxel->y, voxel->z, voxel->colour);
+    collab.edits_out++;
+
+    // Every change out of the listener is followed by an EDIT_MODEL, so the
+    // chunk was known by the peers before this edit
+    checkGeneration();
+    markSent(getChunk(CHUNK_COORD(voxel->x), CHUNK_COORD(voxel->y), CHUNK_COORD(voxel->z), 0));
+    break;
+  case EDIT_CLEAR:
+    wireBatchAdd(&collab.batch, WIRE_CLEAR, 0, 0, 0, 0);
+    collab.edits_out++;
+    break;
+  case EDIT_MODEL:
+    sendChanges();
+    break;
+  }
+
+  if(collab.batch.n_edits >= COLLAB_BATCH_EDITS)
+    flushBatch();
+}
+
+// Publishes the chunks changed by the last WIRE_CHUNK messages
+static void finishChunks() {
+  if(!collab.silent)
+    return;
+
+  collab.applying = collab.role == COLLAB_PEER;
+  modelEdited();
+  collab.applying = 0;
+  collab.silent = 0;
+}
+
+// Replaces the contents of a chunk with the voxels received
+static void applyChunk(struct TWireChunk *received) {
+  static struct TModelVoxel voxels[CHUNK_CELLS];
+  unsigned long long keep[CHUNK_WORDS];
+  struct TChunk* chunk = getChunk(received->cx, received->cy, received->cz, 0);
+  int i, w;
+
+  if(wireChunkVoxels(received, voxels) < 0) {
+    fprintf(stderr, "Malformed chunk received.\n");
+    return;
+  }
+
+  memset(keep, 0, sizeof(keep));
+  for(i = 0; i < received->n_voxels; ++i) {
+    int cell = CELL_INDEX(voxels[i].x, voxels[i].y, voxels[i].z);
+    keep[cell >> 6] |= 1ULL << (cell & 63);
+  }
+
+  // The cells that aren't in the new contents are emptied first
+  if(chunk && chunk->n_voxels > 0) {
+    loadChunk(chunk);
+    for(w = 0; w < CHUNK_WORDS; ++w) {
+      unsigned long long bits = chunk->occupancy[w] & ~keep[w];
+      while(bits) {
+        int cell = w * 64 + __builtin_ctzll(bits);
+        bits &= bits - 1;
+        setCell((received->cx << CHUNK_BITS) | (cell & (CHUNK_SIZE-1)),
+                (received->cy << CHUNK_BITS) | ((cell >> CHUNK_BITS) & (CHUNK_SIZE-1)),
+                (received->cz << CHUNK_BITS) | (cell >> (2*CHUNK_BITS)), -1, 0);
+      }
+    }
+  }
+
+  for(i = 0; i < received->n_voxels; ++i)
+    setCell(voxels[i].x, voxels[i].y, voxels[i].z, voxels[i].colour, 0);
+  collab.silent = 1;
+}
+
+static void applySnapshot() {
+  collab.applying = collab.role == COLLAB_PEER;
+  if(collab.snapshot_voxel_size != voxel_size && collab.snapshot_voxel_size <= PAPER_WIDTH) {
+    voxel_size = collab.snapshot_voxel_size;
+    grid_height = PAPER_HEIGHT / voxel_size;
+    grid_width = PAPER_WIDTH / voxel_size;
+  }
+  setModel(collab.snapshot, collab.n_snapshot);
+  collab.applying = 0;
+
+  if(!collab.synced)
+    printf("Joined the model at %s: %d voxels.\n", collab.address, n_voxels);
+  collab.synced = 1;
+}
+
+static void applyEdits(struct TWireReader *payload) {
+  struct TWireEdits edits;
+  struct TWireEdit edit;
+  int result;
+
+  if(wireReadEdits(payload, &edits) < 0) {
+    fprintf(stderr, "Malformed edits received.\n");
+    return;
+  }
+
+  // Every batch is a step of the history
+  collab.applying = collab.role == COLLAB_PEER;
+  undoBegin();
+  while((result = wireNextEdit(&edits, &edit)) == 1) {
+    switch(edit.op) {
+    case WIRE_SET: setCell(edit.x, edit.y, edit.z, edit.colour, 1); break;
+    case WIRE_REMOVE: setCell(edit.x, edit.y, edit.z, -1, 1); break;
+    case WIRE_CLEAR:
+      // Clearing forgets the history, so the step is closed around it
+      undoEnd();
+      cleanCanvas();
+      undoBegin();
+      break;
+    }
+    collab.edits_in++;
+  }
+  undoEnd();
+  n_colours = countColours();
+  collab.applying = 0;
+
+  if(result < 0)
+    fprintf(stderr, "Malformed edits received.\n");
+}
+
+static void welcome(int id) {
+  struct TWireBuffer snapshot;
+  struct TPeer *peer;
+
+  // The peer gets what was sent up to now as part of the snapshot
+  flushBatch();
+  deliver();
+
+  memset(&snapshot, 0, sizeof(snapshot));
+  encodeSnapshot(&snapshot, collab.seq);
+
+  pthread_mutex_lock(&collab.lock);
+  if((peer = findPeer(id)) != NULL) {
+    wirePut(&peer->out, snapshot.data, snapshot.size);
+    peer->joined = 1;
+    printf("Peer %d joined (%d voxels, %d KB).\n", id, n_voxels, (int)(snapshot.size >> 10));
+  }
+  pthread_mutex_unlock(&collab.lock);
+
+  wireFree(&snapshot);
+  wake();
+}
+
+static void apply(int id, enum EWireMessage type, struct TWireReader *payload) {
+  struct TWireChunk chunk;
+  unsigned int seq;
+  int n_chunks;
+
+  // A peer ignores everything before the snapshot of the host
+  if(collab.role == COLLAB_PEER && !collab.synced && type != WIRE_SNAPSHOT && collab.snapshot_chunks == 0)
+    return;
+
+  if(type != WIRE_CHUNK)
+    finishChunks();
+
+  switch(type) {
+  case WIRE_HELLO:
+    if(collab.role != COLLAB_HOST)
+      break;
+    if(wireGetVarint(payload) != WIRE_VERSION) {
+      struct TPeer *peer;
+      fprintf(stderr, "Peer %d speaks another version of the protocol; dropped.\n", id);
+      pthread_mutex_lock(&collab.lock);
+      if((peer = findPeer(id)) != NULL)
+        peer->dropped = 1;
+      pthread_mutex_unlock(&collab.lock);
+      wake();
+      break;
+    }
+    welcome(id);
+    break;
+  case WIRE_EDITS:
+    applyEdits(payload);
+    break;
+  case WIRE_SNAPSHOT:
+    wireReadSnapshot(payload, &seq, &collab.snapshot_voxel_size, &n_chunks);
+    collab.n_snapshot = 0;
+    collab.snapshot_chunks = n_chunks;
+    if(n_chunks == 0)
+      applySnapshot();
+    break;
+  case WIRE_CHUNK:
+    if(wireReadChunk(payload, &chunk) < 0) {
+      fprintf(stderr, "Malformed chunk received.\n");
+      break;
+    }
+    if(collab.snapshot_chunks == 0) {
+      applyChunk(&chunk);
+      break;
+    }
+
+    if(collab.n_snapshot + chunk.n_voxels > collab.max_snapshot) {
+      collab.max_snapshot = (collab.n_snapshot + chunk.n_voxels) * 2;
+      collab.snapshot = (struct TModelVoxel*)realloc(collab.snapshot,
+                                                    sizeof(struct TModelVoxel) * collab.max_snapshot);
+    }
+    if(wireChunkVoxels(&chunk, &collab.snapshot[collab.n_snapshot]) == 0)
+      collab.n_snapshot += chunk.n_voxels;
+    else
+      fprintf(stderr, "Malformed chunk received.\n");
+    if(--collab.snapshot_chunks == 0)
+      applySnapshot();
+    break;
+  }
+}
+
+void collabPoll() {
+  static struct TWireBuffer received;
+  struct TWireBuffer swap, message;
+  struct TWireReader payload;
+  enum EWireMessage type;
+  size_t pos, size;
+  int id, lost;
+
+  if(collab.role == COLLAB_OFF)
+    return;
+
+  // Take the inbox at once, so the network thread keeps receiving meanwhile
+  wireReset(&received);
+  pthread_mutex_lock(&collab.lock);
+  swap = collab.inbox;
+  collab.inbox = received;
+  received = swap;
+  lost = collab.lost;
+  pthread_mutex_unlock(&collab.lock);
+
+  for(pos = 0; pos < received.size; pos += size) {
+    memcpy(&id, &received.data[pos], sizeof(id));
+    pos += sizeof(id);
+
+    memset(&message, 0, sizeof(message));
+    message.data = &received.data[pos];
+    message.size = received.size - pos;
+    if(wireNextMessage(&message, &type, &payload, &size) != 1)
+      break;
+    apply(id, type, &payload);
+  }
+  finishChunks();
+
+  // What a peer applied came from the host, which knows it already
+  if(collab.role == COLLAB_PEER && received.size > 0 && collab.synced)
+    markAllSent();
+
+  flushBatch();
+  deliver();
+
+  if(lost) {
+    fprintf(stderr, "Lost the connection to %s.\n", collab.address);
+    collabStop();
+  }
+}
+
+static int start(enum ECollabRole role, const char *address, int fd) {
+  static int listening = 0;
+
+  if(pipe(collab.wake) < 0) {
+    perror("collab");
+    close(fd);
+    return -1;
+  }
+  fcntl(collab.wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(collab.wake[1], F_SETFL, O_NONBLOCK);
+
+  snprintf(collab.address, sizeof(collab.address), "%s", address);
+  collab.role = role;
+  collab.stop = 0;
+  collab.lost = 0;
+  collab.seq = 0;
+  collab.n_peers = 0;
+  collab.bytes_in = collab.bytes_out = 0;
+  collab.edits_in = collab.edits_out = 0;
+  collab.edit_bytes = 0;
+  collab.snapshot_chunks = 0;
+  collab.generation = -1;
+  markAllSent();
+
+  if(role == COLLAB_HOST) {
+    collab.listen_fd = fd;
+    collab.synced = 1;
+  }
+  else {
+    struct TPeer *host = newPeer(fd);
+    if(!host) {
+      fprintf(stderr, "Not enough memory for the session.\n");
+      close(fd);
+      collabStop();
+      return -1;
+    }
+    wireHello(&host->out);
+    collab.synced = 0;
+  }
+
+  if(pthread_create(&collab.thread, NULL, networkLoop, NULL) != 0) {
+    fprintf(stderr, "Error starting the network thread.\n");
+    collabStop();
+    return -1;
+  }
+  collab.running = 1;
+
+  if(!listening) {
+    addEditListener(onEdit);
+    listening = 1;
+  }
+  return 0;
+}
+
+int collabHost(const char *address) {
+  int fd;
+
+  if(collab.role != COLLAB_OFF) {
+    fprintf(stderr, "Already in a session; leave it first.\n");
+    return -1;
+  }
+  if((fd = wireListen(address)) < 0)
+    return -1;
+  if(start(COLLAB_HOST, address, fd) < 0)
+    return -1;
+
+  printf("Hosting the model at %s.\n", address);
+  return 0;
+}
+
+int collabJoin(const char *address) {
+  int fd;
+
+  if(collab.role != COLLAB_OFF) {
+    fprintf(stderr, "Already in a session; leave it first.\n");
+    return -1;
+  }
+  if((fd = wireConnect(address)) < 0)
+    return -1;
+  return start(COLLAB_PEER, address, fd);
+}
+
+void collabStatus() {
+  long long bytes_in, bytes_out;
+  int peers;
+
+  if(collab.role == COLLAB_OFF) {
+    printf("No session.\n");
+    return;
+  }
+
+  pthread_mutex_lock(&collab.lock);
+  bytes_in = collab.bytes_in;
+  bytes_out = collab.bytes_out;
+  peers = collab.n_peers;
+  pthread_mutex_unlock(&collab.lock);
+
+  if(collab.role == COLLAB_HOST)
+    printf("Hosting at %s: %d peers, ", collab.address, peers);
+  else
+    printf("Joined to %s%s: ", collab.address, collab.synced ? "" : " (waiting for the snapshot)");
+  printf("message %u, %lld edits sent (%.1f bytes each), %lld edits received, %lld KB out, %lld KB in\n",
+         collab.seq, collab.edits_out, collab.edits_out ? (double)collab.edit_bytes / collab.edits_out : 0.0,
+         collab.edits_in, bytes_out >> 10, bytes_in >> 10);
+}
+
+void collabStop() {
+  int i;
+
+  if(collab.role == COLLAB_OFF)
+    return;
+
+  if(collab.running) {
+    pthread_mutex_lock(&collab.lock);
+    collab.stop = 1;
+    pthread_mutex_unlock(&collab.lock);
+    wake();
+    pthread_join(collab.thread, NULL);
+    collab.running = 0;
+  }
+
+  for(i = collab.n_peers - 1; i >= 0; --i)
+    dropPeer(i);
+  if(collab.listen_fd >= 0) {
+    close(collab.listen_fd);
+    collab.listen_fd = -1;
+    if(strchr(collab.address, '/'))
+      unlink(collab.address);
+  }
+  close(collab.wake[0]);
+  close(collab.wake[1]);
+  collab.wake[0] = collab.wake[1] = -1;
+
+  wireFree(&collab.inbox);
+  wireFree(&collab.outgoing);
+  wireBatchFree(&collab.batch);
+  free(collab.snapshot);
+  collab.snapshot = NULL;
+  collab.n_snapshot = collab.max_snapshot = 0;
+  free(collab.sent);
+  collab.sent = NULL;
+  collab.n_sent = collab.max_sent = 0;
+
+  printf("Left the session at %s.\n", collab.address);
+  collab.role = COLLAB_OFF;
+}
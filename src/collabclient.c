@@ -0,0 +1,497 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Stand-in peer of a shared editing session (collab.h), without camera nor
+ * display, so a session can be tried and measured on a single machine:
+ *
+ *   collabclient [-e edits/s] [-c] [-t seconds] [-o model.vox] [address]
+ *
+ * It joins the model at the address (COLLAB_ADDRESS by default), keeps a
+ * copy of it up to date and makes random edits near the origin, as a
+ * player would, replacing a whole chunk every second with -c, as the fills
+ * do. Every second it prints the traffic and the time the host took to send
+ * its edits back. Once the time is over it waits for the edits in flight,
+ * so the copy can be written and compared with the model of the host.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "collab.h"
+#include "colours.h"
+#include "store.h"
+#include "vox.h"
+#include "wire.h"
+
+// Time between two batches of edits, as a frame of the editor (s)
+#define FRAME_TIME (1.0 / 30.0)
+// Time waiting for the edits in flight after the last one (s)
+#define SETTLE_TIME 0.5
+// Cells edited: a box of this size from the origin
+#define EDIT_BOX 32
+// Edits sent looked up for the one received
+#define MATCH_WINDOW 4096
+// Cell with no voxel
+#define EMPTY 0xFFFF
+
+/**
+ * A chunk of the copy of the model
+ */
+struct TLocalChunk {
+  int cx, cy, cz;
+  int n_voxels;
+  unsigned short cells[CHUNK_CELLS];  // Colour of every cell; EMPTY if none
+};
+
+/**
+ * An edit sent that the host hasn't sent back yet
+ */
+struct TPending {
+  struct TWireEdit edit;
+  double sent;
+};
+
+static struct {
+  struct TLocalChunk **table;     // Open addressing hash of the chunks
+  unsigned int mask;
+  int n_chunks;
+  int n_voxels;
+} model;
+
+static struct {
+  struct TPending *edits;         // Ring buffer
+  int head, n, max;
+  double total, worst;            // Round trips (s)
+  long long samples;
+} pending;
+
+static void usage() {
+  fprintf(stderr, "Usage: collabclient [-e edits/s] [-c] [-t seconds] [-o model.vox] [address]\n");
+  exit(1);
+}
+
+static unsigned int hashChunk(int cx, int cy, int cz) {
+  return ((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u) ^ ((unsigned int)cz * 83492791u);
+}
+
+static struct TLocalChunk* findChunk(int cx, int cy, int cz, int create);
+
+static void growTable() {
+  struct TLocalChunk **old = model.table;
+  unsigned int old_size = old ? model.mask + 1 : 0, i;
+
+  model.mask = old ? old_size * 2 - 1 : 255;
+  model.table = (struct TLocalChunk**)calloc(model.mask + 1, sizeof(struct TLocalChunk*));
+  if(!model.table) {
+    fprintf(stderr, "Not enough memory for the model.\n");
+    exit(1);
+  }
+
+  for(i = 0; i < old_size; ++i) {
+    if(old[i]) {
+      unsigned int slot = hashChunk(old[i]->cx, old[i]->cy, old[i]->cz) & model.mask;
+      while(model.table[slot])
+        slot = (slot + 1) & model.mask;
+      model.table[slot] = old[i];
+    }
+  }
+  free(old);
+}
+
+static struct TLocalChunk* findChunk(int cx, int cy, int cz, int create) {
+  unsigned int slot;
+  struct TLocalChunk *chunk;
+
+  if(!model.table)
+    growTable();
+
+  for(slot = hashChunk(cx, cy, cz) & model.mask; model.table[slot]; slot = (slot + 1) & model.mask) {
+    chunk = model.table[slot];
+    if(chunk->cx == cx && chunk->cy == cy && chunk->cz == cz)
+      return chunk;
+  }
+  if(!create)
+    return NULL;
+
+  if(!(chunk = (struct TLocalChunk*)malloc(sizeof(struct TLocalChunk)))) {
+    fprintf(stderr, "Not enough memory for the model.\n");
+    exit(1);
+  }
+  chunk->cx = cx;
+  chunk->cy = cy;
+  chunk->cz = cz;
+  chunk->n_voxels = 0;
+  memset(chunk->cells, 0xFF, sizeof(chunk->cells));
+  model.table[slot] = chunk;
+
+  if(++model.n_chunks * 2 > (int)model.mask)
+    growTable();
+  return chunk;
+}
+
+static void clearModel() {
+  unsigned int i;
+
+  for(i = 0; model.table && i <= model.mask; ++i)
+    free(model.table[i]);
+  free(model.table);
+  memset(&model, 0, sizeof(model));
+}
+
+static void setCell(int x, int y, int z, int colour) {
+  struct TLocalChunk *chunk = findChunk(CHUNK_COORD(x), CHUNK_COORD(y), CHUNK_COORD(z), colour >= 0);
+  unsigned short *cell;
+
+  if(!chunk)
+    return;
+
+  cell = &chunk->cells[CELL_INDEX(x, y, z)];
+  if(*cell == EMPTY && colour >= 0) {
+    chunk->n_voxels++;
+    model.n_voxels++;
+  }
+  else if(*cell != EMPTY && colour < 0) {
+    chunk->n_voxels--;
+    model.n_voxels--;
+  }
+  *cell = colour >= 0 ? colour : EMPTY;
+}
+
+// Replaces the contents of a chunk
+// - Returns: 0 on success, -1 if it's malformed
+static int setChunk(struct TWireChunk *received) {
+  static struct TModelVoxel voxels[CHUNK_CELLS];
+  struct TLocalChunk *chunk;
+  int i;
+
+  if(wireChunkVoxels(received, voxels) < 0)
+    return -1;
+
+  if((chunk = findChunk(received->cx, received->cy, received->cz, received->n_voxels > 0))) {
+    model.n_voxels -= chunk->n_voxels;
+    chunk->n_voxels = 0;
+    memset(chunk->cells, 0xFF, sizeof(chunk->cells));
+  }
+  for(i = 0; i < received->n_voxels; ++i)
+    setCell(voxels[i].x, voxels[i].y, voxels[i].z, voxels[i].colour);
+  return 0;
+}
+
+// The edits of this peer come back in the order they were sent, among the
+// ones of the others, but for those that changed nothing on the host
+static void matchPending(const struct TWireEdit *edit) {
+  double elapsed;
+  int i;
+
+  for(i = 0; i < pending.n && i < MATCH_WINDOW; ++i) {
+    struct TPending *sent = &pending.edits[(pending.head + i) % pending.max];
+    if(sent->edit.op == edit->op && sent->edit.x == edit->x && sent->edit.y == edit->y &&
+       sent->edit.z == edit->z && (edit->op != WIRE_SET || sent->edit.colour == edit->colour))
+      break;
+  }
+  if(i == pending.n || i == MATCH_WINDOW)
+    return;
+
+  // The ones before it were dropped by the host
+  elapsed = benchNow() - pending.edits[(pending.head + i) % pending.max].sent;
+  pending.total += elapsed;
+  if(elapsed > pending.worst)
+    pending.worst = elapsed;
+  pending.samples++;
+  pending.head = (pending.head + i + 1) % pending.max;
+  pending.n -= i + 1;
+}
+
+static void addPending(const struct TWireEdit *edit) {
+  if(pending.n == pending.max) {
+    // Grown keeping the order of the ring
+    int max = pending.max ? pending.max * 2 : 1024, i;
+    struct TPending *edits = (struct TPending*)malloc(sizeof(struct TPending) * max);
+    if(!edits)
+      return;
+    for(i = 0; i < pending.n; ++i)
+      edits[i] = pending.edits[(pending.head + i) % pending.max];
+    free(pending.edits);
+    pending.edits = edits;
+    pending.head = 0;
+    pending.max = max;
+  }
+
+  pending.edits[(pending.head + pending.n) % pending.max].edit = *edit;
+  pending.edits[(pending.head + pending.n) % pending.max].sent = benchNow();
+  pending.n++;
+}
+
+// Applies a message of the host
+// - Returns: 0 on success, -1 if it's malformed
+static int apply(enum EWireMessage type, struct TWireReader *payload, int *snapshot_chunks) {
+  struct TWireEdits edits;
+  struct TWireEdit edit;
+  struct TWireChunk chunk;
+  unsigned int seq;
+  int voxel_size, result;
+
+  switch(type) {
+  case WIRE_SNAPSHOT:
+    if(wireReadSnapshot(payload, &seq, &voxel_size, snapshot_chunks) < 0)
+      return -1;
+    clearModel();
+    printf("Snapshot: message %u, voxels of size %d, %d chunks\n", seq, voxel_size, *snapshot_chunks);
+    return 0;
+  case WIRE_CHUNK:
+    if(*snapshot_chunks > 0)
+      --*snapshot_chunks;
+    return wireReadChunk(payload, &chunk) < 0 ? -1 : setChunk(&chunk);
+  case WIRE_EDITS:
+    if(wireReadEdits(payload, &edits) < 0)
+      return -1;
+    while((result = wireNextEdit(&edits, &edit)) == 1) {
+      if(edit.op == WIRE_CLEAR)
+        clearModel();
+      else
+        setCell(edit.x, edit.y, edit.z, edit.op == WIRE_SET ? edit.colour : -1);
+      matchPending(&edit);
+    }
+    return result;
+  default:
+    return 0;
+  }
+}
+
+// Makes the random edits of a frame
+static void makeEdits(struct TWireBatch *batch, int n) {
+  struct TWireEdit edit;
+  int i;
+
+  for(i = 0; i < n; ++i) {
+    edit.x = rand() % EDIT_BOX;
+    edit.y = rand() % EDIT_BOX;
+    edit.z = rand() % (EDIT_BOX / 2);
+    edit.op = rand() % 4 == 0 ? WIRE_REMOVE : WIRE_SET;
+    edit.colour = edit.op == WIRE_SET ? rand() % COLOURS_LENGTH : 0;
+
+    setCell(edit.x, edit.y, edit.z, edit.op == WIRE_SET ? edit.colour : -1);
+    wireBatchAdd(batch, edit.op, edit.x, edit.y, edit.z, edit.colour);
+    addPending(&edit);
+  }
+}
+
+// Fills a random chunk of the edit box with a colour
+static void makeChunk(struct TWireBuffer *out, unsigned int seq) {
+  static struct TModelVoxel voxels[CHUNK_CELLS];
+  int cx = rand() % (EDIT_BOX / CHUNK_SIZE), cy = rand() % (EDIT_BOX / CHUNK_SIZE);
+  int colour = rand() % COLOURS_LENGTH, cell, n = 0;
+
+  for(cell = 0; cell < CHUNK_CELLS; ++cell) {
+    int x = (cx << CHUNK_BITS) | (cell & (CHUNK_SIZE-1));
+    int y = (cy << CHUNK_BITS) | ((cell >> CHUNK_BITS) & (CHUNK_SIZE-1));
+    int z = cell >> (2*CHUNK_BITS);
+
+    // The lower half of the chunk
+    if(z >= CHUNK_SIZE / 2)
+      continue;
+    voxels[n].x = x;
+    voxels[n].y = y;
+    voxels[n].z = z;
+    voxels[n].colour = colour;
+    ++n;
+  }
+
+  wireChunk(out, seq, cx, cy, 0, voxels, n);
+}
+
+static int writeModel(const char *path) {
+  struct TModelVoxel *voxels = (struct TModelVoxel*)malloc(sizeof(struct TModelVoxel) * (model.n_voxels + 1));
+  int used[COLOURS_LENGTH] = { 0 }, n_colours = 0, n = 0, cell, result;
+  unsigned int i;
+  FILE *f;
+
+  if(!voxels || !(f = fopen(path, "w"))) {
+    fprintf(stderr, "Error writing %s.\n", path);
+    free(voxels);
+    return -1;
+  }
+
+  for(i = 0; model.table && i <= model.mask; ++i) {
+    struct TLocalChunk *chunk = model.table[i];
+    for(cell = 0; chunk && cell < CHUNK_CELLS; ++cell) {
+      if(chunk->cells[cell] == EMPTY)
+        continue;
+      voxels[n].x = (chunk->cx << CHUNK_BITS) | (cell & (CHUNK_SIZE-1));
+      voxels[n].y = (chunk->cy << CHUNK_BITS) | ((cell >> CHUNK_BITS) & (CHUNK_SIZE-1));
+      voxels[n].z = (chunk->cz << CHUNK_BITS) | (cell >> (2*CHUNK_BITS));
+      voxels[n].colour = chunk->cells[cell];
+      if(voxels[n].colour < COLOURS_LENGTH && !used[voxels[n].colour]++)
+        ++n_colours;
+      ++n;
+    }
+  }
+
+  result = writeVoxFormat(f, voxFormat(path), voxels, n, n_colours, NULL);
+  if(fclose(f) != 0 || result < 0) {
+    fprintf(stderr, "Error writing %s.\n", path);
+    result = -1;
+  }
+  free(voxels);
+  return result;
+}
+
+int main(int argc, char **argv) {
+  struct TWireBuffer in, out;
+  struct TWireSequence received;
+  struct TWireBatch batch;
+  struct TWireReader payload;
+  enum EWireMessage type;
+  const char *address = COLLAB_ADDRESS, *output = NULL;
+  double rate = 30.0, duration = 10.0, start, next_frame, next_report, debt = 0.0;
+  long long bytes_in = 0, bytes_out = 0, edits_out = 0;
+  unsigned int seq = 0;
+  int chunks = 0, snapshot_chunks = 0, synced = 0, fd, opt, seconds = 0;
+  unsigned char buffer[65536];
+  size_t size;
+
+  while((opt = getopt(argc, argv, "e:ct:o:")) != -1) {
+    switch(opt) {
+    case 'e': rate = atof(optarg); break;
+    case 'c': chunks = 1; break;
+    case 't': duration = atof(optarg); break;
+    case 'o': output = optarg; break;
+    default: usage();
+    }
+  }
+  if(optind < argc)
+    address = argv[optind++];
+  if(optind < argc || rate < 0.0)
+    usage();
+
+  if((fd = wireConnect(address)) < 0)
+    return 1;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  srand(getpid());
+
+  memset(&in, 0, sizeof(in));
+  memset(&out, 0, sizeof(out));
+  memset(&received, 0, sizeof(received));
+  memset(&batch, 0, sizeof(batch));
+  wireHello(&out);
+
+  start = benchNow();
+  next_frame = start + FRAME_TIME;
+  next_report = start + 1.0;
+  for(;;) {
+    double elapsed = benchNow() - start;
+    struct pollfd p = { fd, POLLIN | (out.size > 0 ? POLLOUT : 0), 0 };
+    int timeout = (int)((next_frame - benchNow()) * 1000.0);
+
+    // After the last edit, until they're all back (or it's clear they won't come)
+    if(elapsed >= duration && ((pending.n == 0 && elapsed >= duration + SETTLE_TIME) ||
+                               elapsed >= duration + 10 * SETTLE_TIME))
+      break;
+
+    if(poll(&p, 1, timeout > 0 ? timeout : 0) < 0 && errno != EINTR)
+      break;
+
+    if(p.revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if(n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        fprintf(stderr, "The host closed the session.\n");
+        break;
+      }
+      if(n > 0) {
+        int result;
+
+        bytes_in += n;
+        wirePut(&in, buffer, n);
+        while((result = wireNextMessage(&in, &type, &payload, &size)) == 1) {
+          if(wireCheckSeq(&received, type, payload) < 0 || apply(type, &payload, &snapshot_chunks) < 0) {
+            result = -1;
+            break;
+          }
+          if(!synced && type == WIRE_SNAPSHOT)
+            synced = 1;
+          wireConsume(&in, size);
+        }
+        if(result < 0) {
+          fprintf(stderr, "Corrupted stream from the host.\n");
+          break;
+        }
+      }
+    }
+
+    if((p.revents & POLLOUT) && out.size > 0) {
+      ssize_t n = send(fd, out.data, out.size, MSG_NOSIGNAL);
+      if(n < 0 && errno != EAGAIN && errno != EINTR) {
+        perror(address);
+        break;
+      }
+      if(n > 0) {
+        bytes_out += n;
+        wireConsume(&out, n);
+      }
+    }
+
+    // A frame: the edits made during it are sent as a batch
+    if(benchNow() >= next_frame) {
+      next_frame += FRAME_TIME;
+      if(synced && snapshot_chunks == 0 && elapsed < duration) {
+        int n;
+
+        debt += rate * FRAME_TIME;
+        n = (int)debt;
+        debt -= n;
+        makeEdits(&batch, n);
+        edits_out += n;
+        if(batch.n_edits > 0)
+          wireBatchFlush(&batch, ++seq, &out);
+        if(chunks && benchNow() >= next_report)
+          makeChunk(&out, ++seq);
+      }
+    }
+
+    if(benchNow() >= next_report) {
+      next_report += 1.0;
+      ++seconds;
+      printf("[%2ds] %d voxels, %lld edits sent, %lld KB in, %lld KB out (%.1f bytes/edit), "
+             "round trip %.1f ms avg, %.1f ms max, %d waiting\n",
+             seconds, model.n_voxels, edits_out, bytes_in >> 10, bytes_out >> 10,
+             edits_out ? (double)bytes_out / edits_out : 0.0,
+             pending.samples ? pending.total / pending.samples * 1000.0 : 0.0,
+             pending.worst * 1000.0, pending.n);
+      fflush(stdout);
+    }
+  }
+
+  close(fd);
+  if(output && writeModel(output) == 0)
+    printf("Model written to %s (%d voxels).\n", output, model.n_voxels);
+
+  wireFree(&in);
+  wireFree(&out);
+  wireBatchFree(&batch);
+  clearModel();
+  free(pending.edits);
+  return 0;
+}
@@ -18,7 +18,7 @@
 
 #include "colours.h"
 
-struct TColour colours[COLOURS_LENGTH] = {
+struct TColour colours[PALETTE_SIZE] = {
   {0, 0, 0, "Black", BLACK},
   {255, 255, 255, "White", WHITE},
   {0, 0, 128, "NavyBlue", NAVY_BLUE},
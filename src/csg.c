@@ -0,0 +1,247 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "csg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "functions.h"
+#include "shadow.h"
+#include "store.h"
+#include "threads.h"
+#include "undo.h"
+#include "vox.h"
+
+// Chunk coordinates are 12 bits wide for cells in the 16-bit grid
+#define CHUNK_KEY_BITS 12
+#define CHUNK_KEY_BIAS (1 << (CHUNK_KEY_BITS - 1))
+#define CHUNK_KEY_MASK ((1 << CHUNK_KEY_BITS) - 1)
+
+const char *csg_names[CSG_LENGTH] = { "merge", "subtract", "intersect" };
+
+/**
+ * A chunk of the model being combined: the bitset of its cells, as the
+ * chunks of the store keep it, and their colours
+ */
+struct TCsgChunk {
+  int cx, cy, cz;
+  unsigned long long occupancy[CHUNK_WORDS];
+  unsigned short colours[CHUNK_CELLS];
+};
+
+// Sort key of a voxel: chunk, cell inside it and colour, so sorting groups
+// the voxels by chunk
+static unsigned long long voxelKey(int x, int y, int z, int colour) {
+  unsigned long long chunk =
+    ((unsigned long long)((CHUNK_COORD(x) + CHUNK_KEY_BIAS) & CHUNK_KEY_MASK) << (2*CHUNK_KEY_BITS)) |
+    ((unsigned long long)((CHUNK_COORD(y) + CHUNK_KEY_BIAS) & CHUNK_KEY_MASK) << CHUNK_KEY_BITS) |
+    (unsigned long long)((CHUNK_COORD(z) + CHUNK_KEY_BIAS) & CHUNK_KEY_MASK);
+
+  return (chunk << 28) | ((unsigned long long)CELL_INDEX(x, y, z) << 16) | (colour & 0xFFFF);
+}
+
+static int keyChunk(unsigned long long key, int axis) {
+  return (int)((key >> (28 + (2 - axis) * CHUNK_KEY_BITS)) & CHUNK_KEY_MASK) - CHUNK_KEY_BIAS;
+}
+
+static void cellOf(struct TChunk* chunk, int cell, int c[3]) {
+  c[0] = (chunk->cx << CHUNK_BITS) | (cell & (CHUNK_SIZE-1));
+  c[1] = (chunk->cy << CHUNK_BITS) | ((cell >> CHUNK_BITS) & (CHUNK_SIZE-1));
+  c[2] = (chunk->cz << CHUNK_BITS) | (cell >> (2*CHUNK_BITS));
+}
+
+// Stores the model colour on every cell of 'add' (empty) and 'both' (populated)
+static int mergeChunk(struct TChunk* chunk, struct TCsgChunk* other) {
+  unsigned long long add[CHUNK_WORDS], both[CHUNK_WORDS];
+  int w, changed = 0, c[3];
+
+  editChunk(chunk);
+  for(w = 0; w < CHUNK_WORDS; ++w) {
+    add[w] = other->occupancy[w] & ~chunk->occupancy[w];
+    both[w] = other->occupancy[w] & chunk->occupancy[w];
+  }
+
+  for(w = 0; w < CHUNK_WORDS; ++w) {
+    unsigned long long bits = add[w];
+    while(bits) {
+      int cell = w * 64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+
+      cellOf(chunk, cell, c);
+      undoSave(c[0], c[1], c[2], UNDO_EMPTY);
+      chunkStore(chunk, c[0], c[1], c[2], other->colours[cell]);
+      shadowAdd(c[0], c[1]);
+      ++changed;
+    }
+
+    bits = both[w];
+    while(bits) {
+      int cell = w * 64 + __builtin_ctzll(bits);
+      struct TVoxel* v = &chunk->voxels[chunk->slot[cell] - 1];
+      bits &= bits - 1;
+
+      if(v->colour == other->colours[cell])
+        continue;
+      undoSave(v->x, v->y, v->z, v->colour);
+      v->colour = other->colours[cell];
+      ++changed;
+    }
+  }
+
+  return changed;
+}
+
+// Empties every cell of the chunk set in 'remove'
+static int removeCells(struct TChunk* chunk, unsigned long long remove[CHUNK_WORDS]) {
+  int w, changed = 0;
+
+  editChunk(chunk);
+  for(w = 0; w < CHUNK_WORDS; ++w) {
+    unsigned long long bits = remove[w];
+    while(bits) {
+      int cell = w * 64 + __builtin_ctzll(bits);
+      struct TVoxel* v = &chunk->voxels[chunk->slot[cell] - 1];
+      int x = v->x, y = v->y, z = v->z;
+      bits &= bits - 1;
+
+      undoSave(x, y, z, v->colour);
+      chunkErase(chunk, x, y, z);
+      shadowRemove(x, y);
+      ++changed;
+    }
+  }
+
+  return changed;
+}
+
+static int combineChunk(struct TCsgChunk* other, enum ECsg op) {
+  struct TChunk* chunk = getChunk(other->cx, other->cy, other->cz, op == CSG_MERGE);
+  unsigned long long remove[CHUNK_WORDS];
+  int w;
+
+  if(!chunk)
+    return 0;
+
+  switch(op) {
+  case CSG_MERGE:
+    return mergeChunk(chunk, other);
+  case CSG_SUBTRACT:
+    for(w = 0; w < CHUNK_WORDS; ++w)
+      remove[w] = chunk->occupancy[w] & other->occupancy[w];
+    return removeCells(chunk, remove);
+  case CSG_INTERSECT:
+    for(w = 0; w < CHUNK_WORDS; ++w)
+      remove[w] = chunk->occupancy[w] & ~other->occupancy[w];
+    return removeCells(chunk, remove);
+  default:
+    return 0;
+  }
+}
+
+static int compareKeys(const void *a, const void *b) {
+  unsigned long long ka = *(const unsigned long long*)a, kb = *(const unsigned long long*)b;
+  return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+int combineModel(struct TModelVoxel *model, int n, int dx, int dy, int dz, enum ECsg op) {
+  struct TCsgChunk *other;
+  unsigned long long *keys, *chunk_keys;
+  int i, j, n_keys = 0, n_chunk_keys = 0, changed = 0;
+
+  keys = (unsigned long long*)malloc(sizeof(unsigned long long) * (n > 0 ? n : 1));
+  for(i = 0; i < n; ++i) {
+    long x = (long)model[i].x + dx, y = (long)model[i].y + dy, z = (long)model[i].z + dz;
+    if(x < SHRT_MIN || x > SHRT_MAX || y < SHRT_MIN || y > SHRT_MAX || z < SHRT_MIN || z > SHRT_MAX)
+      continue;
+    keys[n_keys++] = voxelKey(x, y, z, model[i].colour);
+  }
+  parallelSortKeys(keys, n_keys);
+
+  // Chunk part of the keys of every chunk of the model, for intersections
+  chunk_keys = (unsigned long long*)malloc(sizeof(unsigned long long) * (n_keys > 0 ? n_keys : 1));
+  other = (struct TCsgChunk*)malloc(sizeof(struct TCsgChunk));
+
+  undoBegin();
+  for(i = 0; i < n_keys; i = j) {
+    unsigned long long chunk = keys[i] >> 28;
+
+    // Bitset and colours of the chunk out of its run of keys
+    memset(other->occupancy, 0, sizeof(other->occupancy));
+    other->cx = keyChunk(keys[i], 0);
+    other->cy = keyChunk(keys[i], 1);
+    other->cz = keyChunk(keys[i], 2);
+    for(j = i; j < n_keys && (keys[j] >> 28) == chunk; ++j) {
+      int cell = (keys[j] >> 16) & (CHUNK_CELLS - 1);
+      other->occupancy[cell >> 6] |= 1ULL << (cell & 63);
+      other->colours[cell] = keys[j] & 0xFFFF;
+    }
+
+    chunk_keys[n_chunk_keys++] = chunk;
+    changed += combineChunk(other, op);
+  }
+
+  // Intersecting empties the chunks the model doesn't reach at all
+  if(op == CSG_INTERSECT) {
+    unsigned long long remove[CHUNK_WORDS];
+    for(i = 0; i < n_chunks; ++i) {
+      struct TChunk* chunk = chunks[i];
+      unsigned long long key = voxelKey(chunk->cx << CHUNK_BITS, chunk->cy << CHUNK_BITS,
+                                        chunk->cz << CHUNK_BITS, 0) >> 28;
+      if(chunk->n_voxels == 0 ||
+         bsearch(&key, chunk_keys, n_chunk_keys, sizeof(unsigned long long), compareKeys))
+        continue;
+
+      memcpy(remove, chunk->occupancy, sizeof(remove));
+      changed += removeCells(chunk, remove);
+    }
+  }
+  undoEnd();
+
+  free(other);
+  free(chunk_keys);
+  free(keys);
+
+  if(changed)
+    modelEdited();
+  return changed;
+}
+
+int combineFile(const char *filename, int dx, int dy, int dz, enum ECsg op) {
+  struct TModelVoxel *model;
+  FILE *f;
+  int n, changed;
+
+  if(!(f=fopen(filename, "r"))) {
+    fprintf(stderr, "Error opening the requested model.\n");
+    return -1;
+  }
+
+  if(readVox(f, 0, &model, &n, NULL) < 0) {
+    fprintf(stderr, "Error reading the requested model.\n");
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+
+  changed = combineModel(model, n, dx, dy, dz, op);
+  free(model);
+  return changed;
+}
@@ -0,0 +1,187 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "diff.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "threads.h"
+#include "vox.h"
+
+// Colours sit below the Morton code in the sort keys of a model
+#define DIFF_COLOUR_BITS 15
+#define DIFF_COLOUR_MASK ((1ULL << DIFF_COLOUR_BITS) - 1)
+// Past the last Morton code, for a model walked to its end
+#define DIFF_END (~0ULL)
+
+// Sort keys of a model, (Morton code, colour), one per cell
+// - Returns: the keys, to be freed by the caller; NULL out of memory
+static unsigned long long* modelKeys(struct TModelVoxel *model, int n, int *n_keys) {
+  unsigned long long *keys = (unsigned long long*)malloc(sizeof(unsigned long long) * (n ? n : 1));
+  int i, m;
+
+  if(!keys)
+    return NULL;
+
+  for(i = 0; i < n; ++i)
+    keys[i] = voxMorton(model[i].x, model[i].y, model[i].z) << DIFF_COLOUR_BITS |
+              (model[i].colour & DIFF_COLOUR_MASK);
+  parallelSortKeys(keys, n);
+
+  for(i = 0, m = 0; i < n; ++i) {
+    if(m > 0 && keys[i] >> DIFF_COLOUR_BITS == keys[m-1] >> DIFF_COLOUR_BITS)
+      --m;
+    keys[m++] = keys[i];
+  }
+  *n_keys = m;
+  return keys;
+}
+
+static void keyVoxel(unsigned long long key, struct TModelVoxel *voxel) {
+  voxMortonCell(key >> DIFF_COLOUR_BITS, &voxel->x, &voxel->y, &voxel->z);
+  voxel->colour = (int)(key & DIFF_COLOUR_MASK);
+}
+
+int diffModels(struct TModelVoxel *a, int n_a, struct TModelVoxel *b, int n_b, struct TVoxEdit **edits) {
+  unsigned long long *keys_a, *keys_b;
+  struct TVoxEdit *out;
+  int i = 0, j = 0, n = 0;
+
+  keys_a = modelKeys(a, n_a, &n_a);
+  keys_b = modelKeys(b, n_b, &n_b);
+  out = (struct TVoxEdit*)malloc(sizeof(struct TVoxEdit) * ((long long)n_a + n_b + 1));
+  if(!keys_a || !keys_b || !out) {
+    free(keys_a);
+    free(keys_b);
+    free(out);
+    return -1;
+  }
+
+  while(i < n_a || j < n_b) {
+    unsigned long long code_a = i < n_a ? keys_a[i] >> DIFF_COLOUR_BITS : DIFF_END;
+    unsigned long long code_b = j < n_b ? keys_b[j] >> DIFF_COLOUR_BITS : DIFF_END;
+
+    if(code_a < code_b) {
+      out[n].edit = VOX_EDIT_REMOVE;
+      keyVoxel(keys_a[i++], &out[n++].voxel);
+    }
+    else if(code_b < code_a) {
+      out[n].edit = VOX_EDIT_ADD;
+      keyVoxel(keys_b[j++], &out[n++].voxel);
+    }
+    else {
+      if(keys_a[i] != keys_b[j]) {
+        out[n].edit = VOX_EDIT_RECOLOUR;
+        keyVoxel(keys_b[j], &out[n++].voxel);
+      }
+      ++i;
+      ++j;
+    }
+  }
+
+  free(keys_a);
+  free(keys_b);
+  *edits = out;
+  return n;
+}
+
+int patchModel(struct TModelVoxel *model, int n, struct TVoxEdit *edits, int n_edits,
+               struct TModelVoxel **patched, int *conflicts) {
+  unsigned long long *keys, code, last = 0;
+  struct TModelVoxel *out;
+  int i = 0, j = 0, m = 0, n_keys;
+
+  keys = modelKeys(model, n, &n_keys);
+  out = (struct TModelVoxel*)malloc(sizeof(struct TModelVoxel) * ((long long)n_keys + n_edits + 1));
+  if(!keys || !out) {
+    free(keys);
+    free(out);
+    return -1;
+  }
+
+  *conflicts = 0;
+  while(i < n_keys || j < n_edits) {
+    unsigned long long cell = i < n_keys ? keys[i] >> DIFF_COLOUR_BITS : DIFF_END;
+    struct TVoxEdit *edit = j < n_edits ? &edits[j] : NULL;
+
+    code = edit ? voxMorton(edit->voxel.x, edit->voxel.y, edit->voxel.z) : DIFF_END;
+    if(edit && j > 0 && code <= last) {
+      free(keys);
+      free(out);
+      return -1;
+    }
+
+    if(cell < code) {
+      keyVoxel(keys[i++], &out[m++]);
+      continue;
+    }
+
+    // The edit says what the cell ends with, whatever it holds now
+    if(cell == code ? edit->edit == VOX_EDIT_ADD : edit->edit != VOX_EDIT_ADD)
+      ++*conflicts;
+    if(edit->edit != VOX_EDIT_REMOVE)
+      out[m++] = edit->voxel;
+    if(cell == code)
+      ++i;
+    last = code;
+    ++j;
+  }
+
+  free(keys);
+  *patched = out;
+  return m;
+}
+
+int diffFiles(const char *a, const char *b, const char *patch) {
+  const char *names[2] = { a, b };
+  struct TModelVoxel *models[2] = { NULL, NULL };
+  struct TVoxEdit *edits = NULL;
+  int n[2], i, n_edits = -1;
+  FILE *f;
+
+  for(i = 0; i < 2; ++i) {
+    if(!(f = fopen(names[i], "rb"))) {
+      fprintf(stderr, "Error opening %s.\n", names[i]);
+      break;
+    }
+    if(readVox(f, 0, &models[i], &n[i], NULL) < 0) {
+      fprintf(stderr, "Error reading %s.\n", names[i]);
+      fclose(f);
+      break;
+    }
+    fclose(f);
+  }
+
+  if(i == 2 && (n_edits = diffModels(models[0], n[0], models[1], n[1], &edits)) < 0)
+    fprintf(stderr, "Not enough memory to compare %s and %s.\n", a, b);
+  if(n_edits >= 0) {
+    if(!(f = fopen(patch, "wb")) || writeVoxPatch(f, edits, n_edits) < 0) {
+      fprintf(stderr, "Error writing %s.\n", patch);
+      n_edits = -1;
+    }
+    if(f && fclose(f) != 0)
+      n_edits = -1;
+  }
+
+  free(edits);
+  free(models[0]);
+  free(models[1]);
+  return n_edits;
+}
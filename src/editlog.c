@@ -0,0 +1,534 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "editlog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "colours.h"
+#include "functions.h"
+#include "palette.h"
+#include "store.h"
+#include "structs.h"
+#include "vox.h"
+
+#define EDITLOG_MAGIC "ARVL"
+#define EDITLOG_VERSION 3
+// First line of the snapshot, with the generation of the log that follows it
+#define EDITLOG_GENERATION "# autosave generation %u\n"
+
+// Record emptying a chunk (x, y, z are its chunk coordinates) before its
+// voxels are logged again as EDIT_ADD records. Out of the range of EEdit
+#define RECORD_CHUNK 0x80
+
+/**
+ * Header at the beginning of the log
+ */
+struct TEditLogHeader {
+  char magic[4];          // EDITLOG_MAGIC
+  int version;            // EDITLOG_VERSION
+  int voxel_size;         // Voxel size of the snapshot and the records
+  unsigned int generation;  // Same as the snapshot the records apply to
+};
+
+/**
+ * An edit as stored in the log (10 bytes)
+ */
+struct TEditRecord {
+  unsigned char type;     // enum EEdit
+  unsigned char r, g, b;  // Colour, as RGB since palette entries are added at runtime
+  short x, y, z;          // Grid cell
+};
+
+/**
+ * Revision of a chunk as the log holds it
+ */
+struct TLoggedChunk {
+  int known;              // Whether the chunk is in the log (or the snapshot)
+  unsigned int revision;  // Its revision then
+};
+
+/**
+ * An item of the queue between the render thread and the writer: either a
+ * record or a snapshot to compact the log with
+ */
+struct TEditLogItem {
+  struct TEditRecord record;
+  struct TModelVoxel *snapshot;   // Not NULL for compactions
+  int n_snapshot, n_colours, voxel_size;
+};
+
+static struct {
+  int enabled;
+  int replaying;                  // Edits come from the log itself
+  char snapshot_path[1024];
+  char log_path[1024];
+  int fd;                         // Log file
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int stop;
+  struct TEditLogItem *pending;   // Queue filled by the render thread
+  int n_pending, max_pending;
+  int n_records;                  // Records in the log since the last snapshot
+  int voxel_size;                 // Voxel size the records are logged at
+  struct TLoggedChunk *logged;    // Per index of chunks[], for bulk changes
+  int n_logged, max_logged;
+  int generation_logged;          // store_generation of 'logged'
+  unsigned int generation;        // Of the snapshot and log on disk (writer thread)
+} editlog = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER, .fd = -1 };
+
+static int writeAll(int fd, const void *data, size_t size) {
+  const char *p = (const char*)data;
+
+  while(size > 0) {
+    ssize_t written = write(fd, p, size);
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += written;
+    size -= written;
+  }
+
+  return 0;
+}
+
+static int writeHeader(int fd, int size, unsigned int generation) {
+  struct TEditLogHeader header;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, EDITLOG_MAGIC, 4);
+  header.version = EDITLOG_VERSION;
+  header.voxel_size = size;
+  header.generation = generation;
+  return writeAll(fd, &header, sizeof(header));
+}
+
+// Starts a new log of the given generation next to the current one and
+// renames it over. Falls back to restarting the current one in place
+// - Returns: 0 on success; -1 if the log couldn't be restarted at all
+static int restartLog(int size, unsigned int generation) {
+  char tmp_path[1040];
+  int fd;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", editlog.log_path);
+  if((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644)) >= 0) {
+    if(writeHeader(fd, size, generation) == 0 && fsync(fd) == 0 &&
+       rename(tmp_path, editlog.log_path) == 0) {
+      close(editlog.fd);
+      editlog.fd = fd;
+      return 0;
+    }
+    close(fd);
+    unlink(tmp_path);
+  }
+
+  if(ftruncate(editlog.fd, 0) != 0 || writeHeader(editlog.fd, size, generation) < 0 ||
+     fsync(editlog.fd) != 0)
+    return -1;
+  return 0;
+}
+
+// Writes the snapshot of the next generation next to the old one and renames
+// it over, so there's always a complete snapshot on disk; then the log
+// starts over with that generation. Until it does, recover() tells the old
+// log apart by its generation and doesn't replay it over the new snapshot
+static void compact(struct TEditLogItem* item) {
+  unsigned int generation = editlog.generation + 1;
+  char tmp_path[1040];
+  FILE *f;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", editlog.snapshot_path);
+  if(!(f=fopen(tmp_path, "w"))) {
+    fprintf(stderr, "Error writing the autosave snapshot.\n");
+    return;
+  }
+
+  if(fprintf(f, EDITLOG_GENERATION, generation) < 0 ||
+     writeVox(f, item->snapshot, item->n_snapshot, item->n_colours, NULL) < 0 ||
+     fflush(f) != 0 || fsync(fileno(f)) != 0) {
+    fprintf(stderr, "Error writing the autosave snapshot.\n");
+    fclose(f);
+    unlink(tmp_path);
+    return;
+  }
+  fclose(f);
+
+  if(rename(tmp_path, editlog.snapshot_path) != 0) {
+    fprintf(stderr, "Error writing the autosave snapshot.\n");
+    unlink(tmp_path);
+    return;
+  }
+  editlog.generation = generation;
+
+  if(restartLog(item->voxel_size, generation) < 0)
+    fprintf(stderr, "Error restarting the autosave log.\n");
+}
+
+static void* writerLoop(void *arg) {
+  struct TEditLogItem *items = NULL;
+  struct TEditRecord *records = NULL;
+  int max_items = 0;
+  int i, n, n_records, stop;
+
+  pthread_mutex_lock(&editlog.lock);
+  for(;;) {
+    struct timespec deadline;
+
+    while(!editlog.stop && editlog.n_pending == 0)
+      pthread_cond_wait(&editlog.cond, &editlog.lock);
+
+    // Let the edits of the next EDITLOG_FLUSH_MS join the batch
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += EDITLOG_FLUSH_MS / 1000;
+    deadline.tv_nsec += (EDITLOG_FLUSH_MS % 1000) * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    while(!editlog.stop &&
+          pthread_cond_timedwait(&editlog.cond, &editlog.lock, &deadline) != ETIMEDOUT)
+      ;
+
+    // Take the whole queue
+    n = editlog.n_pending;
+    if(n > max_items) {
+      max_items = n;
+      items = (struct TEditLogItem*)realloc(items, sizeof(struct TEditLogItem) * max_items);
+      records = (struct TEditRecord*)realloc(records, sizeof(struct TEditRecord) * max_items);
+    }
+    memcpy(items, editlog.pending, sizeof(struct TEditLogItem) * n);
+    editlog.n_pending = 0;
+    stop = editlog.stop;
+    pthread_mutex_unlock(&editlog.lock);
+
+    // Consecutive records are written at once; snapshots in between
+    for(i = 0, n_records = 0; i <= n; ++i) {
+      if(i < n && !items[i].snapshot) {
+        records[n_records++] = items[i].record;
+        continue;
+      }
+
+      if(n_records > 0 && writeAll(editlog.fd, records, sizeof(struct TEditRecord) * n_records) < 0)
+        fprintf(stderr, "Error writing the autosave log.\n");
+      n_records = 0;
+
+      if(i < n) {
+        compact(&items[i]);
+        free(items[i].snapshot);
+      }
+    }
+    if(n > 0)
+      fdatasync(editlog.fd);
+
+    pthread_mutex_lock(&editlog.lock);
+    if(stop && editlog.n_pending == 0)
+      break;
+  }
+  pthread_mutex_unlock(&editlog.lock);
+
+  free(items);
+  free(records);
+  return NULL;
+}
+
+static void enqueue(struct TEditLogItem* item) {
+  pthread_mutex_lock(&editlog.lock);
+  if(editlog.n_pending == editlog.max_pending) {
+    editlog.max_pending = editlog.max_pending ? editlog.max_pending * 2 : 1024;
+    editlog.pending = (struct TEditLogItem*)realloc(editlog.pending,
+                                                    sizeof(struct TEditLogItem) * editlog.max_pending);
+  }
+  editlog.pending[editlog.n_pending++] = *item;
+  pthread_cond_signal(&editlog.cond);
+  pthread_mutex_unlock(&editlog.lock);
+}
+
+// Starts over the revisions of the chunks if the store was cleared
+static void checkGeneration() {
+  if(editlog.generation_logged != store_generation) {
+    editlog.generation_logged = store_generation;
+    editlog.n_logged = 0;
+  }
+
+  if(n_chunks > editlog.max_logged) {
+    editlog.max_logged = n_chunks * 2;
+    editlog.logged = (struct TLoggedChunk*)realloc(editlog.logged, sizeof(struct TLoggedChunk) * editlog.max_logged);
+  }
+  if(n_chunks > editlog.n_logged) {
+    memset(&editlog.logged[editlog.n_logged], 0, sizeof(struct TLoggedChunk) * (n_chunks - editlog.n_logged));
+    editlog.n_logged = n_chunks;
+  }
+}
+
+static void markLogged(struct TChunk* chunk) {
+  editlog.logged[chunk->index].known = 1;
+  editlog.logged[chunk->index].revision = chunk->revision;
+}
+
+static void enqueueSnapshot() {
+  struct TEditLogItem item;
+  int i;
+
+  memset(&item, 0, sizeof(item));
+  item.snapshot = snapshotModel(&item.n_snapshot);
+  item.n_colours = n_colours;
+  item.voxel_size = voxel_size;
+  enqueue(&item);
+  editlog.n_records = 0;
+  editlog.voxel_size = voxel_size;
+
+  checkGeneration();
+  for(i = 0; i < n_chunks; ++i)
+    markLogged(chunks[i]);
+}
+
+static void enqueueRecord(enum EEdit edit, struct TVoxel* voxel) {
+  struct TEditLogItem item;
+
+  memset(&item, 0, sizeof(item));
+  item.record.type = edit;
+  if(voxel) {
+    item.record.r = colours[voxel->colour].r;
+    item.record.g = colours[voxel->colour].g;
+    item.record.b = colours[voxel->colour].b;
+    item.record.x = voxel->x;
+    item.record.y = voxel->y;
+    item.record.z = voxel->z;
+  }
+  enqueue(&item);
+  editlog.n_records++;
+}
+
+// Logs the chunks changed since the log last had them: a RECORD_CHUNK
+// emptying each one and its voxels added again. So a bulk change costs as
+// much I/O as the chunks it touched (plus the ones edited one voxel at a
+// time since they were logged), not the whole model
+static void logChunks() {
+  struct TEditLogItem item;
+  int i, j;
+
+  // A cleared store (e.g., a model was loaded) starts from nothing too
+  if(editlog.generation_logged != store_generation)
+    enqueueRecord(EDIT_CLEAR, NULL);
+  checkGeneration();
+
+  for(i = 0; i < n_chunks; ++i) {
+    struct TChunk* chunk = chunks[i];
+    struct TLoggedChunk* logged = &editlog.logged[i];
+
+    if(logged->known ? logged->revision == chunk->revision : chunk->n_voxels == 0)
+      continue;
+
+    memset(&item, 0, sizeof(item));
+    item.record.type = RECORD_CHUNK;
+    item.record.x = chunk->cx;
+    item.record.y = chunk->cy;
+    item.record.z = chunk->cz;
+    enqueue(&item);
+    editlog.n_records++;
+
+    loadChunk(chunk);
+    for(j = 0; j < chunk->n_voxels; ++j)
+      enqueueRecord(EDIT_ADD, &chunk->voxels[j]);
+    markLogged(chunk);
+  }
+}
+
+static void onEdit(enum EEdit edit, struct TVoxel* voxel) {
+  if(!editlog.enabled || editlog.replaying)
+    return;
+
+  // Records are cells of the voxel size of the log, so a new one needs a
+  // snapshot (and a new header)
+  if(edit == EDIT_MODEL && voxel_size != editlog.voxel_size) {
+    enqueueSnapshot();
+    return;
+  }
+
+  if(edit == EDIT_MODEL)
+    logChunks();
+  else
+    enqueueRecord(edit, voxel);
+
+  if(edit == EDIT_CLEAR)
+    checkGeneration();
+
+  // Compact once the log is longer than the model, so the snapshot cost is
+  // amortized over at least as many edits as voxels it writes
+  if(editlog.n_records > EDITLOG_COMPACT_MIN &&
+     editlog.n_records > n_voxels)
+    enqueueSnapshot();
+}
+
+// Applies a record straight on the store; recover() publishes the changes
+static void replay(struct TEditRecord* record) {
+  struct TChunk* chunk;
+
+  switch(record->type) {
+  case EDIT_ADD:
+  case EDIT_RECOLOUR:
+    setCell(record->x, record->y, record->z, paletteColour(record->r, record->g, record->b), 0);
+    break;
+  case EDIT_REMOVE:
+    setCell(record->x, record->y, record->z, -1, 0);
+    break;
+  case EDIT_CLEAR:
+    cleanCanvas();
+    break;
+  case RECORD_CHUNK:
+    // Erasing moves the last voxel to the hole, so erase from the end
+    if((chunk = getChunk(record->x, record->y, record->z, 0))) {
+      loadChunk(chunk);
+      while(chunk->n_voxels > 0) {
+        struct TVoxel last = chunk->voxels[chunk->n_voxels - 1];
+        setCell(last.x, last.y, last.z, -1, 0);
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+// Loads the snapshot and replays the complete records of the log, unless
+// the log belongs to an older snapshot (a compaction was cut short)
+static int recover(int fd) {
+  struct TEditLogHeader header;
+  struct TEditRecord records[1024];
+  struct TModelVoxel *model;
+  FILE *f;
+  ssize_t size;
+  unsigned int generation;
+  int n, i, replayed = 0, matches;
+
+  if(read(fd, &header, sizeof(header)) != sizeof(header) ||
+     memcmp(header.magic, EDITLOG_MAGIC, 4) != 0 || header.version != EDITLOG_VERSION)
+    return 0;
+
+  editlog.replaying = 1;
+
+  if(header.voxel_size != voxel_size && header.voxel_size > 0 && header.voxel_size <= PAPER_WIDTH) {
+    voxel_size = header.voxel_size;
+    grid_height = PAPER_HEIGHT / voxel_size;
+    grid_width = PAPER_WIDTH / voxel_size;
+  }
+
+  // A first log is replayed on its own, as it may crash before its snapshot
+  matches = header.generation == 0;
+  if((f=fopen(editlog.snapshot_path, "r"))) {
+    if(fscanf(f, EDITLOG_GENERATION, &generation) == 1) {
+      editlog.generation = generation;
+      matches = generation == header.generation;
+    }
+    rewind(f);
+    if(readVox(f, 0, &model, &n, NULL) == 0) {
+      setModel(model, n);
+      free(model);
+    }
+    fclose(f);
+  }
+
+  while(matches && (size = read(fd, records, sizeof(records))) > 0) {
+    // A torn record at the end of the log is dropped
+    for(i = 0; i < size / (ssize_t)sizeof(struct TEditRecord); ++i, ++replayed)
+      replay(&records[i]);
+    if(size % sizeof(struct TEditRecord))
+      break;
+  }
+  if(replayed > 0)
+    modelEdited();
+
+  editlog.replaying = 0;
+  return replayed;
+}
+
+int editLogOpen(const char *snapshot, const char *log) {
+  static int listening = 0;
+  int fd, replayed = 0;
+
+  strncpy(editlog.snapshot_path, snapshot, sizeof(editlog.snapshot_path) - 1);
+  strncpy(editlog.log_path, log, sizeof(editlog.log_path) - 1);
+
+  if((fd = open(log, O_RDONLY)) >= 0) {
+    replayed = recover(fd);
+    close(fd);
+    if(n_voxels > 0)
+      printf("Recovered %d voxels from the autosave (%d edits replayed).\n",
+             n_voxels, replayed);
+  }
+
+  if((editlog.fd = open(log, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0) {
+    fprintf(stderr, "Error opening the autosave log; autosave disabled.\n");
+    return -1;
+  }
+
+  // A new log gets its header now, in case the first snapshot fails
+  if(lseek(editlog.fd, 0, SEEK_END) == 0)
+    writeHeader(editlog.fd, voxel_size, editlog.generation);
+
+  editlog.stop = 0;
+  if(pthread_create(&editlog.thread, NULL, writerLoop, NULL) != 0) {
+    fprintf(stderr, "Error starting the autosave thread; autosave disabled.\n");
+    close(editlog.fd);
+    editlog.fd = -1;
+    return -1;
+  }
+
+  if(!listening) {
+    addEditListener(onEdit);
+    listening = 1;
+  }
+  editlog.enabled = 1;
+
+  // Start over from a snapshot of the recovered model
+  enqueueSnapshot();
+  return replayed;
+}
+
+void editLogClose() {
+  if(!editlog.enabled)
+    return;
+
+  editlog.enabled = 0;
+  pthread_mutex_lock(&editlog.lock);
+  editlog.stop = 1;
+  pthread_cond_signal(&editlog.cond);
+  pthread_mutex_unlock(&editlog.lock);
+
+  pthread_join(editlog.thread, NULL);
+  close(editlog.fd);
+  editlog.fd = -1;
+
+  free(editlog.pending);
+  editlog.pending = NULL;
+  editlog.n_pending = editlog.max_pending = 0;
+  free(editlog.logged);
+  editlog.logged = NULL;
+  editlog.n_logged = editlog.max_logged = 0;
+}
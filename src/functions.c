@@ -24,9 +24,36 @@
 #include <math.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
+#include <limits.h>
 
+#include "analytics.h"
+#include "bench.h"
+#include "capture.h"
+#include "collab.h"
 #include "colours.h"
+#include "csg.h"
+#include "diff.h"
+#include "editlog.h"
+#include "gizmo.h"
+#include "governor.h"
+#include "import.h"
+#include "jobs.h"
+#include "mesher.h"
+#include "palette.h"
+#include "pick.h"
+#include "region.h"
+#include "render.h"
+#include "resample.h"
+#include "selection.h"
+#include "shadow.h"
+#include "store.h"
 #include "structs.h"
+#include "text.h"
+#include "threads.h"
+#include "topology.h"
+#include "undo.h"
+#include "vox.h"
 
 ARMultiMarkerInfoT *mMarker;
 int dim[2];
@@ -35,46 +62,129 @@ int grid_height = PAPER_HEIGHT / 16;
 int grid_width = PAPER_WIDTH / 16;
 struct TObject *objects = NULL;
 int n_objects = 0;
-struct TVoxel *voxels = NULL;
 int n_voxels = 0;
-int n_voxels_non_dirty = 0;
 struct TBrush brush;
-unsigned char colour_index = BLACK;
+int colour_index = BLACK;
 int n_colours = 0;
 int is_input = 0;
 char character[2] = " \0";
+int model_revision = 0;
+int pick_mode = 0;
+
+// Set by keyboard() so the next frame is drawn even without a new camera frame
+static int key_pressed = 0;
+
+// Maximum number of edit listeners
+#define MAX_EDIT_LISTENERS 4
+
+static void (*edit_listeners[MAX_EDIT_LISTENERS])(enum EEdit edit, struct TVoxel* voxel);
+static int n_edit_listeners = 0;
+
+static void notifyEdit(enum EEdit edit, struct TVoxel* voxel) {
+  int i;
+
+  for(i = 0; i < n_edit_listeners; ++i)
+    (*edit_listeners[i])(edit, voxel);
+}
 
 int roundNum(float num) {
   return num < 0 ? num - 0.5 : num + 0.5;
 }
 
 void menu() {
-  char buff[200];
-
-  int num_real_voxels = n_voxels - n_voxels_non_dirty;
-  sprintf(buff,
-          "Colour: %s (%u, %u, %u)\n"
-          "Num. of voxels: %d\n"
-          "Num. of colours: %d\n",
-          brush.colour->name, brush.colour->r, brush.colour->g, brush.colour->b,
-          num_real_voxels < 0 ? 0 : num_real_voxels, n_colours);
-  printText(1.0f, 1.0f, 1.0f,  10, 14,  GLUT_BITMAP_HELVETICA_12,  buff,  1);
-
-  sprintf(buff,
-          "Q: Quit\n"
-          "-/+: Change colour\n"
-          "R: Reset\n"
-          "U: Undo\n"
-          "ENTER: Command line\n"
-          "SPACEBAR: Put voxel\n"
-          "X: Remove voxel\n");
-  printText(1.0f, 1.0f, 1.0f,  10, 14,  GLUT_BITMAP_HELVETICA_12, buff, 0);
+  static char buff[512];
+  static char controls[] =
+    "Q: Quit\n"
+    "-/+: Change colour\n"
+    "R: Reset\n"
+    "U: Undo\n"
+    "ENTER: Command line\n"
+    "SPACEBAR: Put voxel\n"
+    "X: Remove voxel\n"
+    "P: Ray picking\n";
+  static struct TTextBlock status_text, controls_text;
+  static struct TColour* shown_colour = NULL;
+  static int shown_voxels = -1, shown_colours = -1, shown_mode = -1;
+  static int shown_progress = -1, shown_pick = -1, shown_chunks = -1, shown_resident = -1;
+  static int shown_cpu = -1, shown_fps = -1, shown_quality = -1, frames = 0, fps = 0;
+  static int shown_size[3] = { -1, -1, -1 };
+  static double second = 0.0;
+  const char *job_name = NULL;
+  int progress = modelJobProgress(&job_name);
+  int cpu = cpuUsage();
+  int size[3] = { 0, 0, 0 }, min[3], max[3], k;
+
+  if(voxelBounds(min, max))
+    for(k = 0; k < 3; ++k)
+      size[k] = max[k] - min[k] + 1;
+
+  // Frames drawn in the last second
+  ++frames;
+  if(benchNow() - second >= 1.0) {
+    fps = frames;
+    frames = 0;
+    second = benchNow();
+  }
+
+  // Format the status only when something it shows has changed
+  if(brush.colour != shown_colour || n_voxels != shown_voxels ||
+     n_colours != shown_colours || render_mode != shown_mode ||
+     progress != shown_progress || pick_mode != shown_pick ||
+     n_chunks != shown_chunks || store_stats.n_resident != shown_resident ||
+     cpu != shown_cpu || fps != shown_fps || quality.level != shown_quality ||
+     memcmp(size, shown_size, sizeof(size)) != 0) {
+    int len = sprintf(buff,
+            "Colour: %s (%u, %u, %u)\n"
+            "Num. of voxels: %d\n"
+            "Num. of colours: %d\n"
+            "Size: %dx%dx%d cells\n"
+            "Render: %s\n"
+            "Brush: %s\n"
+            "Chunks: %d (%d in memory, %d MB)\n"
+            "CPU: %d%% (%d frames/s)\n"
+            "Quality: %s\n",
+            brush.colour->name, brush.colour->r, brush.colour->g, brush.colour->b,
+            n_voxels, n_colours, size[0], size[1], size[2], render_mode_names[render_mode],
+            pick_mode ? "ray" : "marker",
+            n_chunks, store_stats.n_resident, (int)(store_stats.resident >> 20),
+            cpu, fps, quality_name);
+    if(progress >= 0)
+      sprintf(&buff[len], "%s: %d%%\n", job_name, progress / 10);
+
+    shown_colour = brush.colour;
+    shown_voxels = n_voxels;
+    shown_colours = n_colours;
+    shown_mode = render_mode;
+    shown_progress = progress;
+    shown_pick = pick_mode;
+    shown_chunks = n_chunks;
+    shown_resident = store_stats.n_resident;
+    shown_cpu = cpu;
+    shown_fps = fps;
+    shown_quality = quality.level;
+    memcpy(shown_size, size, sizeof(size));
+  }
+  drawText(&status_text, 1.0f, 1.0f, 1.0f,  10, 14,  GLUT_BITMAP_HELVETICA_12,  buff,  1);
+  if(quality.overlay)
+    drawText(&controls_text, 1.0f, 1.0f, 1.0f,  10, 14,  GLUT_BITMAP_HELVETICA_12, controls, 0);
 
   if(is_input)
     input();
 }
 
+int sceneChanged() {
+  static int revision = -1;
+  const char *job_name;
+  int changed = key_pressed || is_input || model_revision != revision ||
+                modelJobProgress(&job_name) >= 0 || meshesPending() > 0;
+
+  key_pressed = 0;
+  revision = model_revision;
+  return changed;
+}
+
 void keyboard(unsigned char key, int x, int y) {
+  key_pressed = 1;
   if(is_input) {
     character[0] = key;
     return;
@@ -83,16 +193,17 @@ void keyboard(unsigned char key, int x, int y) {
   switch(key) {
   case 0x1B: case 'Q': case 'q': cleanup(); break;
   case '-':
-    colour_index = (colour_index>0)?colour_index-1:COLOURS_LENGTH-1;
+    colour_index = (colour_index>0)?colour_index-1:n_palette-1;
     brush.colour = &colours[colour_index];
     break;
   case '+':
-    colour_index = (colour_index<COLOURS_LENGTH-1)?colour_index+1:0;
+    colour_index = (colour_index<n_palette-1)?colour_index+1:0;
     brush.colour = &colours[colour_index];
     break;
   case 'R': case 'r': cleanCanvas(); break;
-  case 'U': case 'u': removeLastVoxel(); break;
+  case 'U': case 'u': undo(); break;
   case 'X': case 'x': brush.remove_voxel = 1; break;
+  case 'P': case 'p': pick_mode = !pick_mode; break;
   case ' ': brush.put_voxel = 1; break;
   case 0xD: is_input = 1; break;
   }
@@ -101,8 +212,9 @@ void keyboard(unsigned char key, int x, int y) {
 void input() {
   static char buff[1024];
   static int first_enter = 1;
+  static struct TTextBlock prompt_text, input_text;
 
-  printText(0.0f, 1.0f, 0.0f, 164, 14, GLUT_BITMAP_HELVETICA_10, ">", 0);
+  drawText(&prompt_text, 0.0f, 1.0f, 0.0f, 164, 14, GLUT_BITMAP_HELVETICA_10, ">", 0);
 
   // CWD
   if(character[0] == '^') {
@@ -123,7 +235,7 @@ void input() {
     strcat(buff, character);
   }
 
-  printText(0.0f, 1.0f, 0.0f, 174, 14, GLUT_BITMAP_HELVETICA_10, buff, 0);
+  drawText(&input_text, 0.0f, 1.0f, 0.0f, 174, 14, GLUT_BITMAP_HELVETICA_10, buff, 0);
 
   // NULL
   if(character[0] == '\0')
@@ -146,13 +258,200 @@ void input() {
       char arg1[64];
       sscanf(buff, "%*s %s", arg1);
       printf("%s\n", arg1);
-      loadModel(arg1);
+      loadModelAsync(arg1);
     }
     else if(strcmp(command, "save") == 0) {
       char arg1[64];
       sscanf(buff, "%*s %s", arg1);
       printf("%s\n", arg1);
-      saveModel(arg1);
+      saveModelAsync(arg1);
+    }
+    else if(strcmp(command, "render") == 0) {
+      char arg1[64];
+      int mode;
+      if(sscanf(buff, "%*s %63s", arg1) == 1) {
+        for(mode = 0; mode < RENDER_MODES_LENGTH; ++mode)
+          if(strcmp(arg1, render_mode_names[mode]) == 0)
+            break;
+
+        if(mode == RENDER_MODES_LENGTH)
+          fprintf(stderr, "Unknown render mode: %s\n", arg1);
+        else if(!renderModeSupported(mode))
+          fprintf(stderr, "Render mode not supported: %s\n", arg1);
+        else {
+          render_mode = mode;
+          // The levels available depend on the mode
+          setQualityLevel(quality.level);
+        }
+      }
+    }
+    else if(strcmp(command, "resolution") == 0) {
+      int size;
+      if(sscanf(buff, "%*s %d", &size) == 1)
+        setResolution(size);
+    }
+    else if(strcmp(command, "bench") == 0) {
+      int frames = 100;
+      sscanf(buff, "%*s %d", &frames);
+      benchmark(frames > 0 ? frames : 100);
+    }
+    else if(strcmp(command, "stats") == 0) {
+      printStats();
+    }
+    else if(strcmp(command, "host") == 0 || strcmp(command, "join") == 0) {
+      char address[256] = COLLAB_ADDRESS;
+      sscanf(buff, "%*s %255s", address);
+      if(command[0] == 'h')
+        collabHost(address);
+      else
+        collabJoin(address);
+    }
+    else if(strcmp(command, "leave") == 0) {
+      collabStop();
+    }
+    else if(strcmp(command, "peers") == 0) {
+      collabStatus();
+    }
+    else if(strcmp(command, "budget") == 0) {
+      int megabytes;
+      if(sscanf(buff, "%*s %d", &megabytes) == 1)
+        setStoreBudget((long long)megabytes << 20);
+      printf("Chunk cache: %d of %d chunks in memory (%lld of %lld MB), "
+             "%lld hits, %lld misses, %lld evictions (%lld written)\n",
+             store_stats.n_resident, n_chunks, store_stats.resident >> 20, store_budget >> 20,
+             store_stats.hits, store_stats.misses, store_stats.evictions, store_stats.writes);
+    }
+    else if(strcmp(command, "governor") == 0) {
+      double milliseconds;
+      if(sscanf(buff, "%*s %lf", &milliseconds) == 1)
+        setFrameBudget(milliseconds / 1000.0);
+      if(frame_budget > 0.0)
+        printf("Frame budget: %.1f ms, quality: %s\n", frame_budget * 1000.0, quality_name);
+      else
+        printf("Frame budget: off, quality: %s\n", quality_name);
+    }
+    else if(strcmp(command, "fill") == 0 || strcmp(command, "erase") == 0) {
+      int c[6], changed;
+      double start = benchNow();
+      if(sscanf(buff, "%*s %d %d %d %d %d %d", &c[0], &c[1], &c[2], &c[3], &c[4], &c[5]) == 6) {
+        if(command[0] == 'f')
+          changed = fillBox(c[0], c[1], c[2], c[3], c[4], c[5], brush.colour->index);
+        else
+          changed = eraseBox(c[0], c[1], c[2], c[3], c[4], c[5]);
+        if(changed >= 0)
+          printf("%d cells changed in %.1f ms.\n", changed, (benchNow() - start) * 1000.0);
+      }
+      else
+        fprintf(stderr, "Usage: %s x0 y0 z0 x1 y1 z1\n", command);
+    }
+    else if(strcmp(command, "floodfill") == 0) {
+      int *c = brush.picked ? brush.picked_cell : brush.cell;
+      double start = benchNow();
+      int changed = floodFill(c[0], c[1], c[2], brush.colour->index);
+      if(changed >= 0)
+        printf("%d cells changed in %.1f ms.\n", changed, (benchNow() - start) * 1000.0);
+    }
+    else if(strcmp(command, "merge") == 0 || strcmp(command, "subtract") == 0 ||
+            strcmp(command, "intersect") == 0) {
+      char arg1[256];
+      int d[3] = { 0, 0, 0 }, op, changed;
+      double start = benchNow();
+      for(op = 0; strcmp(command, csg_names[op]) != 0; ++op);
+      if(sscanf(buff, "%*s %255s %d %d %d", arg1, &d[0], &d[1], &d[2]) >= 1) {
+        if((changed = combineFile(arg1, d[0], d[1], d[2], op)) >= 0)
+          printf("%d cells changed in %.1f ms.\n", changed, (benchNow() - start) * 1000.0);
+      }
+      else
+        fprintf(stderr, "Usage: %s <file.vox> [dx dy dz]\n", command);
+    }
+    else if(strcmp(command, "diff") == 0) {
+      char arg1[256], arg2[256], arg3[256];
+      int edits;
+      double start = benchNow();
+      if(sscanf(buff, "%*s %255s %255s %255s", arg1, arg2, arg3) == 3) {
+        if((edits = diffFiles(arg1, arg2, arg3)) >= 0)
+          printf("%d edits written in %.1f ms.\n", edits, (benchNow() - start) * 1000.0);
+      }
+      else
+        fprintf(stderr, "Usage: diff <from.vox> <to.vox> <patch.vxp>\n");
+    }
+    else if(strcmp(command, "patch") == 0) {
+      char arg1[256];
+      int changed;
+      double start = benchNow();
+      if(sscanf(buff, "%*s %255s", arg1) == 1) {
+        if((changed = patchFile(arg1)) >= 0)
+          printf("%d cells changed in %.1f ms.\n", changed, (benchNow() - start) * 1000.0);
+      }
+      else
+        fprintf(stderr, "Usage: patch <patch.vxp>\n");
+    }
+    else if(strcmp(command, "import") == 0) {
+      char arg1[256];
+      int size = grid_width;
+      if(sscanf(buff, "%*s %255s %d", arg1, &size) >= 1)
+        importModel(arg1, size);
+      else
+        fprintf(stderr, "Usage: import <file.obj|file.pgm> [size]\n");
+    }
+    else if(strcmp(command, "select") == 0) {
+      int c[6];
+      if(sscanf(buff, "%*s %d %d %d %d %d %d", &c[0], &c[1], &c[2], &c[3], &c[4], &c[5]) == 6)
+        selectBox(c[0], c[1], c[2], c[3], c[4], c[5]);
+      else
+        selectNone();
+    }
+    else if(strcmp(command, "copy") == 0) {
+      int copied = copySelection();
+      if(copied < 0)
+        fprintf(stderr, "Nothing selected.\n");
+      else
+        printf("%d voxels copied.\n", copied);
+    }
+    else if(strcmp(command, "paste") == 0) {
+      int c[3] = { brush.cell[0], brush.cell[1], brush.cell[2] };
+      sscanf(buff, "%*s %d %d %d", &c[0], &c[1], &c[2]);
+      if(pasteClipboard(c[0], c[1], c[2]) < 0)
+        fprintf(stderr, "The clipboard is empty.\n");
+    }
+    else if(strcmp(command, "rotate") == 0 || strcmp(command, "mirror") == 0) {
+      char arg[64] = "z";
+      int degrees = 0, axis;
+      double start = benchNow();
+      int n = command[0] == 'r' ? sscanf(buff, "%*s %d %63s", &degrees, arg)
+                                : sscanf(buff, "%*s %63s", arg);
+      axis = arg[0] >= 'x' && arg[0] <= 'z' && arg[1] == '\0' ? arg[0] - 'x' : -1;
+      if(n < 1 || axis < 0 || degrees % 90 != 0)
+        fprintf(stderr, command[0] == 'r' ? "Usage: rotate <90|180|270> [x|y|z]\n"
+                                          : "Usage: mirror <x|y|z>\n");
+      else if((n = command[0] == 'r' ? rotateSelection(axis, degrees / 90)
+                                     : mirrorSelection(axis)) < 0)
+        fprintf(stderr, "Nothing selected.\n");
+      else
+        printf("%d voxels moved in %.1f ms.\n", n, (benchNow() - start) * 1000.0);
+    }
+    else if(strcmp(command, "colour") == 0) {
+      int r, g, b;
+      if(sscanf(buff, "%*s %d %d %d", &r, &g, &b) == 3) {
+        colour_index = paletteColour(r, g, b);
+        brush.colour = &colours[colour_index];
+      }
+      else
+        fprintf(stderr, "Usage: colour r g b\n");
+    }
+    else if(strcmp(command, "quantize") == 0) {
+      double start = benchNow();
+      int changed = quantizeModel();
+      printf("%d voxels quantized in %.1f ms.\n", changed, (benchNow() - start) * 1000.0);
+    }
+    else if(strcmp(command, "recolour") == 0) {
+      char arg1[64], arg2[64];
+      int from, to;
+      if(sscanf(buff, "%*s %63s %63s", arg1, arg2) == 2 &&
+         (from = findColour(arg1)) >= 0 && (to = findColour(arg2)) >= 0)
+        printf("%d voxels recoloured.\n", recolourAll(from, to));
+      else
+        fprintf(stderr, "Usage: recolour <from> <to> (colour names or indices)\n");
     }
 
     buff[0] = '\0';
@@ -162,6 +461,28 @@ void input() {
   character[0] = '\0';
 }
 
+int findColour(const char *name) {
+  char *end;
+  long index = strtol(name, &end, 10);
+  int i;
+
+  if(*end == '\0')
+    return index >= 0 && index < n_palette ? (int)index : -1;
+
+  for(i = 0; i < n_palette; ++i)
+    if(strcasecmp(name, colours[i].name) == 0)
+      return i;
+
+  return -1;
+}
+
+void addEditListener(void (*listener)(enum EEdit edit, struct TVoxel* voxel)) {
+  if(n_edit_listeners == MAX_EDIT_LISTENERS)
+    ERROR("Too many edit listeners");
+
+  edit_listeners[n_edit_listeners++] = listener;
+}
+
 void addObject(char *p, int patt_id, double w, double c[2], void (*draw)(void)) {
   if((patt_id=arLoadPatt(p)) < 0)
     ERROR("Error loading pattern");
@@ -177,160 +498,260 @@ void addObject(char *p, int patt_id, double w, double c[2], void (*draw)(void))
 }
 
 void addVoxel(struct TColour* colour, int x, int y, int z) {
-  int half_voxel_size = voxel_size / 2;
-  int cx = x * voxel_size + half_voxel_size;
-  int cy = y * voxel_size - half_voxel_size;
-  int cz = z * voxel_size + half_voxel_size;
-
-  int populated = isPopulated(cx, cy, cz, changeColour);
-  switch(populated) {
-  case -1:
-    // Populated location! Ignore it and don't paint;
-    // just change its colour in case
+  if(x < SHRT_MIN || x > SHRT_MAX || y < SHRT_MIN || y > SHRT_MAX ||
+     z < SHRT_MIN || z > SHRT_MAX)
     return;
-  case -2:
-    // Empty location! Draw the voxel in it
-    n_voxels++;
-    voxels = (struct TVoxel*)realloc(voxels, sizeof(struct TVoxel)*n_voxels);
-    populated = n_voxels - 1;
-    break;
-  default:
-    // Non dirty position, i.e., old voxel location but now it's free
-    n_voxels_non_dirty--;
-    break;
-  }
 
-  voxels[populated].colour = colour;
-  voxels[populated].x = cx;
-  voxels[populated].y = cy;
-  voxels[populated].z = cz;
-  voxels[populated].dirty = 1;
+  // Populated locations just change their colour
+  setCell(x, y, z, colour->index, 1);
+  n_colours = countColours();
+}
 
+void removeVoxel(struct TVoxel* voxel) {
+  setCell(voxel->x, voxel->y, voxel->z, -1, 1);
   n_colours = countColours();
 }
 
-void removeLastVoxel() {
-  if(voxels && (n_voxels > 0)) {
-    voxels = (struct TVoxel*)realloc(voxels, sizeof(struct TVoxel)*n_voxels-1);
-    n_voxels--;
-    n_colours = countColours();
+void setCell(int x, int y, int z, int colour, int notify) {
+  struct TChunk* chunk = getChunk(CHUNK_COORD(x), CHUNK_COORD(y), CHUNK_COORD(z), colour >= 0);
+  struct TVoxel *voxel, removed;
+  int slot = 0;
+
+  if(chunk && cellOccupied(x, y, z)) {
+    editChunk(chunk);
+    slot = chunk->slot[CELL_INDEX(x, y, z)];
+  }
+
+  if(!slot) {
+    if(colour < 0)
+      return;
+
+    // Empty location! Draw the voxel in it
+    undoSave(x, y, z, UNDO_EMPTY);
+    voxel = chunkStore(chunk, x, y, z, colour);
+    shadowAdd(x, y);
+    model_revision++;
+    if(notify)
+      notifyEdit(EDIT_ADD, voxel);
+    return;
   }
+
+  voxel = &chunk->voxels[slot - 1];
+  if(voxel->colour == colour)
+    return;
+
+  undoSave(x, y, z, voxel->colour);
+  model_revision++;
+  if(colour >= 0) {
+    voxel->colour = colour;
+    if(notify)
+      notifyEdit(EDIT_RECOLOUR, voxel);
+    return;
+  }
+
+  // The record is overwritten by the store, so listeners get a copy
+  removed = *voxel;
+  chunkErase(chunk, x, y, z);
+  shadowRemove(x, y);
+  if(notify)
+    notifyEdit(EDIT_REMOVE, &removed);
 }
 
-void removeVoxel(struct TVoxel* voxel) {
-  voxel->dirty = 0;
+void modelEdited() {
   n_colours = countColours();
-  n_voxels_non_dirty++;
+  model_revision++;
+  notifyEdit(EDIT_MODEL, NULL);
 }
 
-void loadModel(char *filename) {
+int loadModel(char *filename) {
   FILE *f;
-  char line[64];
-  int colour, x, y, z;
+  struct TModelVoxel *model;
+  int n;
 
   if(!(f=fopen(filename, "r"))) {
     fprintf(stderr, "Error opening the requested model.\n");
-    return;
+    return -1;
   }
 
-  cleanCanvas();
-
-  while(fgets(line, 64, f) != NULL) {
-    switch(line[0]){
-    case 'v':
-      sscanf(&line[2], "%d %d %d %d", &colour, &x, &y, &z);
-      addVoxel(&colours[colour], x, y * (-1), z);
-      break;
-    case '#':
-      // Comment or something; ignore it
-    default:
-      break;
-    }
+  if(readVox(f, 0, &model, &n, NULL) < 0) {
+    fprintf(stderr, "Error reading the requested model.\n");
+    fclose(f);
+    return -1;
   }
 
+  setModel(model, n);
+  free(model);
   fclose(f);
+  return 0;
 }
 
 void saveModel(char *filename) {
   FILE *f;
-  int i;
-  int half_voxel_size = voxel_size / 2;
+  struct TModelVoxel *model;
+  int n;
 
   if(!(f=fopen(filename, "w"))) {
     fprintf(stderr, "Error opening the requested model.\n");
     return;
   }
 
-  fprintf(f,
-          "# +-----------------------------------------------------------+\n"
-          "# | Augmented Reality Voxel Model exported from ARVoxelEditor |\n"
-          "# +-----------------------------------------------------------+\n"
-          "# * Number of voxels: %d\n"
-          "# * Number of colours: %d\n\n",
-          n_voxels, n_colours);
+  model = snapshotModel(&n);
+  if(writeVoxFormat(f, voxFormat(filename), model, n, n_colours, NULL) < 0)
+    fprintf(stderr, "Error writing the requested model.\n");
 
-  for(i = 0; i < n_voxels; ++i) {
-    struct TVoxel* v = &voxels[i];
-    if(!v->dirty)
-      continue;
+  free(model);
+  fclose(f);
+}
 
-    fprintf(f, "v %d %d %d %d\n",
-            v->colour->index,
-            (v->x - half_voxel_size) / voxel_size,
-            (v->y + half_voxel_size) / voxel_size * (-1),
-            (v->z - half_voxel_size) / voxel_size);
+int patchFile(const char *filename) {
+  struct TVoxEdit *edits;
+  FILE *f;
+  int n, i, start = model_revision, conflicts = 0;
+
+  if(!(f=fopen(filename, "rb"))) {
+    fprintf(stderr, "Error opening the requested patch.\n");
+    return -1;
   }
 
+  if(readVoxPatch(f, &edits, &n) < 0) {
+    fprintf(stderr, "Error reading the requested patch.\n");
+    fclose(f);
+    return -1;
+  }
   fclose(f);
+
+  undoBegin();
+  for(i = 0; i < n; ++i) {
+    struct TModelVoxel *v = &edits[i].voxel;
+
+    // The cell ends as the patch says, even if it didn't hold what was expected
+    if(cellOccupied(v->x, v->y, v->z) != (edits[i].edit != VOX_EDIT_ADD))
+      ++conflicts;
+    setCell(v->x, v->y, v->z, edits[i].edit == VOX_EDIT_REMOVE ? -1 : v->colour, 0);
+  }
+  undoEnd();
+  free(edits);
+
+  if(conflicts)
+    fprintf(stderr, "%d edits of the patch didn't match the model.\n", conflicts);
+  if(model_revision == start)
+    return 0;
+
+  // Every cell changed bumped the revision once
+  n = model_revision - start;
+  modelEdited();
+  return n;
 }
 
-int isPopulated(int x, int y, int z, void (*cb)(struct TVoxel *voxel)) {
-  int i;
+struct TModelVoxel* snapshotModel(int *n) {
+  struct TModelVoxel *model;
+  int i, j, total;
 
-  for(i = 0; i < n_voxels; ++i) {
-    struct TVoxel *v = &voxels[i];
-    if((v->x == x) && (v->y == y) && (v->z == z)) {
-      if(v->dirty) {
-        if(cb)
-          (*cb)(v);
-        return -1;
-      }
-      else {
-        return i;
-      }
+  model = (struct TModelVoxel*)malloc(sizeof(struct TModelVoxel) * (n_voxels > 0 ? n_voxels : 1));
+  for(i = 0, total = 0; i < n_chunks; ++i) {
+    struct TChunk* chunk = chunks[i];
+    if(chunk->n_voxels == 0)
+      continue;
+
+    loadChunk(chunk);
+    for(j = 0; j < chunk->n_voxels; ++j) {
+      struct TVoxel* v = &chunk->voxels[j];
+      model[total].colour = v->colour;
+      model[total].x = v->x;
+      model[total].y = v->y;
+      model[total].z = v->z;
+      ++total;
     }
   }
 
-  return -2;
+  *n = total;
+  return model;
 }
 
-int countColours() {
-  enum EColour unique[n_voxels];
-  int total = 0;
+void setModel(struct TModelVoxel *model, int n) {
   int i;
 
-  total = 0;
-  for(i = 0; i < n_voxels; ++i) {
-    if(!voxels[i].dirty)
+  cleanCanvas();
+
+  // Cells are known to be unique, so the voxels are stored straight
+  // away instead of looking each of them up with addVoxel()
+  for(i = 0; i < n; ++i) {
+    struct TModelVoxel* m = &model[i];
+    if(m->x < SHRT_MIN || m->x > SHRT_MAX || m->y < SHRT_MIN || m->y > SHRT_MAX ||
+       m->z < SHRT_MIN || m->z > SHRT_MAX)
       continue;
 
-    enum EColour sv = voxels[i].colour->index;
-    int j;
-    for(j = 0; j < total; ++j)
-      if(sv == unique[j])
-        break;
+    storeVoxel(m->x, m->y, m->z, m->colour);
+    shadowAdd(m->x, m->y);
+  }
 
-    if(total == j) {
-      unique[total] = sv;
-      ++total;
-    }
+  n_colours = countColours();
+  model_revision++;
+  notifyEdit(EDIT_MODEL, NULL);
+}
+
+int isPopulated(int x, int y, int z, void (*cb)(struct TVoxel *voxel)) {
+  struct TVoxel* voxel;
+
+  if(x < SHRT_MIN || x > SHRT_MAX || y < SHRT_MIN || y > SHRT_MAX ||
+     z < SHRT_MIN || z > SHRT_MAX)
+    return -2;
+
+  if(!(voxel = findVoxel(x, y, z)))
+    return -2;
+
+  if(cb)
+    (*cb)(voxel);
+  return -1;
+}
+
+int countColours() {
+  return usedColours();
+}
+
+void setResolution(int size) {
+  struct TModelVoxel *model, *resampled;
+  double start;
+  int n, total;
+
+  if(size < 1 || size > PAPER_WIDTH) {
+    fprintf(stderr, "Voxel size must be between 1 and %d.\n", PAPER_WIDTH);
+    return;
   }
+  if(size == voxel_size)
+    return;
 
-  return total;
+  start = benchNow();
+  model = snapshotModel(&n);
+  total = resampleModel(model, n, voxel_size, size, &resampled);
+  free(model);
+  if(total < 0) {
+    fprintf(stderr, "The model doesn't fit the grid with voxels of size %d.\n", size);
+    return;
+  }
+
+  voxel_size = size;
+  grid_height = PAPER_HEIGHT / voxel_size;
+  grid_width = PAPER_WIDTH / voxel_size;
+
+  setModel(resampled, total);
+  free(resampled);
+
+  printf("Resampled %d voxels into %d voxels of size %d in %.1f ms (%d threads).\n",
+         n, total, size, (benchNow() - start) * 1000.0, threadCount());
+}
+
+void voxelCentre(struct TVoxel* voxel, float centre[3]) {
+  float half_voxel_size = voxel_size / 2;
+
+  centre[0] = voxel->x * voxel_size + half_voxel_size;
+  centre[1] = voxel->y * voxel_size - half_voxel_size;
+  centre[2] = voxel->z * voxel_size + half_voxel_size;
 }
 
 void changeColour(struct TVoxel* voxel) {
-  voxel->colour = brush.colour;
+  setCell(voxel->x, voxel->y, voxel->z, brush.colour->index, 1);
+  n_colours = countColours();
 }
 
 void printText(float r, float g, float b, int x, int y, void *font, char *string, int top) {
@@ -466,41 +887,67 @@ void drawBrush() {
   x = m2[0][3]; y = m2[1][3]; z = m2[2][3];
 
   int half_voxel_size = voxel_size / 2;
-  int ix = roundNum(x / voxel_size) * voxel_size + half_voxel_size;
-  int iy = roundNum(y / voxel_size) * voxel_size - half_voxel_size;
-  int iz = roundNum(z / voxel_size) * voxel_size + half_voxel_size;
+  int cx = roundNum(x / voxel_size), cy = roundNum(y / voxel_size), cz = roundNum(z / voxel_size);
+  struct TPick pick;
+  int picked = -1;
+
+  // The ray goes along the marker's Z axis, away from its face
+  if(pick_mode) {
+    float origin[3] = { x, y, z };
+    float direction[3] = { -m2[0][2], -m2[1][2], -m2[2][2] };
+    picked = pickVoxel(origin, direction, &pick);
+    if(picked == 1)
+      drawPick(&pick, brush.colour);
+    if(picked >= 0) {
+      cx = pick.target[0];
+      cy = pick.target[1];
+      cz = pick.target[2];
+      drawLine(1.0f, brush.colour, x, y, z,
+               x - m2[0][2] * pick.distance, y - m2[1][2] * pick.distance, z - m2[2][2] * pick.distance);
+    }
+  }
 
-  // Wired cube following the marker...
-  (*brush.draw)(voxel_size, brush.colour, ix, iy, iz, 1);
-  // ... and the shadow
-  drawSquare(voxel_size, brush.colour, ix-half_voxel_size, iy-half_voxel_size, 0.0f);
+  int ix = cx * voxel_size + half_voxel_size;
+  int iy = cy * voxel_size - half_voxel_size;
+  int iz = cz * voxel_size + half_voxel_size;
 
-  // Projected lines
-  drawLine(1.0f,  &colours[RED],   ix, iy, iz,  0.0f, iy, iz);
-  drawLine(1.0f,  &colours[LIME],  ix, iy, iz,  ix, 0.0f, iz);
-  drawLine(1.0f,  &colours[BLUE],  ix, iy, iz,  ix, iy, 0.0f);
+  // Wired cube following the marker (or the target of its ray), its shadow
+  // and projections. A custom brush shape is drawn by itself and the gizmo
+  // without the cube
+  if(brush.draw == drawCube) {
+    drawGizmo(voxel_size, brush.colour, ix, iy, iz, 1);
+  }
+  else {
+    (*brush.draw)(voxel_size, brush.colour, ix, iy, iz, 1);
+    drawGizmo(voxel_size, brush.colour, ix, iy, iz, 0);
+  }
 
-  // Projected circles
-  drawCircle(5.0f,  &colours[RED],   0.0f, iy, iz,  0, 0, 1);
-  drawCircle(5.0f,  &colours[LIME],  ix, 0.0f, iz,  0, 1, 0);
-  drawCircle(5.0f,  &colours[BLUE],  ix, iy, 0.0f,  1, 0, 0);
+  // Remembered for the commands working from the brush
+  brush.cell[0] = cx;
+  brush.cell[1] = cy;
+  brush.cell[2] = cz;
+  brush.picked = picked == 1;
+  if(brush.picked) {
+    brush.picked_cell[0] = pick.x;
+    brush.picked_cell[1] = pick.y;
+    brush.picked_cell[2] = pick.z;
+  }
 
   if(brush.put_voxel) {
     brush.put_voxel = 0;
-    addVoxel(brush.colour, roundNum(x/voxel_size), roundNum(y/voxel_size), roundNum(z/voxel_size));
+    addVoxel(brush.colour, cx, cy, cz);
   }
   else if(brush.remove_voxel) {
     brush.remove_voxel = 0;
-    isPopulated(ix, iy, iz, removeVoxel);
+    if(!pick_mode)
+      isPopulated(cx, cy, cz, removeVoxel);
+    else if(picked == 1)
+      isPopulated(pick.x, pick.y, pick.z, removeVoxel);
   }
 }
 
 void draw() {
   double gl_para[16];
-  GLfloat mat_ambient[]     = {1.0, 1.0, 1.0, 1.0};
-  GLfloat mat_diffuse[]     = {0.0, 0.0, 0.0, 1.0};
-  GLfloat light_position[]  = {100.0, -200.0, 200.0, 0.0};
-  int i;
 
   argDrawMode3D();
   argDraw3dCamera(0, 0);
@@ -512,6 +959,14 @@ void draw() {
   glMatrixMode(GL_MODELVIEW);
   glLoadMatrixd(gl_para);
 
+  drawScene();
+
+  glDisable(GL_DEPTH_TEST);
+}
+
+void drawScene() {
+  int i;
+
   // Draw the canvas and the axis
   drawReference();
 
@@ -530,51 +985,125 @@ void draw() {
     }
   }
 
-  // Draw stored voxels with illumination; disable it
-  // to draw shadows and other stuff
-  int half_voxel_size = voxel_size / 2;
-  for(i = 0; i < n_voxels; ++i) {
-    struct TVoxel* v = &voxels[i];
-
-    if(v->dirty) {
-      // The voxel
-      glEnable(GL_LIGHTING);
-      glEnable(GL_LIGHT0);
-      glLightfv(GL_LIGHT0, GL_POSITION, light_position);
-
-      glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-      mat_diffuse[0] = v->colour->r / 255.0f;
-      mat_diffuse[1] = v->colour->g / 255.0f;
-      mat_diffuse[2] = v->colour->b / 255.0f;
-      glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-      drawCube(voxel_size, v->colour, v->x, v->y, v->z, 0);
-
-      glDisable(GL_LIGHT0);
-      glDisable(GL_LIGHTING);
-
-      // The "shadow" over the canvas
-      drawSquare(voxel_size, &colours[LIGHT_GRAY], v->x-half_voxel_size, v->y-half_voxel_size, 0.002f);
-    }
-  }
+  // Draw stored voxels with illumination...
+  drawVoxels();
+
+  // ... and their "shadow" over the canvas without it
+  if(quality.shadows)
+    drawShadow(&colours[LIGHT_GRAY], 0.002f);
+
+  drawSelection(&colours[GOLD]);
+}
+
+void benchmark(int frames) {
+  double gl_para[16];
+
+  printf("Benchmarking %d frames of %d voxels...\n", frames, n_voxels);
+
+  argDrawMode3D();
+  argDraw3dCamera(0, 0);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LEQUAL);
+
+  argConvGlpara(mMarker->trans, gl_para);
+  glMatrixMode(GL_MODELVIEW);
+  glLoadMatrixd(gl_para);
+
+  benchRender(frames);
 
   glDisable(GL_DEPTH_TEST);
+
+  benchScans(frames);
+  benchSelection(frames);
+  benchImport(frames);
+}
+
+void benchScans(int iterations) {
+  struct TModelVoxel *model;
+  struct TTopology topology;
+  struct TPick pick;
+  double start;
+  int i, m;
+
+  printf("Voxel store: %d voxels of %d bytes (%d KB) in %d chunks (%d KB), %d in memory (%d KB)\n",
+         n_voxels, (int)sizeof(struct TVoxel), (int)(n_voxels * sizeof(struct TVoxel) / 1024),
+         n_chunks, (int)(n_chunks * sizeof(struct TChunk) / 1024),
+         store_stats.n_resident, (int)(store_stats.resident / 1024));
+
+  // A cell out of the model and one of it: a hash lookup each
+  start = benchNow();
+  for(i = 0; i < iterations; ++i)
+    isPopulated(SHRT_MAX, SHRT_MAX, SHRT_MAX, NULL);
+  benchReport("isPopulated (miss)", benchNow() - start, iterations, 1, "lookups");
+
+  if(n_chunks > 0 && chunks[0]->n_voxels > 0) {
+    struct TVoxel* v;
+    loadChunk(chunks[0]);
+    v = &chunks[0]->voxels[0];
+    start = benchNow();
+    for(i = 0; i < iterations; ++i)
+      isPopulated(v->x, v->y, v->z, NULL);
+    benchReport("isPopulated (hit)", benchNow() - start, iterations, 1, "lookups");
+  }
+
+  // Slanted rays from over the paper down to it, through the model if any
+  start = benchNow();
+  for(i = 0; i < iterations; ++i) {
+    float origin[3] = { i * 37 % PAPER_HEIGHT, -(i * 53 % PAPER_WIDTH), PAPER_WIDTH };
+    float direction[3] = { 0.2f, -0.1f, -1.0f };
+    pickVoxel(origin, direction, &pick);
+  }
+  benchReport("pickVoxel", benchNow() - start, iterations, 1, "rays");
+
+  // Counted from scratch, as if every chunk had changed
+  start = benchNow();
+  for(i = 0; i < iterations; ++i) {
+    analyticsCleanup();
+    countColours();
+  }
+  benchReport("countColours", benchNow() - start, iterations, n_voxels, "voxels");
+
+  start = benchNow();
+  for(i = 0; i < iterations / 10 + 1; ++i)
+    analyseModel(&topology);
+  benchReport("analyseModel", benchNow() - start, iterations / 10 + 1, n_voxels, "voxels");
+
+  start = benchNow();
+  for(i = 0; i < iterations; ++i) {
+    model = snapshotModel(&m);
+    free(model);
+  }
+  benchReport("snapshotModel", benchNow() - start, iterations, n_voxels, "voxels");
 }
 
 void cleanCanvas() {
-  if(voxels) {
-    free(voxels);
-    voxels = NULL;
-    n_voxels = 0;
-    n_voxels_non_dirty = 0;
+  undoClear();
+  if(n_chunks > 0) {
+    int had_voxels = n_voxels > 0;
+    clearStore();
     n_colours = 0;
+    model_revision++;
+    if(had_voxels)
+      notifyEdit(EDIT_CLEAR, NULL);
   }
+  shadowClear();
 }
 
 void cleanup() {
+  captureStop();
+  collabStop();
+  waitModelJobs();
+  editLogClose();
   arVideoCapStop();
   arVideoClose();
+  renderCleanup();
+  shadowCleanup();
+  analyticsCleanup();
+  textCleanup();
   argCleanup();
   free(objects);
-  free(voxels);
+  undoClear();
+  clearStore();
   exit(0);
 }
@@ -0,0 +1,181 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "gizmo.h"
+
+#include <GL/gl.h>
+#include <math.h>
+#include <string.h>
+
+#include "colours.h"
+
+// Triangles of every projected circle (same as drawCircle())
+#define CIRCLE_TRIANGLES 20
+// Diameter of the projected circles
+#define CIRCLE_SIZE 5.0f
+
+// 12 cube edges + 3 projected lines
+#define GIZMO_LINES_VERTICES (12*2 + 3*2)
+// Shadow square + 3 projected circles
+#define GIZMO_TRIANGLES_VERTICES (2*3 + 3*CIRCLE_TRIANGLES*3)
+
+/**
+ * Interleaved vertex as expected by glVertexPointer/glColorPointer
+ */
+struct TGizmoVertex {
+  GLfloat x, y, z;
+  GLubyte r, g, b, a;
+};
+
+static struct {
+  int initialized;
+  float circle[CIRCLE_TRIANGLES+1][2];  // Unit circle (cos, sin) table
+  // Key of the cached layout
+  float size, x, y, z;
+  struct TColour* colour;
+  int cube;
+  // Cached layout
+  struct TGizmoVertex lines[GIZMO_LINES_VERTICES];
+  struct TGizmoVertex triangles[GIZMO_TRIANGLES_VERTICES];
+  int n_lines;
+} gizmo = { 0 };
+
+static void gizmoInit() {
+  int i;
+
+  for(i = 0; i <= CIRCLE_TRIANGLES; ++i) {
+    float angle = i * 2.0f * M_PI / CIRCLE_TRIANGLES;
+    gizmo.circle[i][0] = cos(angle);
+    gizmo.circle[i][1] = sin(angle);
+  }
+
+  gizmo.colour = NULL;
+  gizmo.initialized = 1;
+}
+
+static struct TGizmoVertex* putVertex(struct TGizmoVertex* v, struct TColour* colour,
+                                      float x, float y, float z) {
+  v->x = x; v->y = y; v->z = z;
+  v->r = colour->r; v->g = colour->g; v->b = colour->b; v->a = 255;
+  return v + 1;
+}
+
+// Circle centered at c over the plane defined by the axis u and v
+static struct TGizmoVertex* putCircle(struct TGizmoVertex* v, struct TColour* colour,
+                                      float c[3], int u, int w) {
+  float radius = CIRCLE_SIZE / 2.0f;
+  float p[3];
+  int i;
+
+  for(i = 0; i < CIRCLE_TRIANGLES; ++i) {
+    v = putVertex(v, colour, c[0], c[1], c[2]);
+
+    memcpy(p, c, sizeof(p));
+    p[u] += radius * gizmo.circle[i][0];
+    p[w] += radius * gizmo.circle[i][1];
+    v = putVertex(v, colour, p[0], p[1], p[2]);
+
+    memcpy(p, c, sizeof(p));
+    p[u] += radius * gizmo.circle[i+1][0];
+    p[w] += radius * gizmo.circle[i+1][1];
+    v = putVertex(v, colour, p[0], p[1], p[2]);
+  }
+
+  return v;
+}
+
+static void gizmoLayout(float size, struct TColour* colour, float x, float y, float z, int cube) {
+  static const int edges[12][2] = {
+    {0, 1}, {1, 3}, {3, 2}, {2, 0},   // Bottom
+    {4, 5}, {5, 7}, {7, 6}, {6, 4},   // Top
+    {0, 4}, {1, 5}, {2, 6}, {3, 7}    // Sides
+  };
+  struct TGizmoVertex* v;
+  float half = size / 2.0f;
+  float c[3];
+  int i, k;
+
+  // Wired cube; corner i has the bits (x, y, z) = (i&1, i&2, i&4)
+  v = gizmo.lines;
+  if(cube) {
+    for(i = 0; i < 12; ++i) {
+      for(k = 0; k < 2; ++k) {
+        int corner = edges[i][k];
+        v = putVertex(v, colour,
+                      x + ((corner & 1) ? half : -half),
+                      y + ((corner & 2) ? half : -half),
+                      z + ((corner & 4) ? half : -half));
+      }
+    }
+  }
+
+  // Projected lines
+  v = putVertex(v, &colours[RED],   x, y, z);
+  v = putVertex(v, &colours[RED],   0.0f, y, z);
+  v = putVertex(v, &colours[LIME],  x, y, z);
+  v = putVertex(v, &colours[LIME],  x, 0.0f, z);
+  v = putVertex(v, &colours[BLUE],  x, y, z);
+  v = putVertex(v, &colours[BLUE],  x, y, 0.0f);
+  gizmo.n_lines = v - gizmo.lines;
+
+  // The shadow
+  v = gizmo.triangles;
+  v = putVertex(v, colour, x-half, y-half, 0.0f);
+  v = putVertex(v, colour, x+half, y-half, 0.0f);
+  v = putVertex(v, colour, x+half, y+half, 0.0f);
+  v = putVertex(v, colour, x-half, y-half, 0.0f);
+  v = putVertex(v, colour, x+half, y+half, 0.0f);
+  v = putVertex(v, colour, x-half, y+half, 0.0f);
+
+  // Projected circles over the YZ, XZ and XY planes
+  c[0] = 0.0f; c[1] = y; c[2] = z;
+  v = putCircle(v, &colours[RED], c, 1, 2);
+  c[0] = x; c[1] = 0.0f; c[2] = z;
+  v = putCircle(v, &colours[LIME], c, 0, 2);
+  c[0] = x; c[1] = y; c[2] = 0.0f;
+  v = putCircle(v, &colours[BLUE], c, 0, 1);
+
+  gizmo.size = size;
+  gizmo.colour = colour;
+  gizmo.x = x; gizmo.y = y; gizmo.z = z;
+  gizmo.cube = cube;
+}
+
+void drawGizmo(float size, struct TColour* colour, float x, float y, float z, int cube) {
+  if(!gizmo.initialized)
+    gizmoInit();
+
+  if(gizmo.colour != colour || gizmo.size != size || gizmo.cube != cube ||
+     gizmo.x != x || gizmo.y != y || gizmo.z != z)
+    gizmoLayout(size, colour, x, y, z, cube);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+
+  glLineWidth(1.0f);
+  glVertexPointer(3, GL_FLOAT, sizeof(struct TGizmoVertex), &gizmo.lines[0].x);
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(struct TGizmoVertex), &gizmo.lines[0].r);
+  glDrawArrays(GL_LINES, 0, gizmo.n_lines);
+
+  glVertexPointer(3, GL_FLOAT, sizeof(struct TGizmoVertex), &gizmo.triangles[0].x);
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(struct TGizmoVertex), &gizmo.triangles[0].r);
+  glDrawArrays(GL_TRIANGLES, 0, GIZMO_TRIANGLES_VERTICES);
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
@@ -0,0 +1,116 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "governor.h"
+
+#include <stdio.h>
+
+#include "render.h"
+
+// Weight of the newest frame in the smoothed frame time
+#define GOVERNOR_SMOOTHING 0.1
+// Lower the quality when the smoothed frame time exceeds the budget by this
+// factor, and raise it when it's under this other one. The gap between both
+// keeps it from bouncing between two levels
+#define GOVERNOR_DOWN 1.1
+#define GOVERNOR_UP 0.6
+// Frames to wait after a change before lowering or raising the quality again.
+// Raising is slower: a wrong raise costs visible stutter
+#define GOVERNOR_DOWN_FRAMES 10
+#define GOVERNOR_UP_FRAMES 90
+
+// From the most expensive to the cheapest: each level gives up one more
+// thing, the least noticeable first
+static const struct TQuality levels[] = {
+  //  level, half_detection, lod, shadows, overlay
+  { 0, 0, 0, 1, 1 },
+  { 1, 0, 0, 1, 0 },
+  { 2, 0, 0, 0, 0 },
+  { 3, 1, 0, 0, 0 },
+  { 4, 1, 1, 0, 0 },
+  { 5, 1, 2, 0, 0 }
+};
+
+struct TQuality quality = { 0, 0, 0, 1, 1 };
+double frame_budget = GOVERNOR_DEFAULT_BUDGET;
+const int n_quality_levels = sizeof(levels) / sizeof(levels[0]);
+char quality_name[64] = "full";
+
+static double smoothed = 0.0;
+static int frames_since_change = 0;
+
+// Cheapest level that gives something up with the current render mode: the
+// levels coarsening the voxels are skipped when it draws the full detail
+static int cheapestLevel() {
+  int level = n_quality_levels - 1;
+
+  if(!renderLodSupported())
+    while(level > 0 && levels[level].lod > 0)
+      --level;
+  return level;
+}
+
+void setQualityLevel(int level) {
+  char lod[16] = "";
+  int cheapest = cheapestLevel();
+
+  if(level < 0) level = 0;
+  if(level > cheapest) level = cheapest;
+
+  quality = levels[level];
+  render_lod = quality.lod;
+  frames_since_change = 0;
+
+  if(quality.lod > 0)
+    sprintf(lod, ", LOD %d", quality.lod);
+  if(level == 0)
+    sprintf(quality_name, "full");
+  else
+    sprintf(quality_name, "%d/%d (detection %s%s, shadows %s, controls %s)",
+            level, cheapest, quality.half_detection ? "half" : "full", lod,
+            quality.shadows ? "on" : "off", quality.overlay ? "on" : "off");
+}
+
+void setFrameBudget(double seconds) {
+  frame_budget = seconds > 0.0 ? seconds : 0.0;
+  smoothed = frame_budget;
+  setQualityLevel(0);
+}
+
+void governorFrame(double seconds) {
+  if(frame_budget <= 0.0)
+    return;
+
+  if(smoothed <= 0.0)
+    smoothed = seconds;
+  else
+    smoothed += (seconds - smoothed) * GOVERNOR_SMOOTHING;
+  ++frames_since_change;
+
+  if(smoothed > frame_budget * GOVERNOR_DOWN &&
+     frames_since_change >= GOVERNOR_DOWN_FRAMES &&
+     quality.level < cheapestLevel()) {
+    setQualityLevel(quality.level + 1);
+  }
+  else if(smoothed < frame_budget * GOVERNOR_UP &&
+          frames_since_change >= GOVERNOR_UP_FRAMES &&
+          quality.level > 0) {
+    setQualityLevel(quality.level - 1);
+  }
+}
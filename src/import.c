@@ -0,0 +1,708 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "import.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "bench.h"
+#include "colours.h"
+#include "csg.h"
+#include "functions.h"
+#include "palette.h"
+#include "threads.h"
+#include "vox.h"
+
+// Longest line of an OBJ or MTL file
+#define LINE_LENGTH 1024
+// Longest name of a material
+#define MATERIAL_NAME_LENGTH 64
+// Rounding error tolerated when sizing the grid, in cells
+#define GRID_EPSILON 1e-3f
+
+/**
+ * A triangle mesh as read from an OBJ file
+ */
+struct TMesh {
+  float *vertices;            // x, y, z of every vertex
+  int n_vertices, max_vertices;
+  int *triangles;             // Vertex indices, three per triangle
+  unsigned short *colours;    // Colour of every triangle
+  int n_triangles, max_triangles;
+};
+
+/**
+ * The grid a mesh is voxelized into. It has an empty margin of one cell all
+ * around, so the space out of the mesh is connected. Cell c spans [c, c+1),
+ * except the last one inside the margin, which also holds the far faces
+ */
+struct TVoxelizer {
+  struct TMesh *mesh;
+  float min[3], scale;        // Mesh to cell units: (v - min) * scale + 1
+  int dim[3];                 // Cells of the grid along each axis
+  unsigned long long *surface; // Cells crossed by a triangle
+  unsigned long long *outside; // Cells connected to the margin
+  unsigned short *colours;    // Colour of the surface cells
+  int *counts;                // Voxels of every slab in the output pass
+  struct TModelVoxel *out;
+};
+
+// Reads the Kd colours of the materials of an MTL file next to the OBJ one
+static int readMaterials(const char *obj, const char *mtl, char (**names)[MATERIAL_NAME_LENGTH],
+                         unsigned short **indices, int n) {
+  char path[LINE_LENGTH], line[LINE_LENGTH];
+  const char *slash = strrchr(obj, '/');
+  float r, g, b;
+  FILE *f;
+
+  snprintf(path, sizeof(path), "%.*s%s", slash ? (int)(slash - obj + 1) : 0, obj, mtl);
+  if(!(f=fopen(path, "r"))) {
+    fprintf(stderr, "Error opening the materials %s.\n", path);
+    return n;
+  }
+
+  while(fgets(line, sizeof(line), f)) {
+    if(strncmp(line, "newmtl ", 7) == 0) {
+      *names = realloc(*names, sizeof(**names) * (n + 1));
+      *indices = realloc(*indices, sizeof(**indices) * (n + 1));
+      sscanf(line + 7, "%63s", (*names)[n]);
+      (*indices)[n++] = colours[WHITE].index;
+    }
+    else if(n > 0 && sscanf(line, " Kd %f %f %f", &r, &g, &b) == 3) {
+      (*indices)[n-1] = paletteColour(r * 255.0f + 0.5f, g * 255.0f + 0.5f, b * 255.0f + 0.5f);
+    }
+  }
+
+  fclose(f);
+  return n;
+}
+
+static void addTriangle(struct TMesh* mesh, int a, int b, int c, int colour) {
+  if(mesh->n_triangles == mesh->max_triangles) {
+    mesh->max_triangles = mesh->max_triangles ? mesh->max_triangles * 2 : 1024;
+    mesh->triangles = realloc(mesh->triangles, sizeof(int) * 3 * mesh->max_triangles);
+    mesh->colours = realloc(mesh->colours, sizeof(unsigned short) * mesh->max_triangles);
+  }
+
+  mesh->triangles[mesh->n_triangles*3+0] = a;
+  mesh->triangles[mesh->n_triangles*3+1] = b;
+  mesh->triangles[mesh->n_triangles*3+2] = c;
+  mesh->colours[mesh->n_triangles++] = colour;
+}
+
+// Reads the vertices and faces of an OBJ file. Polygons are split in fans
+static int readObj(const char *filename, int colour, struct TMesh* mesh) {
+  char line[LINE_LENGTH], name[MATERIAL_NAME_LENGTH];
+  char (*names)[MATERIAL_NAME_LENGTH] = NULL;
+  unsigned short *indices = NULL;
+  int n_materials = 0, i;
+  FILE *f;
+
+  if(!(f=fopen(filename, "r")))
+    return -1;
+
+  memset(mesh, 0, sizeof(*mesh));
+  while(fgets(line, sizeof(line), f)) {
+    if(line[0] == 'v' && line[1] == ' ') {
+      if(mesh->n_vertices == mesh->max_vertices) {
+        mesh->max_vertices = mesh->max_vertices ? mesh->max_vertices * 2 : 1024;
+        mesh->vertices = realloc(mesh->vertices, sizeof(float) * 3 * mesh->max_vertices);
+      }
+      float *v = &mesh->vertices[mesh->n_vertices*3];
+      if(sscanf(line + 2, "%f %f %f", &v[0], &v[1], &v[2]) == 3)
+        mesh->n_vertices++;
+    }
+    else if(line[0] == 'f' && line[1] == ' ') {
+      int first = -1, previous = -1, index, offset;
+      char *p = line + 2;
+
+      // Every token is v, v/vt, v//vn or v/vt/vn; negative ones are relative
+      while(sscanf(p, "%d%n", &index, &offset) == 1) {
+        p += offset;
+        while(*p && *p != ' ' && *p != '\t' && *p != '\n')
+          ++p;
+
+        index = index < 0 ? mesh->n_vertices + index : index - 1;
+        if(index < 0 || index >= mesh->n_vertices)
+          continue;
+
+        if(first < 0) {
+          first = index;
+          continue;
+        }
+        if(previous >= 0)
+          addTriangle(mesh, first, previous, index, colour);
+        previous = index;
+      }
+    }
+    else if(sscanf(line, "mtllib %63s", name) == 1) {
+      n_materials = readMaterials(filename, name, &names, &indices, n_materials);
+    }
+    else if(sscanf(line, "usemtl %63s", name) == 1) {
+      for(i = 0; i < n_materials && strcmp(names[i], name) != 0; ++i);
+      if(i < n_materials)
+        colour = indices[i];
+    }
+  }
+
+  free(names);
+  free(indices);
+  fclose(f);
+  return 0;
+}
+
+// Whether the triangle crosses the box of the given half size around the
+// origin, by the separating axis theorem (Akenine-Moller)
+static int triangleBoxOverlap(float v[3][3], float half) {
+  float e[3][3], normal[3], axis[3], p[3], lo, hi, r, d;
+  int i, j, k;
+
+  for(i = 0; i < 3; ++i)
+    for(k = 0; k < 3; ++k)
+      e[i][k] = v[(i + 1) % 3][k] - v[i][k];
+
+  // The box faces
+  for(k = 0; k < 3; ++k) {
+    lo = fminf(v[0][k], fminf(v[1][k], v[2][k]));
+    hi = fmaxf(v[0][k], fmaxf(v[1][k], v[2][k]));
+    if(lo > half || hi < -half)
+      return 0;
+  }
+
+  // The cross products of the edges and the box axes
+  for(i = 0; i < 3; ++i) {
+    for(j = 0; j < 3; ++j) {
+      axis[j] = 0.0f;
+      axis[(j + 1) % 3] = -e[i][(j + 2) % 3];
+      axis[(j + 2) % 3] = e[i][(j + 1) % 3];
+
+      for(k = 0; k < 3; ++k)
+        p[k] = axis[0] * v[k][0] + axis[1] * v[k][1] + axis[2] * v[k][2];
+      r = half * (fabsf(axis[0]) + fabsf(axis[1]) + fabsf(axis[2]));
+      if(fminf(p[0], fminf(p[1], p[2])) > r || fmaxf(p[0], fmaxf(p[1], p[2])) < -r)
+        return 0;
+    }
+  }
+
+  // The plane of the triangle
+  normal[0] = e[0][1] * e[1][2] - e[0][2] * e[1][1];
+  normal[1] = e[0][2] * e[1][0] - e[0][0] * e[1][2];
+  normal[2] = e[0][0] * e[1][1] - e[0][1] * e[1][0];
+  d = normal[0] * v[0][0] + normal[1] * v[0][1] + normal[2] * v[0][2];
+  r = half * (fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]));
+  return fabsf(d) <= r;
+}
+
+static long long cellIndex(struct TVoxelizer* vox, int i, int j, int k) {
+  return ((long long)k * vox->dim[1] + j) * vox->dim[0] + i;
+}
+
+static int testBit(unsigned long long *bits, long long index) {
+  return (bits[index >> 6] >> (index & 63)) & 1;
+}
+
+// Marks the cells crossed by the triangles [begin, end)
+static void surfaceSlice(void *ctx, int slice, int begin, int end) {
+  struct TVoxelizer* vox = (struct TVoxelizer*)ctx;
+  float tri[3][3], v[3][3];
+  int t, a, k, lo[3], hi[3], c[3];
+
+  for(t = begin; t < end; ++t) {
+    for(a = 0; a < 3; ++a) {
+      float *p = &vox->mesh->vertices[vox->mesh->triangles[t*3+a]*3];
+      for(k = 0; k < 3; ++k)
+        tri[a][k] = fminf((p[k] - vox->min[k]) * vox->scale + 1.0f, vox->dim[k] - 1);
+    }
+
+    for(k = 0; k < 3; ++k) {
+      lo[k] = (int)floorf(fminf(tri[0][k], fminf(tri[1][k], tri[2][k])));
+      hi[k] = (int)floorf(fmaxf(tri[0][k], fmaxf(tri[1][k], tri[2][k])));
+      if(lo[k] < 1) lo[k] = 1;
+      if(lo[k] > vox->dim[k] - 2) lo[k] = vox->dim[k] - 2;
+      if(hi[k] < 1) hi[k] = 1;
+      if(hi[k] > vox->dim[k] - 2) hi[k] = vox->dim[k] - 2;
+    }
+
+    for(c[2] = lo[2]; c[2] <= hi[2]; ++c[2])
+      for(c[1] = lo[1]; c[1] <= hi[1]; ++c[1])
+        for(c[0] = lo[0]; c[0] <= hi[0]; ++c[0]) {
+          for(a = 0; a < 3; ++a)
+            for(k = 0; k < 3; ++k)
+              v[a][k] = tri[a][k] - (c[k] + 0.5f);
+          if(!triangleBoxOverlap(v, 0.5f))
+            continue;
+
+          long long index = cellIndex(vox, c[0], c[1], c[2]);
+          __atomic_fetch_or(&vox->surface[index >> 6], 1ULL << (index & 63), __ATOMIC_RELAXED);
+          __atomic_store_n(&vox->colours[index], vox->mesh->colours[t], __ATOMIC_RELAXED);
+        }
+  }
+}
+
+// Marks the cells connected to the margin, scanline by scanline along x
+static void floodOutside(struct TVoxelizer* vox) {
+  struct { int i, j, k; } *stack;
+  int n_stack = 1, max_stack = 1024, n;
+  static const int rows[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+
+  stack = malloc(sizeof(*stack) * max_stack);
+  stack[0].i = stack[0].j = stack[0].k = 0;
+
+  while(n_stack > 0) {
+    int left, right, j, k, i;
+    long long row;
+
+    --n_stack;
+    left = right = stack[n_stack].i;
+    j = stack[n_stack].j;
+    k = stack[n_stack].k;
+    row = cellIndex(vox, 0, j, k);
+    if(testBit(vox->surface, row + left) || testBit(vox->outside, row + left))
+      continue;
+
+    while(left > 0 && !testBit(vox->surface, row + left - 1) && !testBit(vox->outside, row + left - 1))
+      --left;
+    while(right < vox->dim[0] - 1 && !testBit(vox->surface, row + right + 1) &&
+          !testBit(vox->outside, row + right + 1))
+      ++right;
+    for(i = left; i <= right; ++i)
+      vox->outside[(row + i) >> 6] |= 1ULL << ((row + i) & 63);
+
+    for(n = 0; n < 4; ++n) {
+      int nj = j + rows[n][0], nk = k + rows[n][1], in_run = 0;
+      long long next;
+
+      if(nj < 0 || nj >= vox->dim[1] || nk < 0 || nk >= vox->dim[2])
+        continue;
+
+      next = cellIndex(vox, 0, nj, nk);
+      for(i = left; i <= right; ++i) {
+        if(testBit(vox->surface, next + i) || testBit(vox->outside, next + i)) {
+          in_run = 0;
+          continue;
+        }
+        if(in_run)
+          continue;
+
+        in_run = 1;
+        if(n_stack == max_stack) {
+          max_stack *= 2;
+          stack = realloc(stack, sizeof(*stack) * max_stack);
+        }
+        stack[n_stack].i = i;
+        stack[n_stack].j = nj;
+        stack[n_stack].k = nk;
+        ++n_stack;
+      }
+    }
+  }
+
+  free(stack);
+}
+
+// Counts (out = NULL) or writes the voxels of the slabs [begin, end) of the
+// grid along the OBJ z axis. Inner cells take the colour of the last surface
+// cell of their row
+static void outputSlice(void *ctx, int slice, int begin, int end) {
+  struct TVoxelizer* vox = (struct TVoxelizer*)ctx;
+  int i, j, k, n = 0, colour;
+
+  if(vox->out)
+    for(k = 0; k < slice; ++k)
+      n += vox->counts[k];
+
+  for(k = begin + 1; k <= end; ++k)
+    for(j = 1; j < vox->dim[1] - 1; ++j) {
+      long long row = cellIndex(vox, 0, j, k);
+      colour = 0;
+
+      for(i = 1; i < vox->dim[0] - 1; ++i) {
+        if(testBit(vox->surface, row + i))
+          colour = vox->colours[row + i];
+        else if(testBit(vox->outside, row + i))
+          continue;
+
+        if(vox->out) {
+          struct TModelVoxel* v = &vox->out[n];
+          v->colour = colour;
+          v->x = i - 1;
+          v->y = -(k - 1);
+          v->z = j - 1;
+        }
+        ++n;
+      }
+    }
+
+  if(!vox->out)
+    vox->counts[slice] = n;
+}
+
+// Voxelizes a mesh as voxelizeObj() does, printing the timings if 'verbose'
+// ('parsed' is how long reading it took)
+static int voxelizeMesh(struct TMesh* mesh, int size, struct TModelVoxel **out,
+                        int verbose, double parsed) {
+  struct TVoxelizer vox;
+  float max[3], extent = 0.0f;
+  double start, surfaced, filled;
+  long long cells, words;
+  int i, k, n;
+
+  start = benchNow();
+  memset(&vox, 0, sizeof(vox));
+  vox.mesh = mesh;
+  for(k = 0; k < 3; ++k) {
+    vox.min[k] = max[k] = mesh->vertices[k];
+    for(i = 1; i < mesh->n_vertices; ++i) {
+      vox.min[k] = fminf(vox.min[k], mesh->vertices[i*3+k]);
+      max[k] = fmaxf(max[k], mesh->vertices[i*3+k]);
+    }
+    extent = fmaxf(extent, max[k] - vox.min[k]);
+  }
+
+  // The longest side spans 'size' cells and every other one the cells it
+  // reaches into, plus the margin
+  vox.scale = extent > 0.0f ? size / extent : 1.0f;
+  for(k = 0, cells = 1; k < 3; ++k) {
+    vox.dim[k] = (int)ceilf((max[k] - vox.min[k]) * vox.scale - GRID_EPSILON);
+    if(vox.dim[k] < 1) vox.dim[k] = 1;
+    if(vox.dim[k] > size) vox.dim[k] = size;
+    vox.dim[k] += 2;
+    cells *= vox.dim[k];
+  }
+  if(cells > IMPORT_MAX_CELLS) {
+    fprintf(stderr, "The mesh needs %lld cells; %d at most.\n", cells, IMPORT_MAX_CELLS);
+    return -1;
+  }
+
+  words = (cells + 63) / 64;
+  vox.surface = calloc(words, sizeof(unsigned long long));
+  vox.outside = calloc(words, sizeof(unsigned long long));
+  vox.colours = malloc(sizeof(unsigned short) * cells);
+  vox.counts = calloc(threadCount(), sizeof(int));
+
+  parallelFor(mesh->n_triangles, surfaceSlice, &vox);
+  surfaced = benchNow();
+
+  floodOutside(&vox);
+  filled = benchNow();
+
+  // Count the voxels of every slab and then write them in place
+  parallelFor(vox.dim[2] - 2, outputSlice, &vox);
+  for(i = 0, n = 0; i < threadCount(); ++i)
+    n += vox.counts[i];
+  vox.out = malloc(sizeof(struct TModelVoxel) * (n > 0 ? n : 1));
+  parallelFor(vox.dim[2] - 2, outputSlice, &vox);
+
+  if(verbose)
+    printf("Voxelized %d triangles into %dx%dx%d cells: parse %.1f ms, surface %.1f ms, "
+           "fill %.1f ms, output %.1f ms (%d threads).\n",
+           mesh->n_triangles, vox.dim[0] - 2, vox.dim[1] - 2, vox.dim[2] - 2,
+           parsed * 1000.0, (surfaced - start) * 1000.0,
+           (filled - surfaced) * 1000.0, (benchNow() - filled) * 1000.0, threadCount());
+
+  free(vox.surface);
+  free(vox.outside);
+  free(vox.colours);
+  free(vox.counts);
+
+  *out = vox.out;
+  return n;
+}
+
+int voxelizeObj(const char *filename, int size, int colour, struct TModelVoxel **out) {
+  struct TMesh mesh;
+  double start = benchNow();
+  int n = -1;
+
+  if(readObj(filename, colour, &mesh) < 0 || mesh.n_triangles == 0)
+    fprintf(stderr, "Error reading the mesh %s.\n", filename);
+  else
+    n = voxelizeMesh(&mesh, size, out, 1, benchNow() - start);
+
+  free(mesh.vertices);
+  free(mesh.triangles);
+  free(mesh.colours);
+  return n;
+}
+
+// A closed box of 4x2x2 units, as 12 triangles facing out
+static void boxMesh(struct TMesh* mesh) {
+  static const int faces[6][4] = {
+    {0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5}
+  };
+  int i;
+
+  memset(mesh, 0, sizeof(*mesh));
+  mesh->n_vertices = mesh->max_vertices = 8;
+  mesh->vertices = malloc(sizeof(float) * 3 * 8);
+  for(i = 0; i < 8; ++i) {
+    mesh->vertices[i*3+0] = i & 1 ? 4.0f : 0.0f;
+    mesh->vertices[i*3+1] = i & 2 ? 2.0f : 0.0f;
+    mesh->vertices[i*3+2] = i & 4 ? 2.0f : 0.0f;
+  }
+  for(i = 0; i < 6; ++i) {
+    addTriangle(mesh, faces[i][0], faces[i][1], faces[i][2], colours[WHITE].index);
+    addTriangle(mesh, faces[i][0], faces[i][2], faces[i][3], colours[WHITE].index);
+  }
+}
+
+int benchImport(int iterations) {
+  static const int sizes[] = { 8, 20, 64 };
+  struct TModelVoxel *model;
+  struct TMesh mesh;
+  double start;
+  int i, n, failed = 0;
+
+  // A closed box must come out solid, 4x2x2 times the cell size
+  boxMesh(&mesh);
+  for(i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); ++i) {
+    int expected = sizes[i] * (sizes[i] / 2) * (sizes[i] / 2);
+    if((n = voxelizeMesh(&mesh, sizes[i], &model, 0, 0.0)) != expected) {
+      fprintf(stderr, "Import check failed: a box at size %d gave %d voxels instead of %d.\n",
+              sizes[i], n, expected);
+      failed = 1;
+    }
+    if(n >= 0)
+      free(model);
+  }
+
+  start = benchNow();
+  for(i = 0; i < iterations / 10 + 1; ++i)
+    if((n = voxelizeMesh(&mesh, 64, &model, 0, 0.0)) >= 0)
+      free(model);
+  benchReport("voxelizeMesh (box)", benchNow() - start, iterations / 10 + 1, n > 0 ? n : 0, "voxels");
+
+  free(mesh.vertices);
+  free(mesh.triangles);
+  free(mesh.colours);
+  return failed ? -1 : 0;
+}
+
+/**
+ * A heightmap being turned into columns of voxels
+ */
+struct THeightmap {
+  int width, height, maxval;  // Size and white level of the image
+  unsigned short *pixels;
+  float scale;                // Cells per pixel
+  int columns[2];             // Cells of the output along x and y
+  int top;                    // Height of white, in cells
+  unsigned short *layers;     // Colour of every height
+  int *counts;                // Voxels of every slice in the output pass
+  struct TModelVoxel *out;
+};
+
+static int readNumber(FILE *f) {
+  int c, n;
+
+  // Comments run until the end of the line
+  while((c = fgetc(f)) != EOF) {
+    if(c == '#')
+      while((c = fgetc(f)) != EOF && c != '\n');
+    else if(c != ' ' && c != '\t' && c != '\n' && c != '\r')
+      break;
+  }
+  ungetc(c, f);
+
+  return fscanf(f, "%d", &n) == 1 ? n : -1;
+}
+
+static int readPgm(const char *filename, struct THeightmap* map) {
+  char magic[3] = "";
+  long i, n;
+  FILE *f;
+
+  if(!(f=fopen(filename, "rb")))
+    return -1;
+
+  if(fread(magic, 1, 2, f) != 2 || magic[0] != 'P' || (magic[1] != '2' && magic[1] != '5') ||
+     (map->width = readNumber(f)) <= 0 || (map->height = readNumber(f)) <= 0 ||
+     (map->maxval = readNumber(f)) <= 0 || map->maxval > 65535) {
+    fclose(f);
+    return -1;
+  }
+  fgetc(f);
+
+  n = (long)map->width * map->height;
+  if(!(map->pixels = malloc(sizeof(unsigned short) * n))) {
+    fclose(f);
+    return -1;
+  }
+  for(i = 0; i < n; ++i) {
+    int value;
+    if(magic[1] == '2') {
+      value = readNumber(f);
+    }
+    else if(map->maxval < 256) {
+      value = fgetc(f);
+    }
+    else {
+      value = fgetc(f) << 8;
+      value |= fgetc(f);
+    }
+    if(value < 0)
+      break;
+    map->pixels[i] = value > map->maxval ? map->maxval : value;
+  }
+
+  fclose(f);
+  return i == n ? 0 : -1;
+}
+
+static int columnHeight(struct THeightmap* map, int x, int y) {
+  int px = (int)(x / map->scale), py = (int)(y / map->scale);
+
+  if(px >= map->width) px = map->width - 1;
+  if(py >= map->height) py = map->height - 1;
+  return 1 + (int)((long)map->pixels[py * map->width + px] * (map->top - 1) / map->maxval);
+}
+
+// Counts (out = NULL) or writes the voxels of the rows [begin, end)
+static void heightmapSlice(void *ctx, int slice, int begin, int end) {
+  struct THeightmap* map = (struct THeightmap*)ctx;
+  int x, y, z, h, n = 0;
+
+  if(map->out)
+    for(z = 0; z < slice; ++z)
+      n += map->counts[z];
+
+  for(y = begin; y < end; ++y)
+    for(x = 0; x < map->columns[0]; ++x) {
+      h = columnHeight(map, x, y);
+      if(map->out) {
+        for(z = 0; z < h; ++z) {
+          struct TModelVoxel* v = &map->out[n + z];
+          v->colour = map->layers[z];
+          v->x = x;
+          v->y = -y;
+          v->z = z;
+        }
+      }
+      n += h;
+    }
+
+  if(!map->out)
+    map->counts[slice] = n;
+}
+
+int voxelizeHeightmap(const char *filename, int size, int height, struct TModelVoxel **out) {
+  // Water, grass, earth and snow
+  static const float stops[4][3] = { {0, 0, 128}, {34, 139, 34}, {160, 82, 45}, {255, 250, 250} };
+  struct THeightmap map;
+  double start = benchNow();
+  long long cells;
+  int i, n;
+
+  memset(&map, 0, sizeof(map));
+  if(readPgm(filename, &map) < 0) {
+    fprintf(stderr, "Error reading the heightmap %s.\n", filename);
+    free(map.pixels);
+    return -1;
+  }
+
+  map.scale = (float)size / (map.width > map.height ? map.width : map.height);
+  map.columns[0] = (int)ceilf(map.width * map.scale);
+  map.columns[1] = (int)ceilf(map.height * map.scale);
+  map.top = height > 0 ? height : 1;
+
+  // Every column may reach the top
+  cells = (long long)map.columns[0] * map.columns[1] * map.top;
+  if(cells > IMPORT_MAX_CELLS) {
+    fprintf(stderr, "The heightmap needs %lld cells; %d at most.\n", cells, IMPORT_MAX_CELLS);
+    free(map.pixels);
+    return -1;
+  }
+
+  // Colours of the layers between the stops of the gradient
+  map.layers = malloc(sizeof(unsigned short) * map.top);
+  map.counts = calloc(threadCount(), sizeof(int));
+  if(!map.layers || !map.counts) {
+    fprintf(stderr, "Error allocating the heightmap.\n");
+    free(map.pixels);
+    free(map.layers);
+    free(map.counts);
+    return -1;
+  }
+  for(i = 0; i < map.top; ++i) {
+    float t = map.top > 1 ? 3.0f * i / (map.top - 1) : 0.0f;
+    int s = t >= 3.0f ? 2 : (int)t;
+    float f = t - s;
+    map.layers[i] = paletteColour(stops[s][0] + (stops[s+1][0] - stops[s][0]) * f,
+                                  stops[s][1] + (stops[s+1][1] - stops[s][1]) * f,
+                                  stops[s][2] + (stops[s+1][2] - stops[s][2]) * f);
+  }
+
+  parallelFor(map.columns[1], heightmapSlice, &map);
+  for(i = 0, n = 0; i < threadCount(); ++i)
+    n += map.counts[i];
+  if(!(map.out = malloc(sizeof(struct TModelVoxel) * (n > 0 ? n : 1)))) {
+    fprintf(stderr, "Error allocating the heightmap voxels.\n");
+    free(map.pixels);
+    free(map.layers);
+    free(map.counts);
+    return -1;
+  }
+  parallelFor(map.columns[1], heightmapSlice, &map);
+
+  printf("Voxelized a %dx%d heightmap into %dx%dx%d cells in %.1f ms (%d threads).\n",
+         map.width, map.height, map.columns[0], map.columns[1], map.top,
+         (benchNow() - start) * 1000.0, threadCount());
+
+  free(map.pixels);
+  free(map.layers);
+  free(map.counts);
+
+  *out = map.out;
+  return n;
+}
+
+int importModel(const char *filename, int size) {
+  const char *extension = strrchr(filename, '.');
+  struct TModelVoxel *model;
+  double start;
+  int n;
+
+  if(size < 1 || size > IMPORT_MAX_SIZE) {
+    fprintf(stderr, "The size must be between 1 and %d cells.\n", IMPORT_MAX_SIZE);
+    return -1;
+  }
+
+  if(extension && strcasecmp(extension, ".obj") == 0) {
+    n = voxelizeObj(filename, size, brush.colour->index, &model);
+  }
+  else if(extension && strcasecmp(extension, ".pgm") == 0) {
+    n = voxelizeHeightmap(filename, size, size / 4, &model);
+  }
+  else {
+    fprintf(stderr, "Only OBJ meshes and PGM heightmaps can be imported.\n");
+    return -1;
+  }
+  if(n < 0)
+    return -1;
+
+  start = benchNow();
+  combineModel(model, n, 0, 0, 0, CSG_MERGE);
+  free(model);
+  printf("Merged %d voxels in %.1f ms.\n", n, (benchNow() - start) * 1000.0);
+
+  return n;
+}
@@ -0,0 +1,188 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "jobs.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "functions.h"
+#include "vox.h"
+
+/**
+ * The available background jobs
+ */
+enum EJob { JOB_NONE, JOB_LOAD, JOB_SAVE };
+
+static struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  enum EJob type;               // Job started (JOB_NONE if idle)
+  int finished;                 // Whether the worker is done with it
+  int failed;                   // Whether the job failed
+  volatile int permille;        // Progress reported by the worker
+  char filename[1024];
+  struct TModelVoxel *model;    // Snapshot to save or staging model loaded
+  int n_model;
+  int n_colours;
+} job = { .lock = PTHREAD_MUTEX_INITIALIZER, .type = JOB_NONE };
+
+static void* loadWorker(void *arg) {
+  FILE *f;
+  long size;
+  int failed = 0;
+
+  if(!(f=fopen(job.filename, "r"))) {
+    fprintf(stderr, "Error opening the requested model.\n");
+    failed = 1;
+  }
+  else {
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if(readVox(f, size, &job.model, &job.n_model, &job.permille) < 0) {
+      fprintf(stderr, "Error reading the requested model.\n");
+      failed = 1;
+    }
+    fclose(f);
+  }
+
+  pthread_mutex_lock(&job.lock);
+  job.failed = failed;
+  job.finished = 1;
+  pthread_mutex_unlock(&job.lock);
+  return NULL;
+}
+
+static void* saveWorker(void *arg) {
+  FILE *f;
+  int failed = 0;
+
+  if(!(f=fopen(job.filename, "w"))) {
+    fprintf(stderr, "Error opening the requested model.\n");
+    failed = 1;
+  }
+  else {
+    if(writeVoxFormat(f, voxFormat(job.filename), job.model, job.n_model, job.n_colours, &job.permille) < 0) {
+      fprintf(stderr, "Error writing the requested model.\n");
+      failed = 1;
+    }
+    if(fclose(f) != 0)
+      failed = 1;
+  }
+
+  pthread_mutex_lock(&job.lock);
+  job.failed = failed;
+  job.finished = 1;
+  pthread_mutex_unlock(&job.lock);
+  return NULL;
+}
+
+// Checks whether a job is running, before its model is touched
+static int jobBusy() {
+  if(job.type != JOB_NONE) {
+    fprintf(stderr, "Another model is being loaded or saved; wait for it.\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+static int startJob(enum EJob type, char *filename, void* (*worker)(void*)) {
+  job.type = type;
+  job.finished = 0;
+  job.failed = 0;
+  job.permille = 0;
+  strncpy(job.filename, filename, sizeof(job.filename) - 1);
+  job.filename[sizeof(job.filename) - 1] = '\0';
+
+  if(pthread_create(&job.thread, NULL, worker, NULL) != 0) {
+    fprintf(stderr, "Error starting the background job.\n");
+    free(job.model);
+    job.model = NULL;
+    job.type = JOB_NONE;
+    return -1;
+  }
+
+  return 0;
+}
+
+int loadModelAsync(char *filename) {
+  if(jobBusy())
+    return -1;
+
+  job.model = NULL;
+  job.n_model = 0;
+  return startJob(JOB_LOAD, filename, loadWorker);
+}
+
+int saveModelAsync(char *filename) {
+  if(jobBusy())
+    return -1;
+
+  job.model = snapshotModel(&job.n_model);
+  job.n_colours = n_colours;
+  return startJob(JOB_SAVE, filename, saveWorker);
+}
+
+void pollModelJobs() {
+  int finished;
+
+  if(job.type == JOB_NONE)
+    return;
+
+  pthread_mutex_lock(&job.lock);
+  finished = job.finished;
+  pthread_mutex_unlock(&job.lock);
+  if(!finished)
+    return;
+
+  pthread_join(job.thread, NULL);
+
+  // Swap the staging model in, all at once between two frames
+  if(job.type == JOB_LOAD && !job.failed)
+    setModel(job.model, job.n_model);
+
+  free(job.model);
+  job.model = NULL;
+  job.type = JOB_NONE;
+}
+
+int modelJobProgress(const char **name) {
+  switch(job.type) {
+  case JOB_LOAD: *name = "Loading"; break;
+  case JOB_SAVE: *name = "Saving"; break;
+  default: return -1;
+  }
+
+  return job.permille;
+}
+
+void waitModelJobs() {
+  if(job.type == JOB_NONE)
+    return;
+
+  pthread_join(job.thread, NULL);
+
+  free(job.model);
+  job.model = NULL;
+  job.type = JOB_NONE;
+}
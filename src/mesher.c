@@ -0,0 +1,427 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define GL_GLEXT_PROTOTYPES
+
+#include "mesher.h"
+
+#include <GL/glut.h>
+#include <GL/glext.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "colours.h"
+#include "functions.h"
+#include "store.h"
+#include "threads.h"
+
+// Side of the grid a chunk is meshed from: its cells plus a one cell border
+// taken from its neighbours
+#define MESH_GRID (CHUNK_SIZE + 2)
+#define MESH_INDEX(x, y, z) ((x) + MESH_GRID * ((y) + MESH_GRID * (z)))
+// Border cells occupied by a neighbour (their colour doesn't matter)
+#define MESH_NEIGHBOUR 0xFFFF
+// Time of a frame spent copying chunks and uploading meshes, in seconds
+#define MESH_FRAME_BUDGET 0.004
+// Chunks being meshed at once, which bounds the memory of the copies
+#define MESH_MAX_JOBS 256
+
+/**
+ * A vertex of a chunk mesh, packed in 12 bytes
+ */
+struct TMeshVertex {
+  GLshort x, y, z;          // Corner in cells
+  GLbyte nx, ny, nz;        // Face normal
+  GLubyte r, g, b;          // Colour
+};
+
+/**
+ * A chunk copied for a worker, and the mesh it makes out of it
+ */
+struct TMeshJob {
+  int index;                                  // Chunk index in chunks[]...
+  int generation;                             // ... of this store_generation
+  int origin[3];                              // First cell of the chunk
+  unsigned short grid[MESH_GRID * MESH_GRID * MESH_GRID]; // Colour + 1 of every cell; 0 if empty
+  struct TMeshVertex *vertices;               // Quads, four vertices each
+  int n_vertices, max_vertices;
+  struct TMeshJob *next;                      // In the list of finished jobs
+};
+
+/**
+ * The mesh of a chunk on the GL side
+ */
+struct TChunkMesh {
+  GLuint vbo[2];            // Front (drawn) and back (uploaded to) buffers
+  int front;                // Which of them is the front one
+  int n_vertices;           // Vertices in the front buffer
+  unsigned int revision;    // Revision of the chunk last seen
+  int dirty;                // Needs to be meshed again?
+  int queued;               // Waiting in the queue?
+  int meshing;              // A job of it is in flight?
+};
+
+static struct {
+  int generation;             // store_generation the meshes belong to
+  int revision;               // model_revision last scanned for changes
+  struct TChunkMesh *meshes;  // One per chunk
+  int n_meshes, max_meshes;
+  int *queue;                 // Chunks to copy for meshing
+  int n_queue, max_queue;
+  int n_jobs;                 // Jobs in flight or waiting to be uploaded
+  pthread_mutex_t lock;       // Guards 'done'
+  struct TMeshJob *done;      // Jobs finished by the workers
+} meshing = { 0, -1, NULL, 0, 0, NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, NULL };
+
+static void emitQuad(struct TMeshJob* job, int d, int side, int depth,
+                     int a, int b, int w, int h, int colour) {
+  int u = (d + 1) % 3, v = (d + 2) % 3;
+  int corners[4][2] = { {a, b}, {a + w, b}, {a + w, b + h}, {a, b + h} };
+  struct TColour* c = &colours[colour];
+  int i;
+
+  if(job->n_vertices + 4 > job->max_vertices) {
+    job->max_vertices = job->max_vertices ? job->max_vertices * 2 : 1024;
+    job->vertices = (struct TMeshVertex*)realloc(job->vertices, sizeof(struct TMeshVertex) * job->max_vertices);
+  }
+
+  // Counter-clockwise seen from the side the face looks at
+  for(i = 0; i < 4; ++i) {
+    struct TMeshVertex* vertex = &job->vertices[job->n_vertices++];
+    int corner = side ? i : 3 - i;
+    int p[3], n[3] = { 0, 0, 0 };
+
+    p[d] = depth;
+    p[u] = corners[corner][0];
+    p[v] = corners[corner][1];
+    n[d] = side ? 127 : -127;
+
+    // Cell (x, y, z) spans [x, x+1] x [y-1, y] x [z, z+1]
+    vertex->x = job->origin[0] + p[0];
+    vertex->y = job->origin[1] + p[1] - 1;
+    vertex->z = job->origin[2] + p[2];
+    vertex->nx = n[0];
+    vertex->ny = n[1];
+    vertex->nz = n[2];
+    vertex->r = c->r;
+    vertex->g = c->g;
+    vertex->b = c->b;
+  }
+}
+
+// Greedy meshing: for every face direction and slice of the chunk, the
+// visible faces form a 2D mask of colours whose runs are merged into the
+// widest and then tallest rectangles
+static void meshTask(void *arg) {
+  struct TMeshJob* job = (struct TMeshJob*)arg;
+  unsigned short mask[CHUNK_SIZE][CHUNK_SIZE];
+  int d, side, i, a, b, k, w, h;
+
+  for(d = 0; d < 3; ++d) {
+    int u = (d + 1) % 3, v = (d + 2) % 3;
+    int step[3] = { 1, MESH_GRID, MESH_GRID * MESH_GRID };
+
+    for(side = 0; side < 2; ++side) {
+      int offset = side ? step[d] : -step[d];
+
+      for(i = 0; i < CHUNK_SIZE; ++i) {
+        for(b = 0; b < CHUNK_SIZE; ++b)
+          for(a = 0; a < CHUNK_SIZE; ++a) {
+            int p[3], cell;
+            unsigned short colour;
+            p[d] = i + 1;
+            p[u] = a + 1;
+            p[v] = b + 1;
+            cell = MESH_INDEX(p[0], p[1], p[2]);
+            colour = job->grid[cell];
+            mask[b][a] = colour && !job->grid[cell + offset] ? colour : 0;
+          }
+
+        for(b = 0; b < CHUNK_SIZE; ++b)
+          for(a = 0; a < CHUNK_SIZE; a += w) {
+            unsigned short colour = mask[b][a];
+            w = 1;
+            if(!colour)
+              continue;
+
+            while(a + w < CHUNK_SIZE && mask[b][a + w] == colour)
+              ++w;
+            for(h = 1; b + h < CHUNK_SIZE; ++h) {
+              for(k = 0; k < w && mask[b + h][a + k] == colour; ++k);
+              if(k < w)
+                break;
+            }
+
+            emitQuad(job, d, side, i + side, a, b, w, h, colour - 1);
+            for(k = 0; k < h; ++k)
+              memset(&mask[b + k][a], 0, sizeof(unsigned short) * w);
+          }
+      }
+    }
+  }
+
+  pthread_mutex_lock(&meshing.lock);
+  job->next = meshing.done;
+  meshing.done = job;
+  pthread_mutex_unlock(&meshing.lock);
+}
+
+// Copies the voxels of the chunk and the occupancy of the layer of every
+// neighbour touching it
+static struct TMeshJob* copyChunk(struct TChunk* chunk) {
+  static const int directions[6][3] = { {-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1} };
+  struct TMeshJob* job = (struct TMeshJob*)malloc(sizeof(struct TMeshJob));
+  int i, a, b;
+
+  job->index = chunk->index;
+  job->generation = store_generation;
+  job->origin[0] = chunk->cx << CHUNK_BITS;
+  job->origin[1] = chunk->cy << CHUNK_BITS;
+  job->origin[2] = chunk->cz << CHUNK_BITS;
+  job->vertices = NULL;
+  job->n_vertices = job->max_vertices = 0;
+  memset(job->grid, 0, sizeof(job->grid));
+
+  if(chunk->n_voxels > 0) {
+    loadChunk(chunk);
+    for(i = 0; i < chunk->n_voxels; ++i) {
+      struct TVoxel* v = &chunk->voxels[i];
+      job->grid[MESH_INDEX((v->x & (CHUNK_SIZE-1)) + 1, (v->y & (CHUNK_SIZE-1)) + 1,
+                           (v->z & (CHUNK_SIZE-1)) + 1)] = v->colour + 1;
+    }
+  }
+
+  for(i = 0; i < 6; ++i) {
+    const int *dir = directions[i];
+    struct TChunk* other = getChunk(chunk->cx + dir[0], chunk->cy + dir[1], chunk->cz + dir[2], 0);
+    int d = i / 2, u = (d + 1) % 3, v = (d + 2) % 3;
+
+    if(!other || other->n_voxels == 0)
+      continue;
+
+    for(b = 0; b < CHUNK_SIZE; ++b)
+      for(a = 0; a < CHUNK_SIZE; ++a) {
+        int p[3], cell;
+        p[d] = dir[d] > 0 ? 0 : CHUNK_SIZE - 1;
+        p[u] = a;
+        p[v] = b;
+        cell = CELL_INDEX(p[0], p[1], p[2]);
+        if(!((other->occupancy[cell >> 6] >> (cell & 63)) & 1))
+          continue;
+
+        p[d] = dir[d] > 0 ? MESH_GRID - 1 : 0;
+        p[u] = a + 1;
+        p[v] = b + 1;
+        job->grid[MESH_INDEX(p[0], p[1], p[2])] = MESH_NEIGHBOUR;
+      }
+  }
+
+  return job;
+}
+
+static void freeJob(struct TMeshJob* job) {
+  free(job->vertices);
+  free(job);
+}
+
+static void markDirty(int index) {
+  struct TChunkMesh* mesh = &meshing.meshes[index];
+
+  mesh->dirty = 1;
+  if(mesh->queued || mesh->meshing)
+    return;
+
+  if(meshing.n_queue == meshing.max_queue) {
+    meshing.max_queue = meshing.max_queue ? meshing.max_queue * 2 : 256;
+    meshing.queue = (int*)realloc(meshing.queue, sizeof(int) * meshing.max_queue);
+  }
+  meshing.queue[meshing.n_queue++] = index;
+  mesh->queued = 1;
+}
+
+static void releaseMeshes() {
+  int i;
+
+  for(i = 0; i < meshing.n_meshes; ++i)
+    if(meshing.meshes[i].vbo[0])
+      glDeleteBuffers(2, meshing.meshes[i].vbo);
+
+  free(meshing.meshes);
+  free(meshing.queue);
+  meshing.meshes = NULL;
+  meshing.queue = NULL;
+  meshing.n_meshes = meshing.max_meshes = 0;
+  meshing.n_queue = meshing.max_queue = 0;
+  meshing.revision = -1;
+}
+
+// Marks the chunks edited since the last scan, and their neighbours whose
+// border faces may have been uncovered or hidden
+static void scanChunks() {
+  static const int directions[6][3] = { {-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1} };
+  int i, j;
+
+  if(meshing.generation != store_generation) {
+    releaseMeshes();
+    meshing.generation = store_generation;
+  }
+
+  if(meshing.revision == model_revision && meshing.n_meshes == n_chunks)
+    return;
+  meshing.revision = model_revision;
+
+  if(n_chunks > meshing.max_meshes) {
+    meshing.max_meshes = n_chunks * 2;
+    meshing.meshes = (struct TChunkMesh*)realloc(meshing.meshes, sizeof(struct TChunkMesh) * meshing.max_meshes);
+  }
+  for(i = meshing.n_meshes; i < n_chunks; ++i) {
+    memset(&meshing.meshes[i], 0, sizeof(struct TChunkMesh));
+    meshing.meshes[i].revision = chunks[i]->revision - 1;
+  }
+  meshing.n_meshes = n_chunks;
+
+  for(i = 0; i < n_chunks; ++i) {
+    struct TChunk* chunk = chunks[i];
+    if(chunk->revision == meshing.meshes[i].revision)
+      continue;
+
+    meshing.meshes[i].revision = chunk->revision;
+    markDirty(i);
+    for(j = 0; j < 6; ++j) {
+      struct TChunk* other = getChunk(chunk->cx + directions[j][0], chunk->cy + directions[j][1],
+                                      chunk->cz + directions[j][2], 0);
+      if(other)
+        markDirty(other->index);
+    }
+  }
+}
+
+static void uploadMesh(struct TMeshJob* job) {
+  struct TChunkMesh* mesh = &meshing.meshes[job->index];
+  int back = !mesh->front;
+
+  mesh->meshing = 0;
+  if(job->n_vertices > 0) {
+    if(!mesh->vbo[0])
+      glGenBuffers(2, mesh->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo[back]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(struct TMeshVertex) * job->n_vertices,
+                 job->vertices, GL_STATIC_DRAW);
+    mesh->front = back;
+  }
+  mesh->n_vertices = job->n_vertices;
+
+  // Edited again while it was being meshed
+  if(mesh->dirty)
+    markDirty(job->index);
+}
+
+void updateMeshes() {
+  double start = benchNow();
+  struct TMeshJob *done, *job;
+
+  scanChunks();
+
+  // Hand the queued chunks to the workers
+  while(meshing.n_queue > 0 && meshing.n_jobs < MESH_MAX_JOBS &&
+        benchNow() - start < MESH_FRAME_BUDGET) {
+    int index = meshing.queue[--meshing.n_queue];
+    struct TChunkMesh* mesh = &meshing.meshes[index];
+
+    mesh->queued = 0;
+    if(!mesh->dirty)
+      continue;
+
+    mesh->dirty = 0;
+    mesh->meshing = 1;
+    meshing.n_jobs++;
+    spawnTask(meshTask, copyChunk(chunks[index]));
+  }
+
+  // Upload the finished ones; those left over wait for the next frame
+  pthread_mutex_lock(&meshing.lock);
+  done = meshing.done;
+  meshing.done = NULL;
+  pthread_mutex_unlock(&meshing.lock);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  while((job = done)) {
+    if(job->generation == meshing.generation && benchNow() - start >= 2 * MESH_FRAME_BUDGET)
+      break;
+
+    done = job->next;
+    meshing.n_jobs--;
+    if(job->generation == meshing.generation)
+      uploadMesh(job);
+    freeJob(job);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if(done) {
+    pthread_mutex_lock(&meshing.lock);
+    for(job = done; job->next; job = job->next);
+    job->next = meshing.done;
+    meshing.done = done;
+    pthread_mutex_unlock(&meshing.lock);
+  }
+}
+
+void drawMeshes() {
+  int i;
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+
+  for(i = 0; i < meshing.n_meshes; ++i) {
+    struct TChunkMesh* mesh = &meshing.meshes[i];
+    if(mesh->n_vertices == 0)
+      continue;
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo[mesh->front]);
+    glVertexPointer(3, GL_SHORT, sizeof(struct TMeshVertex), (void*)0);
+    glNormalPointer(GL_BYTE, sizeof(struct TMeshVertex), (void*)offsetof(struct TMeshVertex, nx));
+    glColorPointer(3, GL_UNSIGNED_BYTE, sizeof(struct TMeshVertex), (void*)offsetof(struct TMeshVertex, r));
+    glDrawArrays(GL_QUADS, 0, mesh->n_vertices);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+int meshesPending() {
+  return meshing.n_queue + meshing.n_jobs;
+}
+
+void meshCleanup() {
+  struct TMeshJob* job;
+
+  waitTasks();
+  while((job = meshing.done)) {
+    meshing.done = job->next;
+    freeJob(job);
+  }
+  meshing.n_jobs = 0;
+  releaseMeshes();
+}
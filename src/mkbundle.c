@@ -0,0 +1,62 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Compiles the tracking assets of the data directory into the bundle the
+ * editor maps on startup, and compares loading the sources with loading
+ * the bundle:
+ *
+ *   mkbundle [bundle]
+ *
+ * The editor rebuilds a stale bundle by itself; this is for read-only
+ * installs and for measuring.
+ */
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "bundle.h"
+
+int main(int argc, char **argv) {
+  const char *file = argc > 1 ? argv[1] : dataPath(BUNDLE_FILE);
+  char path[4096];
+  struct TBundle bundle;
+  double cold, warm;
+
+  snprintf(path, sizeof(path), "%s", file);
+
+  cold = benchNow();
+  if(bundleBuild(path, &bundle) < 0)
+    return 1;
+  cold = benchNow() - cold;
+  bundleClose(&bundle);
+
+  warm = benchNow();
+  if(bundleOpen(path, &bundle) < 0) {
+    fprintf(stderr, "Error reading back %s\n", path);
+    return 1;
+  }
+  warm = benchNow() - warm;
+
+  printf("%s: %d patterns from %d files, %lu bytes\n", path,
+         bundle.header->n_patterns, bundle.header->n_sources, (unsigned long)bundle.length);
+  printf("[bench] from sources: %.3f ms, from the bundle: %.3f ms\n", cold * 1000.0, warm * 1000.0);
+  bundleClose(&bundle);
+
+  return 0;
+}
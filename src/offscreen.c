@@ -0,0 +1,255 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define GL_GLEXT_PROTOTYPES
+
+#include "offscreen.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GL/glu.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "analytics.h"
+#include "functions.h"
+
+// Vertical field of view of the virtual camera, in degrees
+#define CAMERA_FOV 35.0
+
+static struct {
+  EGLDisplay display;
+  EGLContext context;
+  GLuint framebuffer, colour, depth;
+  int width, height;
+} offscreen = { EGL_NO_DISPLAY, EGL_NO_CONTEXT, 0, 0, 0, 0, 0 };
+
+int offscreenOpen(int width, int height) {
+  static const EGLint config_attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  EGLConfig config = NULL;
+  EGLint n_configs = 0;
+
+  if(getPlatformDisplay)
+    offscreen.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if(offscreen.display == EGL_NO_DISPLAY)
+    offscreen.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if(offscreen.display == EGL_NO_DISPLAY || !eglInitialize(offscreen.display, NULL, NULL)) {
+    fprintf(stderr, "Error opening an EGL display.\n");
+    return -1;
+  }
+
+  // Without surfaces any config will do, even none at all
+  if(!eglBindAPI(EGL_OPENGL_API) ||
+     !eglChooseConfig(offscreen.display, config_attributes, &config, 1, &n_configs)) {
+    fprintf(stderr, "Error choosing an EGL config for OpenGL.\n");
+    offscreenClose();
+    return -1;
+  }
+  offscreen.context = eglCreateContext(offscreen.display, n_configs > 0 ? config : EGL_NO_CONFIG_KHR,
+                                       EGL_NO_CONTEXT, NULL);
+  if(offscreen.context == EGL_NO_CONTEXT ||
+     !eglMakeCurrent(offscreen.display, EGL_NO_SURFACE, EGL_NO_SURFACE, offscreen.context)) {
+    fprintf(stderr, "Error creating a surfaceless EGL context.\n");
+    offscreenClose();
+    return -1;
+  }
+
+  offscreen.width = width;
+  offscreen.height = height;
+  glGenRenderbuffers(1, &offscreen.colour);
+  glBindRenderbuffer(GL_RENDERBUFFER, offscreen.colour);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &offscreen.depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, offscreen.depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glGenFramebuffers(1, &offscreen.framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, offscreen.framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreen.colour);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreen.depth);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    fprintf(stderr, "Error creating a %dx%d framebuffer.\n", width, height);
+    offscreenClose();
+    return -1;
+  }
+
+  glViewport(0, 0, width, height);
+  return 0;
+}
+
+// Bounds of the model in canvas coordinates. Returns 0 if there are no voxels
+static int modelBounds(float min[3], float max[3]) {
+  int lo[3], hi[3];
+
+  if(!voxelBounds(lo, hi))
+    return 0;
+
+  // Cell (x, y, z) spans [x, x+1] x [y-1, y] x [z, z+1] voxels
+  min[0] = lo[0] * voxel_size;       max[0] = (hi[0] + 1) * voxel_size;
+  min[1] = (lo[1] - 1) * voxel_size; max[1] = hi[1] * voxel_size;
+  min[2] = lo[2] * voxel_size;       max[2] = (hi[2] + 1) * voxel_size;
+  return 1;
+}
+
+void offscreenCamera() {
+  // From the front right corner, above the canvas
+  static const float view[3] = { 0.55f, -0.75f, 0.65f };
+  float min[3], max[3], centre[3], radius, distance, length;
+  int i;
+
+  if(!modelBounds(min, max)) {
+    min[0] = 0.0f;          max[0] = PAPER_HEIGHT;
+    min[1] = -PAPER_WIDTH;  max[1] = 0.0f;
+    min[2] = 0.0f;          max[2] = 0.0f;
+  }
+
+  for(i = 0, radius = 0.0f; i < 3; ++i) {
+    centre[i] = (min[i] + max[i]) / 2.0f;
+    radius += (max[i] - min[i]) * (max[i] - min[i]) / 4.0f;
+  }
+  radius = sqrtf(radius);
+  distance = radius / sinf(CAMERA_FOV / 2.0f * M_PI / 180.0f);
+  length = sqrtf(view[0]*view[0] + view[1]*view[1] + view[2]*view[2]);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, offscreen.framebuffer);
+  glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LEQUAL);
+
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  gluPerspective(CAMERA_FOV, (double)offscreen.width / offscreen.height,
+                 distance / 100.0, distance + 2.0 * radius);
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+  gluLookAt(centre[0] + view[0] / length * distance,
+            centre[1] + view[1] / length * distance,
+            centre[2] + view[2] / length * distance,
+            centre[0], centre[1], centre[2], 0.0, 0.0, 1.0);
+}
+
+void offscreenRead(unsigned char *rgb) {
+  int row;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, offscreen.framebuffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, offscreen.width, offscreen.height, GL_RGB, GL_UNSIGNED_BYTE, rgb);
+
+  // GL rows go bottom up
+  for(row = 0; row < offscreen.height / 2; ++row) {
+    unsigned char *a = &rgb[row * offscreen.width * 3];
+    unsigned char *b = &rgb[(offscreen.height - 1 - row) * offscreen.width * 3];
+    int i;
+    for(i = 0; i < offscreen.width * 3; ++i) {
+      unsigned char t = a[i];
+      a[i] = b[i];
+      b[i] = t;
+    }
+  }
+}
+
+void offscreenClose() {
+  if(offscreen.context != EGL_NO_CONTEXT) {
+    if(offscreen.framebuffer) {
+      glDeleteFramebuffers(1, &offscreen.framebuffer);
+      glDeleteRenderbuffers(1, &offscreen.colour);
+      glDeleteRenderbuffers(1, &offscreen.depth);
+    }
+    eglMakeCurrent(offscreen.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(offscreen.display, offscreen.context);
+  }
+  if(offscreen.display != EGL_NO_DISPLAY)
+    eglTerminate(offscreen.display);
+
+  offscreen.display = EGL_NO_DISPLAY;
+  offscreen.context = EGL_NO_CONTEXT;
+  offscreen.framebuffer = offscreen.colour = offscreen.depth = 0;
+}
+
+static void writeChunk(FILE *f, const char *type, const unsigned char *data, unsigned int size) {
+  unsigned char header[8];
+  unsigned long crc;
+
+  header[0] = size >> 24; header[1] = size >> 16; header[2] = size >> 8; header[3] = size;
+  memcpy(&header[4], type, 4);
+  crc = crc32(crc32(0L, Z_NULL, 0), &header[4], 4);
+  crc = crc32(crc, data, size);
+
+  fwrite(header, 1, 8, f);
+  fwrite(data, 1, size, f);
+  header[0] = crc >> 24; header[1] = crc >> 16; header[2] = crc >> 8; header[3] = crc;
+  fwrite(header, 1, 4, f);
+}
+
+int writeImage(const char *filename, const unsigned char *rgb, int width, int height) {
+  static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+  const char *extension = strrchr(filename, '.');
+  unsigned char ihdr[13], *rows, *deflated;
+  uLongf deflated_size;
+  int row, error;
+  FILE *f;
+
+  if(!(f = fopen(filename, "wb")))
+    return -1;
+
+  if(!extension || strcmp(extension, ".png") != 0) {
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    fwrite(rgb, 3, width * height, f);
+    error = ferror(f);
+    return (fclose(f) != 0 || error) ? -1 : 0;
+  }
+
+  // Every row goes after a filter type byte (0, none)
+  rows = (unsigned char*)malloc((width * 3 + 1) * height);
+  for(row = 0; row < height; ++row) {
+    rows[row * (width * 3 + 1)] = 0;
+    memcpy(&rows[row * (width * 3 + 1) + 1], &rgb[row * width * 3], width * 3);
+  }
+  deflated_size = compressBound((width * 3 + 1) * height);
+  deflated = (unsigned char*)malloc(deflated_size);
+  if(compress2(deflated, &deflated_size, rows, (width * 3 + 1) * height, Z_BEST_COMPRESSION) != Z_OK) {
+    free(rows);
+    free(deflated);
+    fclose(f);
+    return -1;
+  }
+
+  ihdr[0] = width >> 24; ihdr[1] = width >> 16; ihdr[2] = width >> 8; ihdr[3] = width;
+  ihdr[4] = height >> 24; ihdr[5] = height >> 16; ihdr[6] = height >> 8; ihdr[7] = height;
+  ihdr[8] = 8;    // Bit depth
+  ihdr[9] = 2;    // RGB
+  ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+  fwrite(signature, 1, 8, f);
+  writeChunk(f, "IHDR", ihdr, 13);
+  writeChunk(f, "IDAT", deflated, deflated_size);
+  writeChunk(f, "IEND", NULL, 0);
+
+  free(rows);
+  free(deflated);
+  error = ferror(f);
+  return (fclose(f) != 0 || error) ? -1 : 0;
+}
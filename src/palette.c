@@ -0,0 +1,117 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "palette.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "colours.h"
+
+// Slots of the RGB hash table (power of two, twice the palette)
+#define TABLE_SIZE (2 * PALETTE_SIZE)
+
+int n_palette = COLOURS_LENGTH;
+
+// RGB to entry + 1 of colours[]; 0 for empty slots
+static unsigned short table[TABLE_SIZE];
+static int table_ready = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int hashRgb(unsigned int rgb) {
+  return (rgb * 2654435761u) >> 16 & (TABLE_SIZE - 1);
+}
+
+// Returns the slot of the given colour, or the empty one it would take
+static unsigned int findSlot(unsigned int rgb) {
+  unsigned int i = hashRgb(rgb);
+
+  while(table[i]) {
+    struct TColour* c = &colours[table[i] - 1];
+    if((unsigned int)(c->r << 16 | c->g << 8 | c->b) == rgb)
+      break;
+    i = (i + 1) & (TABLE_SIZE - 1);
+  }
+
+  return i;
+}
+
+int paletteColour(int r, int g, int b) {
+  unsigned int rgb = (r & 0xFF) << 16 | (g & 0xFF) << 8 | (b & 0xFF);
+  unsigned int slot;
+  int i, index;
+
+  pthread_mutex_lock(&lock);
+
+  // The first fixed colour of every RGB value wins
+  if(!table_ready) {
+    for(i = 0; i < COLOURS_LENGTH; ++i) {
+      unsigned int fixed = colours[i].r << 16 | colours[i].g << 8 | colours[i].b;
+      slot = findSlot(fixed);
+      if(!table[slot])
+        table[slot] = i + 1;
+    }
+    table_ready = 1;
+  }
+
+  slot = findSlot(rgb);
+  if(table[slot]) {
+    index = table[slot] - 1;
+  }
+  else if(n_palette == PALETTE_SIZE) {
+    // Full: the nearest entry
+    int best_distance = -1;
+    for(i = 0, index = 0; i < n_palette; ++i) {
+      int dr = colours[i].r - r, dg = colours[i].g - g, db = colours[i].b - b;
+      int distance = dr*dr + dg*dg + db*db;
+      if(best_distance < 0 || distance < best_distance) {
+        index = i;
+        best_distance = distance;
+      }
+    }
+  }
+  else {
+    // The entry is complete before it's counted, so readers never see it half done
+    index = n_palette;
+    colours[index].r = r;
+    colours[index].g = g;
+    colours[index].b = b;
+    snprintf(colours[index].name, sizeof(colours[index].name), "#%02X%02X%02X", r & 0xFF, g & 0xFF, b & 0xFF);
+    colours[index].index = index;
+    table[slot] = index + 1;
+    __atomic_store_n(&n_palette, index + 1, __ATOMIC_RELEASE);
+  }
+
+  pthread_mutex_unlock(&lock);
+  return index;
+}
+
+int nearestColour(int r, int g, int b) {
+  int i, best = 0, best_distance = -1;
+
+  for(i = 0; i < COLOURS_LENGTH; ++i) {
+    int dr = colours[i].r - r, dg = colours[i].g - g, db = colours[i].b - b;
+    int distance = dr*dr + dg*dg + db*db;
+    if(best_distance < 0 || distance < best_distance) {
+      best = i;
+      best_distance = distance;
+    }
+  }
+
+  return best;
+}
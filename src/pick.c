@@ -0,0 +1,189 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "pick.h"
+
+#include <GL/gl.h>
+#include <math.h>
+#include <limits.h>
+
+#include "colours.h"
+#include "functions.h"
+#include "store.h"
+
+// Offset of the highlighted face over the voxel, in canvas units
+#define FACE_OFFSET 0.2f
+
+// Cell of the grid containing the given point in cell units, i.e., the cell
+// the ray is leaving the point towards when it lies on a boundary
+static int cellOf(double p, double d) {
+  double cell = floor(p);
+  return (int)(d < 0 && cell == p ? cell - 1 : cell);
+}
+
+static int inRange(int cell[3]) {
+  return cell[0] >= SHRT_MIN && cell[0] <= SHRT_MAX &&
+         cell[1] >= SHRT_MIN && cell[1] <= SHRT_MAX &&
+         cell[2] >= SHRT_MIN && cell[2] <= SHRT_MAX;
+}
+
+int pickVoxel(const float origin[3], const float direction[3], struct TPick* pick) {
+  double o[3], d[3], t_max[3], t_delta[3], t_end, t = 0.0, length;
+  int cell[3], step[3], face = -1, a = 0, b;
+
+  length = sqrt(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2]);
+  if(length == 0.0)
+    return -1;
+
+  // Work in cell units, where cell y covers [y-1, y) * voxel_size
+  for(a = 0; a < 3; ++a) {
+    o[a] = origin[a] / voxel_size + (a == 1 ? 1.0 : 0.0);
+    d[a] = direction[a] / length;
+    step[a] = d[a] > 0 ? 1 : -1;
+    t_delta[a] = d[a] != 0 ? fabs(1.0 / d[a]) : INFINITY;
+    cell[a] = cellOf(o[a], d[a]);
+  }
+  t_end = (double)PICK_MAX_DISTANCE / voxel_size;
+
+  while(t <= t_end && inRange(cell)) {
+    struct TChunk* chunk = getChunk(CHUNK_COORD(cell[0]), CHUNK_COORD(cell[1]), CHUNK_COORD(cell[2]), 0);
+
+    if(!chunk || !chunk->n_voxels) {
+      // Empty chunk: jump to where the ray leaves it
+      double t_exit = INFINITY;
+      for(b = 0; b < 3; ++b) {
+        if(d[b] == 0)
+          continue;
+
+        int first = CHUNK_COORD(cell[b]) << CHUNK_BITS;
+        double t_b = ((d[b] > 0 ? first + CHUNK_SIZE : first) - o[b]) / d[b];
+        if(t_b < t_exit) {
+          t_exit = t_b;
+          a = b;
+        }
+      }
+
+      int entered = step[a] > 0 ? (CHUNK_COORD(cell[a]) + 1) << CHUNK_BITS
+                                : (CHUNK_COORD(cell[a]) << CHUNK_BITS) - 1;
+      for(b = 0; b < 3; ++b) {
+        if(b == a)
+          continue;
+
+        // Keep the other axes in the chunk against rounding at its edges
+        int first = CHUNK_COORD(cell[b]) << CHUNK_BITS;
+        cell[b] = cellOf(o[b] + d[b] * t_exit, d[b]);
+        if(cell[b] < first)
+          cell[b] = first;
+        else if(cell[b] >= first + CHUNK_SIZE)
+          cell[b] = first + CHUNK_SIZE - 1;
+      }
+      cell[a] = entered;
+      t = t_exit;
+      face = a;
+
+      for(b = 0; b < 3; ++b)
+        t_max[b] = d[b] != 0 ? ((step[b] > 0 ? cell[b] + 1 : cell[b]) - o[b]) / d[b] : INFINITY;
+      continue;
+    }
+
+    if(face < 0) {
+      for(b = 0; b < 3; ++b)
+        t_max[b] = d[b] != 0 ? ((step[b] > 0 ? cell[b] + 1 : cell[b]) - o[b]) / d[b] : INFINITY;
+    }
+
+    // Walk the cells of the chunk until a voxel or its border is met
+    while(CHUNK_COORD(cell[0]) == chunk->cx && CHUNK_COORD(cell[1]) == chunk->cy &&
+          CHUNK_COORD(cell[2]) == chunk->cz) {
+      int index = CELL_INDEX(cell[0], cell[1], cell[2]);
+
+      if((chunk->occupancy[index >> 6] >> (index & 63)) & 1) {
+        // Hit. Inside a voxel from the start, the face is the one facing back
+        if(face < 0) {
+          face = fabs(d[0]) >= fabs(d[1]) ? (fabs(d[0]) >= fabs(d[2]) ? 0 : 2)
+                                          : (fabs(d[1]) >= fabs(d[2]) ? 1 : 2);
+        }
+
+        pick->x = cell[0];
+        pick->y = cell[1];
+        pick->z = cell[2];
+        for(b = 0; b < 3; ++b)
+          pick->normal[b] = b == face ? -step[b] : 0;
+        for(b = 0; b < 3; ++b)
+          pick->target[b] = cell[b] + pick->normal[b];
+        pick->distance = t * voxel_size;
+        return 1;
+      }
+
+      a = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+      t = t_max[a];
+      t_max[a] += t_delta[a];
+      cell[a] += step[a];
+      face = a;
+
+      if(t > t_end)
+        break;
+    }
+  }
+
+  // No voxel: the cell where the ray meets the canvas, if it does ahead
+  if(d[2] != 0) {
+    t = -o[2] / d[2];
+    if(t >= 0 && t <= t_end) {
+      pick->target[0] = cellOf(o[0] + d[0] * t, d[0]);
+      pick->target[1] = cellOf(o[1] + d[1] * t, d[1]);
+      pick->target[2] = 0;
+      pick->distance = t * voxel_size;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+void drawPick(struct TPick* pick, struct TColour* colour) {
+  float lo[3], hi[3], v[4][3];
+  int axis, u, w, i;
+
+  lo[0] = pick->x * voxel_size;
+  lo[1] = (pick->y - 1) * voxel_size;
+  lo[2] = pick->z * voxel_size;
+  for(i = 0; i < 3; ++i)
+    hi[i] = lo[i] + voxel_size;
+
+  // Wired voxel hit
+  drawCube(voxel_size + 2 * FACE_OFFSET, &colours[WHITE],
+           lo[0] + voxel_size / 2.0f, lo[1] + voxel_size / 2.0f, lo[2] + voxel_size / 2.0f, 1);
+
+  // Face hit, slightly over the voxel
+  for(axis = 0; axis < 3 && !pick->normal[axis]; ++axis);
+  if(axis == 3)
+    return;
+  u = (axis + 1) % 3;
+  w = (axis + 2) % 3;
+  for(i = 0; i < 4; ++i) {
+    v[i][axis] = pick->normal[axis] > 0 ? hi[axis] + FACE_OFFSET : lo[axis] - FACE_OFFSET;
+    v[i][u] = (i == 1 || i == 2) ? hi[u] : lo[u];
+    v[i][w] = (i >= 2) ? hi[w] : lo[w];
+  }
+
+  glColor3ub(colour->r, colour->g, colour->b);
+  glBegin(GL_QUADS);
+  for(i = 0; i < 4; ++i)
+    glVertex3fv(v[i]);
+  glEnd();
+}
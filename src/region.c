@@ -0,0 +1,381 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "region.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "colours.h"
+#include "functions.h"
+#include "palette.h"
+#include "shadow.h"
+#include "store.h"
+#include "undo.h"
+
+static int clampCell(int c) {
+  return c < SHRT_MIN ? SHRT_MIN : (c > SHRT_MAX ? SHRT_MAX : c);
+}
+
+int regionBox(int *x0, int *y0, int *z0, int *x1, int *y1, int *z1) {
+  int t;
+  long long cells;
+
+  if(*x0 > *x1) { t = *x0; *x0 = *x1; *x1 = t; }
+  if(*y0 > *y1) { t = *y0; *y0 = *y1; *y1 = t; }
+  if(*z0 > *z1) { t = *z0; *z0 = *z1; *z1 = t; }
+  *x0 = clampCell(*x0); *y0 = clampCell(*y0); *z0 = clampCell(*z0);
+  *x1 = clampCell(*x1); *y1 = clampCell(*y1); *z1 = clampCell(*z1);
+
+  cells = (long long)(*x1 - *x0 + 1) * (*y1 - *y0 + 1) * (*z1 - *z0 + 1);
+  if(cells > REGION_MAX_CELLS) {
+    fprintf(stderr, "The region has %lld cells; %d at most.\n", cells, REGION_MAX_CELLS);
+    return -1;
+  }
+
+  return (int)cells;
+}
+
+int fillBox(int x0, int y0, int z0, int x1, int y1, int z1, int colour) {
+  int cx, cy, cz, x, y, z, changed = 0;
+
+  if(regionBox(&x0, &y0, &z0, &x1, &y1, &z1) < 0)
+    return -1;
+
+  undoBegin();
+  for(cz = CHUNK_COORD(z0); cz <= CHUNK_COORD(z1); ++cz)
+  for(cy = CHUNK_COORD(y0); cy <= CHUNK_COORD(y1); ++cy)
+  for(cx = CHUNK_COORD(x0); cx <= CHUNK_COORD(x1); ++cx) {
+    struct TChunk* chunk = getChunk(cx, cy, cz, 1);
+    int lx0 = cx << CHUNK_BITS, ly0 = cy << CHUNK_BITS, lz0 = cz << CHUNK_BITS;
+    int lx1 = lx0 + CHUNK_SIZE - 1, ly1 = ly0 + CHUNK_SIZE - 1, lz1 = lz0 + CHUNK_SIZE - 1;
+
+    // An empty chunk inside the box is filled at once
+    if(chunk->n_voxels == 0 && lx0 >= x0 && lx1 <= x1 && ly0 >= y0 &&
+       ly1 <= y1 && lz0 >= z0 && lz1 <= z1) {
+      chunkFill(chunk, colour);
+      for(z = lz0; z <= lz1; ++z)
+        for(y = ly0; y <= ly1; ++y)
+          for(x = lx0; x <= lx1; ++x) {
+            undoSave(x, y, z, UNDO_EMPTY);
+            shadowAdd(x, y);
+          }
+      changed += CHUNK_CELLS;
+      continue;
+    }
+
+    if(lx0 < x0) lx0 = x0;
+    if(ly0 < y0) ly0 = y0;
+    if(lz0 < z0) lz0 = z0;
+    if(lx1 > x1) lx1 = x1;
+    if(ly1 > y1) ly1 = y1;
+    if(lz1 > z1) lz1 = z1;
+
+    editChunk(chunk);
+    for(z = lz0; z <= lz1; ++z)
+      for(y = ly0; y <= ly1; ++y)
+        for(x = lx0; x <= lx1; ++x) {
+          int slot = chunk->slot[CELL_INDEX(x, y, z)];
+          if(!slot) {
+            undoSave(x, y, z, UNDO_EMPTY);
+            chunkStore(chunk, x, y, z, colour);
+            shadowAdd(x, y);
+          }
+          else if(chunk->voxels[slot - 1].colour != colour) {
+            undoSave(x, y, z, chunk->voxels[slot - 1].colour);
+            chunk->voxels[slot - 1].colour = colour;
+          }
+          else {
+            continue;
+          }
+          ++changed;
+        }
+  }
+  undoEnd();
+
+  if(changed)
+    modelEdited();
+  return changed;
+}
+
+int eraseBox(int x0, int y0, int z0, int x1, int y1, int z1) {
+  int cx, cy, cz, i, changed = 0;
+
+  if(regionBox(&x0, &y0, &z0, &x1, &y1, &z1) < 0)
+    return -1;
+
+  undoBegin();
+  for(cz = CHUNK_COORD(z0); cz <= CHUNK_COORD(z1); ++cz)
+  for(cy = CHUNK_COORD(y0); cy <= CHUNK_COORD(y1); ++cy)
+  for(cx = CHUNK_COORD(x0); cx <= CHUNK_COORD(x1); ++cx) {
+    struct TChunk* chunk = getChunk(cx, cy, cz, 0);
+    int lx0 = cx << CHUNK_BITS, ly0 = cy << CHUNK_BITS, lz0 = cz << CHUNK_BITS;
+    int inside;
+
+    if(!chunk || chunk->n_voxels == 0)
+      continue;
+
+    inside = lx0 >= x0 && lx0 + CHUNK_SIZE - 1 <= x1 && ly0 >= y0 &&
+             ly0 + CHUNK_SIZE - 1 <= y1 && lz0 >= z0 && lz0 + CHUNK_SIZE - 1 <= z1;
+
+    // Backwards, as erasing moves the last voxel of the chunk to the hole
+    loadChunk(chunk);
+    for(i = chunk->n_voxels - 1; i >= 0; --i) {
+      struct TVoxel* v = &chunk->voxels[i];
+      if(!inside && (v->x < x0 || v->x > x1 || v->y < y0 || v->y > y1 || v->z < z0 || v->z > z1))
+        continue;
+
+      undoSave(v->x, v->y, v->z, v->colour);
+      shadowRemove(v->x, v->y);
+      if(!inside)
+        chunkErase(chunk, v->x, v->y, v->z);
+      ++changed;
+    }
+
+    // A chunk inside the box is cleared at once
+    if(inside)
+      chunkClear(chunk);
+  }
+  undoEnd();
+
+  if(changed)
+    modelEdited();
+  return changed;
+}
+
+/**
+ * State of a flood fill: what the cells to fill look like plus a one chunk
+ * cache, as consecutive cells usually share it
+ */
+struct TFlood {
+  int colour;                 // Colour to fill with
+  int match;                  // Colour of the cells to fill; -1 for empty ones
+  int min[3], max[3];         // Cells the fill is limited to
+  struct TChunk* chunk;       // Last chunk looked up...
+  int cx, cy, cz, cached;     // ... and its coordinates
+};
+
+static struct TChunk* floodChunk(struct TFlood* flood, int x, int y, int z, int create) {
+  int cx = CHUNK_COORD(x), cy = CHUNK_COORD(y), cz = CHUNK_COORD(z);
+
+  if(!flood->cached || cx != flood->cx || cy != flood->cy || cz != flood->cz ||
+     (create && !flood->chunk)) {
+    // Only the chunk of the cache is used in between, so it stays resident
+    if((flood->chunk = getChunk(cx, cy, cz, create)))
+      loadChunk(flood->chunk);
+    flood->cx = cx;
+    flood->cy = cy;
+    flood->cz = cz;
+    flood->cached = 1;
+  }
+
+  return flood->chunk;
+}
+
+static int floodMatch(struct TFlood* flood, int x, int y, int z) {
+  struct TChunk* chunk;
+  int slot;
+
+  if(x < flood->min[0] || x > flood->max[0] || y < flood->min[1] || y > flood->max[1] ||
+     z < flood->min[2] || z > flood->max[2])
+    return 0;
+
+  chunk = floodChunk(flood, x, y, z, 0);
+  slot = chunk ? chunk->slot[CELL_INDEX(x, y, z)] : 0;
+  if(flood->match < 0)
+    return !slot;
+
+  return slot && chunk->voxels[slot - 1].colour == flood->match;
+}
+
+static void floodApply(struct TFlood* flood, int x, int y, int z) {
+  struct TChunk* chunk = floodChunk(flood, x, y, z, 1);
+  int slot;
+
+  editChunk(chunk);
+  slot = chunk->slot[CELL_INDEX(x, y, z)];
+  if(slot) {
+    undoSave(x, y, z, flood->match);
+    chunk->voxels[slot - 1].colour = flood->colour;
+  }
+  else {
+    undoSave(x, y, z, UNDO_EMPTY);
+    chunkStore(chunk, x, y, z, flood->colour);
+    shadowAdd(x, y);
+  }
+}
+
+int floodFill(int x, int y, int z, int colour) {
+  struct TFlood flood = { 0 };
+  struct TVoxel *voxel = findVoxel(x, y, z);
+  struct { short x, y, z; } *stack = NULL;
+  int n_stack = 0, max_stack = 0, changed = 0, i, n;
+  // Rows next to a run: y - 1, y + 1, z - 1 and z + 1
+  static const int rows[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+
+  flood.colour = colour;
+  if(voxel) {
+    if(voxel->colour == colour)
+      return 0;
+
+    flood.match = voxel->colour;
+    flood.min[0] = flood.min[1] = flood.min[2] = SHRT_MIN;
+    flood.max[0] = flood.max[1] = flood.max[2] = SHRT_MAX;
+  }
+  else {
+    // The empty space over the canvas, whose cells y cover [y-1, y)
+    flood.match = -1;
+    flood.min[0] = 0;               flood.max[0] = grid_height - 1;
+    flood.min[1] = 1 - grid_width;  flood.max[1] = 0;
+    flood.min[2] = 0;               flood.max[2] = grid_width - 1;
+    if(!floodMatch(&flood, x, y, z)) {
+      fprintf(stderr, "Flood fills of empty space must start over the canvas.\n");
+      return -1;
+    }
+  }
+
+  undoBegin();
+
+  // Scanline: fill whole runs along x and seed the runs of the rows next to them
+  max_stack = 1024;
+  stack = malloc(sizeof(*stack) * max_stack);
+  stack[0].x = x; stack[0].y = y; stack[0].z = z;
+  n_stack = 1;
+
+  while(n_stack > 0 && changed <= REGION_MAX_CELLS) {
+    int left, right, y0, z0;
+
+    --n_stack;
+    left = right = stack[n_stack].x;
+    y0 = stack[n_stack].y;
+    z0 = stack[n_stack].z;
+    if(!floodMatch(&flood, left, y0, z0))
+      continue;
+
+    while(floodMatch(&flood, left - 1, y0, z0))
+      --left;
+    while(floodMatch(&flood, right + 1, y0, z0))
+      ++right;
+    for(i = left; i <= right; ++i)
+      floodApply(&flood, i, y0, z0);
+    changed += right - left + 1;
+
+    for(n = 0; n < 4; ++n) {
+      int ny = y0 + rows[n][0], nz = z0 + rows[n][1], in_run = 0;
+
+      for(i = left; i <= right; ++i) {
+        if(!floodMatch(&flood, i, ny, nz)) {
+          in_run = 0;
+          continue;
+        }
+        if(in_run)
+          continue;
+
+        in_run = 1;
+        if(n_stack == max_stack) {
+          max_stack *= 2;
+          stack = realloc(stack, sizeof(*stack) * max_stack);
+        }
+        stack[n_stack].x = i;
+        stack[n_stack].y = ny;
+        stack[n_stack].z = nz;
+        ++n_stack;
+      }
+    }
+  }
+  free(stack);
+
+  undoEnd();
+
+  if(changed > REGION_MAX_CELLS)
+    fprintf(stderr, "Flood fill stopped after %d cells.\n", changed);
+  if(changed)
+    modelEdited();
+  return changed;
+}
+
+int recolourAll(int from, int to) {
+  int i, j, changed = 0;
+
+  if(from == to)
+    return 0;
+
+  undoBegin();
+  for(i = 0; i < n_chunks; ++i) {
+    struct TChunk* chunk = chunks[i];
+    if(chunk->n_voxels == 0)
+      continue;
+
+    loadChunk(chunk);
+    for(j = 0; j < chunk->n_voxels; ++j) {
+      struct TVoxel* v = &chunk->voxels[j];
+      if(v->colour != from)
+        continue;
+
+      editChunk(chunk);
+      undoSave(v->x, v->y, v->z, from);
+      v->colour = to;
+      ++changed;
+    }
+  }
+  undoEnd();
+
+  if(changed)
+    modelEdited();
+  return changed;
+}
+
+int quantizeModel() {
+  // Nearest fixed colour + 1 of every entry of the palette; 0 until computed
+  unsigned char *nearest = (unsigned char*)calloc(n_palette, sizeof(unsigned char));
+  int i, j, changed = 0;
+
+  if(!nearest) {
+    fprintf(stderr, "Error allocating the quantization table.\n");
+    return 0;
+  }
+
+  undoBegin();
+  for(i = 0; i < n_chunks; ++i) {
+    struct TChunk* chunk = chunks[i];
+    if(chunk->n_voxels == 0)
+      continue;
+
+    loadChunk(chunk);
+    for(j = 0; j < chunk->n_voxels; ++j) {
+      struct TVoxel* v = &chunk->voxels[j];
+      struct TColour* c = &colours[v->colour];
+      if(v->colour < COLOURS_LENGTH)
+        continue;
+
+      editChunk(chunk);
+      undoSave(v->x, v->y, v->z, v->colour);
+      if(!nearest[v->colour])
+        nearest[v->colour] = 1 + nearestColour(c->r, c->g, c->b);
+      v->colour = nearest[v->colour] - 1;
+      ++changed;
+    }
+  }
+  undoEnd();
+  free(nearest);
+
+  if(changed)
+    modelEdited();
+  return changed;
+}
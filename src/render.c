@@ -0,0 +1,531 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include "render.h"
+
+#include <GL/glut.h>
+#include <GL/glext.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "colours.h"
+#include "functions.h"
+#include "mesher.h"
+#include "palette.h"
+#include "store.h"
+#include "structs.h"
+#include "threads.h"
+
+// Size of the palette lookup texture: PALETTE_SIZE entries laid out in rows
+#define PALETTE_TEXTURE_WIDTH 256
+#define PALETTE_TEXTURE_HEIGHT (PALETTE_SIZE / PALETTE_TEXTURE_WIDTH)
+
+enum ERenderMode render_mode = RENDER_IMMEDIATE;
+const char *render_mode_names[RENDER_MODES_LENGTH] = { "immediate", "instanced", "meshed" };
+int render_lod = 0;
+
+// Same light used by the fixed function path
+static GLfloat light_position[] = {100.0, -200.0, 200.0, 0.0};
+
+/**
+ * GL objects of the instanced path. Built the first time it's used
+ */
+static struct {
+  int initialized;          // Whether the objects below were created
+  int supported;            // Whether the GL context can instance at all
+  GLuint program;           // Shader doing the palette lookup and lighting
+  GLuint cube_vbo;          // Unit cube: 36 vertices of (position, normal)
+  GLuint instance_vbo;      // Per voxel (x, y, z, colour index) as shorts
+  GLuint palette_texture;   // colours[] as a 2D RGB texture, 256 entries per row
+  int n_palette;            // Number of palette entries uploaded to it
+  GLint a_position, a_normal, a_instance;
+  GLint u_size, u_cell, u_light, u_palette;
+  int n_instances;          // Number of instances in instance_vbo
+  int revision;             // model_revision the instance buffer was built from
+  int lod;                  // render_lod the instance buffer was built with
+} instancing = { 0 };
+
+static const char *vertex_shader =
+  "#version 120\n"
+  "attribute vec3 a_position;\n"
+  "attribute vec3 a_normal;\n"
+  "attribute vec4 a_instance;\n"
+  "uniform float u_size;\n"
+  "uniform float u_cell;\n"
+  "uniform vec3 u_light;\n"
+  "varying float v_index;\n"
+  "varying float v_diffuse;\n"
+  "void main() {\n"
+  "  vec3 centre = (a_instance.xyz * u_cell + vec3(0.5, 0.5, 0.5) * u_cell -\n"
+  "                vec3(0.0, 1.0, 0.0)) * u_size;\n"
+  "  v_index = a_instance.w;\n"
+  "  v_diffuse = max(dot(a_normal, u_light), 0.0);\n"
+  "  gl_Position = gl_ModelViewProjectionMatrix *\n"
+  "                vec4(centre + a_position * u_size * u_cell, 1.0);\n"
+  "}\n";
+
+// Mimics the fixed function lighting of the immediate path: global
+// ambient (0.2) times the white material ambient plus the diffuse term
+static const char *fragment_shader =
+  "#version 120\n"
+  "uniform sampler2D u_palette;\n"
+  "varying float v_index;\n"
+  "varying float v_diffuse;\n"
+  "void main() {\n"
+  "  vec2 texel = vec2(mod(v_index, 256.0) + 0.5, floor(v_index / 256.0) + 0.5);\n"
+  "  vec3 colour = texture2D(u_palette, texel / vec2(256.0, 128.0)).rgb;\n"
+  "  gl_FragColor = vec4(min(vec3(0.2) + colour * v_diffuse, 1.0), 1.0);\n"
+  "}\n";
+
+static GLuint compileShader(GLenum type, const char *source) {
+  GLuint shader = glCreateShader(type);
+  GLint ok;
+
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if(!ok) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    fprintf(stderr, "Error compiling the instancing shader: %s\n", log);
+    glDeleteShader(shader);
+    return 0;
+  }
+
+  return shader;
+}
+
+// Fills 'out' with the 36 vertices (position, normal) of a unit cube
+// centered on the origin, two triangles per face
+static void buildCube(GLfloat out[36][6]) {
+  static const int faces[6][4][3] = {
+    {{ 1,-1,-1}, { 1, 1,-1}, { 1, 1, 1}, { 1,-1, 1}},   // +X
+    {{-1,-1, 1}, {-1, 1, 1}, {-1, 1,-1}, {-1,-1,-1}},   // -X
+    {{-1, 1,-1}, {-1, 1, 1}, { 1, 1, 1}, { 1, 1,-1}},   // +Y
+    {{-1,-1, 1}, {-1,-1,-1}, { 1,-1,-1}, { 1,-1, 1}},   // -Y
+    {{-1,-1, 1}, { 1,-1, 1}, { 1, 1, 1}, {-1, 1, 1}},   // +Z
+    {{-1, 1,-1}, { 1, 1,-1}, { 1,-1,-1}, {-1,-1,-1}}    // -Z
+  };
+  static const GLfloat normals[6][3] = {
+    {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+  };
+  static const int corners[6] = {0, 1, 2, 0, 2, 3};
+  int f, i, k;
+
+  for(f = 0; f < 6; ++f) {
+    for(i = 0; i < 6; ++i) {
+      for(k = 0; k < 3; ++k) {
+        out[f*6+i][k] = faces[f][corners[i]][k] * 0.5f;
+        out[f*6+i][3+k] = normals[f][k];
+      }
+    }
+  }
+}
+
+static void initInstancing() {
+  const char *version = (const char*)glGetString(GL_VERSION);
+  const GLubyte *extensions = glGetString(GL_EXTENSIONS);
+  GLfloat cube[36][6];
+  GLuint vs, fs;
+  GLint ok;
+
+  instancing.initialized = 1;
+  instancing.supported = 0;
+  instancing.revision = -1;
+
+  // Shaders, VBOs and instanced arrays
+  if(!version || atof(version) < 2.0 || !extensions ||
+     !gluCheckExtension((const GLubyte*)"GL_ARB_instanced_arrays", extensions) ||
+     !gluCheckExtension((const GLubyte*)"GL_ARB_draw_instanced", extensions)) {
+    fprintf(stderr, "Instanced rendering is not supported by this GL context.\n");
+    return;
+  }
+
+  if(!(vs = compileShader(GL_VERTEX_SHADER, vertex_shader)))
+    return;
+  if(!(fs = compileShader(GL_FRAGMENT_SHADER, fragment_shader))) {
+    glDeleteShader(vs);
+    return;
+  }
+
+  instancing.program = glCreateProgram();
+  glAttachShader(instancing.program, vs);
+  glAttachShader(instancing.program, fs);
+  glLinkProgram(instancing.program);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  glGetProgramiv(instancing.program, GL_LINK_STATUS, &ok);
+  if(!ok) {
+    fprintf(stderr, "Error linking the instancing shader.\n");
+    glDeleteProgram(instancing.program);
+    return;
+  }
+
+  instancing.a_position = glGetAttribLocation(instancing.program, "a_position");
+  instancing.a_normal = glGetAttribLocation(instancing.program, "a_normal");
+  instancing.a_instance = glGetAttribLocation(instancing.program, "a_instance");
+  instancing.u_size = glGetUniformLocation(instancing.program, "u_size");
+  instancing.u_cell = glGetUniformLocation(instancing.program, "u_cell");
+  instancing.u_light = glGetUniformLocation(instancing.program, "u_light");
+  instancing.u_palette = glGetUniformLocation(instancing.program, "u_palette");
+
+  // The cube mesh shared by all the instances
+  buildCube(cube);
+  glGenBuffers(1, &instancing.cube_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, instancing.cube_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(cube), cube, GL_STATIC_DRAW);
+  glGenBuffers(1, &instancing.instance_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // The palette is allocated at its full size and filled by updatePalette()
+  glGenTextures(1, &instancing.palette_texture);
+  glBindTexture(GL_TEXTURE_2D, instancing.palette_texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, PALETTE_TEXTURE_WIDTH, PALETTE_TEXTURE_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  instancing.n_palette = 0;
+
+  instancing.supported = 1;
+}
+
+// Same as coarseCells() for a chunk paged out: its cells come from the
+// bitset, which always stays in memory, all coloured as its first voxel
+static int summaryCells(struct TChunk* chunk, int lod, GLshort *out) {
+  static unsigned char seen[CHUNK_CELLS];
+  int side = CHUNK_SIZE >> lod, cell, n = 0;
+
+  memset(seen, 0, side * side * side);
+  for(cell = 0; cell < CHUNK_CELLS; ++cell) {
+    int x, y, z, coarse;
+
+    if(!((chunk->occupancy[cell >> 6] >> (cell & 63)) & 1))
+      continue;
+
+    x = (cell & (CHUNK_SIZE-1)) >> lod;
+    y = ((cell >> CHUNK_BITS) & (CHUNK_SIZE-1)) >> lod;
+    z = (cell >> (2*CHUNK_BITS)) >> lod;
+    coarse = x + (y + z * side) * side;
+    if(seen[coarse])
+      continue;
+    seen[coarse] = 1;
+    out[n*4+0] = chunk->cx * side + x;
+    out[n*4+1] = chunk->cy * side + y;
+    out[n*4+2] = chunk->cz * side + z;
+    out[n*4+3] = chunk->colour;
+    ++n;
+  }
+
+  return n;
+}
+
+// Fills 'out' with (x, y, z, colour) of the cubes drawing the voxels of the
+// chunk at the given level of detail: the coarse cells (coordinates >> lod)
+// holding any voxel, coloured as the first one found.
+// Drawing never pages chunks in (nor reorders the cache), since a model over
+// the memory budget would read the whole swap file every frame: chunks paged
+// out are drawn from their summary instead
+// - Returns: the number of cubes (at most the voxels of the chunk)
+static int coarseCells(struct TChunk* chunk, int lod, GLshort *out) {
+  static unsigned char seen[CHUNK_CELLS];
+  int side = CHUNK_SIZE >> lod, j, n = 0;
+
+  if(!chunk->slot)
+    return summaryCells(chunk, lod, out);
+
+  if(lod == 0) {
+    for(j = 0; j < chunk->n_voxels; ++j, ++n) {
+      struct TVoxel* v = &chunk->voxels[j];
+      out[n*4+0] = v->x;
+      out[n*4+1] = v->y;
+      out[n*4+2] = v->z;
+      out[n*4+3] = v->colour;
+    }
+    return n;
+  }
+
+  memset(seen, 0, side * side * side);
+  for(j = 0; j < chunk->n_voxels; ++j) {
+    struct TVoxel* v = &chunk->voxels[j];
+    int x = v->x >> lod, y = v->y >> lod, z = v->z >> lod;
+    int cell = (x & (side-1)) + ((y & (side-1)) + (z & (side-1)) * side) * side;
+
+    if(seen[cell])
+      continue;
+    seen[cell] = 1;
+    out[n*4+0] = x;
+    out[n*4+1] = y;
+    out[n*4+2] = z;
+    out[n*4+3] = v->colour;
+    ++n;
+  }
+
+  return n;
+}
+
+// Rebuilds the per instance buffer when the model or the level of detail have
+// changed since the last upload. Instances are the (coarse) grid cells; the
+// shader computes their centres
+static void updateInstances() {
+  GLshort *data;
+  int i, n;
+
+  if(instancing.revision == model_revision && instancing.lod == render_lod)
+    return;
+
+  data = (GLshort*)malloc(sizeof(GLshort) * 4 * (n_voxels > 0 ? n_voxels : 1));
+  for(i = 0, n = 0; i < n_chunks; ++i) {
+    if(chunks[i]->n_voxels > 0)
+      n += coarseCells(chunks[i], render_lod, &data[n*4]);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, instancing.instance_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(GLshort) * 4 * n, data, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  free(data);
+
+  instancing.n_instances = n;
+  instancing.revision = model_revision;
+  instancing.lod = render_lod;
+}
+
+static void drawVoxelsImmediate() {
+  static GLshort cells[CHUNK_CELLS * 4];
+  GLfloat mat_ambient[] = {1.0, 1.0, 1.0, 1.0};
+  GLfloat mat_diffuse[] = {0.0, 0.0, 0.0, 1.0};
+  float cell = (float)(1 << render_lod), size = voxel_size * cell;
+  float centre[3];
+  int i, j, n;
+
+  for(i = 0; i < n_chunks; ++i) {
+    if(chunks[i]->n_voxels == 0)
+      continue;
+
+    n = coarseCells(chunks[i], render_lod, cells);
+    for(j = 0; j < n; ++j) {
+      GLshort *v = &cells[j*4];
+
+      glEnable(GL_LIGHTING);
+      glEnable(GL_LIGHT0);
+      glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+
+      struct TColour* colour = &colours[v[3]];
+      glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
+      mat_diffuse[0] = colour->r / 255.0f;
+      mat_diffuse[1] = colour->g / 255.0f;
+      mat_diffuse[2] = colour->b / 255.0f;
+      glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
+      // Same as voxelCentre() for cubes of 'cell' cells
+      centre[0] = (v[0] + 0.5f) * size;
+      centre[1] = (v[1] + 0.5f) * size - voxel_size;
+      centre[2] = (v[2] + 0.5f) * size;
+      drawCube(size, colour, centre[0], centre[1], centre[2], 0);
+
+      glDisable(GL_LIGHT0);
+      glDisable(GL_LIGHTING);
+    }
+  }
+}
+
+// Uploads the rows of the palette texture holding entries added since the
+// last upload. Entries never move, so the rows already uploaded stay valid
+static void updatePalette() {
+  static GLubyte rows[PALETTE_TEXTURE_HEIGHT][PALETTE_TEXTURE_WIDTH][3];
+  int count = n_palette, first, last, i;
+
+  if(count == instancing.n_palette)
+    return;
+
+  first = instancing.n_palette / PALETTE_TEXTURE_WIDTH;
+  last = (count - 1) / PALETTE_TEXTURE_WIDTH;
+  for(i = instancing.n_palette; i < count; ++i) {
+    rows[i / PALETTE_TEXTURE_WIDTH][i % PALETTE_TEXTURE_WIDTH][0] = colours[i].r;
+    rows[i / PALETTE_TEXTURE_WIDTH][i % PALETTE_TEXTURE_WIDTH][1] = colours[i].g;
+    rows[i / PALETTE_TEXTURE_WIDTH][i % PALETTE_TEXTURE_WIDTH][2] = colours[i].b;
+  }
+
+  glBindTexture(GL_TEXTURE_2D, instancing.palette_texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, PALETTE_TEXTURE_WIDTH, last - first + 1,
+                  GL_RGB, GL_UNSIGNED_BYTE, rows[first]);
+  instancing.n_palette = count;
+}
+
+static void drawVoxelsInstanced() {
+  GLfloat light[3];
+  float length;
+
+  updateInstances();
+  if(instancing.n_instances == 0)
+    return;
+
+  // Directional light, normalized once on the CPU
+  length = sqrtf(light_position[0]*light_position[0] +
+                 light_position[1]*light_position[1] +
+                 light_position[2]*light_position[2]);
+  light[0] = light_position[0] / length;
+  light[1] = light_position[1] / length;
+  light[2] = light_position[2] / length;
+
+  glUseProgram(instancing.program);
+  glUniform1f(instancing.u_size, voxel_size);
+  glUniform1f(instancing.u_cell, (GLfloat)(1 << render_lod));
+  glUniform3fv(instancing.u_light, 1, light);
+  glUniform1i(instancing.u_palette, 0);
+
+  glActiveTexture(GL_TEXTURE0);
+  updatePalette();
+  glBindTexture(GL_TEXTURE_2D, instancing.palette_texture);
+
+  glBindBuffer(GL_ARRAY_BUFFER, instancing.cube_vbo);
+  glEnableVertexAttribArray(instancing.a_position);
+  glVertexAttribPointer(instancing.a_position, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)0);
+  glEnableVertexAttribArray(instancing.a_normal);
+  glVertexAttribPointer(instancing.a_normal, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)(3*sizeof(GLfloat)));
+
+  glBindBuffer(GL_ARRAY_BUFFER, instancing.instance_vbo);
+  glEnableVertexAttribArray(instancing.a_instance);
+  glVertexAttribPointer(instancing.a_instance, 4, GL_SHORT, GL_FALSE, 0, (void*)0);
+  glVertexAttribDivisorARB(instancing.a_instance, 1);
+
+  glDrawArraysInstancedARB(GL_TRIANGLES, 0, 36, instancing.n_instances);
+
+  // Leave the state as the fixed function path expects it
+  glVertexAttribDivisorARB(instancing.a_instance, 0);
+  glDisableVertexAttribArray(instancing.a_instance);
+  glDisableVertexAttribArray(instancing.a_normal);
+  glDisableVertexAttribArray(instancing.a_position);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glUseProgram(0);
+}
+
+// The meshes are updated as they're drawn; chunks still being meshed show
+// their previous mesh (if any)
+static void drawVoxelsMeshed() {
+  GLfloat mat_ambient[] = {1.0, 1.0, 1.0, 1.0};
+
+  updateMeshes();
+
+  glEnable(GL_LIGHTING);
+  glEnable(GL_LIGHT0);
+  glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+  glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
+  glColorMaterial(GL_FRONT, GL_DIFFUSE);
+  glEnable(GL_COLOR_MATERIAL);
+  glEnable(GL_RESCALE_NORMAL);
+
+  glPushMatrix();
+  glScalef(voxel_size, voxel_size, voxel_size);
+  drawMeshes();
+  glPopMatrix();
+
+  glDisable(GL_RESCALE_NORMAL);
+  glDisable(GL_COLOR_MATERIAL);
+  glDisable(GL_LIGHT0);
+  glDisable(GL_LIGHTING);
+}
+
+int renderModeSupported(enum ERenderMode mode) {
+  const char *version;
+
+  switch(mode) {
+  case RENDER_IMMEDIATE:
+    return 1;
+  case RENDER_INSTANCED:
+    if(!instancing.initialized)
+      initInstancing();
+    return instancing.supported;
+  case RENDER_MESHED:
+    // Vertex buffer objects
+    version = (const char*)glGetString(GL_VERSION);
+    return version && atof(version) >= 1.5;
+  default:
+    return 0;
+  }
+}
+
+int renderLodSupported() {
+  return render_mode != RENDER_MESHED || !renderModeSupported(RENDER_MESHED);
+}
+
+void drawVoxels() {
+  if(render_mode == RENDER_INSTANCED && renderModeSupported(RENDER_INSTANCED))
+    drawVoxelsInstanced();
+  else if(render_mode == RENDER_MESHED && renderModeSupported(RENDER_MESHED))
+    drawVoxelsMeshed();
+  else
+    drawVoxelsImmediate();
+}
+
+void benchRender(int frames) {
+  enum ERenderMode previous = render_mode;
+  int mode, i;
+
+  for(mode = 0; mode < RENDER_MODES_LENGTH; ++mode) {
+    double start;
+
+    if(!renderModeSupported(mode)) {
+      printf("[bench] %s: not supported\n", render_mode_names[mode]);
+      continue;
+    }
+
+    render_mode = mode;
+    // Warm up: builds the buffers so the upload isn't measured. Meshes are
+    // built from scratch over several frames, which is timed on its own
+    if(mode == RENDER_MESHED) {
+      meshCleanup();
+      start = benchNow();
+      for(i = 0; i == 0 || meshesPending(); ++i)
+        drawVoxels();
+      glFinish();
+      benchReport("meshing", benchNow() - start, 1, n_voxels, "voxels");
+      printf("[bench] meshing took %d frames on %d threads\n", i, threadCount());
+    }
+    drawVoxels();
+    glFinish();
+
+    start = benchNow();
+    for(i = 0; i < frames; ++i)
+      drawVoxels();
+    glFinish();
+
+    benchReport(render_mode_names[mode], benchNow() - start, frames,
+                n_voxels, "voxels");
+  }
+
+  render_mode = previous;
+}
+
+void renderCleanup() {
+  if(instancing.initialized && instancing.supported) {
+    glDeleteProgram(instancing.program);
+    glDeleteBuffers(1, &instancing.cube_vbo);
+    glDeleteBuffers(1, &instancing.instance_vbo);
+    glDeleteTextures(1, &instancing.palette_texture);
+  }
+  instancing.initialized = 0;
+  meshCleanup();
+}
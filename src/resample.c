@@ -0,0 +1,218 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "resample.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "threads.h"
+#include "vox.h"
+
+/**
+ * State shared by the slices of a resampling
+ */
+struct TResampleJob {
+  struct TModelVoxel *in, *out;
+  int old_size, new_size;
+  unsigned long long *keys;   // Coarser: (new cell, colour) per voxel
+  long long *offsets;         // Finer: first output voxel of every input voxel
+  int failed;                 // Some cell was out of the 16-bit grid
+};
+
+// Rounding towards -infinity and +infinity of a / b (b > 0)
+static long long floorDiv(long long a, long long b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static long long ceilDiv(long long a, long long b) {
+  return -floorDiv(-a, b);
+}
+
+// Range of new cells whose centres lie inside an old cell. X and Z cells
+// cover [c, c+1) * size and Y cells [c-1, c) * size (see voxelCentre()),
+// so the doubled centres are (2c+1) * size and (2c-1) * size respectively
+static void splitRange(int c, int old_size, int new_size, int y_axis, long long *first, long long *last) {
+  long long lo = y_axis ? 2LL * (c - 1) * old_size + new_size : 2LL * c * old_size - new_size;
+  long long hi = lo + 2LL * old_size;
+
+  *first = ceilDiv(lo, 2LL * new_size);
+  *last = ceilDiv(hi, 2LL * new_size) - 1;
+}
+
+// New cell holding the centre of an old cell
+static long long mergeCell(int c, int old_size, int new_size, int y_axis) {
+  return y_axis ? floorDiv((2LL * c - 1) * old_size, 2LL * new_size) + 1
+                : floorDiv((2LL * c + 1) * old_size, 2LL * new_size);
+}
+
+static int outOfGrid(long long c) {
+  return c < SHRT_MIN || c > SHRT_MAX;
+}
+
+static void countSplits(void *ctx, int slice, int begin, int end) {
+  struct TResampleJob* job = (struct TResampleJob*)ctx;
+  long long x0, x1, y0, y1, z0, z1;
+  int i;
+
+  for(i = begin; i < end; ++i) {
+    struct TModelVoxel* v = &job->in[i];
+    splitRange(v->x, job->old_size, job->new_size, 0, &x0, &x1);
+    splitRange(v->y, job->old_size, job->new_size, 1, &y0, &y1);
+    splitRange(v->z, job->old_size, job->new_size, 0, &z0, &z1);
+
+    if(outOfGrid(x0) || outOfGrid(x1) || outOfGrid(y0) || outOfGrid(y1) ||
+       outOfGrid(z0) || outOfGrid(z1))
+      job->failed = 1;
+
+    job->offsets[i+1] = (x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1);
+  }
+}
+
+static void writeSplits(void *ctx, int slice, int begin, int end) {
+  struct TResampleJob* job = (struct TResampleJob*)ctx;
+  long long x0, x1, y0, y1, z0, z1, x, y, z;
+  int i;
+
+  for(i = begin; i < end; ++i) {
+    struct TModelVoxel* v = &job->in[i];
+    struct TModelVoxel* o = &job->out[job->offsets[i]];
+
+    splitRange(v->x, job->old_size, job->new_size, 0, &x0, &x1);
+    splitRange(v->y, job->old_size, job->new_size, 1, &y0, &y1);
+    splitRange(v->z, job->old_size, job->new_size, 0, &z0, &z1);
+
+    for(z = z0; z <= z1; ++z) {
+      for(y = y0; y <= y1; ++y) {
+        for(x = x0; x <= x1; ++x, ++o) {
+          o->colour = v->colour;
+          o->x = x;
+          o->y = y;
+          o->z = z;
+        }
+      }
+    }
+  }
+}
+
+// Key sorting by cell and then by colour; cells are biased to unsigned
+static void mergeKeys(void *ctx, int slice, int begin, int end) {
+  struct TResampleJob* job = (struct TResampleJob*)ctx;
+  int i;
+
+  for(i = begin; i < end; ++i) {
+    struct TModelVoxel* v = &job->in[i];
+    long long x = mergeCell(v->x, job->old_size, job->new_size, 0);
+    long long y = mergeCell(v->y, job->old_size, job->new_size, 1);
+    long long z = mergeCell(v->z, job->old_size, job->new_size, 0);
+
+    if(outOfGrid(x) || outOfGrid(y) || outOfGrid(z))
+      job->failed = 1;
+
+    job->keys[i] = ((unsigned long long)((x - SHRT_MIN) & 0xFFFF) << 48) |
+                   ((unsigned long long)((y - SHRT_MIN) & 0xFFFF) << 32) |
+                   ((unsigned long long)((z - SHRT_MIN) & 0xFFFF) << 16) |
+                   (unsigned long long)(v->colour & 0xFFFF);
+  }
+}
+
+static int resampleFiner(struct TResampleJob* job, int n, struct TModelVoxel **out) {
+  long long total;
+  int i;
+
+  job->offsets = (long long*)calloc(n + 1, sizeof(long long));
+  parallelFor(n, countSplits, job);
+
+  for(i = 0; i < n; ++i)
+    job->offsets[i+1] += job->offsets[i];
+  total = job->offsets[n];
+
+  if(job->failed || total > RESAMPLE_MAX_VOXELS) {
+    free(job->offsets);
+    return -1;
+  }
+
+  job->out = (struct TModelVoxel*)malloc(sizeof(struct TModelVoxel) * (total > 0 ? total : 1));
+  parallelFor(n, writeSplits, job);
+
+  free(job->offsets);
+  *out = job->out;
+  return (int)total;
+}
+
+static int resampleCoarser(struct TResampleJob* job, int n, struct TModelVoxel **out) {
+  int i, j, total;
+
+  job->keys = (unsigned long long*)malloc(sizeof(unsigned long long) * (n > 0 ? n : 1));
+  parallelFor(n, mergeKeys, job);
+  if(job->failed) {
+    free(job->keys);
+    return -1;
+  }
+  parallelSortKeys(job->keys, n);
+
+  // Runs of the same cell are sorted by colour: the majority colour is the
+  // longest run of equal keys
+  job->out = (struct TModelVoxel*)malloc(sizeof(struct TModelVoxel) * (n > 0 ? n : 1));
+  for(i = 0, total = 0; i < n; i = j) {
+    unsigned long long cell = job->keys[i] >> 16;
+    unsigned long long best = job->keys[i];
+    int best_count = 0;
+
+    for(j = i; j < n && (job->keys[j] >> 16) == cell; ) {
+      int k = j;
+      while(k < n && job->keys[k] == job->keys[j])
+        ++k;
+      if(k - j > best_count) {
+        best_count = k - j;
+        best = job->keys[j];
+      }
+      j = k;
+    }
+
+    job->out[total].colour = best & 0xFFFF;
+    job->out[total].x = (int)((best >> 48) & 0xFFFF) + SHRT_MIN;
+    job->out[total].y = (int)((best >> 32) & 0xFFFF) + SHRT_MIN;
+    job->out[total].z = (int)((best >> 16) & 0xFFFF) + SHRT_MIN;
+    ++total;
+  }
+
+  free(job->keys);
+  *out = job->out;
+  return total;
+}
+
+int resampleModel(struct TModelVoxel *in, int n, int old_size, int new_size,
+                  struct TModelVoxel **out) {
+  struct TResampleJob job;
+
+  memset(&job, 0, sizeof(job));
+  job.in = in;
+  job.old_size = old_size;
+  job.new_size = new_size;
+
+  if(new_size == old_size) {
+    *out = (struct TModelVoxel*)malloc(sizeof(struct TModelVoxel) * (n > 0 ? n : 1));
+    memcpy(*out, in, sizeof(struct TModelVoxel) * n);
+    return n;
+  }
+
+  return new_size < old_size ? resampleFiner(&job, n, out)
+                             : resampleCoarser(&job, n, out);
+}
@@ -0,0 +1,283 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "selection.h"
+
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "bench.h"
+#include "colours.h"
+#include "functions.h"
+#include "region.h"
+#include "store.h"
+#include "undo.h"
+#include "vox.h"
+
+// Pairs of transforms timed at most by benchSelection()
+#define BENCH_MAX_TRANSFORMS 10
+
+struct TSelection selection = { 0 };
+
+/**
+ * The copied voxels, relative to the lowest corner of the box they were in
+ */
+static struct {
+  struct TModelVoxel *voxels;
+  int n_voxels;
+  int size[3];
+} clipboard = { NULL, 0, { 0, 0, 0 } };
+
+int selectBox(int x0, int y0, int z0, int x1, int y1, int z1) {
+  if(regionBox(&x0, &y0, &z0, &x1, &y1, &z1) < 0)
+    return -1;
+
+  selection.min[0] = x0; selection.min[1] = y0; selection.min[2] = z0;
+  selection.max[0] = x1; selection.max[1] = y1; selection.max[2] = z1;
+  selection.active = 1;
+  return 0;
+}
+
+void selectNone() {
+  selection.active = 0;
+}
+
+// Collects the voxels of the selection chunk by chunk, relative to its lowest
+// corner. Chunks wholly inside the box are taken without testing every voxel
+static int gatherSelection(struct TModelVoxel **out) {
+  struct TModelVoxel *voxels = NULL;
+  int n = 0, max = 0, cx, cy, cz, i;
+  int *lo = selection.min, *hi = selection.max;
+
+  for(cz = CHUNK_COORD(lo[2]); cz <= CHUNK_COORD(hi[2]); ++cz)
+  for(cy = CHUNK_COORD(lo[1]); cy <= CHUNK_COORD(hi[1]); ++cy)
+  for(cx = CHUNK_COORD(lo[0]); cx <= CHUNK_COORD(hi[0]); ++cx) {
+    struct TChunk* chunk = getChunk(cx, cy, cz, 0);
+    int inside;
+
+    if(!chunk || chunk->n_voxels == 0)
+      continue;
+
+    inside = (cx << CHUNK_BITS) >= lo[0] && (cx << CHUNK_BITS) + CHUNK_SIZE - 1 <= hi[0] &&
+             (cy << CHUNK_BITS) >= lo[1] && (cy << CHUNK_BITS) + CHUNK_SIZE - 1 <= hi[1] &&
+             (cz << CHUNK_BITS) >= lo[2] && (cz << CHUNK_BITS) + CHUNK_SIZE - 1 <= hi[2];
+
+    if(n + chunk->n_voxels > max) {
+      while(n + chunk->n_voxels > max)
+        max = max ? max * 2 : 1024;
+      voxels = (struct TModelVoxel*)realloc(voxels, sizeof(struct TModelVoxel) * max);
+    }
+
+    loadChunk(chunk);
+    for(i = 0; i < chunk->n_voxels; ++i) {
+      struct TVoxel* v = &chunk->voxels[i];
+      if(!inside && (v->x < lo[0] || v->x > hi[0] || v->y < lo[1] || v->y > hi[1] ||
+                     v->z < lo[2] || v->z > hi[2]))
+        continue;
+
+      voxels[n].colour = v->colour;
+      voxels[n].x = v->x - lo[0];
+      voxels[n].y = v->y - lo[1];
+      voxels[n].z = v->z - lo[2];
+      ++n;
+    }
+  }
+
+  *out = voxels;
+  return n;
+}
+
+int copySelection() {
+  int i;
+
+  if(!selection.active)
+    return -1;
+
+  free(clipboard.voxels);
+  clipboard.n_voxels = gatherSelection(&clipboard.voxels);
+  for(i = 0; i < 3; ++i)
+    clipboard.size[i] = selection.max[i] - selection.min[i] + 1;
+
+  return clipboard.n_voxels;
+}
+
+// Checks whether a box of the given size fits the grid from the given corner
+static int fits(int x, int y, int z, int size[3]) {
+  return x >= SHRT_MIN && y >= SHRT_MIN && z >= SHRT_MIN &&
+         x + size[0] - 1 <= SHRT_MAX && y + size[1] - 1 <= SHRT_MAX && z + size[2] - 1 <= SHRT_MAX;
+}
+
+int pasteClipboard(int x, int y, int z) {
+  int i;
+
+  if(clipboard.size[0] == 0)
+    return -1;
+  if(!fits(x, y, z, clipboard.size)) {
+    fprintf(stderr, "The clipboard doesn't fit the grid there.\n");
+    return 0;
+  }
+
+  undoBegin();
+  for(i = 0; i < clipboard.n_voxels; ++i) {
+    struct TModelVoxel* v = &clipboard.voxels[i];
+    setCell(x + v->x, y + v->y, z + v->z, v->colour, 0);
+  }
+  undoEnd();
+  modelEdited();
+
+  selectBox(x, y, z, x + clipboard.size[0] - 1, y + clipboard.size[1] - 1, z + clipboard.size[2] - 1);
+  return clipboard.n_voxels;
+}
+
+// Moves the voxels of the selection to their place after mirroring along
+// 'mirror' (if >= 0) and 'turns' quarters of a turn around 'axis'
+static int transformSelection(int mirror, int axis, int turns) {
+  struct TModelVoxel *voxels;
+  int size[3], n, i, t, u, w;
+
+  if(!selection.active)
+    return -1;
+
+  for(i = 0; i < 3; ++i)
+    size[i] = selection.max[i] - selection.min[i] + 1;
+
+  u = (axis + 1) % 3;
+  w = (axis + 2) % 3;
+  turns = ((turns % 4) + 4) % 4;
+  if(turns % 2) {
+    t = size[u]; size[u] = size[w]; size[w] = t;
+  }
+  if(!fits(selection.min[0], selection.min[1], selection.min[2], size)) {
+    fprintf(stderr, "The transformed selection doesn't fit the grid.\n");
+    return 0;
+  }
+  for(i = 0; i < 3; ++i)
+    size[i] = selection.max[i] - selection.min[i] + 1;
+
+  n = gatherSelection(&voxels);
+
+  undoBegin();
+  for(i = 0; i < n; ++i)
+    setCell(selection.min[0] + voxels[i].x, selection.min[1] + voxels[i].y,
+            selection.min[2] + voxels[i].z, -1, 0);
+
+  for(i = 0; i < n; ++i) {
+    int c[3] = { voxels[i].x, voxels[i].y, voxels[i].z };
+    int s[3] = { size[0], size[1], size[2] }, k;
+
+    if(mirror >= 0)
+      c[mirror] = s[mirror] - 1 - c[mirror];
+
+    // A quarter of a turn takes (u, w) to (-w, u), shifted back into the box
+    for(k = 0; k < turns; ++k) {
+      t = c[u];
+      c[u] = s[w] - 1 - c[w];
+      c[w] = t;
+      t = s[u]; s[u] = s[w]; s[w] = t;
+    }
+
+    setCell(selection.min[0] + c[0], selection.min[1] + c[1], selection.min[2] + c[2],
+            voxels[i].colour, 0);
+  }
+  undoEnd();
+  free(voxels);
+
+  if(turns % 2) {
+    t = size[u]; size[u] = size[w]; size[w] = t;
+    for(i = 0; i < 3; ++i)
+      selection.max[i] = selection.min[i] + size[i] - 1;
+  }
+
+  if(n)
+    modelEdited();
+  return n;
+}
+
+int rotateSelection(int axis, int turns) {
+  return transformSelection(-1, axis, turns);
+}
+
+int mirrorSelection(int axis) {
+  return transformSelection(axis, 2, 0);
+}
+
+void drawSelection(struct TColour* colour) {
+  float lo[3], hi[3];
+
+  if(!selection.active)
+    return;
+
+  // Cell y covers [y-1, y) * voxel_size
+  lo[0] = selection.min[0] * voxel_size;
+  lo[1] = (selection.min[1] - 1) * voxel_size;
+  lo[2] = selection.min[2] * voxel_size;
+  hi[0] = (selection.max[0] + 1) * voxel_size;
+  hi[1] = selection.max[1] * voxel_size;
+  hi[2] = (selection.max[2] + 1) * voxel_size;
+
+  glLineWidth(2);
+  glColor3ub(colour->r, colour->g, colour->b);
+  glPushMatrix();
+  glTranslatef((lo[0] + hi[0]) / 2, (lo[1] + hi[1]) / 2, (lo[2] + hi[2]) / 2);
+  glScalef(hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]);
+  glutWireCube(1.0);
+  glPopMatrix();
+}
+
+void benchSelection(int iterations) {
+  struct TModelVoxel *voxels;
+  double start;
+  int i, n = 0;
+
+  if(!selection.active) {
+    printf("No selection to benchmark.\n");
+    return;
+  }
+
+  start = benchNow();
+  for(i = 0; i < iterations; ++i) {
+    n = gatherSelection(&voxels);
+    free(voxels);
+  }
+  benchReport("copy", benchNow() - start, iterations, n, "voxels");
+
+  // Every transform is applied twice, which leaves the model as it was, and
+  // out of the history, which is left as the user had it
+  if(iterations > BENCH_MAX_TRANSFORMS)
+    iterations = BENCH_MAX_TRANSFORMS;
+  undoSuspend();
+
+  start = benchNow();
+  for(i = 0; i < iterations; ++i) {
+    mirrorSelection(i % 3);
+    mirrorSelection(i % 3);
+  }
+  benchReport("mirror", benchNow() - start, iterations * 2, n, "voxels");
+
+  start = benchNow();
+  for(i = 0; i < iterations; ++i) {
+    rotateSelection(i % 3, 2);
+    rotateSelection(i % 3, 2);
+  }
+  benchReport("rotate 180", benchNow() - start, iterations * 2, n, "voxels");
+
+  undoResume();
+}
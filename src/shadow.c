@@ -0,0 +1,249 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "shadow.h"
+
+#include <GL/gl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "colours.h"
+#include "functions.h"
+
+// Columns along each side of a tile of the footprint
+#define TILE_BITS 4
+#define TILE_SIZE (1 << TILE_BITS)
+#define TILE_COLUMNS (TILE_SIZE * TILE_SIZE)
+// Rectangles a tile is merged into at most (a checkerboard)
+#define TILE_RECTS (TILE_COLUMNS / 2)
+// Initial size of the tile hash table (power of two)
+#define TABLE_INITIAL_SIZE 64
+
+/**
+ * A rectangle of occupied columns of a tile: [x, x+w) x [y, y+h) in columns
+ * from its corner
+ */
+struct TShadowRect {
+  unsigned char x, y, w, h;
+};
+
+/**
+ * The columns of TILE_SIZE x TILE_SIZE grid cells, merged on their own so a
+ * change only rebuilds the rectangles of its tile
+ */
+struct TShadowTile {
+  int tx, ty;                   // Grid cell (tx, ty) * TILE_SIZE is its corner
+  int counts[TILE_COLUMNS];     // Number of voxels in every column
+  int changed;                  // Whether the footprint changed since the last merge
+  struct TShadowRect rects[TILE_RECTS];
+  int n_rects;
+};
+
+static struct {
+  struct TShadowTile **tiles;   // Every tile, in creation order
+  int n_tiles, max_tiles;
+  struct TShadowTile **table;   // Open addressing hash table, at most half full
+  int table_size;
+  int n_rects;                  // Rectangles of all the tiles
+} shadow = { 0 };
+
+static unsigned int hashTile(int tx, int ty) {
+  return ((unsigned int)tx * 73856093u) ^ ((unsigned int)ty * 19349663u);
+}
+
+static void tableInsert(struct TShadowTile* tile) {
+  unsigned int i = hashTile(tile->tx, tile->ty) & (shadow.table_size - 1);
+
+  while(shadow.table[i])
+    i = (i + 1) & (shadow.table_size - 1);
+  shadow.table[i] = tile;
+}
+
+// Finds the tile holding the column (x, y), creating it if asked to
+// - Returns: the tile; NULL if it doesn't exist or there's no memory for it
+static struct TShadowTile* getTile(int x, int y, int create) {
+  struct TShadowTile *tile, **table;
+  int tx = x >> TILE_BITS, ty = y >> TILE_BITS, i;
+  unsigned int h;
+
+  if(shadow.table) {
+    h = hashTile(tx, ty) & (shadow.table_size - 1);
+    while((tile = shadow.table[h])) {
+      if(tile->tx == tx && tile->ty == ty)
+        return tile;
+      h = (h + 1) & (shadow.table_size - 1);
+    }
+  }
+
+  if(!create)
+    return NULL;
+
+  if(shadow.n_tiles == shadow.max_tiles) {
+    int max = shadow.max_tiles ? shadow.max_tiles * 2 : TABLE_INITIAL_SIZE;
+    struct TShadowTile **tiles = (struct TShadowTile**)realloc(shadow.tiles, sizeof(struct TShadowTile*) * max);
+    if(!tiles)
+      return NULL;
+    shadow.tiles = tiles;
+    shadow.max_tiles = max;
+  }
+  if((shadow.n_tiles + 1) * 2 > shadow.table_size) {
+    int size = shadow.table_size ? shadow.table_size * 2 : TABLE_INITIAL_SIZE;
+    if(!(table = (struct TShadowTile**)calloc(size, sizeof(struct TShadowTile*))))
+      return NULL;
+    free(shadow.table);
+    shadow.table = table;
+    shadow.table_size = size;
+    for(i = 0; i < shadow.n_tiles; ++i)
+      tableInsert(shadow.tiles[i]);
+  }
+
+  if(!(tile = (struct TShadowTile*)calloc(1, sizeof(struct TShadowTile))))
+    return NULL;
+  tile->tx = tx;
+  tile->ty = ty;
+  shadow.tiles[shadow.n_tiles++] = tile;
+  tableInsert(tile);
+  return tile;
+}
+
+// Greedy merge of the occupied columns of a tile into rectangles: every run
+// of occupied columns of a row not merged yet is grown downwards while the
+// next rows have the very same run occupied
+static void mergeTile(struct TShadowTile* tile) {
+  unsigned char used[TILE_COLUMNS];
+  int x, y, w, h, k;
+
+  shadow.n_rects -= tile->n_rects;
+  tile->n_rects = 0;
+  tile->changed = 0;
+  memset(used, 0, sizeof(used));
+
+  for(y = 0; y < TILE_SIZE; ++y) {
+    for(x = 0; x < TILE_SIZE; ++x) {
+      int i = y * TILE_SIZE + x;
+      if(!tile->counts[i] || used[i])
+        continue;
+
+      for(w = 1; x + w < TILE_SIZE; ++w)
+        if(!tile->counts[i+w] || used[i+w])
+          break;
+
+      for(h = 1; y + h < TILE_SIZE; ++h) {
+        int row = (y + h) * TILE_SIZE + x;
+        for(k = 0; k < w; ++k)
+          if(!tile->counts[row+k] || used[row+k])
+            break;
+        if(k < w)
+          break;
+      }
+
+      for(k = 0; k < h; ++k)
+        memset(&used[(y + k) * TILE_SIZE + x], 1, w);
+
+      tile->rects[tile->n_rects].x = x;
+      tile->rects[tile->n_rects].y = y;
+      tile->rects[tile->n_rects].w = w;
+      tile->rects[tile->n_rects].h = h;
+      tile->n_rects++;
+
+      x += w - 1;
+    }
+  }
+
+  shadow.n_rects += tile->n_rects;
+}
+
+static int* columnCount(struct TShadowTile* tile, int x, int y) {
+  return &tile->counts[(y & (TILE_SIZE - 1)) * TILE_SIZE + (x & (TILE_SIZE - 1))];
+}
+
+void shadowAdd(int x, int y) {
+  struct TShadowTile* tile = getTile(x, y, 1);
+
+  // Without memory the column is just left out of the footprint
+  if(tile && (*columnCount(tile, x, y))++ == 0)
+    tile->changed = 1;
+}
+
+void shadowRemove(int x, int y) {
+  struct TShadowTile* tile = getTile(x, y, 0);
+  int *count;
+
+  if(!tile)
+    return;
+
+  count = columnCount(tile, x, y);
+  if(*count > 0 && --(*count) == 0)
+    tile->changed = 1;
+}
+
+void shadowClear() {
+  int i;
+
+  for(i = 0; i < shadow.n_tiles; ++i)
+    free(shadow.tiles[i]);
+  shadow.n_tiles = 0;
+  shadow.n_rects = 0;
+  if(shadow.table)
+    memset(shadow.table, 0, shadow.table_size * sizeof(struct TShadowTile*));
+}
+
+void drawShadow(struct TColour* colour, float z) {
+  int i, j;
+
+  if(shadowRectangles() == 0)
+    return;
+
+  // Column (x, y) covers [x, x+1] * voxel_size horizontally and
+  // [y-1, y] * voxel_size vertically, as the voxels centres do
+  glColor3ub(colour->r, colour->g, colour->b);
+  glBegin(GL_QUADS);
+  for(i = 0; i < shadow.n_tiles; ++i) {
+    struct TShadowTile* tile = shadow.tiles[i];
+    for(j = 0; j < tile->n_rects; ++j) {
+      struct TShadowRect* r = &tile->rects[j];
+      int x = tile->tx * TILE_SIZE + r->x, y = tile->ty * TILE_SIZE + r->y;
+      float x1 = x * voxel_size;
+      float y1 = (y - 1) * voxel_size;
+      float x2 = (x + r->w) * voxel_size;
+      float y2 = (y + r->h - 1) * voxel_size;
+
+      glVertex3f(x1, y1, z);
+      glVertex3f(x2, y1, z);
+      glVertex3f(x2, y2, z);
+      glVertex3f(x1, y2, z);
+    }
+  }
+  glEnd();
+}
+
+int shadowRectangles() {
+  int i;
+
+  for(i = 0; i < shadow.n_tiles; ++i)
+    if(shadow.tiles[i]->changed)
+      mergeTile(shadow.tiles[i]);
+  return shadow.n_rects;
+}
+
+void shadowCleanup() {
+  shadowClear();
+  free(shadow.tiles);
+  free(shadow.table);
+  memset(&shadow, 0, sizeof(shadow));
+}
@@ -0,0 +1,391 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "store.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "functions.h"
+
+// Initial size of the chunk hash table (power of two)
+#define TABLE_INITIAL_SIZE 64
+// Swap file of the paged out chunks, created in the working directory and
+// unlinked straight away
+#define SWAP_TEMPLATE "arvoxeleditor-swap-XXXXXX"
+
+struct TChunk **chunks = NULL;
+int n_chunks = 0;
+int store_generation = 0;
+long long store_budget = STORE_DEFAULT_BUDGET;
+struct TStoreStats store_stats = { 0 };
+
+// Resident chunks, from the most to the least recently used
+static struct TChunk *newest = NULL, *oldest = NULL;
+// Swap file and its size (pages are appended and reused while they fit)
+static int swap_fd = -1;
+static long long swap_size = 0;
+
+// Open addressing hash table of the chunks, at most half full
+static struct TChunk **table = NULL;
+static int table_size = 0;
+static int max_chunks = 0;
+
+static unsigned int hashChunk(int cx, int cy, int cz) {
+  return ((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u) ^ ((unsigned int)cz * 83492791u);
+}
+
+static void tableInsert(struct TChunk* chunk) {
+  unsigned int i = hashChunk(chunk->cx, chunk->cy, chunk->cz) & (table_size - 1);
+
+  while(table[i])
+    i = (i + 1) & (table_size - 1);
+  table[i] = chunk;
+}
+
+static void tableGrow() {
+  int i;
+
+  table_size = table_size ? table_size * 2 : TABLE_INITIAL_SIZE;
+  free(table);
+  table = (struct TChunk**)calloc(table_size, sizeof(struct TChunk*));
+  for(i = 0; i < n_chunks; ++i)
+    tableInsert(chunks[i]);
+}
+
+struct TChunk* getChunk(int cx, int cy, int cz, int create) {
+  struct TChunk* chunk;
+  unsigned int i;
+
+  if(table) {
+    i = hashChunk(cx, cy, cz) & (table_size - 1);
+    while((chunk = table[i])) {
+      if(chunk->cx == cx && chunk->cy == cy && chunk->cz == cz)
+        return chunk;
+      i = (i + 1) & (table_size - 1);
+    }
+  }
+
+  if(!create)
+    return NULL;
+
+  chunk = (struct TChunk*)calloc(1, sizeof(struct TChunk));
+  chunk->cx = cx;
+  chunk->cy = cy;
+  chunk->cz = cz;
+  chunk->index = n_chunks;
+  chunk->page_offset = -1;
+
+  if(n_chunks == max_chunks) {
+    max_chunks = max_chunks ? max_chunks * 2 : TABLE_INITIAL_SIZE;
+    chunks = (struct TChunk**)realloc(chunks, sizeof(struct TChunk*) * max_chunks);
+  }
+  chunks[n_chunks++] = chunk;
+
+  if(n_chunks * 2 > table_size)
+    tableGrow();
+  else
+    tableInsert(chunk);
+
+  return chunk;
+}
+
+static void cacheUnlink(struct TChunk* chunk) {
+  if(chunk->newer)
+    chunk->newer->older = chunk->older;
+  else
+    newest = chunk->older;
+  if(chunk->older)
+    chunk->older->newer = chunk->newer;
+  else
+    oldest = chunk->newer;
+  chunk->newer = chunk->older = NULL;
+}
+
+static void cacheLink(struct TChunk* chunk) {
+  chunk->older = newest;
+  chunk->newer = NULL;
+  if(newest)
+    newest->newer = chunk;
+  else
+    oldest = chunk;
+  newest = chunk;
+}
+
+static int swapIO(int write, void *data, size_t size, long long offset) {
+  char *p = (char*)data;
+
+  while(size > 0) {
+    ssize_t done = write ? pwrite(swap_fd, p, size, offset) : pread(swap_fd, p, size, offset);
+    if(done < 0 && errno == EINTR)
+      continue;
+    if(done <= 0)
+      return -1;
+    p += done;
+    size -= done;
+    offset += done;
+  }
+
+  return 0;
+}
+
+// Writes the voxels of the chunk to its page (if they changed) and frees
+// them. Returns 0 if the page couldn't be written, keeping them in memory
+static int pageOut(struct TChunk* chunk) {
+  if(chunk->n_voxels > 0 && (chunk->dirty || chunk->page_offset < 0)) {
+    if(swap_fd < 0) {
+      char path[] = SWAP_TEMPLATE;
+      if((swap_fd = mkstemp(path)) < 0) {
+        fprintf(stderr, "Error creating the swap file: %s\n", strerror(errno));
+        return 0;
+      }
+      unlink(path);
+    }
+
+    // A page too small for the chunk is left behind for a new one at the end
+    if(chunk->n_voxels > chunk->page_capacity) {
+      chunk->page_offset = swap_size;
+      chunk->page_capacity = chunk->max_voxels;
+      swap_size += (long long)chunk->max_voxels * sizeof(struct TVoxel);
+    }
+
+    if(swapIO(1, chunk->voxels, chunk->n_voxels * sizeof(struct TVoxel), chunk->page_offset) < 0) {
+      fprintf(stderr, "Error writing the swap file: %s\n", strerror(errno));
+      return 0;
+    }
+    store_stats.writes++;
+  }
+
+  if(chunk->n_voxels > 0)
+    chunk->colour = chunk->voxels[0].colour;
+
+  store_stats.resident -= (long long)chunk->max_voxels * sizeof(struct TVoxel) +
+                          CHUNK_CELLS * sizeof(unsigned short);
+  store_stats.n_resident--;
+  store_stats.evictions++;
+
+  free(chunk->voxels);
+  free(chunk->slot);
+  chunk->voxels = NULL;
+  chunk->slot = NULL;
+  chunk->max_voxels = 0;
+  chunk->dirty = 0;
+  cacheUnlink(chunk);
+
+  return 1;
+}
+
+// Pages out the least recently used chunks until the budget is met, except
+// for 'keep'
+static void trimCache(struct TChunk* keep) {
+  while(store_stats.resident > store_budget && oldest && oldest != keep)
+    if(!pageOut(oldest))
+      break;
+}
+
+static void reserveVoxels(struct TChunk* chunk, int n) {
+  int old = chunk->max_voxels;
+
+  if(n <= chunk->max_voxels)
+    return;
+
+  while(chunk->max_voxels < n)
+    chunk->max_voxels = chunk->max_voxels ? chunk->max_voxels * 2 : 16;
+  chunk->voxels = (struct TVoxel*)realloc(chunk->voxels, sizeof(struct TVoxel) * chunk->max_voxels);
+
+  store_stats.resident += (long long)(chunk->max_voxels - old) * sizeof(struct TVoxel);
+  trimCache(chunk);
+}
+
+void loadChunk(struct TChunk* chunk) {
+  int i;
+
+  if(chunk->slot) {
+    store_stats.hits++;
+    if(chunk != newest) {
+      cacheUnlink(chunk);
+      cacheLink(chunk);
+    }
+    return;
+  }
+
+  chunk->slot = (unsigned short*)calloc(CHUNK_CELLS, sizeof(unsigned short));
+  store_stats.resident += CHUNK_CELLS * sizeof(unsigned short);
+  store_stats.n_resident++;
+  cacheLink(chunk);
+
+  // Chunks never paged out (or emptied since) have nothing to read
+  if(chunk->n_voxels > 0) {
+    store_stats.misses++;
+    reserveVoxels(chunk, chunk->n_voxels);
+    if(swapIO(0, chunk->voxels, chunk->n_voxels * sizeof(struct TVoxel), chunk->page_offset) < 0)
+      ERROR("Error reading the swap file: %s\n", strerror(errno));
+
+    for(i = 0; i < chunk->n_voxels; ++i) {
+      struct TVoxel* v = &chunk->voxels[i];
+      chunk->slot[CELL_INDEX(v->x, v->y, v->z)] = i + 1;
+    }
+  }
+
+  trimCache(chunk);
+}
+
+void editChunk(struct TChunk* chunk) {
+  loadChunk(chunk);
+  chunk->dirty = 1;
+  chunk->revision++;
+}
+
+void setStoreBudget(long long bytes) {
+  store_budget = bytes < STORE_MIN_BUDGET ? STORE_MIN_BUDGET : bytes;
+  trimCache(NULL);
+}
+
+struct TVoxel* findVoxel(int x, int y, int z) {
+  struct TChunk* chunk = getChunk(CHUNK_COORD(x), CHUNK_COORD(y), CHUNK_COORD(z), 0);
+  int cell = CELL_INDEX(x, y, z);
+
+  // The bitset is resident, so empty cells never page the chunk in
+  if(!chunk || !((chunk->occupancy[cell >> 6] >> (cell & 63)) & 1))
+    return NULL;
+
+  loadChunk(chunk);
+  return &chunk->voxels[chunk->slot[cell] - 1];
+}
+
+int cellOccupied(int x, int y, int z) {
+  struct TChunk* chunk = getChunk(CHUNK_COORD(x), CHUNK_COORD(y), CHUNK_COORD(z), 0);
+  int cell = CELL_INDEX(x, y, z);
+
+  return chunk && ((chunk->occupancy[cell >> 6] >> (cell & 63)) & 1);
+}
+
+struct TVoxel* storeVoxel(int x, int y, int z, int colour) {
+  return chunkStore(getChunk(CHUNK_COORD(x), CHUNK_COORD(y), CHUNK_COORD(z), 1), x, y, z, colour);
+}
+
+void eraseVoxel(int x, int y, int z) {
+  struct TChunk* chunk = getChunk(CHUNK_COORD(x), CHUNK_COORD(y), CHUNK_COORD(z), 0);
+
+  if(chunk)
+    chunkErase(chunk, x, y, z);
+}
+
+struct TVoxel* chunkStore(struct TChunk* chunk, int x, int y, int z, int colour) {
+  int cell = CELL_INDEX(x, y, z);
+  struct TVoxel* voxel;
+
+  editChunk(chunk);
+  reserveVoxels(chunk, chunk->n_voxels + 1);
+
+  voxel = &chunk->voxels[chunk->n_voxels++];
+  voxel->x = x;
+  voxel->y = y;
+  voxel->z = z;
+  voxel->colour = colour;
+
+  chunk->slot[cell] = chunk->n_voxels;
+  chunk->occupancy[cell >> 6] |= 1ULL << (cell & 63);
+  n_voxels++;
+
+  return voxel;
+}
+
+void chunkErase(struct TChunk* chunk, int x, int y, int z) {
+  int cell = CELL_INDEX(x, y, z);
+  int slot;
+
+  if(!((chunk->occupancy[cell >> 6] >> (cell & 63)) & 1))
+    return;
+
+  editChunk(chunk);
+  slot = chunk->slot[cell];
+
+  // Move the last voxel of the chunk to the hole
+  if(slot != chunk->n_voxels) {
+    struct TVoxel* last = &chunk->voxels[chunk->n_voxels - 1];
+    chunk->voxels[slot - 1] = *last;
+    chunk->slot[CELL_INDEX(last->x, last->y, last->z)] = slot;
+  }
+
+  chunk->n_voxels--;
+  chunk->slot[cell] = 0;
+  chunk->occupancy[cell >> 6] &= ~(1ULL << (cell & 63));
+  n_voxels--;
+}
+
+void chunkFill(struct TChunk* chunk, int colour) {
+  int cell;
+
+  editChunk(chunk);
+  n_voxels -= chunk->n_voxels;
+  reserveVoxels(chunk, CHUNK_CELLS);
+
+  // Voxels in cell order, so the slot of every cell is its index
+  for(cell = 0; cell < CHUNK_CELLS; ++cell) {
+    struct TVoxel* voxel = &chunk->voxels[cell];
+    voxel->x = (chunk->cx << CHUNK_BITS) | (cell & (CHUNK_SIZE-1));
+    voxel->y = (chunk->cy << CHUNK_BITS) | ((cell >> CHUNK_BITS) & (CHUNK_SIZE-1));
+    voxel->z = (chunk->cz << CHUNK_BITS) | (cell >> (2*CHUNK_BITS));
+    voxel->colour = colour;
+    chunk->slot[cell] = cell + 1;
+  }
+  memset(chunk->occupancy, 0xFF, sizeof(chunk->occupancy));
+
+  chunk->n_voxels = CHUNK_CELLS;
+  n_voxels += CHUNK_CELLS;
+}
+
+void chunkClear(struct TChunk* chunk) {
+  // A paged out chunk just forgets its page
+  memset(chunk->occupancy, 0, sizeof(chunk->occupancy));
+  if(chunk->slot)
+    memset(chunk->slot, 0, CHUNK_CELLS * sizeof(unsigned short));
+  chunk->revision++;
+  n_voxels -= chunk->n_voxels;
+  chunk->n_voxels = 0;
+}
+
+void clearStore() {
+  int i;
+
+  for(i = 0; i < n_chunks; ++i) {
+    free(chunks[i]->voxels);
+    free(chunks[i]->slot);
+    free(chunks[i]);
+  }
+
+  if(swap_fd >= 0)
+    close(swap_fd);
+  swap_fd = -1;
+  swap_size = 0;
+  newest = oldest = NULL;
+  store_stats.resident = 0;
+  store_stats.n_resident = 0;
+
+  free(chunks);
+  free(table);
+  chunks = NULL;
+  table = NULL;
+  n_chunks = max_chunks = table_size = 0;
+  store_generation++;
+  n_voxels = 0;
+}
@@ -0,0 +1,289 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include "text.h"
+
+#include <GL/glut.h>
+#include <GL/glext.h>
+#include <AR/gsub.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "functions.h"
+
+// Size of every glyph atlas texture
+#define ATLAS_SIZE 256
+// Printable ASCII range stored in the atlas
+#define FIRST_GLYPH 32
+#define LAST_GLYPH 126
+// Maximum number of fonts with an atlas
+#define MAX_ATLASES 4
+// Distance between lines, as printText() does
+#define LINE_HEIGHT 14
+// Height of a glyph cell in the atlas and pixels of it below the baseline;
+// big enough for the GLUT Helvetica and Times bitmap fonts up to 12 points
+#define CELL_HEIGHT 18
+#define CELL_DESCENT 5
+
+/**
+ * The glyphs of a GLUT bitmap font rendered into a texture
+ */
+struct TGlyphAtlas {
+  void *font;                             // Font the atlas was built from
+  GLuint texture;                         // White glyphs over transparent black
+  int height;                             // Height of every glyph cell
+  int descent;                            // Pixels below the baseline in a cell
+  int advance[LAST_GLYPH+1];              // Raster advance of every glyph
+  int cell[LAST_GLYPH+1][2];              // Bottom-left corner of every glyph cell
+};
+
+static struct TGlyphAtlas atlases[MAX_ATLASES];
+static int n_atlases = 0;
+// -1 unknown, 0 no render to texture (fallback to printText()), 1 supported
+static int atlas_supported = -1;
+
+static int atlasSupported() {
+  if(atlas_supported == -1) {
+    const GLubyte *extensions = glGetString(GL_EXTENSIONS);
+    atlas_supported = extensions &&
+      gluCheckExtension((const GLubyte*)"GL_ARB_framebuffer_object", extensions);
+    if(!atlas_supported)
+      fprintf(stderr, "No render to texture support; text drawn glyph by glyph.\n");
+  }
+
+  return atlas_supported;
+}
+
+// Renders every glyph of the font with glutBitmapCharacter into a texture
+// through a framebuffer object, so the window contents are left untouched
+static struct TGlyphAtlas* buildAtlas(void *font) {
+  struct TGlyphAtlas* atlas;
+  GLint viewport[4], previous_fbo;
+  GLuint fbo;
+  int c, x, y;
+
+  if(n_atlases == MAX_ATLASES)
+    return NULL;
+
+  atlas = &atlases[n_atlases];
+  atlas->font = font;
+  atlas->height = CELL_HEIGHT;
+  atlas->descent = CELL_DESCENT;
+
+  glGenTextures(1, &atlas->texture);
+  glBindTexture(GL_TEXTURE_2D, atlas->texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlas->texture, 0);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &atlas->texture);
+    atlas_supported = 0;
+    fprintf(stderr, "Error creating the glyph atlas; text drawn glyph by glyph.\n");
+    return NULL;
+  }
+
+  glViewport(0, 0, ATLAS_SIZE, ATLAS_SIZE);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  gluOrtho2D(0.0, ATLAS_SIZE, 0.0, ATLAS_SIZE);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+
+  for(c = FIRST_GLYPH, x = 1, y = 1; c <= LAST_GLYPH; ++c) {
+    atlas->advance[c] = glutBitmapWidth(font, c);
+    if(x + atlas->advance[c] + 1 > ATLAS_SIZE) {
+      x = 1;
+      y += atlas->height;
+    }
+
+    atlas->cell[c][0] = x;
+    atlas->cell[c][1] = y;
+    glRasterPos2i(x, y + atlas->descent);
+    glutBitmapCharacter(font, c);
+
+    x += atlas->advance[c] + 1;
+  }
+
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+  glDeleteFramebuffers(1, &fbo);
+
+  n_atlases++;
+  return atlas;
+}
+
+static struct TGlyphAtlas* getAtlas(void *font) {
+  int i;
+
+  for(i = 0; i < n_atlases; ++i)
+    if(atlases[i].font == font)
+      return &atlases[i];
+
+  return buildAtlas(font);
+}
+
+// Lays out the string as printText() would print it: glyphs advance over
+// the baseline and every '\n' moves LINE_HEIGHT pixels along the Y axis.
+// With top = 1 the Y axis points down, so glyphs grow towards -Y
+static void layoutText(struct TTextBlock* block, struct TGlyphAtlas* atlas,
+                       int x, int y, void *font, char *string, int top) {
+  int len = (int)strlen(string);
+  int up = top ? -1 : 1;
+  int pen_x = x, pen_y = y;
+  int i;
+
+  if(block->max_vertices < len * 4) {
+    block->max_vertices = len * 4;
+    block->vertices = (float*)realloc(block->vertices, sizeof(float) * 4 * block->max_vertices);
+  }
+
+  block->n_vertices = 0;
+  for(i = 0; i < len; ++i) {
+    unsigned char c = string[i];
+    float *v;
+    float u1, v1, u2, v2, x2, y1, y2;
+
+    if(c == '\n') {
+      pen_x = x;
+      pen_y += LINE_HEIGHT;
+      continue;
+    }
+    if(c < FIRST_GLYPH || c > LAST_GLYPH)
+      continue;
+
+    u1 = atlas->cell[c][0] / (float)ATLAS_SIZE;
+    v1 = atlas->cell[c][1] / (float)ATLAS_SIZE;
+    u2 = (atlas->cell[c][0] + atlas->advance[c]) / (float)ATLAS_SIZE;
+    v2 = (atlas->cell[c][1] + atlas->height) / (float)ATLAS_SIZE;
+    x2 = pen_x + atlas->advance[c];
+    y1 = pen_y - up * atlas->descent;
+    y2 = y1 + up * atlas->height;
+
+    v = &block->vertices[block->n_vertices * 4];
+    v[0]  = pen_x; v[1]  = y1; v[2]  = u1; v[3]  = v1;
+    v[4]  = x2;    v[5]  = y1; v[6]  = u2; v[7]  = v1;
+    v[8]  = x2;    v[9]  = y2; v[10] = u2; v[11] = v2;
+    v[12] = pen_x; v[13] = y2; v[14] = u1; v[15] = v2;
+    block->n_vertices += 4;
+
+    pen_x += atlas->advance[c];
+  }
+
+  free(block->text);
+  block->text = strdup(string);
+  block->font = font;
+  block->x = x;
+  block->y = y;
+  block->top = top;
+}
+
+void drawText(struct TTextBlock* block, float r, float g, float b,
+              int x, int y, void *font, char *string, int top) {
+  struct TGlyphAtlas* atlas = NULL;
+
+  if(atlasSupported())
+    atlas = getAtlas(font);
+  if(!atlas) {
+    printText(r, g, b, x, y, font, string, top);
+    return;
+  }
+
+  if(!block->text || block->font != font || block->x != x || block->y != y ||
+     block->top != top || strcmp(block->text, string) != 0)
+    layoutText(block, atlas, x, y, font, string, top);
+  if(block->n_vertices == 0)
+    return;
+
+  argDrawMode2D();
+
+  if(top) {
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0.0, dim[0], dim[1], 0.0);
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+  }
+
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, atlas->texture);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  glEnable(GL_ALPHA_TEST);
+  glAlphaFunc(GL_GREATER, 0.5f);
+  glColor3f(r, g, b);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glVertexPointer(2, GL_FLOAT, 4 * sizeof(float), &block->vertices[0]);
+  glTexCoordPointer(2, GL_FLOAT, 4 * sizeof(float), &block->vertices[2]);
+  glDrawArrays(GL_QUADS, 0, block->n_vertices);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  glDisable(GL_ALPHA_TEST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisable(GL_TEXTURE_2D);
+
+  if(top) {
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+  }
+}
+
+void freeTextBlock(struct TTextBlock* block) {
+  free(block->text);
+  free(block->vertices);
+  memset(block, 0, sizeof(struct TTextBlock));
+}
+
+void textCleanup() {
+  int i;
+
+  for(i = 0; i < n_atlases; ++i)
+    glDeleteTextures(1, &atlases[i].texture);
+  n_atlases = 0;
+}
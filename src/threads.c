@@ -0,0 +1,356 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "threads.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Upper bound of slices, so they can live on the stack
+#define MAX_THREADS 64
+// Initial capacity of every task deque (power of two)
+#define DEQUE_INITIAL_SIZE 256
+
+/**
+ * A slice of a parallelFor() call
+ */
+struct TSlice {
+  void (*fn)(void *ctx, int slice, int begin, int end);
+  void *ctx;
+  int slice, begin, end;
+};
+
+static void* runSlice(void *arg) {
+  struct TSlice* s = (struct TSlice*)arg;
+  s->fn(s->ctx, s->slice, s->begin, s->end);
+  return NULL;
+}
+
+int threadCount() {
+  static int count = 0;
+
+  if(count == 0) {
+    char *env = getenv("ARVE_THREADS");
+    count = env ? atoi(env) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(count < 1)
+      count = 1;
+    if(count > MAX_THREADS)
+      count = MAX_THREADS;
+  }
+
+  return count;
+}
+
+void parallelFor(int n, void (*fn)(void *ctx, int slice, int begin, int end), void *ctx) {
+  struct TSlice slices[MAX_THREADS];
+  pthread_t threads[MAX_THREADS];
+  int started[MAX_THREADS];
+  int n_slices = threadCount();
+  int i;
+
+  if(n_slices > n)
+    n_slices = n > 0 ? n : 1;
+
+  for(i = 0; i < n_slices; ++i) {
+    slices[i].fn = fn;
+    slices[i].ctx = ctx;
+    slices[i].slice = i;
+    slices[i].begin = (int)((long long)n * i / n_slices);
+    slices[i].end = (int)((long long)n * (i + 1) / n_slices);
+  }
+
+  // If a thread can't be created its slice just runs on this one
+  for(i = 0; i < n_slices - 1; ++i)
+    started[i] = pthread_create(&threads[i], NULL, runSlice, &slices[i]) == 0;
+  runSlice(&slices[n_slices - 1]);
+
+  for(i = 0; i < n_slices - 1; ++i) {
+    if(started[i])
+      pthread_join(threads[i], NULL);
+    else
+      runSlice(&slices[i]);
+  }
+}
+
+static int compareKeys(const void *a, const void *b) {
+  unsigned long long ka = *(const unsigned long long*)a;
+  unsigned long long kb = *(const unsigned long long*)b;
+  return ka < kb ? -1 : ka > kb;
+}
+
+/**
+ * State of a parallelSortKeys() call
+ */
+struct TSortJob {
+  unsigned long long *src, *dst;
+  int n, runs;          // Runs of 'width' sorted slices
+  int *bounds;          // Slice boundaries, runs+1 entries
+  int width;            // Slices per run being merged
+};
+
+static void sortSlice(void *ctx, int slice, int begin, int end) {
+  struct TSortJob* job = (struct TSortJob*)ctx;
+  int i;
+
+  for(i = begin; i < end; ++i)
+    qsort(&job->src[job->bounds[i]], job->bounds[i+1] - job->bounds[i],
+          sizeof(unsigned long long), compareKeys);
+}
+
+static void mergeSlice(void *ctx, int slice, int begin, int end) {
+  struct TSortJob* job = (struct TSortJob*)ctx;
+  int pair;
+
+  // Every item merges the pair of runs [pair*2w, pair*2w+w) and [.., +2w)
+  for(pair = begin; pair < end; ++pair) {
+    int first = pair * 2 * job->width;
+    int middle = first + job->width;
+    int last = middle + job->width;
+    int a, a_end, b, b_end, k;
+
+    if(middle > job->runs) middle = job->runs;
+    if(last > job->runs) last = job->runs;
+
+    a = job->bounds[first]; a_end = job->bounds[middle];
+    b = a_end; b_end = job->bounds[last];
+    k = a;
+    while(a < a_end && b < b_end)
+      job->dst[k++] = job->src[a] <= job->src[b] ? job->src[a++] : job->src[b++];
+    while(a < a_end)
+      job->dst[k++] = job->src[a++];
+    while(b < b_end)
+      job->dst[k++] = job->src[b++];
+  }
+}
+
+void parallelSortKeys(unsigned long long *keys, int n) {
+  struct TSortJob job;
+  unsigned long long *buffer, *swap;
+  int bounds[MAX_THREADS + 1];
+  int runs = threadCount();
+  int i;
+
+  if(runs == 1 || n < 4096) {
+    qsort(keys, n, sizeof(unsigned long long), compareKeys);
+    return;
+  }
+
+  for(i = 0; i <= runs; ++i)
+    bounds[i] = (int)((long long)n * i / runs);
+
+  job.src = keys;
+  job.n = n;
+  job.runs = runs;
+  job.bounds = bounds;
+  parallelFor(runs, sortSlice, &job);
+
+  buffer = (unsigned long long*)malloc(sizeof(unsigned long long) * n);
+  job.dst = buffer;
+  for(job.width = 1; job.width < runs; job.width *= 2) {
+    int pairs = (runs + 2 * job.width - 1) / (2 * job.width);
+    parallelFor(pairs, mergeSlice, &job);
+    swap = job.src; job.src = job.dst; job.dst = swap;
+  }
+
+  if(job.src != keys)
+    memcpy(keys, job.src, sizeof(unsigned long long) * n);
+  free(buffer);
+}
+
+/**
+ * A task queued with spawnTask()
+ */
+struct TTask {
+  void (*fn)(void *arg);
+  void *arg;
+};
+
+/**
+ * Deque of tasks of a worker. The owner pushes and pops at the back (the
+ * newest task, likely still in cache) while thieves take the front
+ */
+struct TDeque {
+  pthread_mutex_t lock;
+  struct TTask *tasks;      // Ring buffer
+  int capacity;             // Size of tasks (power of two)
+  int front, back;          // Monotonic; queued tasks are [front, back)
+};
+
+/**
+ * The task pool, started by the first spawnTask()
+ */
+static struct {
+  pthread_once_t once;
+  int n_workers;
+  struct TDeque deques[MAX_THREADS];
+  pthread_mutex_t lock;     // Guards the counters below
+  pthread_cond_t wake;      // Signaled when a task is queued
+  pthread_cond_t done;      // Broadcast when no task is pending
+  int queued;               // Tasks in the deques
+  int pending;              // Tasks spawned and not finished yet
+  unsigned int next;        // Deque for the next task spawned out of the pool
+} pool = { PTHREAD_ONCE_INIT };
+
+// Deque of the worker running on this thread; -1 out of the pool
+static __thread int worker_id = -1;
+
+static void dequePush(struct TDeque* d, struct TTask* task) {
+  pthread_mutex_lock(&d->lock);
+  if(d->back - d->front == d->capacity) {
+    struct TTask *tasks = (struct TTask*)malloc(sizeof(struct TTask) * d->capacity * 2);
+    int i;
+    for(i = d->front; i < d->back; ++i)
+      tasks[i & (d->capacity * 2 - 1)] = d->tasks[i & (d->capacity - 1)];
+    free(d->tasks);
+    d->tasks = tasks;
+    d->capacity *= 2;
+  }
+  d->tasks[d->back++ & (d->capacity - 1)] = *task;
+  pthread_mutex_unlock(&d->lock);
+}
+
+static int dequePop(struct TDeque* d, struct TTask* task, int steal) {
+  int found = 0;
+
+  pthread_mutex_lock(&d->lock);
+  if(d->back > d->front) {
+    *task = steal ? d->tasks[d->front++ & (d->capacity - 1)]
+                  : d->tasks[--d->back & (d->capacity - 1)];
+    found = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return found;
+}
+
+// Takes a task from the own deque or, failing that, steals one
+static int takeTask(struct TTask* task) {
+  int i, first = worker_id >= 0 ? worker_id : 0;
+
+  if(worker_id >= 0 && dequePop(&pool.deques[worker_id], task, 0))
+    goto taken;
+
+  for(i = 0; i < pool.n_workers; ++i) {
+    int victim = (first + 1 + i) % pool.n_workers;
+    if(victim != worker_id && dequePop(&pool.deques[victim], task, 1))
+      goto taken;
+  }
+  return 0;
+
+taken:
+  pthread_mutex_lock(&pool.lock);
+  pool.queued--;
+  pthread_mutex_unlock(&pool.lock);
+  return 1;
+}
+
+static void runTask(struct TTask* task) {
+  task->fn(task->arg);
+
+  pthread_mutex_lock(&pool.lock);
+  if(--pool.pending == 0)
+    pthread_cond_broadcast(&pool.done);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+static void* taskWorker(void *arg) {
+  struct TTask task;
+
+  worker_id = (int)(long)arg;
+  for(;;) {
+    if(takeTask(&task)) {
+      runTask(&task);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    while(pool.queued == 0)
+      pthread_cond_wait(&pool.wake, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+  }
+
+  return NULL;
+}
+
+static void startPool() {
+  pthread_t thread;
+  int i;
+
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.wake, NULL);
+  pthread_cond_init(&pool.done, NULL);
+
+  pool.n_workers = threadCount();
+  for(i = 0; i < pool.n_workers; ++i) {
+    pthread_mutex_init(&pool.deques[i].lock, NULL);
+    pool.deques[i].capacity = DEQUE_INITIAL_SIZE;
+    pool.deques[i].tasks = (struct TTask*)malloc(sizeof(struct TTask) * DEQUE_INITIAL_SIZE);
+  }
+
+  // Without workers waitTasks() still runs everything on the caller
+  for(i = 0; i < pool.n_workers; ++i) {
+    if(pthread_create(&thread, NULL, taskWorker, (void*)(long)i) != 0) {
+      fprintf(stderr, "Error starting task worker %d\n", i);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+}
+
+void spawnTask(void (*fn)(void *arg), void *arg) {
+  struct TTask task = { fn, arg };
+  int deque;
+
+  pthread_once(&pool.once, startPool);
+
+  pthread_mutex_lock(&pool.lock);
+  deque = worker_id >= 0 ? worker_id : (int)(pool.next++ % pool.n_workers);
+  pool.pending++;
+  pthread_mutex_unlock(&pool.lock);
+
+  dequePush(&pool.deques[deque], &task);
+
+  pthread_mutex_lock(&pool.lock);
+  pool.queued++;
+  pthread_cond_signal(&pool.wake);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+void waitTasks() {
+  struct TTask task;
+
+  pthread_once(&pool.once, startPool);
+
+  for(;;) {
+    if(takeTask(&task)) {
+      runTask(&task);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    if(pool.pending == 0) {
+      pthread_mutex_unlock(&pool.lock);
+      return;
+    }
+    pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+  }
+}
@@ -0,0 +1,278 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * Renders a thumbnail of every .vox file given (or found in the directories
+ * given) without camera or display, and reports the frames per second, so
+ * it doubles as a rendering benchmark:
+ *
+ *   thumbnails [-s size] [-f frames] [-j processes] [-m mode] [-o dir] <file.vox|dir>...
+ *
+ * The files are split among processes, each with its own offscreen context.
+ */
+
+#include <GL/gl.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "functions.h"
+#include "mesher.h"
+#include "offscreen.h"
+#include "render.h"
+#include "structs.h"
+#include "threads.h"
+
+/**
+ * Options of the batch
+ */
+struct TThumbnails {
+  int size;                 // Width and height of the thumbnails
+  int frames;               // Frames rendered per model
+  const char *output;       // Directory of the thumbnails; NULL for next to the models
+  enum ERenderMode mode;
+  char **files;
+  int n_files, max_files;
+};
+
+/**
+ * What a process reports back to the parent
+ */
+struct TThumbnailsResult {
+  int thumbnails;           // Models rendered
+  int frames;               // Frames rendered
+  double seconds;           // Time spent in them
+};
+
+static void addFile(struct TThumbnails* batch, const char *path) {
+  if(batch->n_files == batch->max_files) {
+    batch->max_files = batch->max_files ? batch->max_files * 2 : 64;
+    batch->files = (char**)realloc(batch->files, sizeof(char*) * batch->max_files);
+  }
+  batch->files[batch->n_files++] = strdup(path);
+}
+
+static int hasExtension(const char *name, const char *extension) {
+  size_t length = strlen(name), ext_length = strlen(extension);
+  return length > ext_length && strcmp(&name[length - ext_length], extension) == 0;
+}
+
+static int compareNames(const void *a, const void *b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Adds the .vox files of a directory, or the path itself if it isn't one
+static void addPath(struct TThumbnails* batch, const char *path) {
+  struct dirent *entry;
+  char file[1024];
+  DIR *dir;
+  int first = batch->n_files;
+
+  if(!(dir = opendir(path))) {
+    addFile(batch, path);
+    return;
+  }
+
+  while((entry = readdir(dir)) != NULL) {
+    if(!hasExtension(entry->d_name, ".vox"))
+      continue;
+    snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+    addFile(batch, file);
+  }
+  closedir(dir);
+
+  qsort(&batch->files[first], batch->n_files - first, sizeof(char*), compareNames);
+}
+
+// Thumbnail of a model: its name with a .png extension, in the output
+// directory if any
+static void thumbnailName(struct TThumbnails* batch, const char *model, char *name, size_t size) {
+  const char *base = strrchr(model, '/');
+  int length;
+
+  if(batch->output)
+    snprintf(name, size, "%s/%s", batch->output, base ? base + 1 : model);
+  else
+    snprintf(name, size, "%s", model);
+
+  length = strlen(name);
+  if(hasExtension(name, ".vox"))
+    length -= 4;
+  snprintf(&name[length], size - length, ".png");
+}
+
+// Renders the files of index 'first', 'first' + 'step'... in this process
+static void renderFiles(struct TThumbnails* batch, int first, int step, struct TThumbnailsResult* result) {
+  unsigned char *rgb = (unsigned char*)malloc(batch->size * batch->size * 3);
+  char name[1024];
+  int i, frame;
+
+  memset(result, 0, sizeof(*result));
+  if(offscreenOpen(batch->size, batch->size) < 0) {
+    free(rgb);
+    return;
+  }
+
+  render_mode = batch->mode;
+  if(!renderModeSupported(render_mode)) {
+    fprintf(stderr, "Render mode not supported offscreen: %s\n", render_mode_names[render_mode]);
+    offscreenClose();
+    free(rgb);
+    return;
+  }
+
+  for(i = first; i < batch->n_files; i += step) {
+    double start;
+
+    if(loadModel(batch->files[i]) < 0)
+      continue;
+
+    // Meshes are built in the background; wait for them outside the timing
+    if(render_mode == RENDER_MESHED) {
+      do {
+        updateMeshes();
+        waitTasks();
+      } while(meshesPending());
+    }
+
+    start = benchNow();
+    for(frame = 0; frame < batch->frames; ++frame) {
+      offscreenCamera();
+      drawScene();
+    }
+    glFinish();
+    start = benchNow() - start;
+
+    offscreenRead(rgb);
+    thumbnailName(batch, batch->files[i], name, sizeof(name));
+    if(writeImage(name, rgb, batch->size, batch->size) < 0) {
+      fprintf(stderr, "Error writing %s\n", name);
+      continue;
+    }
+
+    printf("%s: %d voxels, %.2f ms/frame (%.1f frames/s) -> %s\n", batch->files[i], n_voxels,
+           start * 1000.0 / batch->frames, batch->frames / start, name);
+    fflush(stdout);
+
+    result->thumbnails++;
+    result->frames += batch->frames;
+    result->seconds += start;
+  }
+
+  meshCleanup();
+  offscreenClose();
+  free(rgb);
+}
+
+static void usage() {
+  fprintf(stderr, "Usage: thumbnails [-s size] [-f frames] [-j processes] [-m mode] [-o dir] "
+                  "<file.vox|dir>...\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  struct TThumbnails batch = { 256, 1, NULL, RENDER_MESHED, NULL, 0, 0 };
+  struct TThumbnailsResult total = { 0, 0, 0.0 }, result;
+  int processes = threadCount();
+  int fds[64], i, j, opt;
+  pid_t pids[64];
+  double start;
+
+  while((opt = getopt(argc, argv, "s:f:j:m:o:")) != -1) {
+    switch(opt) {
+    case 's': batch.size = atoi(optarg); break;
+    case 'f': batch.frames = atoi(optarg); break;
+    case 'j': processes = atoi(optarg); break;
+    case 'o': batch.output = optarg; break;
+    case 'm':
+      for(j = 0; j < RENDER_MODES_LENGTH && strcmp(optarg, render_mode_names[j]) != 0; ++j);
+      if(j == RENDER_MODES_LENGTH)
+        usage();
+      batch.mode = j;
+      break;
+    default:
+      usage();
+    }
+  }
+  if(optind == argc || batch.size < 1 || batch.frames < 1)
+    usage();
+  // Its cubes are drawn by GLUT, which needs a display
+  if(batch.mode == RENDER_IMMEDIATE) {
+    fprintf(stderr, "The immediate render mode needs a display; use instanced or meshed.\n");
+    return 1;
+  }
+
+  for(i = optind; i < argc; ++i)
+    addPath(&batch, argv[i]);
+
+  if(processes > batch.n_files)
+    processes = batch.n_files;
+  if(processes > 64)
+    processes = 64;
+  if(processes < 1)
+    processes = 1;
+
+  voxel_size = 16;
+  grid_height = PAPER_HEIGHT / voxel_size;
+  grid_width = PAPER_WIDTH / voxel_size;
+
+  start = benchNow();
+  if(processes == 1) {
+    renderFiles(&batch, 0, 1, &total);
+  }
+  else {
+    // Every process reports its result through a pipe
+    for(i = 0; i < processes; ++i) {
+      int fd[2];
+      if(pipe(fd) < 0 || (pids[i] = fork()) < 0)
+        ERROR("Error starting the rendering processes\n");
+
+      if(pids[i] == 0) {
+        close(fd[0]);
+        renderFiles(&batch, i, processes, &result);
+        if(write(fd[1], &result, sizeof(result)) != sizeof(result))
+          _exit(1);
+        _exit(0);
+      }
+      close(fd[1]);
+      fds[i] = fd[0];
+    }
+
+    for(i = 0; i < processes; ++i) {
+      if(read(fds[i], &result, sizeof(result)) == sizeof(result)) {
+        total.thumbnails += result.thumbnails;
+        total.frames += result.frames;
+        total.seconds += result.seconds;
+      }
+      close(fds[i]);
+      waitpid(pids[i], NULL, 0);
+    }
+  }
+  start = benchNow() - start;
+
+  printf("%d of %d thumbnails in %.2f s on %d processes (%s): %d frames, %.1f frames/s per process\n",
+         total.thumbnails, batch.n_files, start, processes, render_mode_names[batch.mode],
+         total.frames, total.seconds > 0 ? total.frames / total.seconds : 0.0);
+
+  return total.thumbnails == batch.n_files ? 0 : 1;
+}
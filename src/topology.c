@@ -0,0 +1,339 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "topology.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "store.h"
+#include "threads.h"
+#include "vox.h"
+
+/**
+ * Chunks being analysed: a hash table to find the neighbours of a chunk and
+ * the identifier of the first voxel of every word of its bitset
+ */
+struct TTopologyJob {
+  const struct TOccupancy *chunks;
+  int n_chunks;
+  int *table;                 // Index + 1 of the chunk; 0 for empty slots
+  unsigned int table_mask;
+  int *ranks;                 // CHUNK_WORDS per chunk
+  int *neighbours;            // 6 per chunk: -x, +x, -y, +y, -z, +z (-1 if none)
+  int *parent;                // Union-find forest over the voxels
+  long long *faces;           // Exposed faces counted by every slice
+};
+
+static unsigned int hashCoords(int cx, int cy, int cz) {
+  return ((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u) ^ ((unsigned int)cz * 83492791u);
+}
+
+static int findChunk(struct TTopologyJob *job, int cx, int cy, int cz) {
+  unsigned int slot = hashCoords(cx, cy, cz) & job->table_mask;
+
+  while(job->table[slot]) {
+    const struct TOccupancy *chunk = &job->chunks[job->table[slot] - 1];
+    if(chunk->cx == cx && chunk->cy == cy && chunk->cz == cz)
+      return job->table[slot] - 1;
+    slot = (slot + 1) & job->table_mask;
+  }
+
+  return -1;
+}
+
+static int cellSet(const struct TOccupancy *chunk, int cell) {
+  return (chunk->bits[cell >> 6] >> (cell & 63)) & 1;
+}
+
+// Identifier of the voxel of an occupied cell: its rank among all of them
+static int voxelId(struct TTopologyJob *job, int chunk, int cell) {
+  unsigned long long below = job->chunks[chunk].bits[cell >> 6] & ((1ULL << (cell & 63)) - 1);
+  return job->ranks[chunk * CHUNK_WORDS + (cell >> 6)] + __builtin_popcountll(below);
+}
+
+// Lock free union-find: roots are only ever linked to smaller roots with a
+// compare and swap, and paths are halved on the way
+static int findRoot(int *parent, int x) {
+  for(;;) {
+    int p = __atomic_load_n(&parent[x], __ATOMIC_RELAXED), gp;
+    if(p == x)
+      return x;
+    gp = __atomic_load_n(&parent[p], __ATOMIC_RELAXED);
+    if(gp != p)
+      __sync_bool_compare_and_swap(&parent[x], p, gp);
+    x = p;
+  }
+}
+
+static void unite(int *parent, int a, int b) {
+  for(;;) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if(a == b)
+      return;
+    if(a < b) { int t = a; a = b; b = t; }
+    if(__sync_bool_compare_and_swap(&parent[a], a, b))
+      return;
+  }
+}
+
+// The neighbour of a cell in one of the 6 directions, maybe in another chunk
+// - Returns: the cell and its chunk in *chunk; -1 if there's no such chunk
+static int neighbourCell(struct TTopologyJob *job, int *chunk, int cell, int direction) {
+  static const int shift[3] = { 0, CHUNK_BITS, 2 * CHUNK_BITS };
+  int axis = direction >> 1, c = (cell >> shift[axis]) & (CHUNK_SIZE - 1);
+  int step = 1 << shift[axis];
+
+  if(direction & 1) {
+    if(c < CHUNK_SIZE - 1)
+      return cell + step;
+    *chunk = job->neighbours[*chunk * 6 + direction];
+    return cell - (CHUNK_SIZE - 1) * step;
+  }
+  if(c > 0)
+    return cell - step;
+  *chunk = job->neighbours[*chunk * 6 + direction];
+  return cell + (CHUNK_SIZE - 1) * step;
+}
+
+// Unites every voxel with its neighbours towards +x, +y and +z, and counts
+// the faces of the voxels without a neighbour
+static void uniteChunks(void *ctx, int slice, int begin, int end) {
+  struct TTopologyJob *job = (struct TTopologyJob*)ctx;
+  long long faces = 0;
+  int i, w, d;
+
+  for(i = begin; i < end; ++i) {
+    for(w = 0; w < CHUNK_WORDS; ++w) {
+      unsigned long long bits = job->chunks[i].bits[w];
+      while(bits) {
+        int cell = w * 64 + __builtin_ctzll(bits);
+        int id = voxelId(job, i, cell);
+        bits &= bits - 1;
+
+        for(d = 0; d < 6; ++d) {
+          int other = i, neighbour = neighbourCell(job, &other, cell, d);
+
+          if(other < 0 || !cellSet(&job->chunks[other], neighbour))
+            ++faces;
+          else if(d & 1)
+            unite(job->parent, id, voxelId(job, other, neighbour));
+        }
+      }
+    }
+  }
+
+  job->faces[slice] = faces;
+}
+
+void occupancyBounds(const struct TOccupancy *chunk, int min[3], int max[3]) {
+  int w, k;
+
+  for(w = 0; w < CHUNK_WORDS; ++w) {
+    unsigned long long bits = chunk->bits[w];
+    int c[3], lo, hi;
+    unsigned int rows;
+
+    if(!bits)
+      continue;
+
+    // A word holds 4 rows of 16 cells along x, so x comes from their union
+    rows = (bits | bits >> 16 | bits >> 32 | bits >> 48) & 0xFFFF;
+    lo = __builtin_ctz(rows);
+    hi = 31 - __builtin_clz(rows);
+    c[1] = (w * 64) >> CHUNK_BITS & (CHUNK_SIZE - 1);
+    c[2] = (w * 64) >> (2 * CHUNK_BITS);
+
+    c[0] = (chunk->cx << CHUNK_BITS) + lo;
+    if(c[0] < min[0]) min[0] = c[0];
+    c[0] = (chunk->cx << CHUNK_BITS) + hi;
+    if(c[0] > max[0]) max[0] = c[0];
+
+    for(k = 1; k < 3; ++k) {
+      int first = k == 1 ? c[1] + __builtin_ctzll(bits) / 16 : c[2];
+      int last = k == 1 ? c[1] + (63 - __builtin_clzll(bits)) / 16 : c[2];
+      int base = (k == 1 ? chunk->cy : chunk->cz) << CHUNK_BITS;
+      if(base + first < min[k]) min[k] = base + first;
+      if(base + last > max[k]) max[k] = base + last;
+    }
+  }
+}
+
+int analyseTopology(const struct TOccupancy *chunks, int n, struct TTopology *out) {
+  static const int directions[6][3] = { {-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1} };
+  struct TTopologyJob job;
+  unsigned int size = 1;
+  unsigned char *grounded = NULL;
+  int *sizes = NULL;
+  int i, w, d, id, total = 0, result = -1;
+
+  memset(out, 0, sizeof(*out));
+  out->min[0] = out->min[1] = out->min[2] = 1 << 30;
+  out->max[0] = out->max[1] = out->max[2] = -(1 << 30);
+
+  memset(&job, 0, sizeof(job));
+  job.chunks = chunks;
+  job.n_chunks = n;
+  while(size < 2u * (n > 0 ? n : 1))
+    size <<= 1;
+  job.table_mask = size - 1;
+  job.table = (int*)calloc(size, sizeof(int));
+  job.ranks = (int*)malloc(sizeof(int) * CHUNK_WORDS * (n > 0 ? n : 1));
+  job.neighbours = (int*)malloc(sizeof(int) * 6 * (n > 0 ? n : 1));
+  job.faces = (long long*)calloc(threadCount(), sizeof(long long));
+  if(!job.table || !job.ranks || !job.neighbours || !job.faces)
+    goto done;
+
+  // Identifiers of the voxels: their order in the chunks
+  for(i = 0; i < n; ++i) {
+    unsigned int slot = hashCoords(chunks[i].cx, chunks[i].cy, chunks[i].cz) & job.table_mask;
+    while(job.table[slot])
+      slot = (slot + 1) & job.table_mask;
+    job.table[slot] = i + 1;
+
+    for(w = 0; w < CHUNK_WORDS; ++w) {
+      job.ranks[i * CHUNK_WORDS + w] = total;
+      total += __builtin_popcountll(chunks[i].bits[w]);
+    }
+    occupancyBounds(&chunks[i], out->min, out->max);
+  }
+  for(i = 0; i < n; ++i)
+    for(d = 0; d < 6; ++d)
+      job.neighbours[i * 6 + d] = findChunk(&job, chunks[i].cx + directions[d][0],
+                                            chunks[i].cy + directions[d][1],
+                                            chunks[i].cz + directions[d][2]);
+
+  job.parent = (int*)malloc(sizeof(int) * (total > 0 ? total : 1));
+  sizes = (int*)calloc(total > 0 ? total : 1, sizeof(int));
+  grounded = (unsigned char*)calloc(total > 0 ? total : 1, 1);
+  if(!job.parent || !sizes || !grounded)
+    goto done;
+  for(i = 0; i < total; ++i)
+    job.parent[i] = i;
+
+  parallelFor(n, uniteChunks, &job);
+  for(i = 0; i < threadCount(); ++i)
+    out->faces += job.faces[i];
+
+  // Size of every component and whether any of its voxels is on the canvas
+  for(i = 0, id = 0; i < n; ++i) {
+    for(w = 0; w < CHUNK_WORDS; ++w) {
+      unsigned long long bits = chunks[i].bits[w];
+      while(bits) {
+        int cell = w * 64 + __builtin_ctzll(bits);
+        int root = findRoot(job.parent, id++);
+        bits &= bits - 1;
+
+        sizes[root]++;
+        if((chunks[i].cz << CHUNK_BITS) + (cell >> (2 * CHUNK_BITS)) <= 0)
+          grounded[root] = 1;
+      }
+    }
+  }
+
+  out->voxels = total;
+  for(i = 0; i < total; ++i) {
+    if(job.parent[i] != i)
+      continue;
+
+    out->components++;
+    if(sizes[i] > out->largest)
+      out->largest = sizes[i];
+    if(!grounded[i]) {
+      out->floating += sizes[i];
+      out->floating_components++;
+    }
+  }
+  result = 0;
+
+done:
+  free(grounded);
+  free(sizes);
+  free(job.parent);
+  free(job.faces);
+  free(job.neighbours);
+  free(job.ranks);
+  free(job.table);
+  return result;
+}
+
+int voxelOccupancy(const struct TModelVoxel *voxels, int n, struct TOccupancy **chunks,
+                   unsigned long long **bits) {
+  struct TTopologyJob job;
+  unsigned int size = 1;
+  int i, n_chunks = 0, max_chunks = 0;
+
+  *chunks = NULL;
+  *bits = NULL;
+  memset(&job, 0, sizeof(job));
+  while(size < 2u * (n > 0 ? n : 1))
+    size <<= 1;
+  job.table_mask = size - 1;
+  if(!(job.table = (int*)calloc(size, sizeof(int))))
+    return -1;
+
+  for(i = 0; i < n; ++i) {
+    int cx = voxels[i].x >> CHUNK_BITS, cy = voxels[i].y >> CHUNK_BITS, cz = voxels[i].z >> CHUNK_BITS;
+    int cell = CELL_INDEX(voxels[i].x, voxels[i].y, voxels[i].z), chunk;
+
+    job.chunks = *chunks;
+    if((chunk = findChunk(&job, cx, cy, cz)) < 0) {
+      unsigned int slot = hashCoords(cx, cy, cz) & job.table_mask;
+
+      if(n_chunks == max_chunks) {
+        struct TOccupancy *grown_chunks;
+        unsigned long long *grown_bits;
+
+        max_chunks = max_chunks ? max_chunks * 2 : 64;
+        grown_chunks = (struct TOccupancy*)realloc(*chunks, sizeof(struct TOccupancy) * max_chunks);
+        if(grown_chunks)
+          *chunks = grown_chunks;
+        grown_bits = (unsigned long long*)realloc(*bits, sizeof(unsigned long long) * CHUNK_WORDS * max_chunks);
+        if(grown_bits)
+          *bits = grown_bits;
+        if(!grown_chunks || !grown_bits) {
+          free(*chunks);
+          free(*bits);
+          free(job.table);
+          return -1;
+        }
+        job.chunks = *chunks;
+      }
+
+      chunk = n_chunks++;
+      (*chunks)[chunk].cx = cx;
+      (*chunks)[chunk].cy = cy;
+      (*chunks)[chunk].cz = cz;
+      memset(&(*bits)[chunk * CHUNK_WORDS], 0, sizeof(unsigned long long) * CHUNK_WORDS);
+      while(job.table[slot])
+        slot = (slot + 1) & job.table_mask;
+      job.table[slot] = chunk + 1;
+    }
+
+    (*bits)[chunk * CHUNK_WORDS + (cell >> 6)] |= 1ULL << (cell & 63);
+  }
+
+  // The bitsets may have moved while growing
+  for(i = 0; i < n_chunks; ++i)
+    (*chunks)[i].bits = &(*bits)[i * CHUNK_WORDS];
+
+  free(job.table);
+  return n_chunks;
+}
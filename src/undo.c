@@ -0,0 +1,154 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "undo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "functions.h"
+#include "structs.h"
+
+/**
+ * The history: the saved cells of every step one after another, plus where
+ * each step starts
+ */
+static struct {
+  struct TVoxel *cells;   // Previous state of the changed cells
+  int n_cells, max_cells;
+  int *steps;             // Index in cells of the first cell of every step
+  int n_steps, max_steps;
+  int depth;              // Nesting of undoBegin()
+  int restoring;          // Whether undo() is changing the cells
+  int suspended;          // Nesting of undoSuspend()
+} history;
+
+static void pushStep() {
+  if(history.n_steps == history.max_steps) {
+    history.max_steps = history.max_steps ? history.max_steps * 2 : 64;
+    history.steps = (int*)realloc(history.steps, sizeof(int) * history.max_steps);
+  }
+  history.steps[history.n_steps++] = history.n_cells;
+}
+
+// Drops the oldest steps (but the open one) while the history is too long
+static void trimHistory() {
+  int drop = 0, cells, i;
+
+  while(drop < history.n_steps - 1 &&
+        history.n_cells - history.steps[drop] > UNDO_MAX_CELLS)
+    ++drop;
+  if(drop == 0)
+    return;
+
+  cells = history.steps[drop];
+  memmove(history.cells, &history.cells[cells], sizeof(struct TVoxel) * (history.n_cells - cells));
+  history.n_cells -= cells;
+  for(i = drop; i < history.n_steps; ++i)
+    history.steps[i - drop] = history.steps[i] - cells;
+  history.n_steps -= drop;
+}
+
+void undoBegin() {
+  if(history.depth++ == 0)
+    pushStep();
+}
+
+void undoSave(int x, int y, int z, int colour) {
+  struct TVoxel* cell;
+
+  if(history.restoring || history.suspended)
+    return;
+
+  if(history.depth == 0)
+    pushStep();
+
+  if(history.n_cells == history.max_cells) {
+    history.max_cells = history.max_cells ? history.max_cells * 2 : 1024;
+    history.cells = (struct TVoxel*)realloc(history.cells, sizeof(struct TVoxel) * history.max_cells);
+  }
+
+  cell = &history.cells[history.n_cells++];
+  cell->x = x;
+  cell->y = y;
+  cell->z = z;
+  cell->colour = colour;
+
+  if(history.depth == 0)
+    trimHistory();
+}
+
+void undoEnd() {
+  if(history.depth == 0 || --history.depth > 0)
+    return;
+
+  // Forget empty steps
+  if(history.steps[history.n_steps - 1] == history.n_cells)
+    history.n_steps--;
+  else
+    trimHistory();
+}
+
+void undoSuspend() {
+  history.suspended++;
+}
+
+void undoResume() {
+  if(history.suspended > 0)
+    history.suspended--;
+}
+
+int undo() {
+  int first, n, i, notify;
+
+  if(history.depth > 0 || history.n_steps == 0)
+    return 0;
+
+  first = history.steps[--history.n_steps];
+  n = history.n_cells - first;
+  notify = n <= UNDO_NOTIFY_CELLS;
+
+  // Backwards, so a cell changed twice ends with its oldest state
+  history.restoring = 1;
+  for(i = history.n_cells - 1; i >= first; --i) {
+    struct TVoxel* cell = &history.cells[i];
+    setCell(cell->x, cell->y, cell->z, cell->colour == UNDO_EMPTY ? -1 : cell->colour, notify);
+  }
+  history.restoring = 0;
+  history.n_cells = first;
+
+  if(!notify)
+    modelEdited();
+  else
+    n_colours = countColours();
+
+  return n;
+}
+
+void undoClear() {
+  // The open step would be lost, and the rest of it saved step by step
+  if(history.depth > 0) {
+    fprintf(stderr, "The history can't be cleared while a step is open.\n");
+    return;
+  }
+
+  free(history.cells);
+  free(history.steps);
+  memset(&history, 0, sizeof(history));
+}
@@ -0,0 +1,833 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "vox.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "colours.h"
+#include "palette.h"
+#include "threads.h"
+
+// Index of a parsed voxel; sorted to find the repeated cells
+struct TVoxEntry {
+  struct TModelVoxel* voxel;
+  int order;
+};
+
+static int compareEntries(const void *a, const void *b) {
+  const struct TVoxEntry *ea = a, *eb = b;
+  const struct TModelVoxel *va = ea->voxel, *vb = eb->voxel;
+
+  if(va->x != vb->x) return va->x < vb->x ? -1 : 1;
+  if(va->y != vb->y) return va->y < vb->y ? -1 : 1;
+  if(va->z != vb->z) return va->z < vb->z ? -1 : 1;
+  return ea->order - eb->order;
+}
+
+int removeRepeated(struct TModelVoxel *voxels, int n) {
+  struct TVoxEntry *entries;
+  unsigned char *keep;
+  int i, total;
+
+  if(n < 2)
+    return n;
+
+  entries = (struct TVoxEntry*)malloc(sizeof(struct TVoxEntry) * n);
+  keep = (unsigned char*)calloc(n, 1);
+  for(i = 0; i < n; ++i) {
+    entries[i].voxel = &voxels[i];
+    entries[i].order = i;
+  }
+
+  qsort(entries, n, sizeof(struct TVoxEntry), compareEntries);
+  for(i = 0; i < n; ++i) {
+    if(i + 1 < n &&
+       entries[i].voxel->x == entries[i+1].voxel->x &&
+       entries[i].voxel->y == entries[i+1].voxel->y &&
+       entries[i].voxel->z == entries[i+1].voxel->z)
+      continue;
+    keep[entries[i].order] = 1;
+  }
+
+  for(i = 0, total = 0; i < n; ++i)
+    if(keep[i])
+      voxels[total++] = voxels[i];
+
+  free(keep);
+  free(entries);
+  return total;
+}
+
+// Palette of a file: its indices to entries + 1 of colours[]
+static int fileColour(unsigned short **palette, int index, int r, int g, int b) {
+  if(index < 0 || index >= PALETTE_SIZE)
+    return -1;
+
+  if(!*palette && !(*palette = (unsigned short*)calloc(PALETTE_SIZE, sizeof(unsigned short))))
+    return -1;
+  (*palette)[index] = paletteColour(r, g, b) + 1;
+  return 0;
+}
+
+// Colours out of the palette of the file are fixed ones
+// - Returns: the entry of colours[]; -1 if it's unknown
+static int voxelColour(unsigned short *palette, int colour) {
+  if(colour < 0 || colour >= PALETTE_SIZE)
+    return -1;
+  if(palette && palette[colour])
+    return palette[colour] - 1;
+  return colour < COLOURS_LENGTH ? colour : -1;
+}
+
+static int outOfGrid(int c) {
+  return c < SHRT_MIN || c > SHRT_MAX;
+}
+
+static void appendVoxel(struct TModelVoxel **out, int *n, int *max, int colour, int x, int y, int z) {
+  if(*n == *max) {
+    *max = *max ? *max * 2 : 1024;
+    *out = (struct TModelVoxel*)realloc(*out, sizeof(struct TModelVoxel) * *max);
+  }
+  (*out)[*n].colour = colour;
+  (*out)[*n].x = x;
+  (*out)[*n].y = y * (-1);
+  (*out)[*n].z = z;
+  ++*n;
+}
+
+static void reportBad(struct TVoxReport *report, int record) {
+  if(!report)
+    return;
+  if(report->bad++ == 0)
+    report->first_bad = record;
+}
+
+static int parseText(FILE *f, long size, struct TModelVoxel **voxels, int *n_voxels,
+                     volatile int *permille, struct TVoxReport *report) {
+  struct TModelVoxel *out = NULL;
+  unsigned short *palette = NULL;
+  int n = 0, max = 0, line_number = 1;
+  char line[64];
+  int colour, x, y, z, r, g, b;
+
+  for(; fgets(line, 64, f) != NULL; line_number += strchr(line, '\n') != NULL) {
+    switch(line[0]) {
+    case 'p':
+      // Palette entry of the file: its index and RGB colour
+      if(sscanf(&line[2], "%d %d %d %d", &colour, &r, &g, &b) != 4 ||
+         fileColour(&palette, colour, r, g, b) < 0)
+        reportBad(report, line_number);
+      break;
+    case 'v':
+      if(sscanf(&line[2], "%d %d %d %d", &colour, &x, &y, &z) != 4 ||
+         (colour = voxelColour(palette, colour)) < 0) {
+        reportBad(report, line_number);
+        break;
+      }
+
+      if(report && (outOfGrid(x) || outOfGrid(-y) || outOfGrid(z)))
+        report->out_of_grid++;
+      appendVoxel(&out, &n, &max, colour, x, y, z);
+
+      if(permille && size > 0 && (n & 0x3FF) == 0)
+        *permille = (int)(ftell(f) * 1000 / size);
+      break;
+    case '#':
+      // Comment or something; ignore it
+    default:
+      break;
+    }
+  }
+
+  free(palette);
+  if(ferror(f)) {
+    free(out);
+    return -1;
+  }
+
+  *voxels = out;
+  *n_voxels = n;
+  return 0;
+}
+
+static unsigned int readU32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static void writeU32(unsigned char *p, unsigned int v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+// Voxel records read (and written) per fread() call
+#define BINARY_BLOCK 4096
+
+// Palette of a binary or compressed file, right after its magic and version.
+// 'record' counts its entries
+// - Returns: 0 on success; -1 if it's cut short
+static int parsePalette(FILE *f, unsigned short **palette, unsigned int *record, struct TVoxReport *report) {
+  unsigned char header[4], block[BINARY_BLOCK * 5];
+  unsigned int count, done, i;
+  int got;
+
+  if(fread(header, 1, 4, f) != 4)
+    return -1;
+
+  count = readU32(header);
+  for(done = 0; done < count; done += got) {
+    got = fread(block, 5, count - done < BINARY_BLOCK ? count - done : BINARY_BLOCK, f);
+    if(got <= 0)
+      return -1;
+    for(i = 0; i < (unsigned int)got; ++i) {
+      unsigned char *e = &block[i * 5];
+      if(fileColour(palette, e[0] | (e[1] << 8), e[2], e[3], e[4]) < 0)
+        reportBad(report, *record + 1);
+      ++*record;
+    }
+  }
+  return 0;
+}
+
+// The colours out of the fixed ones, as the palette of a binary or compressed file
+static int writePalette(FILE *f, struct TModelVoxel *voxels, int n_voxels) {
+  unsigned char *used = (unsigned char*)calloc(PALETTE_SIZE, 1);
+  unsigned char header[4], block[BINARY_BLOCK * 5];
+  int i, j, n;
+
+  if(!used)
+    return -1;
+
+  for(i = 0, n = 0; i < n_voxels; ++i) {
+    int colour = voxels[i].colour;
+    if(colour >= COLOURS_LENGTH && colour < PALETTE_SIZE && !used[colour]) {
+      used[colour] = 1;
+      ++n;
+    }
+  }
+  writeU32(header, n);
+  fwrite(header, 1, 4, f);
+  for(i = COLOURS_LENGTH, j = 0; i < PALETTE_SIZE; ++i) {
+    if(!used[i])
+      continue;
+
+    block[j*5+0] = i;
+    block[j*5+1] = i >> 8;
+    block[j*5+2] = colours[i].r;
+    block[j*5+3] = colours[i].g;
+    block[j*5+4] = colours[i].b;
+    if(++j == BINARY_BLOCK) {
+      fwrite(block, 5, j, f);
+      j = 0;
+    }
+  }
+  fwrite(block, 5, j, f);
+  free(used);
+  return 0;
+}
+
+static int parseBinary(FILE *f, struct TModelVoxel **voxels, int *n_voxels,
+                       volatile int *permille, struct TVoxReport *report) {
+  unsigned char header[4], block[BINARY_BLOCK * 8];
+  struct TModelVoxel *out = NULL;
+  unsigned short *palette = NULL;
+  unsigned int count, done = 0, i, record = 0;
+  int n = 0, max = 0, colour, got;
+
+  // The voxels, streamed in blocks
+  if(parsePalette(f, &palette, &record, report) == 0 && fread(header, 1, 4, f) == 4) {
+    count = readU32(header);
+    if(count <= INT_MAX && (out = (struct TModelVoxel*)malloc(sizeof(struct TModelVoxel) * (count ? count : 1))))
+      max = count ? count : 1;
+
+    for(done = 0; out && done < count; done += got) {
+      got = fread(block, 8, count - done < BINARY_BLOCK ? count - done : BINARY_BLOCK, f);
+      if(got <= 0)
+        break;
+      for(i = 0; i < (unsigned int)got; ++i) {
+        unsigned char *v = &block[i * 8];
+        ++record;
+        if((colour = voxelColour(palette, v[6] | (v[7] << 8))) < 0) {
+          reportBad(report, record);
+          continue;
+        }
+        appendVoxel(&out, &n, &max, colour,
+                    (short)(v[0] | (v[1] << 8)), (short)(v[2] | (v[3] << 8)), (short)(v[4] | (v[5] << 8)));
+      }
+
+      if(permille && count > 0)
+        *permille = (int)((long long)(done + got) * 1000 / count);
+    }
+  }
+  free(palette);
+  if(ferror(f) || !out || done != count) {
+    if(report && !ferror(f)) {
+      // What was read is still reported
+      report->truncated = 1;
+      *voxels = out;
+      *n_voxels = n;
+      return 0;
+    }
+    free(out);
+    return -1;
+  }
+
+  *voxels = out;
+  *n_voxels = n;
+  return 0;
+}
+
+// Colours of the compressed format fit below the Morton code in a sort key
+#define COMPRESSED_COLOUR_BITS 15
+#define COMPRESSED_COLOUR_MASK ((1ULL << COMPRESSED_COLOUR_BITS) - 1)
+// Bytes of varints read (and written) per fread() call
+#define COMPRESSED_BLOCK 65536
+// Longest varint of a 64-bit value
+#define VARINT_MAX 10
+
+// Spreads the bits of a coordinate to every third bit of a Morton code
+static unsigned long long spreadBits(unsigned int v) {
+  unsigned long long m = v & 0x1FFFFF;
+  m = (m | (m << 32)) & 0x1F00000000FFFFULL;
+  m = (m | (m << 16)) & 0x1F0000FF0000FFULL;
+  m = (m | (m << 8)) & 0x100F00F00F00F00FULL;
+  m = (m | (m << 4)) & 0x10C30C30C30C30C3ULL;
+  m = (m | (m << 2)) & 0x1249249249249249ULL;
+  return m;
+}
+
+// Gathers every third bit of a Morton code, the inverse of spreadBits()
+static unsigned int compactBits(unsigned long long m) {
+  m &= 0x1249249249249249ULL;
+  m = (m ^ (m >> 2)) & 0x10C30C30C30C30C3ULL;
+  m = (m ^ (m >> 4)) & 0x100F00F00F00F00FULL;
+  m = (m ^ (m >> 8)) & 0x1F0000FF0000FFULL;
+  m = (m ^ (m >> 16)) & 0x1F00000000FFFFULL;
+  m = (m ^ (m >> 32)) & 0x1FFFFF;
+  return (unsigned int)m;
+}
+
+unsigned long long voxMorton(int x, int y, int z) {
+  return spreadBits(x - SHRT_MIN) | (spreadBits(y - SHRT_MIN) << 1) | (spreadBits(z - SHRT_MIN) << 2);
+}
+
+void voxMortonCell(unsigned long long code, int *x, int *y, int *z) {
+  *x = (int)compactBits(code) + SHRT_MIN;
+  *y = (int)compactBits(code >> 1) + SHRT_MIN;
+  *z = (int)compactBits(code >> 2) + SHRT_MIN;
+}
+
+/**
+ * Varints of a compressed file or a patch, buffered in blocks
+ */
+struct TVarintStream {
+  FILE *f;
+  unsigned char block[COMPRESSED_BLOCK];
+  size_t pos, size;
+};
+
+static void putVarint(struct TVarintStream *s, unsigned long long v) {
+  if(s->pos > COMPRESSED_BLOCK - VARINT_MAX) {
+    fwrite(s->block, 1, s->pos, s->f);
+    s->pos = 0;
+  }
+  for(; v >= 0x80; v >>= 7)
+    s->block[s->pos++] = (unsigned char)(v | 0x80);
+  s->block[s->pos++] = (unsigned char)v;
+}
+
+// - Returns: 0 on success; -1 if the file ends first or the varint is too long
+static int getVarint(struct TVarintStream *s, unsigned long long *v) {
+  unsigned long long value = 0;
+  int shift;
+
+  // Keeps at least a whole varint in the block while the file lasts
+  if(s->size - s->pos < VARINT_MAX && !feof(s->f) && !ferror(s->f)) {
+    memmove(s->block, &s->block[s->pos], s->size - s->pos);
+    s->size -= s->pos;
+    s->pos = 0;
+    s->size += fread(&s->block[s->size], 1, COMPRESSED_BLOCK - s->size, s->f);
+  }
+
+  for(shift = 0; s->pos < s->size && shift < 64; shift += 7) {
+    unsigned char byte = s->block[s->pos++];
+    value |= (unsigned long long)(byte & 0x7F) << shift;
+    if(!(byte & 0x80)) {
+      *v = value;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int parseCompressed(FILE *f, struct TModelVoxel **voxels, int *n_voxels,
+                           volatile int *permille, struct TVoxReport *report) {
+  struct TVarintStream *s = (struct TVarintStream*)malloc(sizeof(struct TVarintStream));
+  struct TModelVoxel *out = NULL;
+  unsigned short *palette = NULL;
+  unsigned long long value, spans, length, code = 0;
+  unsigned char header[10];
+  unsigned int count = 0, record = 0;
+  int n = 0, read = 0, origin[3], colour, failed = 1;
+
+  if(!s)
+    return -1;
+  s->f = f;
+  s->pos = s->size = 0;
+
+  if(parsePalette(f, &palette, &record, report) == 0 && fread(header, 1, 10, f) == 10) {
+    count = readU32(header);
+    origin[0] = (short)(header[4] | (header[5] << 8));
+    origin[1] = (short)(header[6] | (header[7] << 8));
+    origin[2] = (short)(header[8] | (header[9] << 8));
+    if(count <= INT_MAX)
+      out = (struct TModelVoxel*)malloc(sizeof(struct TModelVoxel) * (count ? count : 1));
+    failed = !out;
+  }
+
+  // Colour runs until every voxel is read
+  while(!failed && (unsigned int)read < count) {
+    if(getVarint(s, &value) < 0 || getVarint(s, &spans) < 0) {
+      failed = 1;
+      break;
+    }
+    colour = value < PALETTE_SIZE ? voxelColour(palette, (int)value) : -1;
+
+    for(; spans > 0; --spans) {
+      if(getVarint(s, &value) < 0 || getVarint(s, &length) < 0 || length >= count - read) {
+        failed = 1;
+        break;
+      }
+      for(code += value, ++length; length > 0; --length, ++code) {
+        int x = origin[0] + (int)compactBits(code);
+        int y = origin[1] + (int)compactBits(code >> 1);
+        int z = origin[2] + (int)compactBits(code >> 2);
+
+        ++read;
+        if(colour < 0 || outOfGrid(x) || outOfGrid(y) || outOfGrid(z)) {
+          reportBad(report, read);
+          continue;
+        }
+        out[n].colour = colour;
+        out[n].x = x;
+        out[n].y = -y;
+        out[n].z = z;
+        ++n;
+      }
+    }
+
+    if(permille && count > 0)
+      *permille = (int)((long long)read * 1000 / count);
+  }
+
+  free(palette);
+  free(s);
+  if(ferror(f) || failed) {
+    if(report && out && !ferror(f)) {
+      // What was read is still reported
+      report->truncated = 1;
+      *voxels = out;
+      *n_voxels = n;
+      return 0;
+    }
+    free(out);
+    return -1;
+  }
+
+  *voxels = out;
+  *n_voxels = n;
+  return 0;
+}
+
+// Reads any format, telling the text one apart by the first byte and the
+// others by their magic
+static int parseVox(FILE *f, long size, struct TModelVoxel **voxels, int *n_voxels,
+                    volatile int *permille, struct TVoxReport *report, enum EVoxFormat *format) {
+  unsigned char header[8];
+  int c = getc(f);
+
+  *voxels = NULL;
+  *n_voxels = 0;
+  *format = VOX_TEXT;
+  if(c == EOF)
+    return ferror(f) ? -1 : 0;
+  ungetc(c, f);
+
+  if(c != (unsigned char)VOX_BINARY_MAGIC[0])
+    return parseText(f, size, voxels, n_voxels, permille, report);
+
+  if(fread(header, 1, 8, f) != 8)
+    return -1;
+  if(memcmp(header, VOX_BINARY_MAGIC, 4) == 0 && readU32(&header[4]) == VOX_BINARY_VERSION) {
+    *format = VOX_BINARY;
+    return parseBinary(f, voxels, n_voxels, permille, report);
+  }
+  if(memcmp(header, VOX_COMPRESSED_MAGIC, 4) == 0 && readU32(&header[4]) == VOX_COMPRESSED_VERSION) {
+    *format = VOX_COMPRESSED;
+    return parseCompressed(f, voxels, n_voxels, permille, report);
+  }
+  return -1;
+}
+
+int readVoxFormat(FILE *f, long size, struct TModelVoxel **voxels, int *n_voxels,
+                  volatile int *permille, enum EVoxFormat *format) {
+  enum EVoxFormat found;
+
+  if(parseVox(f, size, voxels, n_voxels, permille, NULL, &found) < 0)
+    return -1;
+
+  // Compressed files can't repeat cells
+  if(found != VOX_COMPRESSED)
+    *n_voxels = removeRepeated(*voxels, *n_voxels);
+  if(format)
+    *format = found;
+  if(permille)
+    *permille = 1000;
+  return 0;
+}
+
+int readVox(FILE *f, long size, struct TModelVoxel **voxels, int *n_voxels, volatile int *permille) {
+  return readVoxFormat(f, size, voxels, n_voxels, permille, NULL);
+}
+
+int validateVox(FILE *f, struct TVoxReport *report) {
+  struct TModelVoxel *voxels;
+  int n;
+
+  memset(report, 0, sizeof(*report));
+  if(parseVox(f, 0, &voxels, &n, NULL, report, &report->format) < 0)
+    return -1;
+
+  report->voxels = n;
+  report->repeated = n - removeRepeated(voxels, n);
+  free(voxels);
+
+  return report->bad || report->repeated || report->out_of_grid || report->truncated ? 1 : 0;
+}
+
+int writeVox(FILE *f, struct TModelVoxel *voxels, int n_voxels, int n_colours, volatile int *permille) {
+  unsigned char *used = (unsigned char*)calloc(PALETTE_SIZE, 1);
+  int i;
+
+  if(!used)
+    return -1;
+
+  fprintf(f,
+          "# +-----------------------------------------------------------+\n"
+          "# | Augmented Reality Voxel Model exported from ARVoxelEditor |\n"
+          "# +-----------------------------------------------------------+\n"
+          "# * Number of voxels: %d\n"
+          "# * Number of colours: %d\n\n",
+          n_voxels, n_colours);
+
+  // The colours out of the fixed ones go first, as the palette of the file
+  for(i = 0; i < n_voxels; ++i) {
+    int colour = voxels[i].colour;
+    if(colour < COLOURS_LENGTH || colour >= PALETTE_SIZE || used[colour])
+      continue;
+
+    used[colour] = 1;
+    fprintf(f, "p %d %u %u %u\n", colour, colours[colour].r, colours[colour].g, colours[colour].b);
+  }
+  free(used);
+
+  for(i = 0; i < n_voxels; ++i) {
+    struct TModelVoxel* v = &voxels[i];
+
+    fprintf(f, "v %d %d %d %d\n", v->colour, v->x, v->y * (-1), v->z);
+
+    if(permille && (i & 0x3FF) == 0)
+      *permille = (int)((long)i * 1000 / n_voxels);
+  }
+
+  if(permille)
+    *permille = 1000;
+  return ferror(f) ? -1 : 0;
+}
+
+int writeVoxBinary(FILE *f, struct TModelVoxel *voxels, int n_voxels, volatile int *permille) {
+  unsigned char header[8], block[BINARY_BLOCK * 8];
+  int i, j;
+
+  for(i = 0; i < n_voxels; ++i)
+    if(outOfGrid(voxels[i].x) || outOfGrid(-voxels[i].y) || outOfGrid(voxels[i].z))
+      return -1;
+
+  memcpy(header, VOX_BINARY_MAGIC, 4);
+  writeU32(&header[4], VOX_BINARY_VERSION);
+  fwrite(header, 1, 8, f);
+  if(writePalette(f, voxels, n_voxels) < 0)
+    return -1;
+
+  writeU32(header, n_voxels);
+  fwrite(header, 1, 4, f);
+  for(i = 0, j = 0; i < n_voxels; ++i) {
+    struct TModelVoxel* v = &voxels[i];
+    int y = v->y * (-1);
+
+    block[j*8+0] = v->x;
+    block[j*8+1] = v->x >> 8;
+    block[j*8+2] = y;
+    block[j*8+3] = y >> 8;
+    block[j*8+4] = v->z;
+    block[j*8+5] = v->z >> 8;
+    block[j*8+6] = v->colour;
+    block[j*8+7] = v->colour >> 8;
+    if(++j == BINARY_BLOCK) {
+      fwrite(block, 8, j, f);
+      j = 0;
+
+      if(permille)
+        *permille = (int)((long long)i * 1000 / n_voxels);
+    }
+  }
+  fwrite(block, 8, j, f);
+
+  if(permille)
+    *permille = 1000;
+  return ferror(f) ? -1 : 0;
+}
+
+int writeVoxCompressed(FILE *f, struct TModelVoxel *voxels, int n_voxels, volatile int *permille) {
+  struct TVarintStream *s;
+  unsigned long long *keys;
+  unsigned char header[10];
+  int origin[3] = {0, 0, 0}, i, j, k, l, n, spans;
+  unsigned long long code, end;
+
+  for(i = 0; i < n_voxels; ++i) {
+    int c[3] = { voxels[i].x, -voxels[i].y, voxels[i].z };
+    if(outOfGrid(c[0]) || outOfGrid(c[1]) || outOfGrid(c[2]) ||
+       voxels[i].colour < 0 || voxels[i].colour > (int)COMPRESSED_COLOUR_MASK)
+      return -1;
+    for(k = 0; k < 3; ++k)
+      if(i == 0 || c[k] < origin[k])
+        origin[k] = c[k];
+  }
+
+  if(!(keys = (unsigned long long*)malloc(sizeof(unsigned long long) * (n_voxels ? n_voxels : 1))))
+    return -1;
+  if(!(s = (struct TVarintStream*)malloc(sizeof(struct TVarintStream)))) {
+    free(keys);
+    return -1;
+  }
+  s->f = f;
+  s->pos = 0;
+
+  // Sorted by Morton code, with the colour below it
+  for(i = 0; i < n_voxels; ++i) {
+    code = spreadBits(voxels[i].x - origin[0]) | (spreadBits(-voxels[i].y - origin[1]) << 1) |
+           (spreadBits(voxels[i].z - origin[2]) << 2);
+    keys[i] = (code << COMPRESSED_COLOUR_BITS) | voxels[i].colour;
+  }
+  parallelSortKeys(keys, n_voxels);
+  for(i = 0, n = 0; i < n_voxels; ++i) {
+    if(n > 0 && keys[i] >> COMPRESSED_COLOUR_BITS == keys[n-1] >> COMPRESSED_COLOUR_BITS)
+      --n;
+    keys[n++] = keys[i];
+  }
+
+  memcpy(header, VOX_COMPRESSED_MAGIC, 4);
+  writeU32(&header[4], VOX_COMPRESSED_VERSION);
+  fwrite(header, 1, 8, f);
+  if(writePalette(f, voxels, n_voxels) < 0) {
+    free(s);
+    free(keys);
+    return -1;
+  }
+
+  writeU32(header, n);
+  for(k = 0; k < 3; ++k) {
+    header[4+k*2] = origin[k];
+    header[5+k*2] = origin[k] >> 8;
+  }
+  fwrite(header, 1, 10, f);
+
+  for(i = 0, end = 0; i < n; i = j) {
+    int colour = keys[i] & COMPRESSED_COLOUR_MASK;
+
+    // The run of this colour, counting its spans first
+    for(j = i, spans = 0; j < n && (int)(keys[j] & COMPRESSED_COLOUR_MASK) == colour; ++j)
+      if(j == i || keys[j] >> COMPRESSED_COLOUR_BITS != (keys[j-1] >> COMPRESSED_COLOUR_BITS) + 1)
+        ++spans;
+    putVarint(s, colour);
+    putVarint(s, spans);
+
+    for(k = i; k < j; k = l) {
+      code = keys[k] >> COMPRESSED_COLOUR_BITS;
+      for(l = k + 1; l < j && keys[l] >> COMPRESSED_COLOUR_BITS == code + (l - k); ++l);
+      putVarint(s, code - end);
+      putVarint(s, l - k - 1);
+      end = code + (l - k);
+    }
+
+    if(permille && n > 0)
+      *permille = (int)((long long)j * 1000 / n);
+  }
+  fwrite(s->block, 1, s->pos, f);
+
+  free(s);
+  free(keys);
+  if(permille)
+    *permille = 1000;
+  return ferror(f) ? -1 : 0;
+}
+
+int writeVoxFormat(FILE *f, enum EVoxFormat format, struct TModelVoxel *voxels, int n_voxels,
+                   int n_colours, volatile int *permille) {
+  switch(format) {
+  case VOX_BINARY: return writeVoxBinary(f, voxels, n_voxels, permille);
+  case VOX_COMPRESSED: return writeVoxCompressed(f, voxels, n_voxels, permille);
+  default: return writeVox(f, voxels, n_voxels, n_colours, permille);
+  }
+}
+
+static int hasExtension(const char *filename, const char *extension) {
+  size_t len = strlen(filename), ext = strlen(extension);
+  return len >= ext && strcasecmp(filename + len - ext, extension) == 0;
+}
+
+enum EVoxFormat voxFormat(const char *filename) {
+  if(hasExtension(filename, VOX_BINARY_EXTENSION))
+    return VOX_BINARY;
+  if(hasExtension(filename, VOX_COMPRESSED_EXTENSION))
+    return VOX_COMPRESSED;
+  return VOX_TEXT;
+}
+
+const char* voxExtension(enum EVoxFormat format) {
+  switch(format) {
+  case VOX_BINARY: return VOX_BINARY_EXTENSION;
+  case VOX_COMPRESSED: return VOX_COMPRESSED_EXTENSION;
+  default: return ".vox";
+  }
+}
+
+int writeVoxPatch(FILE *f, struct TVoxEdit *edits, int n_edits) {
+  struct TModelVoxel *painted;
+  struct TVarintStream *s;
+  unsigned char header[8];
+  unsigned long long code, last = 0;
+  int i, n;
+
+  // Only the colours painted go in the palette
+  if(!(painted = (struct TModelVoxel*)malloc(sizeof(struct TModelVoxel) * (n_edits ? n_edits : 1))))
+    return -1;
+  for(i = 0, n = 0; i < n_edits; ++i) {
+    struct TModelVoxel *v = &edits[i].voxel;
+    if(outOfGrid(v->x) || outOfGrid(v->y) || outOfGrid(v->z) ||
+       (code = voxMorton(v->x, v->y, v->z)) < last || (i > 0 && code == last) ||
+       (edits[i].edit != VOX_EDIT_REMOVE && (v->colour < 0 || v->colour >= PALETTE_SIZE))) {
+      free(painted);
+      return -1;
+    }
+    last = code;
+    if(edits[i].edit != VOX_EDIT_REMOVE)
+      painted[n++] = *v;
+  }
+
+  if(!(s = (struct TVarintStream*)malloc(sizeof(struct TVarintStream)))) {
+    free(painted);
+    return -1;
+  }
+  s->f = f;
+  s->pos = 0;
+
+  memcpy(header, VOX_PATCH_MAGIC, 4);
+  writeU32(&header[4], VOX_PATCH_VERSION);
+  fwrite(header, 1, 8, f);
+  if(writePalette(f, painted, n) < 0) {
+    free(s);
+    free(painted);
+    return -1;
+  }
+  free(painted);
+
+  writeU32(header, n_edits);
+  fwrite(header, 1, 4, f);
+  for(i = 0, last = 0; i < n_edits; ++i) {
+    struct TModelVoxel *v = &edits[i].voxel;
+
+    code = voxMorton(v->x, v->y, v->z);
+    putVarint(s, (code - last) << 2 | edits[i].edit);
+    if(edits[i].edit != VOX_EDIT_REMOVE)
+      putVarint(s, v->colour);
+    last = code;
+  }
+  fwrite(s->block, 1, s->pos, f);
+
+  free(s);
+  return ferror(f) ? -1 : 0;
+}
+
+int readVoxPatch(FILE *f, struct TVoxEdit **edits, int *n_edits) {
+  struct TVarintStream *s = (struct TVarintStream*)malloc(sizeof(struct TVarintStream));
+  struct TVoxEdit *out = NULL;
+  unsigned short *palette = NULL;
+  unsigned long long value, colour, code = 0;
+  unsigned char header[8];
+  unsigned int count = 0, i = 0, record = 0;
+  struct TVoxReport report;
+
+  if(!s)
+    return -1;
+  s->f = f;
+  s->pos = s->size = 0;
+
+  // Unknown colours make it malformed, as they're found in the report
+  memset(&report, 0, sizeof(report));
+  if(fread(header, 1, 8, f) == 8 && memcmp(header, VOX_PATCH_MAGIC, 4) == 0 &&
+     readU32(&header[4]) == VOX_PATCH_VERSION && parsePalette(f, &palette, &record, &report) == 0 &&
+     report.bad == 0 && fread(header, 1, 4, f) == 4) {
+    count = readU32(header);
+    if(count <= INT_MAX)
+      out = (struct TVoxEdit*)malloc(sizeof(struct TVoxEdit) * (count ? count : 1));
+  }
+
+  for(i = 0; out && i < count; ++i) {
+    struct TVoxEdit *e = &out[i];
+
+    if(getVarint(s, &value) < 0 || (value & 3) >= VOX_EDITS_LENGTH ||
+       (value >> 2) > (1ULL << 48) || (i > 0 && (value >> 2) == 0))
+      break;
+    code += value >> 2;
+    if(code >= 1ULL << 48)
+      break;
+    e->edit = (enum EVoxEdit)(value & 3);
+    voxMortonCell(code, &e->voxel.x, &e->voxel.y, &e->voxel.z);
+
+    e->voxel.colour = 0;
+    if(e->edit != VOX_EDIT_REMOVE &&
+       (getVarint(s, &colour) < 0 || colour >= PALETTE_SIZE ||
+        (e->voxel.colour = voxelColour(palette, (int)colour)) < 0))
+      break;
+  }
+
+  free(palette);
+  free(s);
+  if(!out || i != count || ferror(f)) {
+    free(out);
+    return -1;
+  }
+
+  *edits = out;
+  *n_edits = count;
+  return 0;
+}
@@ -0,0 +1,703 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Batch processing of VOX files without camera nor display, built on the
+ * voxel core only (no GL or ARToolKit):
+ *
+ *   voxcli convert [-t|-b|-z] [-o dir] <file|dir>...
+ *   voxcli stats <file|dir>...
+ *   voxcli validate <file|dir>...
+ *   voxcli resample <old_size> <new_size> [-o dir] <file|dir>...
+ *   voxcli merge -o <output> <file|dir>...
+ *   voxcli bench <file|dir>...
+ *   voxcli diff -o <patch> <from> <to>
+ *   voxcli patch <patch> [-o dir] <file|dir>...
+ *
+ * Every command takes -j threads. Files are processed concurrently on the
+ * thread pool, streamed in and out, and reported in the order given. A
+ * single "-" reads from stdin and writes to stdout.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "colours.h"
+#include "diff.h"
+#include "resample.h"
+#include "threads.h"
+#include "topology.h"
+#include "vox.h"
+
+enum ECommand {
+  COMMAND_CONVERT,
+  COMMAND_STATS,
+  COMMAND_VALIDATE,
+  COMMAND_RESAMPLE,
+  COMMAND_MERGE,
+  COMMAND_BENCH,
+  COMMAND_DIFF,
+  COMMAND_PATCH,
+  COMMANDS_LENGTH
+};
+
+static const char *command_names[COMMANDS_LENGTH] = {
+  "convert", "stats", "validate", "resample", "merge", "bench", "diff", "patch"
+};
+
+static const char *format_names[VOX_FORMATS_LENGTH] = {
+  "text", "binary", "compressed"
+};
+
+/**
+ * Options of the batch
+ */
+struct TBatch {
+  enum ECommand command;
+  int format;               // Output format of convert: -1 the other one, or an EVoxFormat
+  int old_size, new_size;   // Voxel sizes of resample
+  struct TVoxEdit *edits;   // Patch applied by patch
+  int n_edits;
+  const char *output;       // Output directory (or file of merge and diff); NULL for next to the inputs
+  char **files;
+  int n_files, max_files;
+};
+
+/**
+ * A file of the batch and what was done with it
+ */
+struct TFile {
+  struct TBatch *batch;
+  const char *path;
+  int failed;
+  char report[2560];        // Printed once every file is done
+  struct TModelVoxel *model;  // Kept for merge and diff
+  int n_model;
+};
+
+static void addFile(struct TBatch* batch, const char *path) {
+  if(batch->n_files == batch->max_files) {
+    batch->max_files = batch->max_files ? batch->max_files * 2 : 64;
+    batch->files = (char**)realloc(batch->files, sizeof(char*) * batch->max_files);
+  }
+  batch->files[batch->n_files++] = strdup(path);
+}
+
+static int hasExtension(const char *name, const char *extension) {
+  size_t length = strlen(name), ext_length = strlen(extension);
+  return length > ext_length && strcmp(&name[length - ext_length], extension) == 0;
+}
+
+static int compareNames(const void *a, const void *b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Adds the VOX files of a directory, or the path itself if it isn't one
+static void addPath(struct TBatch* batch, const char *path) {
+  struct dirent *entry;
+  char file[1024];
+  DIR *dir;
+  int first = batch->n_files;
+
+  if(!(dir = opendir(path))) {
+    addFile(batch, path);
+    return;
+  }
+
+  while((entry = readdir(dir)) != NULL) {
+    if(!hasExtension(entry->d_name, ".vox") && !hasExtension(entry->d_name, VOX_BINARY_EXTENSION) &&
+       !hasExtension(entry->d_name, VOX_COMPRESSED_EXTENSION))
+      continue;
+    snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+    addFile(batch, file);
+  }
+  closedir(dir);
+
+  qsort(&batch->files[first], batch->n_files - first, sizeof(char*), compareNames);
+}
+
+// Name of an output file: the input with 'suffix' before the new extension,
+// in the output directory if any
+static void outputName(struct TBatch* batch, const char *input, const char *suffix,
+                       const char *extension, char *name, size_t size) {
+  const char *base = strrchr(input, '/');
+  char *dot;
+
+  if(batch->output)
+    snprintf(name, size, "%s/%s", batch->output, base ? base + 1 : input);
+  else
+    snprintf(name, size, "%s", input);
+
+  dot = strrchr(name, '.');
+  if(dot && !strchr(dot, '/'))
+    *dot = '\0';
+  snprintf(&name[strlen(name)], size - strlen(name), "%s%s", suffix, extension);
+}
+
+static FILE* openInput(const char *path) {
+  return strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+}
+
+static void closeFile(FILE *f) {
+  if(f != stdin && f != stdout)
+    fclose(f);
+}
+
+static int countModelColours(struct TModelVoxel *model, int n) {
+  unsigned char *used = (unsigned char*)calloc(PALETTE_SIZE, 1);
+  int i, count = 0;
+
+  for(i = 0; used && i < n; ++i) {
+    if(!used[model[i].colour]) {
+      used[model[i].colour] = 1;
+      ++count;
+    }
+  }
+
+  free(used);
+  return count;
+}
+
+// Writes a model to a file (or stdout for "-") in the given format. Files
+// are written aside and renamed over, so a failed write never destroys the
+// file there (e.g., the input of a conversion to its own format)
+static int writeModel(const char *path, struct TModelVoxel *model, int n, enum EVoxFormat format) {
+  char tmp_path[1040];
+  FILE *f;
+  int failed;
+
+  if(strcmp(path, "-") == 0) {
+    failed = writeVoxFormat(stdout, format, model, n, countModelColours(model, n), NULL) < 0;
+    return failed || fflush(stdout) != 0 ? -1 : 0;
+  }
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  if(!(f=fopen(tmp_path, "wb")))
+    return -1;
+
+  failed = writeVoxFormat(f, format, model, n, countModelColours(model, n), NULL) < 0;
+  failed |= fclose(f) != 0;
+  if(failed || rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    return -1;
+  }
+  return 0;
+}
+
+// Reads a whole model
+// - Returns: 0 on success; -1 (with the reason in the report) on error
+static int readModel(struct TFile *file, enum EVoxFormat *format, struct TModelVoxel **model, int *n) {
+  FILE *f = openInput(file->path);
+
+  if(!f) {
+    snprintf(file->report, sizeof(file->report), "%s: can't be opened", file->path);
+    return -1;
+  }
+
+  if(readVoxFormat(f, 0, model, n, NULL, format) < 0) {
+    snprintf(file->report, sizeof(file->report), "%s: read error", file->path);
+    closeFile(f);
+    return -1;
+  }
+
+  closeFile(f);
+  return 0;
+}
+
+static void convertFile(struct TFile *file) {
+  struct TModelVoxel *model;
+  enum EVoxFormat format;
+  char name[1024];
+  int n;
+  double start = benchNow();
+
+  if(readModel(file, &format, &model, &n) < 0) {
+    file->failed = 1;
+    return;
+  }
+
+  if(file->batch->format >= 0)
+    format = file->batch->format;
+  else
+    format = format == VOX_TEXT ? VOX_BINARY : VOX_TEXT;
+  if(strcmp(file->path, "-") == 0)
+    snprintf(name, sizeof(name), "-");
+  else
+    outputName(file->batch, file->path, "", voxExtension(format), name, sizeof(name));
+
+  if(writeModel(name, model, n, format) < 0) {
+    snprintf(file->report, sizeof(file->report), "%s: error writing %s", file->path, name);
+    file->failed = 1;
+  }
+  else {
+    snprintf(file->report, sizeof(file->report), "%s -> %s: %d voxels in %.1f ms",
+             file->path, name, n, (benchNow() - start) * 1000.0);
+  }
+  free(model);
+}
+
+static void statsFile(struct TFile *file) {
+  struct TModelVoxel *model;
+  struct TOccupancy *occupancy;
+  unsigned long long *bits;
+  struct TTopology topology;
+  int min[3] = {0, 0, 0}, max[3] = {0, 0, 0};
+  enum EVoxFormat format;
+  int n, i, len, n_occupancy;
+  double start = benchNow();
+
+  if(readModel(file, &format, &model, &n) < 0) {
+    file->failed = 1;
+    return;
+  }
+
+  for(i = 0; i < n; ++i) {
+    int c[3] = { model[i].x, -model[i].y, model[i].z }, k;
+    for(k = 0; k < 3; ++k) {
+      if(i == 0 || c[k] < min[k]) min[k] = c[k];
+      if(i == 0 || c[k] > max[k]) max[k] = c[k];
+    }
+  }
+
+  len = snprintf(file->report, sizeof(file->report),
+                 "%s: %s, %d voxels, %d colours, bounds (%d, %d, %d)-(%d, %d, %d) = %dx%dx%d",
+                 file->path, format_names[format], n, countModelColours(model, n),
+                 min[0], min[1], min[2], max[0], max[1], max[2],
+                 n ? max[0] - min[0] + 1 : 0, n ? max[1] - min[1] + 1 : 0, n ? max[2] - min[2] + 1 : 0);
+
+  n_occupancy = voxelOccupancy(model, n, &occupancy, &bits);
+  if(n_occupancy >= 0 && analyseTopology(occupancy, n_occupancy, &topology) == 0)
+    len += snprintf(&file->report[len], sizeof(file->report) - len,
+                    ", %d components (largest %d voxels), %d floating voxels in %d components, %lld faces",
+                    topology.components, topology.largest, topology.floating,
+                    topology.floating_components, topology.faces);
+  else
+    len += snprintf(&file->report[len], sizeof(file->report) - len, ", no memory for the topology");
+  if(n_occupancy >= 0) {
+    free(occupancy);
+    free(bits);
+  }
+
+  snprintf(&file->report[len], sizeof(file->report) - len, ", analysed in %.1f ms",
+           (benchNow() - start) * 1000.0);
+  free(model);
+}
+
+static void validateFile(struct TFile *file) {
+  struct TVoxReport report;
+  FILE *f = openInput(file->path);
+  int result;
+
+  if(!f) {
+    snprintf(file->report, sizeof(file->report), "%s: can't be opened", file->path);
+    file->failed = 1;
+    return;
+  }
+
+  result = validateVox(f, &report);
+  closeFile(f);
+
+  if(result < 0)
+    snprintf(file->report, sizeof(file->report), "%s: read error", file->path);
+  else if(result == 0)
+    snprintf(file->report, sizeof(file->report), "%s: valid (%s, %d voxels)",
+             file->path, format_names[report.format], report.voxels);
+  else {
+    int len = snprintf(file->report, sizeof(file->report), "%s: INVALID (%s, %d voxels)",
+                       file->path, format_names[report.format], report.voxels);
+    if(report.bad)
+      len += snprintf(&file->report[len], sizeof(file->report) - len, ", %d bad records (first at %s %d)",
+                      report.bad, report.format == VOX_TEXT ? "line" :
+                      report.format == VOX_BINARY ? "record" : "voxel", report.first_bad);
+    if(report.repeated)
+      len += snprintf(&file->report[len], sizeof(file->report) - len, ", %d repeated cells", report.repeated);
+    if(report.out_of_grid)
+      len += snprintf(&file->report[len], sizeof(file->report) - len, ", %d out of the grid", report.out_of_grid);
+    if(report.truncated)
+      snprintf(&file->report[len], sizeof(file->report) - len, ", truncated");
+  }
+  file->failed = result != 0;
+}
+
+static void resampleFile(struct TFile *file) {
+  struct TModelVoxel *model, *resampled;
+  enum EVoxFormat format;
+  char name[1024], suffix[32];
+  int n, m;
+  double start = benchNow();
+
+  if(readModel(file, &format, &model, &n) < 0) {
+    file->failed = 1;
+    return;
+  }
+
+  m = resampleModel(model, n, file->batch->old_size, file->batch->new_size, &resampled);
+  free(model);
+  if(m < 0) {
+    snprintf(file->report, sizeof(file->report), "%s: the resampled model doesn't fit the grid", file->path);
+    file->failed = 1;
+    return;
+  }
+
+  snprintf(suffix, sizeof(suffix), "_%d", file->batch->new_size);
+  if(strcmp(file->path, "-") == 0)
+    snprintf(name, sizeof(name), "-");
+  else
+    outputName(file->batch, file->path, suffix, voxExtension(format), name, sizeof(name));
+
+  if(writeModel(name, resampled, m, format) < 0) {
+    snprintf(file->report, sizeof(file->report), "%s: error writing %s", file->path, name);
+    file->failed = 1;
+  }
+  else {
+    snprintf(file->report, sizeof(file->report), "%s -> %s: %d -> %d voxels in %.1f ms",
+             file->path, name, n, m, (benchNow() - start) * 1000.0);
+  }
+  free(resampled);
+}
+
+static void patchFile(struct TFile *file) {
+  struct TModelVoxel *model, *patched;
+  enum EVoxFormat format;
+  char name[1024];
+  int n, m, conflicts;
+  double start = benchNow();
+
+  if(readModel(file, &format, &model, &n) < 0) {
+    file->failed = 1;
+    return;
+  }
+
+  m = patchModel(model, n, file->batch->edits, file->batch->n_edits, &patched, &conflicts);
+  free(model);
+  if(m < 0) {
+    snprintf(file->report, sizeof(file->report), "%s: not enough memory to patch it", file->path);
+    file->failed = 1;
+    return;
+  }
+
+  if(strcmp(file->path, "-") == 0)
+    snprintf(name, sizeof(name), "-");
+  else
+    outputName(file->batch, file->path, "_patched", voxExtension(format), name, sizeof(name));
+
+  if(writeModel(name, patched, m, format) < 0) {
+    snprintf(file->report, sizeof(file->report), "%s: error writing %s", file->path, name);
+    file->failed = 1;
+  }
+  else {
+    snprintf(file->report, sizeof(file->report), "%s -> %s: %d -> %d voxels, %d conflicting edits in %.1f ms",
+             file->path, name, n, m, conflicts, (benchNow() - start) * 1000.0);
+  }
+  free(patched);
+}
+
+// Merge and diff only read the files in parallel; they're combined in order
+static void loadFile(struct TFile *file) {
+  enum EVoxFormat format;
+
+  if(readModel(file, &format, &file->model, &file->n_model) < 0)
+    file->failed = 1;
+  else
+    snprintf(file->report, sizeof(file->report), "%s: %d voxels", file->path, file->n_model);
+}
+
+// Decodes of every format timed by bench, keeping the best
+#define BENCH_RUNS 3
+
+// Writes the model in every format in memory and times reading it back
+static void benchFile(struct TFile *file) {
+  struct TModelVoxel *model, *decoded;
+  enum EVoxFormat format;
+  char *data[VOX_FORMATS_LENGTH];
+  size_t size[VOX_FORMATS_LENGTH];
+  int n, m, i, run, len;
+
+  if(readModel(file, &format, &model, &n) < 0) {
+    file->failed = 1;
+    return;
+  }
+
+  len = snprintf(file->report, sizeof(file->report), "%s: %d voxels", file->path, n);
+  for(i = 0; i < VOX_FORMATS_LENGTH; ++i) {
+    FILE *f = open_memstream(&data[i], &size[i]);
+    double best = 0.0;
+
+    if(!f || writeVoxFormat(f, i, model, n, countModelColours(model, n), NULL) < 0 || fclose(f) != 0) {
+      len += snprintf(&file->report[len], sizeof(file->report) - len, "\n  %-10s can't be written",
+                      format_names[i]);
+      file->failed = 1;
+      data[i] = NULL;
+      continue;
+    }
+
+    for(run = 0; run < BENCH_RUNS; ++run) {
+      double start = benchNow(), elapsed;
+
+      if(!(f = fmemopen(data[i], size[i], "rb")))
+        break;
+      if(readVox(f, 0, &decoded, &m, NULL) < 0) {
+        fclose(f);
+        break;
+      }
+      elapsed = benchNow() - start;
+      fclose(f);
+      free(decoded);
+      if(m != n)
+        break;
+      if(run == 0 || elapsed < best)
+        best = elapsed;
+    }
+
+    if(run < BENCH_RUNS) {
+      len += snprintf(&file->report[len], sizeof(file->report) - len, "\n  %-10s can't be read back",
+                      format_names[i]);
+      file->failed = 1;
+    }
+    else {
+      len += snprintf(&file->report[len], sizeof(file->report) - len,
+                      "\n  %-10s %10lu bytes (%5.2f per voxel, %5.1fx smaller than text), "
+                      "decoded in %7.1f ms: %7.1f MB/s, %6.1f Mvoxels/s",
+                      format_names[i], (unsigned long)size[i], n ? (double)size[i] / n : 0.0,
+                      data[VOX_TEXT] && size[i] ? (double)size[VOX_TEXT] / size[i] : 0.0, best * 1000.0,
+                      best > 0.0 ? size[i] / best / 1e6 : 0.0, best > 0.0 ? n / best / 1e6 : 0.0);
+    }
+  }
+
+  for(i = 0; i < VOX_FORMATS_LENGTH; ++i)
+    free(data[i]);
+  free(model);
+}
+
+static void runFile(void *arg) {
+  struct TFile *file = (struct TFile*)arg;
+
+  switch(file->batch->command) {
+  case COMMAND_CONVERT: convertFile(file); break;
+  case COMMAND_STATS: statsFile(file); break;
+  case COMMAND_VALIDATE: validateFile(file); break;
+  case COMMAND_RESAMPLE: resampleFile(file); break;
+  case COMMAND_MERGE: case COMMAND_DIFF: loadFile(file); break;
+  case COMMAND_PATCH: patchFile(file); break;
+  case COMMAND_BENCH: benchFile(file); break;
+  default: break;
+  }
+}
+
+// Union of the models read, in order: cells repeated keep the colour of the
+// last file holding them
+static int mergeFiles(struct TBatch *batch, struct TFile *files) {
+  struct TModelVoxel *merged;
+  long long total = 0;
+  int i, n;
+
+  for(i = 0; i < batch->n_files; ++i)
+    total += files[i].n_model;
+  if(total > RESAMPLE_MAX_VOXELS ||
+     !(merged = (struct TModelVoxel*)malloc(sizeof(struct TModelVoxel) * (total ? total : 1)))) {
+    fprintf(stderr, "The merged model is too big (%lld voxels).\n", total);
+    return -1;
+  }
+
+  for(i = 0, n = 0; i < batch->n_files; ++i) {
+    memcpy(&merged[n], files[i].model, sizeof(struct TModelVoxel) * files[i].n_model);
+    n += files[i].n_model;
+  }
+  n = removeRepeated(merged, n);
+
+  if(writeModel(batch->output, merged, n, voxFormat(batch->output)) < 0) {
+    fprintf(stderr, "Error writing %s\n", batch->output);
+    free(merged);
+    return -1;
+  }
+
+  fprintf(strcmp(batch->output, "-") == 0 ? stderr : stdout,
+          "%s: %d voxels from %d files\n", batch->output, n, batch->n_files);
+  free(merged);
+  return 0;
+}
+
+// Patch turning the first file read into the second one
+static int writeDiff(struct TBatch *batch, struct TFile *files) {
+  struct TVoxEdit *edits;
+  int counts[VOX_EDITS_LENGTH] = { 0, 0, 0 }, n, i, failed;
+  double start = benchNow();
+  FILE *f;
+
+  if((n = diffModels(files[0].model, files[0].n_model, files[1].model, files[1].n_model, &edits)) < 0) {
+    fprintf(stderr, "Not enough memory to compare the models.\n");
+    return -1;
+  }
+
+  f = strcmp(batch->output, "-") == 0 ? stdout : fopen(batch->output, "wb");
+  failed = !f || writeVoxPatch(f, edits, n) < 0;
+  if(f == stdout)
+    failed |= fflush(f) != 0;
+  else if(f)
+    failed |= fclose(f) != 0;
+  if(failed) {
+    fprintf(stderr, "Error writing %s\n", batch->output);
+    free(edits);
+    return -1;
+  }
+
+  for(i = 0; i < n; ++i)
+    counts[edits[i].edit]++;
+  fprintf(strcmp(batch->output, "-") == 0 ? stderr : stdout,
+          "%s: %d edits (%d added, %d removed, %d recoloured) in %.1f ms\n", batch->output, n,
+          counts[VOX_EDIT_ADD], counts[VOX_EDIT_REMOVE], counts[VOX_EDIT_RECOLOUR],
+          (benchNow() - start) * 1000.0);
+  free(edits);
+  return 0;
+}
+
+// Reads the patch applied by the patch command
+static int readPatch(struct TBatch *batch, const char *path) {
+  FILE *f = fopen(path, "rb");
+  int result;
+
+  if(!f) {
+    fprintf(stderr, "%s can't be opened.\n", path);
+    return -1;
+  }
+
+  if((result = readVoxPatch(f, &batch->edits, &batch->n_edits)) < 0)
+    fprintf(stderr, "%s isn't a valid patch.\n", path);
+  fclose(f);
+  return result;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: voxcli convert [-t|-b|-z] [-o dir] [-j threads] <file|dir>...\n"
+          "       voxcli stats [-j threads] <file|dir>...\n"
+          "       voxcli validate [-j threads] <file|dir>...\n"
+          "       voxcli resample <old_size> <new_size> [-o dir] [-j threads] <file|dir>...\n"
+          "       voxcli merge -o <output> [-j threads] <file|dir>...\n"
+          "       voxcli bench [-j threads] <file|dir>...\n"
+          "       voxcli diff -o <patch> [-j threads] <from> <to>\n"
+          "       voxcli patch <patch> [-o dir] [-j threads] <file|dir>...\n"
+          "Files are written next to the inputs unless -o is given; \"-\" is stdin/stdout.\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  struct TBatch batch = { COMMAND_CONVERT, -1, 0, 0, NULL, 0, NULL, NULL, 0, 0 };
+  struct TFile *files;
+  char threads[16];
+  int failed = 0, i, opt;
+  FILE *out;
+  double start;
+
+  if(argc < 2)
+    usage();
+  for(i = 0; i < COMMANDS_LENGTH && strcmp(argv[1], command_names[i]) != 0; ++i);
+  if(i == COMMANDS_LENGTH)
+    usage();
+  batch.command = i;
+  optind = 2;
+
+  if(batch.command == COMMAND_RESAMPLE) {
+    if(argc < 4 || (batch.old_size = atoi(argv[2])) < 1 || (batch.new_size = atoi(argv[3])) < 1)
+      usage();
+    optind = 4;
+  }
+  else if(batch.command == COMMAND_PATCH) {
+    if(argc < 3)
+      usage();
+    if(readPatch(&batch, argv[2]) < 0)
+      return 1;
+    optind = 3;
+  }
+
+  while((opt = getopt(argc, argv, "tbzo:j:")) != -1) {
+    switch(opt) {
+    case 't': batch.format = VOX_TEXT; break;
+    case 'b': batch.format = VOX_BINARY; break;
+    case 'z': batch.format = VOX_COMPRESSED; break;
+    case 'o': batch.output = optarg; break;
+    case 'j':
+      // The pool reads it when it starts
+      snprintf(threads, sizeof(threads), "%d", atoi(optarg));
+      setenv("ARVE_THREADS", threads, 1);
+      break;
+    default:
+      usage();
+    }
+  }
+  if(optind == argc || ((batch.command == COMMAND_MERGE || batch.command == COMMAND_DIFF) && !batch.output))
+    usage();
+
+  for(i = optind; i < argc; ++i)
+    addPath(&batch, argv[i]);
+  if(batch.command == COMMAND_DIFF && batch.n_files != 2) {
+    fprintf(stderr, "diff compares exactly two files.\n");
+    return 1;
+  }
+
+  // Standard input can't be shared
+  for(i = 0; i < batch.n_files; ++i) {
+    if(strcmp(batch.files[i], "-") == 0 && batch.n_files > 1) {
+      fprintf(stderr, "\"-\" must be the only file.\n");
+      return 1;
+    }
+  }
+
+  start = benchNow();
+  files = (struct TFile*)calloc(batch.n_files, sizeof(struct TFile));
+  for(i = 0; i < batch.n_files; ++i) {
+    files[i].batch = &batch;
+    files[i].path = batch.files[i];
+    spawnTask(runFile, &files[i]);
+  }
+  waitTasks();
+
+  // Reports go to stderr when the model itself goes to stdout
+  out = strcmp(batch.files[0], "-") == 0 && batch.command != COMMAND_STATS &&
+        batch.command != COMMAND_VALIDATE && batch.command != COMMAND_BENCH ? stderr : stdout;
+  if(batch.output && strcmp(batch.output, "-") == 0)
+    out = stderr;
+  for(i = 0; i < batch.n_files; ++i) {
+    fprintf(out, "%s\n", files[i].report);
+    failed += files[i].failed;
+  }
+
+  if(batch.command == COMMAND_MERGE && !failed && mergeFiles(&batch, files) < 0)
+    failed = 1;
+  if(batch.command == COMMAND_DIFF && !failed && writeDiff(&batch, files) < 0)
+    failed = 1;
+
+  fprintf(out,
+          "[bench] %s: %d files (%d failed) in %.1f ms on %d threads\n",
+          command_names[batch.command], batch.n_files, failed, (benchNow() - start) * 1000.0,
+          threadCount());
+
+  for(i = 0; i < batch.n_files; ++i) {
+    free(files[i].model);
+    free(batch.files[i]);
+  }
+  free(files);
+  free(batch.files);
+  free(batch.edits);
+
+  return failed ? 1 : 0;
+}
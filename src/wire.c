@@ -0,0 +1,595 @@
+/* ARVoxelEditor - Augmented Reality Voxel Editor
+ * Copyright (C) 2015 Santiago Sánchez Sobrino
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "wire.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "colours.h"
+#include "palette.h"
+#include "store.h"
+#include "vox.h"
+
+// Bytes of a varint of 64 bits at most
+#define VARINT_MAX_BYTES 10
+
+// Host when an address only gives the port
+#define WIRE_DEFAULT_HOST "127.0.0.1"
+
+static int reserve(struct TWireBuffer *buffer, size_t size) {
+  unsigned char *data;
+  size_t capacity;
+
+  if(buffer->failed)
+    return -1;
+  if(buffer->size + size <= buffer->capacity)
+    return 0;
+
+  capacity = buffer->capacity ? buffer->capacity : 256;
+  while(capacity < buffer->size + size)
+    capacity *= 2;
+  if(!(data = (unsigned char*)realloc(buffer->data, capacity))) {
+    buffer->failed = 1;
+    return -1;
+  }
+
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return 0;
+}
+
+void wirePut(struct TWireBuffer *buffer, const void *data, size_t size) {
+  if(size == 0 || reserve(buffer, size) < 0)
+    return;
+
+  memcpy(&buffer->data[buffer->size], data, size);
+  buffer->size += size;
+}
+
+void wirePutVarint(struct TWireBuffer *buffer, unsigned long long value) {
+  unsigned char *p;
+
+  if(reserve(buffer, VARINT_MAX_BYTES) < 0)
+    return;
+
+  p = &buffer->data[buffer->size];
+  while(value >= 0x80) {
+    *p++ = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = (unsigned char)value;
+  buffer->size = p - buffer->data;
+}
+
+void wirePutSigned(struct TWireBuffer *buffer, long long value) {
+  wirePutVarint(buffer, ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+unsigned long long wireGetVarint(struct TWireReader *in) {
+  unsigned long long value = 0;
+  int shift;
+
+  for(shift = 0; !in->failed && shift < 7 * VARINT_MAX_BYTES; shift += 7) {
+    unsigned char byte;
+
+    if(in->pos >= in->size)
+      break;
+    byte = in->data[in->pos++];
+    value |= (unsigned long long)(byte & 0x7F) << shift;
+    if(!(byte & 0x80))
+      return value;
+  }
+
+  in->failed = 1;
+  return 0;
+}
+
+long long wireGetSigned(struct TWireReader *in) {
+  unsigned long long value = wireGetVarint(in);
+  return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+// Reads a varint that must be in [0, max]
+static int getCount(struct TWireReader *in, int max) {
+  unsigned long long value = wireGetVarint(in);
+
+  if(value > (unsigned long long)max) {
+    in->failed = 1;
+    return 0;
+  }
+  return (int)value;
+}
+
+// Reads a cell or chunk coordinate, which must fit a short
+static int getCoord(struct TWireReader *in) {
+  long long value = wireGetSigned(in);
+
+  if(value < -32768 || value > 32767) {
+    in->failed = 1;
+    return 0;
+  }
+  return (int)value;
+}
+
+void wireReset(struct TWireBuffer *buffer) {
+  buffer->size = 0;
+  buffer->failed = 0;
+}
+
+void wireConsume(struct TWireBuffer *buffer, size_t size) {
+  if(size >= buffer->size) {
+    buffer->size = 0;
+    return;
+  }
+
+  memmove(buffer->data, &buffer->data[size], buffer->size - size);
+  buffer->size -= size;
+}
+
+void wireFree(struct TWireBuffer *buffer) {
+  free(buffer->data);
+  memset(buffer, 0, sizeof(*buffer));
+}
+
+int wireColour(struct TWireColours *table, int colour) {
+  int i;
+
+  // Edits and voxels come in runs of the same colour
+  if(table->last < table->n && table->entries[table->last] == colour)
+    return table->last;
+
+  for(i = 0; i < table->n; ++i)
+    if(table->entries[i] == colour)
+      return table->last = i;
+
+  if(table->n == table->max) {
+    int max = table->max ? table->max * 2 : 16;
+    int *entries = (int*)realloc(table->entries, sizeof(int) * max);
+    if(!entries)
+      return 0;
+    table->entries = entries;
+    table->max = max;
+  }
+
+  table->entries[table->n] = colour;
+  return table->last = table->n++;
+}
+
+static void putColours(struct TWireBuffer *out, const struct TWireColours *table) {
+  int i;
+
+  wirePutVarint(out, table->n);
+  for(i = 0; i < table->n; ++i) {
+    const struct TColour* c = &colours[table->entries[i]];
+    unsigned char rgb[3] = { c->r, c->g, c->b };
+    wirePut(out, rgb, 3);
+  }
+}
+
+// Reads a colour table, returning where its triplets are
+static const unsigned char* getColours(struct TWireReader *in, int *n) {
+  const unsigned char *rgb;
+
+  *n = getCount(in, PALETTE_SIZE);
+  if(in->failed || in->size - in->pos < (size_t)*n * 3) {
+    in->failed = 1;
+    return NULL;
+  }
+
+  rgb = &in->data[in->pos];
+  in->pos += (size_t)*n * 3;
+  return rgb;
+}
+
+void wireMessage(struct TWireBuffer *out, enum EWireMessage type, const struct TWireBuffer *payload) {
+  unsigned char byte = type;
+
+  wirePut(out, &byte, 1);
+  wirePutVarint(out, payload->size);
+  wirePut(out, payload->data, payload->size);
+  if(payload->failed)
+    out->failed = 1;
+}
+
+int wireNextMessage(const struct TWireBuffer *in, enum EWireMessage *type,
+                    struct TWireReader *payload, size_t *size) {
+  struct TWireReader header;
+  unsigned long long length;
+
+  if(in->size < 2)
+    return 0;
+
+  header.data = in->data;
+  header.size = in->size;
+  header.pos = 1;
+  header.failed = 0;
+  length = wireGetVarint(&header);
+  if(header.failed)
+    return in->size - 1 >= VARINT_MAX_BYTES ? -1 : 0;
+  if(in->data[0] < WIRE_HELLO || in->data[0] > WIRE_CHUNK || length > WIRE_MAX_MESSAGE)
+    return -1;
+  if(in->size - header.pos < length)
+    return 0;
+
+  *type = (enum EWireMessage)in->data[0];
+  payload->data = &in->data[header.pos];
+  payload->size = length;
+  payload->pos = 0;
+  payload->failed = 0;
+  *size = header.pos + length;
+  return 1;
+}
+
+int wireCheckSeq(struct TWireSequence *sequence, enum EWireMessage type, struct TWireReader payload) {
+  unsigned int seq;
+  int voxel_size, n_chunks;
+
+  switch(type) {
+  case WIRE_HELLO:
+    return 0;
+  case WIRE_SNAPSHOT:
+    if(wireReadSnapshot(&payload, &seq, &voxel_size, &n_chunks) < 0)
+      return -1;
+    sequence->seq = seq;
+    sequence->snapshot_chunks = n_chunks;
+    return 0;
+  case WIRE_CHUNK:
+    seq = (unsigned int)wireGetVarint(&payload);
+    if(sequence->snapshot_chunks > 0) {
+      sequence->snapshot_chunks--;
+      return seq == sequence->seq ? 0 : -1;
+    }
+    break;
+  default:
+    seq = (unsigned int)wireGetVarint(&payload);
+    break;
+  }
+
+  if(payload.failed || seq != sequence->seq + 1)
+    return -1;
+  sequence->seq = seq;
+  return 0;
+}
+
+void wireHello(struct TWireBuffer *out) {
+  struct TWireBuffer payload;
+
+  memset(&payload, 0, sizeof(payload));
+  wirePutVarint(&payload, WIRE_VERSION);
+  wireMessage(out, WIRE_HELLO, &payload);
+  wireFree(&payload);
+}
+
+void wireBatchAdd(struct TWireBatch *batch, enum EWireOp op, int x, int y, int z, int colour) {
+  int entry = op == WIRE_SET ? wireColour(&batch->colours, colour) : 0;
+
+  wirePutVarint(&batch->edits, (unsigned long long)entry << 2 | op);
+  if(op != WIRE_CLEAR) {
+    wirePutSigned(&batch->edits, x - batch->x);
+    wirePutSigned(&batch->edits, y - batch->y);
+    wirePutSigned(&batch->edits, z - batch->z);
+    batch->x = x;
+    batch->y = y;
+    batch->z = z;
+  }
+  batch->n_edits++;
+}
+
+void wireBatchFlush(struct TWireBatch *batch, unsigned int seq, struct TWireBuffer *out) {
+  struct TWireBuffer header;
+  unsigned char byte = WIRE_EDITS;
+
+  memset(&header, 0, sizeof(header));
+  wirePutVarint(&header, seq);
+  wirePutVarint(&header, batch->n_edits);
+  putColours(&header, &batch->colours);
+
+  // The edits are appended straight after the header, not copied into it
+  wirePut(out, &byte, 1);
+  wirePutVarint(out, header.size + batch->edits.size);
+  wirePut(out, header.data, header.size);
+  wirePut(out, batch->edits.data, batch->edits.size);
+  if(header.failed || batch->edits.failed)
+    out->failed = 1;
+  wireFree(&header);
+
+  wireReset(&batch->edits);
+  batch->colours.n = batch->colours.last = 0;
+  batch->n_edits = 0;
+  batch->x = batch->y = batch->z = 0;
+}
+
+void wireBatchFree(struct TWireBatch *batch) {
+  wireFree(&batch->edits);
+  free(batch->colours.entries);
+  memset(batch, 0, sizeof(*batch));
+}
+
+int wireReadEdits(struct TWireReader *payload, struct TWireEdits *edits) {
+  memset(edits, 0, sizeof(*edits));
+  edits->seq = (unsigned int)wireGetVarint(payload);
+  edits->n_edits = getCount(payload, WIRE_MAX_MESSAGE);
+  edits->rgb = getColours(payload, &edits->n_colours);
+  edits->in = *payload;
+  return payload->failed ? -1 : 0;
+}
+
+int wireNextEdit(struct TWireEdits *edits, struct TWireEdit *edit) {
+  unsigned long long header;
+  int entry;
+
+  if(edits->n_read == edits->n_edits)
+    return 0;
+
+  header = wireGetVarint(&edits->in);
+  edit->op = (enum EWireOp)(header & 3);
+  if(edit->op > WIRE_CLEAR || (edit->op == WIRE_SET && header >> 2 >= (unsigned long long)edits->n_colours))
+    return -1;
+  entry = (int)(header >> 2);
+
+  if(edit->op != WIRE_CLEAR) {
+    long long x = edits->x + wireGetSigned(&edits->in);
+    long long y = edits->y + wireGetSigned(&edits->in);
+    long long z = edits->z + wireGetSigned(&edits->in);
+    if(x < -32768 || x > 32767 || y < -32768 || y > 32767 || z < -32768 || z > 32767)
+      return -1;
+    edits->x = (int)x;
+    edits->y = (int)y;
+    edits->z = (int)z;
+  }
+  if(edits->in.failed)
+    return -1;
+
+  edit->x = edits->x;
+  edit->y = edits->y;
+  edit->z = edits->z;
+  edit->colour = 0;
+  if(edit->op == WIRE_SET) {
+    const unsigned char *rgb = &edits->rgb[entry * 3];
+    edit->colour = paletteColour(rgb[0], rgb[1], rgb[2]);
+  }
+
+  edits->n_read++;
+  return 1;
+}
+
+void wireSnapshot(struct TWireBuffer *out, unsigned int seq, int voxel_size, int n_chunks) {
+  struct TWireBuffer payload;
+
+  memset(&payload, 0, sizeof(payload));
+  wirePutVarint(&payload, seq);
+  wirePutVarint(&payload, voxel_size);
+  wirePutVarint(&payload, n_chunks);
+  wireMessage(out, WIRE_SNAPSHOT, &payload);
+  wireFree(&payload);
+}
+
+int wireReadSnapshot(struct TWireReader *payload, unsigned int *seq, int *voxel_size, int *n_chunks) {
+  *seq = (unsigned int)wireGetVarint(payload);
+  *voxel_size = getCount(payload, 1 << 16);
+  *n_chunks = getCount(payload, 1 << 30);
+  return payload->failed || *voxel_size < 1 ? -1 : 0;
+}
+
+void wireChunk(struct TWireBuffer *out, unsigned int seq, int cx, int cy, int cz,
+               const struct TModelVoxel *voxels, int n) {
+  struct TWireColours colours;
+  struct TWireBuffer header, body;
+  unsigned char byte = WIRE_CHUNK;
+  int i, previous = -1, colour = -1;
+
+  memset(&colours, 0, sizeof(colours));
+  memset(&body, 0, sizeof(body));
+  for(i = 0; i < n; ++i) {
+    int cell = CELL_INDEX(voxels[i].x, voxels[i].y, voxels[i].z);
+    int changed = voxels[i].colour != colour;
+
+    wirePutVarint(&body, (unsigned long long)(cell - previous - 1) << 1 | changed);
+    if(changed)
+      wirePutVarint(&body, wireColour(&colours, voxels[i].colour));
+    previous = cell;
+    colour = voxels[i].colour;
+  }
+
+  memset(&header, 0, sizeof(header));
+  wirePutVarint(&header, seq);
+  wirePutSigned(&header, cx);
+  wirePutSigned(&header, cy);
+  wirePutSigned(&header, cz);
+  wirePutVarint(&header, n);
+  putColours(&header, &colours);
+
+  wirePut(out, &byte, 1);
+  wirePutVarint(out, header.size + body.size);
+  wirePut(out, header.data, header.size);
+  wirePut(out, body.data, body.size);
+  if(header.failed || body.failed)
+    out->failed = 1;
+
+  wireFree(&header);
+  wireFree(&body);
+  free(colours.entries);
+}
+
+int wireReadChunk(struct TWireReader *payload, struct TWireChunk *chunk) {
+  memset(chunk, 0, sizeof(*chunk));
+  chunk->seq = (unsigned int)wireGetVarint(payload);
+  chunk->cx = getCoord(payload);
+  chunk->cy = getCoord(payload);
+  chunk->cz = getCoord(payload);
+  chunk->n_voxels = getCount(payload, CHUNK_CELLS);
+  chunk->rgb = getColours(payload, &chunk->n_colours);
+  chunk->in = *payload;
+  return payload->failed || chunk->n_colours > CHUNK_CELLS ? -1 : 0;
+}
+
+int wireChunkVoxels(struct TWireChunk *chunk, struct TModelVoxel *voxels) {
+  int palette[CHUNK_CELLS];
+  int i, cell = -1, colour = -1;
+
+  for(i = 0; i < chunk->n_colours; ++i)
+    palette[i] = -1;
+
+  for(i = 0; i < chunk->n_voxels; ++i) {
+    unsigned long long code = wireGetVarint(&chunk->in);
+
+    if(code >> 1 >= CHUNK_CELLS || cell + (int)(code >> 1) + 1 >= CHUNK_CELLS)
+      return -1;
+    cell += (int)(code >> 1) + 1;
+
+    if(code & 1) {
+      int entry = getCount(&chunk->in, chunk->n_colours - 1);
+      if(chunk->in.failed || chunk->n_colours == 0)
+        return -1;
+      if(palette[entry] < 0)
+        palette[entry] = paletteColour(chunk->rgb[entry * 3], chunk->rgb[entry * 3 + 1],
+                                       chunk->rgb[entry * 3 + 2]);
+      colour = palette[entry];
+    }
+    if(chunk->in.failed || colour < 0)
+      return -1;
+
+    voxels[i].x = (chunk->cx << CHUNK_BITS) | (cell & (CHUNK_SIZE-1));
+    voxels[i].y = (chunk->cy << CHUNK_BITS) | ((cell >> CHUNK_BITS) & (CHUNK_SIZE-1));
+    voxels[i].z = (chunk->cz << CHUNK_BITS) | (cell >> (2*CHUNK_BITS));
+    voxels[i].colour = colour;
+  }
+
+  return 0;
+}
+
+// Fills a Unix socket address if the address is a path
+static int unixAddress(const char *address, struct sockaddr_un *un) {
+  if(!strchr(address, '/'))
+    return 0;
+
+  memset(un, 0, sizeof(*un));
+  un->sun_family = AF_UNIX;
+  if(strlen(address) >= sizeof(un->sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", address);
+    return -1;
+  }
+  strcpy(un->sun_path, address);
+  return 1;
+}
+
+// Resolves [host:]port
+static struct addrinfo* tcpAddress(const char *address, int passive) {
+  struct addrinfo hints, *info = NULL;
+  char host[256];
+  const char *port = strrchr(address, ':');
+  int error;
+
+  if(port) {
+    snprintf(host, sizeof(host), "%.*s", (int)(port - address), address);
+    ++port;
+  }
+  else {
+    strcpy(host, WIRE_DEFAULT_HOST);
+    port = address;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  if((error = getaddrinfo(host, port, &hints, &info)) != 0) {
+    fprintf(stderr, "Bad address %s: %s\n", address, gai_strerror(error));
+    return NULL;
+  }
+  return info;
+}
+
+int wireListen(const char *address) {
+  struct sockaddr_un un;
+  struct addrinfo *info;
+  int fd, is_unix, one = 1;
+
+  if((is_unix = unixAddress(address, &un)) < 0)
+    return -1;
+
+  if(is_unix) {
+    // A socket left by a previous session
+    unlink(un.sun_path);
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+       bind(fd, (struct sockaddr*)&un, sizeof(un)) < 0 || listen(fd, 16) < 0) {
+      perror(address);
+      if(fd >= 0)
+        close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  if(!(info = tcpAddress(address, 1)))
+    return -1;
+  if((fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol)) < 0 ||
+     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+     bind(fd, info->ai_addr, info->ai_addrlen) < 0 || listen(fd, 16) < 0) {
+    perror(address);
+    if(fd >= 0)
+      close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(info);
+  return fd;
+}
+
+int wireConnect(const char *address) {
+  struct sockaddr_un un;
+  struct addrinfo *info;
+  int fd, is_unix, one = 1;
+
+  if((is_unix = unixAddress(address, &un)) < 0)
+    return -1;
+
+  if(is_unix) {
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+       connect(fd, (struct sockaddr*)&un, sizeof(un)) < 0) {
+      perror(address);
+      if(fd >= 0)
+        close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  if(!(info = tcpAddress(address, 0)))
+    return -1;
+  if((fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol)) < 0 ||
+     connect(fd, info->ai_addr, info->ai_addrlen) < 0) {
+    perror(address);
+    if(fd >= 0)
+      close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(info);
+
+  // Edits are batched already; don't hold them back any longer
+  if(fd >= 0)
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}